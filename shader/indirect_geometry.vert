@@ -0,0 +1,84 @@
+#version 450 core
+
+// GPU裁剪后的间接绘制：gl_InstanceIndex 就是chunk序号（firstInstance），
+// 从chunk记录里取段槽位和偏移，再按 pulled_geometry.vert 的方式拉取顶点
+
+// 段槽位数和默认的逐对象数据槽位由 GeometryRenderSystem::setShaderConstants 以特化常量传入
+layout(constant_id = 0) const uint SEGMENT_SLOTS = 1;
+layout(constant_id = 1) const uint DEFAULT_OBJECT_SLOT = 0;
+
+struct Vertex
+{
+    float px, py, pz;
+    float cr, cg, cb;
+};
+
+//与 InstanceData2D 一致，和 simple_shader.vert 读取同一个逐对象数据缓冲
+struct ObjectData
+{
+    vec4 linear;        //2x2 线性部分，列主序
+    vec2 translation;
+    uint color;         //RGBA8，a 为覆盖顶点颜色的比例
+    uint reserved;
+};
+
+struct ChunkRecord
+{
+    vec4 bounds;
+    uint segmentSlot;
+    int vertexOffset;
+    uint firstIndex;
+    uint indexed;
+    uint drawCount;
+    uint type;
+    uint state;
+    float minFeatureSize;
+};
+
+layout(set = 0, binding = 0) uniform GlobalUbo
+{
+    mat4 projectionViewMatirx;
+    vec3 globalcolor;
+} ubo;
+
+layout(std430, set = 1, binding = 0) readonly buffer VertexBuffer
+{
+    Vertex vertices[];
+} vertexBuffers[SEGMENT_SLOTS];
+
+layout(std430, set = 1, binding = 1) readonly buffer IndexBuffer
+{
+    uint indices[];
+} indexBuffers[SEGMENT_SLOTS];
+
+layout(std430, set = 2, binding = 0) readonly buffer RecordBuffer
+{
+    ChunkRecord records[];
+};
+
+layout(std430, set = 3, binding = 0) readonly buffer ObjectBuffer
+{
+    ObjectData objects[];
+};
+
+layout(location = 0) out vec3 fragColor;
+
+void main()
+{
+    ChunkRecord record = records[gl_InstanceIndex];
+
+    uint index = uint(gl_VertexIndex);
+    if (record.indexed != 0u)
+        index = indexBuffers[record.segmentSlot].indices[record.firstIndex + index];
+
+    Vertex v = vertexBuffers[record.segmentSlot].vertices[record.vertexOffset + int(index)];
+
+    // gl_InstanceIndex 已用作chunk序号；有逐对象覆盖的chunk不走这条路径，统一读默认槽位
+    ObjectData object = objects[DEFAULT_OBJECT_SLOT];
+    vec2 xy = mat2(object.linear.xy, object.linear.zw) * vec2(v.px, v.py) + object.translation;
+    vec4 objectColor = unpackUnorm4x8(object.color);
+
+    gl_Position = ubo.projectionViewMatirx * vec4(xy, v.pz, 1.0);
+    gl_PointSize = 1.0;
+    fragColor = mix(vec3(v.cr, v.cg, v.cb), objectColor.rgb, objectColor.a);
+}
@@ -0,0 +1,19 @@
+#version 450 core
+
+layout(location = 0) in vec4 fragColor;
+layout(location = 1) in vec2 fragUV;
+
+layout(location = 0) out vec4 outColor;
+
+layout(set = 1, binding = 0) uniform sampler2D symbolAtlas;
+
+void main()
+{
+    // 内置符号是白色蒙版，彩色图标使用白色实例颜色即可保持原色
+    vec4 symbol = texture(symbolAtlas, fragUV);
+    float alpha = symbol.a * fragColor.a;
+    if (alpha < 1.0 / 255.0)
+        discard;
+
+    outColor = vec4(symbol.rgb * fragColor.rgb, alpha);
+}
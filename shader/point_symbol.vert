@@ -0,0 +1,55 @@
+#version 450 core
+
+// 每个实例是一个点，6个顶点扩展成屏幕空间的符号四边形，大小以像素为单位不随缩放变化
+
+layout(location = 0) in vec2 inPosition;
+layout(location = 1) in vec4 inColor;
+layout(location = 2) in uvec2 inSymbol;         // x: 符号ID y: 8.8定点缩放
+
+struct SymbolRect
+{
+    vec4 uvRect;
+    vec2 sizePx;
+    vec2 padding;
+};
+
+layout(set = 0, binding = 0) uniform GlobalUbo
+{
+    mat4 projectionViewMatirx;
+    vec3 globalcolor;
+} ubo;
+
+layout(std430, set = 1, binding = 1) readonly buffer SymbolRects
+{
+    SymbolRect rects[];
+};
+
+layout(push_constant) uniform Push
+{
+    vec2 viewportSize;
+    float planeZ;
+    float padding;
+} push;
+
+layout(location = 0) out vec4 fragColor;
+layout(location = 1) out vec2 fragUV;
+
+const vec2 corners[6] = vec2[](
+    vec2(-1.0, -1.0), vec2(1.0, -1.0), vec2(1.0, 1.0),
+    vec2(-1.0, -1.0), vec2(1.0, 1.0), vec2(-1.0, 1.0)
+);
+
+void main()
+{
+    SymbolRect rect = rects[inSymbol.x];
+    vec2 sizePx = rect.sizePx * (float(inSymbol.y) / 256.0);
+    vec2 corner = corners[gl_VertexIndex];
+
+    vec4 clip = ubo.projectionViewMatirx * vec4(inPosition, push.planeZ, 1.0);
+    // 半尺寸/半视口 = 尺寸/视口
+    clip.xy += corner * sizePx / push.viewportSize * clip.w;
+    gl_Position = clip;
+
+    fragColor = inColor;
+    fragUV = mix(rect.uvRect.xy, rect.uvRect.zw, corner * 0.5 + 0.5);
+}
@@ -0,0 +1,71 @@
+#version 450 core
+
+// 顶点拉取：不绑定顶点/索引缓冲，按段槽位从BufferPool的段缓冲里读取
+// 所有类型的所有段放在同一个描述符集里，跨段绘制只需要换推送常量
+
+// 段槽位数由 GeometryRenderSystem::setShaderConstants 以特化常量传入
+layout(constant_id = 0) const uint SEGMENT_SLOTS = 1;
+
+struct Vertex
+{
+    float px, py, pz;
+    float cr, cg, cb;
+};
+
+//与 InstanceData2D 一致，和 simple_shader.vert 读取同一个逐对象数据缓冲
+struct ObjectData
+{
+    vec4 linear;        //2x2 线性部分，列主序
+    vec2 translation;
+    uint color;         //RGBA8，a 为覆盖顶点颜色的比例
+    uint reserved;
+};
+
+layout(set = 0, binding = 0) uniform GlobalUbo
+{
+    mat4 projectionViewMatirx;
+    vec3 globalcolor;
+} ubo;
+
+layout(std430, set = 1, binding = 0) readonly buffer VertexBuffer
+{
+    Vertex vertices[];
+} vertexBuffers[SEGMENT_SLOTS];
+
+layout(std430, set = 1, binding = 1) readonly buffer IndexBuffer
+{
+    uint indices[];
+} indexBuffers[SEGMENT_SLOTS];
+
+layout(std430, set = 2, binding = 0) readonly buffer ObjectBuffer
+{
+    ObjectData objects[];
+};
+
+layout(push_constant) uniform Push
+{
+    uint segmentSlot;
+    int vertexOffset;
+    uint firstIndex;
+    uint indexed;           // 0 表示chunk没有索引，按顶点序号直接读取
+} push;
+
+layout(location = 0) out vec3 fragColor;
+
+void main()
+{
+    uint index = uint(gl_VertexIndex);
+    if (push.indexed != 0u)
+        index = indexBuffers[push.segmentSlot].indices[push.firstIndex + index];
+
+    Vertex v = vertexBuffers[push.segmentSlot].vertices[push.vertexOffset + int(index)];
+
+    // 与逐段绑定的路径相同：firstInstance 指向逐对象数据槽位
+    ObjectData object = objects[gl_InstanceIndex];
+    vec2 xy = mat2(object.linear.xy, object.linear.zw) * vec2(v.px, v.py) + object.translation;
+    vec4 objectColor = unpackUnorm4x8(object.color);
+
+    gl_Position = ubo.projectionViewMatirx * vec4(xy, v.pz, 1.0);
+    gl_PointSize = 1.0;
+    fragColor = mix(vec3(v.cr, v.cg, v.cb), objectColor.rgb, objectColor.a);
+}
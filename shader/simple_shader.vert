@@ -11,13 +11,24 @@ layout(set =0, binding = 0) uniform GlobalUbo
     vec3 globalcolor;
 } ubo;
 
-layout(push_constant) uniform Push
+//与 InstanceData2D 一致，按 firstInstance 指定的槽位读取
+struct ObjectData
 {
-    mat4 modelMatrix;
-    vec3 color;
-}push;
+    vec4 linear;        //2x2 线性部分，列主序
+    vec2 translation;
+    uint color;         //RGBA8，a 为覆盖顶点颜色的比例
+    uint reserved;
+};
+
+layout(std430, set = 1, binding = 0) readonly buffer ObjectBuffer
+{
+    ObjectData objects[];
+};
 
 void main() {
-   gl_Position = ubo.projectionViewMatirx * vec4(position , 1.0); 
-   fragColor = ubo.globalcolor
-;}
+   ObjectData object = objects[gl_InstanceIndex];
+   vec2 xy = mat2(object.linear.xy, object.linear.zw) * position.xy + object.translation;
+   vec4 objectColor = unpackUnorm4x8(object.color);
+   gl_Position = ubo.projectionViewMatirx * vec4(xy, position.z, 1.0); 
+   fragColor = mix(color, objectColor.rgb, objectColor.a);
+}
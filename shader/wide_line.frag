@@ -0,0 +1,31 @@
+#version 450 core
+
+layout(location = 0) in vec4 fragColor;
+layout(location = 1) noperspective in vec2 lineCoord;
+layout(location = 2) flat in float segmentLength;
+
+layout(location = 0) out vec4 outColor;
+
+layout(push_constant) uniform Push
+{
+    vec4 color;
+    vec2 viewportSize;
+    float width;
+    float feather;
+    int vertexOffset;
+    uint firstIndex;
+} push;
+
+void main()
+{
+    // 到线段的像素距离，两端按圆头处理，折线连接处自然形成圆角
+    float outside = max(max(-lineCoord.x, lineCoord.x - segmentLength), 0.0);
+    float dist = length(vec2(outside, lineCoord.y));
+
+    float halfWidth = push.width * 0.5;
+    float coverage = clamp((halfWidth - dist) / max(push.feather, 1e-3) + 0.5, 0.0, 1.0);
+    if (coverage <= 0.0)
+        discard;
+
+    outColor = vec4(fragColor.rgb, fragColor.a * coverage);
+}
@@ -0,0 +1,84 @@
+#version 450 core
+
+// 每个实例是一条线段，6个顶点把线段扩展成屏幕空间的四边形
+// 端点直接从BufferPool的顶点/索引段里读取，不产生额外几何
+
+struct Vertex
+{
+    float px, py, pz;
+    float cr, cg, cb;
+};
+
+layout(set = 0, binding = 0) uniform GlobalUbo
+{
+    mat4 projectionViewMatirx;
+    vec3 globalcolor;
+} ubo;
+
+layout(std430, set = 1, binding = 0) readonly buffer VertexBuffer
+{
+    Vertex vertices[];
+};
+
+layout(std430, set = 1, binding = 1) readonly buffer IndexBuffer
+{
+    uint indices[];
+};
+
+layout(push_constant) uniform Push
+{
+    vec4 color;
+    vec2 viewportSize;
+    float width;
+    float feather;
+    int vertexOffset;
+    uint firstIndex;
+} push;
+
+layout(location = 0) out vec4 fragColor;
+layout(location = 1) noperspective out vec2 lineCoord;      // x: 沿线段方向(像素) y: 垂直方向(像素)
+layout(location = 2) flat out float segmentLength;
+
+const vec2 corners[6] = vec2[](
+    vec2(0.0, -1.0), vec2(1.0, -1.0), vec2(1.0, 1.0),
+    vec2(0.0, -1.0), vec2(1.0, 1.0), vec2(0.0, 1.0)
+);
+
+Vertex fetchVertex(uint index)
+{
+    return vertices[push.vertexOffset + int(index)];
+}
+
+void main()
+{
+    uint base = push.firstIndex + 2u * uint(gl_InstanceIndex);
+    Vertex v0 = fetchVertex(indices[base]);
+    Vertex v1 = fetchVertex(indices[base + 1u]);
+    vec4 clip0 = ubo.projectionViewMatirx * vec4(v0.px, v0.py, v0.pz, 1.0);
+    vec4 clip1 = ubo.projectionViewMatirx * vec4(v1.px, v1.py, v1.pz, 1.0);
+
+    vec2 halfViewport = push.viewportSize * 0.5;
+    vec2 screen0 = clip0.xy / clip0.w * halfViewport;
+    vec2 screen1 = clip1.xy / clip1.w * halfViewport;
+
+    vec2 delta = screen1 - screen0;
+    float len = length(delta);
+    vec2 dir = len > 1e-5 ? delta / len : vec2(1.0, 0.0);
+    vec2 normal = vec2(-dir.y, dir.x);
+
+    // 外扩半宽+羽化宽度，端点方向同样外扩用于圆头
+    float extent = push.width * 0.5 + push.feather;
+    vec2 corner = corners[gl_VertexIndex];
+
+    vec4 clip = corner.x < 0.5 ? clip0 : clip1;
+    float along = corner.x < 0.5 ? -extent : len + extent;
+    vec2 offset = dir * (corner.x < 0.5 ? -extent : extent) + normal * corner.y * extent;
+
+    clip.xy += offset / halfViewport * clip.w;
+    gl_Position = clip;
+
+    // 要素颜色已写进顶点，push.color 作为整层的色调/透明度
+    fragColor = vec4(v0.cr, v0.cg, v0.cb, 1.0) * push.color;
+    lineCoord = vec2(along, corner.y * extent);
+    segmentLength = len;
+}
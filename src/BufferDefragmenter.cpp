@@ -0,0 +1,410 @@
+#include "BufferDefragmenter.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+BufferDefragmenter::BufferDefragmenter(Device& device, BufferPool& bufferPool) :
+    m_device(device),
+    m_bufferPool(bufferPool)
+{
+    VkFenceCreateInfo fenceInfo{};
+    fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+    if (vkCreateFence(m_device.device(), &fenceInfo, nullptr, &m_fence) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to create defragmentation fence!");
+    }
+}
+
+BufferDefragmenter::~BufferDefragmenter()
+{
+    //析构时不再提交搬移，只等待还在执行的拷贝
+    if (m_commandBuffer != VK_NULL_HANDLE)
+    {
+        vkWaitForFences(m_device.device(), 1, &m_fence, VK_TRUE, UINT64_MAX);
+        vkFreeCommandBuffers(m_device.device(), m_device.getCommandPool(), 1, &m_commandBuffer);
+    }
+    vkDestroyFence(m_device.device(), m_fence, nullptr);
+}
+
+void BufferDefragmenter::update()
+{
+    if (!completeBatch())
+        return;
+
+    if (!m_enabled)
+        return;
+
+    if (m_cooldownFrames > 0)
+    {
+        m_cooldownFrames--;
+        return;
+    }
+
+    if (m_candidates.empty())
+    {
+        if (m_progress.active)
+            finishPass();
+
+        if (!beginPass())
+            return;
+    }
+
+    recordBatch();
+}
+
+bool BufferDefragmenter::completeBatch()
+{
+    if (m_commandBuffer == VK_NULL_HANDLE)
+        return true;
+
+    //只查询不等待，拷贝没完成就下一帧再来
+    if (vkGetFenceStatus(m_device.device(), m_fence) != VK_SUCCESS)
+        return false;
+
+    {
+        std::lock_guard<std::mutex> lock(m_bufferPool.m_mutex);
+
+        for (const Move& move : m_inFlightMoves)
+        {
+            //槽位可能被释放后又分给新chunk，类型和区间都一致才认为是同一个
+            BufferPool::Chunk current = m_bufferPool.m_chunks.get(move.chunkId);
+            bool valid = m_bufferPool.m_chunks.contains(move.chunkId) &&
+                current.isLoaded &&
+                current.type == move.type &&
+                current.segmentIndex == move.srcSegment &&
+                current.vertexOffset == move.srcVertexOffset &&
+                current.indexOffset == move.srcIndexOffset &&
+                current.vertexCount == move.vertexCount &&
+                current.indexCount == move.indexCount;
+
+            if (!valid)
+            {
+                //拷贝期间chunk被删除或重新分配，新区间还没被任何帧引用，直接归还
+                BufferPool::PendingFree ranges;
+                ranges.type = move.type;
+                ranges.segmentIndex = move.dstSegment;
+                ranges.vertexOffset = move.dstVertexOffset;
+                ranges.vertexCount = move.vertexCount;
+                ranges.indexOffset = move.dstIndexOffset;
+                ranges.indexCount = move.indexCount;
+                m_bufferPool.releaseRanges(ranges);
+                m_progress.movesDiscarded++;
+                continue;
+            }
+
+            //旧区间可能还在被在途帧读取，按帧延迟回收
+            m_bufferPool.retireChunkRanges(move.chunkId);
+            ChunkTable::Ref chunk = m_bufferPool.m_chunks.at(move.chunkId);
+
+            if (move.dstSegment != move.srcSegment)
+            {
+                auto& segments = m_bufferPool.m_bufferPools[move.type];
+                auto& srcChunks = segments[move.srcSegment].chunks;
+                srcChunks.erase(std::remove(srcChunks.begin(), srcChunks.end(), move.chunkId), srcChunks.end());
+                segments[move.dstSegment].chunks.push_back(move.chunkId);
+            }
+
+            chunk.segmentIndex = move.dstSegment;
+            chunk.vertexOffset = move.dstVertexOffset;
+            chunk.indexOffset = move.dstIndexOffset;
+
+            m_bufferPool.m_snapshotDirty = true;
+
+            m_progress.passChunksMoved++;
+            m_progress.totalChunksMoved++;
+            m_progress.totalBytesMoved += chunkBytes(current);
+        }
+    }
+
+    vkResetFences(m_device.device(), 1, &m_fence);
+    vkFreeCommandBuffers(m_device.device(), m_device.getCommandPool(), 1, &m_commandBuffer);
+    m_commandBuffer = VK_NULL_HANDLE;
+    m_inFlightMoves.clear();
+    return true;
+}
+
+bool BufferDefragmenter::beginPass()
+{
+    releaseEmptySegments();
+
+    std::lock_guard<std::mutex> lock(m_bufferPool.m_mutex);
+
+    float bestScore = 0.f;
+    bool found = false;
+    for (const auto& [type, segments] : m_bufferPool.m_bufferPools)
+    {
+        uint32_t activeCount = static_cast<uint32_t>(std::count_if(segments.begin(), segments.end(),
+            [](const BufferPool::BufferSegment& segment) { return segment.isActive; }));
+
+        for (uint32_t i = 0; i < segments.size(); i++)
+        {
+            const auto& segment = segments[i];
+            if (!segment.isActive || segment.chunks.empty())
+                continue;
+
+            auto vertexStats = segment.vertexAllocator.getStats();
+            auto indexStats = segment.indexAllocator.getStats();
+            float usage = vertexStats.capacity > 0 ? static_cast<float>(vertexStats.used) / vertexStats.capacity : 1.f;
+            float fragmentation = qMax(vertexStats.fragmentation, indexStats.fragmentation);
+
+            //稀疏段优先整体搬空，其次整理碎片率最高的段
+            bool evacuate = activeCount > 1 && usage < EVACUATE_THRESHOLD;
+            float score = evacuate ? 2.f - usage : fragmentation;
+            if (!evacuate && (fragmentation < FRAGMENTATION_THRESHOLD ||
+                (vertexStats.freeBlockCount < 2 && indexStats.freeBlockCount < 2)))
+                continue;
+
+            if (score > bestScore)
+            {
+                bestScore = score;
+                found = true;
+                m_progress.type = type;
+                m_progress.segmentIndex = i;
+                m_progress.evacuating = evacuate;
+            }
+        }
+    }
+
+    if (!found)
+        return false;
+
+    const auto& segment = m_bufferPool.m_bufferPools[m_progress.type][m_progress.segmentIndex];
+
+    //按顶点偏移升序排列，从尾部取，先搬地址最高的chunk
+    m_candidates = segment.chunks;
+    std::sort(m_candidates.begin(), m_candidates.end(), [this](uint32_t a, uint32_t b) {
+        return m_bufferPool.m_chunks.get(a).vertexOffset < m_bufferPool.m_chunks.get(b).vertexOffset;
+        });
+
+    m_progress.active = true;
+    m_progress.passBytes = 0;
+    m_progress.passBytesDone = 0;
+    m_progress.passChunksMoved = 0;
+    for (uint32_t chunkId : m_candidates)
+    {
+        m_progress.passBytes += chunkBytes(m_bufferPool.m_chunks.get(chunkId));
+    }
+
+    qDebug() << (m_progress.evacuating ? "evacuating" : "compacting") << "buffer segment"
+        << m_progress.segmentIndex << "of type" << static_cast<int>(m_progress.type)
+        << ":" << m_candidates.size() << "chunks," << m_progress.passBytes << "bytes";
+    return true;
+}
+
+void BufferDefragmenter::recordBatch()
+{
+    std::vector<Move> moves;
+
+    {
+        std::lock_guard<std::mutex> lock(m_bufferPool.m_mutex);
+
+        VkDeviceSize batchBytes = 0;
+        uint32_t examined = 0;
+        while (!m_candidates.empty() && examined < MAX_CANDIDATES_PER_FRAME)
+        {
+            uint32_t chunkId = m_candidates.back();
+            VkDeviceSize bytes = m_bufferPool.m_chunks.contains(chunkId) ? chunkBytes(m_bufferPool.m_chunks.get(chunkId)) : 0;
+
+            //超过预算的chunk在空批次里单独搬，否则永远搬不动
+            if (!moves.empty() && batchBytes + bytes > m_frameBudget)
+                break;
+
+            m_candidates.pop_back();
+            examined++;
+            m_progress.passBytesDone += bytes;
+
+            Move move;
+            if (planMove(chunkId, move))
+            {
+                moves.push_back(move);
+                batchBytes += bytes;
+            }
+        }
+    }
+
+    if (!moves.empty())
+        submitBatch(moves);
+}
+
+void BufferDefragmenter::finishPass()
+{
+    qDebug() << "buffer defragmentation pass finished:" << m_progress.passChunksMoved << "chunks moved,"
+        << m_progress.totalBytesMoved << "bytes moved in total";
+
+    //整轮没有搬动任何chunk，说明空闲块放不下，过一段时间再试
+    if (m_progress.passChunksMoved == 0)
+        m_cooldownFrames = IDLE_COOLDOWN_FRAMES;
+
+    m_progress.active = false;
+}
+
+void BufferDefragmenter::releaseEmptySegments()
+{
+    std::lock_guard<std::mutex> lock(m_bufferPool.m_mutex);
+
+    for (auto& [type, segments] : m_bufferPool.m_bufferPools)
+    {
+        uint32_t activeCount = static_cast<uint32_t>(std::count_if(segments.begin(), segments.end(),
+            [](const BufferPool::BufferSegment& segment) { return segment.isActive; }));
+
+        for (uint32_t i = 0; i < segments.size() && activeCount > 1; i++)
+        {
+            const auto& segment = segments[i];
+            //已用量为0说明延迟回收的区间也都归还了
+            if (!segment.isActive || !segment.chunks.empty() ||
+                segment.vertexAllocator.getUsed() != 0 || segment.indexAllocator.getUsed() != 0)
+                continue;
+
+            m_bufferPool.releaseSegment(type, i);
+            activeCount--;
+            m_progress.segmentsReleased++;
+            qDebug() << "released empty buffer segment" << i << "of type" << static_cast<int>(type);
+        }
+    }
+}
+
+bool BufferDefragmenter::planMove(uint32_t chunkId, Move& move)
+{
+    if (!m_bufferPool.m_chunks.contains(chunkId))
+        return false;
+
+    const BufferPool::Chunk chunk = m_bufferPool.m_chunks.get(chunkId);
+    if (!chunk.isLoaded)
+        return false;
+
+    auto& segments = m_bufferPool.m_bufferPools[m_progress.type];
+    if (chunk.segmentIndex != m_progress.segmentIndex)
+        return false;
+
+    move.type = m_progress.type;
+    move.chunkId = chunkId;
+    move.srcSegment = chunk.segmentIndex;
+    move.srcVertexOffset = chunk.vertexOffset;
+    move.srcIndexOffset = chunk.indexOffset;
+    move.vertexCount = chunk.vertexCount;
+    move.indexCount = chunk.indexCount;
+
+    auto tryPlace = [&](uint32_t segmentIndex, bool below) {
+        auto& segment = segments[segmentIndex];
+        if (!segment.isActive)
+            return false;
+
+        uint32_t vertexOffset = below ?
+            segment.vertexAllocator.allocateBelow(chunk.vertexCount, chunk.vertexOffset) :
+            segment.vertexAllocator.allocate(chunk.vertexCount);
+        if (vertexOffset == RangeAllocator::INVALID_OFFSET)
+            return false;
+
+        uint32_t indexOffset = 0;
+        if (chunk.indexCount > 0)
+        {
+            //索引区间尽量也往前挪，放不下时接受任意空闲块
+            indexOffset = below ?
+                segment.indexAllocator.allocateBelow(chunk.indexCount, chunk.indexOffset) :
+                RangeAllocator::INVALID_OFFSET;
+            if (indexOffset == RangeAllocator::INVALID_OFFSET)
+                indexOffset = segment.indexAllocator.allocate(chunk.indexCount);
+            if (indexOffset == RangeAllocator::INVALID_OFFSET)
+            {
+                segment.vertexAllocator.free(vertexOffset, chunk.vertexCount);
+                return false;
+            }
+        }
+
+        segment.usedVertices = segment.vertexAllocator.getUsed();
+        segment.usedIndices = segment.indexAllocator.getUsed();
+        move.dstSegment = segmentIndex;
+        move.dstVertexOffset = vertexOffset;
+        move.dstIndexOffset = indexOffset;
+        return true;
+        };
+
+    if (!m_progress.evacuating)
+        return tryPlace(chunk.segmentIndex, true);
+
+    //搬空时只放进其它已有的段，不扩容也不新建段
+    for (uint32_t i = 0; i < segments.size(); i++)
+    {
+        if (i != chunk.segmentIndex && tryPlace(i, false))
+            return true;
+    }
+    return false;
+}
+
+void BufferDefragmenter::submitBatch(const std::vector<Move>& moves)
+{
+    VkCommandBufferAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    allocInfo.commandPool = m_device.getCommandPool();
+    allocInfo.commandBufferCount = 1;
+    if (vkAllocateCommandBuffers(m_device.device(), &allocInfo, &m_commandBuffer) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to allocate defragmentation command buffer!");
+    }
+
+    VkCommandBufferBeginInfo beginInfo{};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    vkBeginCommandBuffer(m_commandBuffer, &beginInfo);
+
+    {
+        //录制时持锁，防止段在录制过程中扩容换掉缓冲
+        std::lock_guard<std::mutex> lock(m_bufferPool.m_mutex);
+        auto& segments = m_bufferPool.m_bufferPools[moves.front().type];
+
+        //源区间可能还有没提交的上传，先提交，排在搬移拷贝之前
+        m_bufferPool.m_stagingRing->flush();
+
+        //新旧区间互不重叠，同一缓冲内也可以直接拷贝
+        for (const Move& move : moves)
+        {
+            const auto& src = segments[move.srcSegment];
+            const auto& dst = segments[move.dstSegment];
+
+            VkBufferCopy vertexCopy{};
+            vertexCopy.srcOffset = static_cast<VkDeviceSize>(move.srcVertexOffset) * sizeof(Model::Vertex);
+            vertexCopy.dstOffset = static_cast<VkDeviceSize>(move.dstVertexOffset) * sizeof(Model::Vertex);
+            vertexCopy.size = static_cast<VkDeviceSize>(move.vertexCount) * sizeof(Model::Vertex);
+            vkCmdCopyBuffer(m_commandBuffer, src.vertexBuffer->getBuffer(), dst.vertexBuffer->getBuffer(), 1, &vertexCopy);
+
+            if (move.indexCount > 0)
+            {
+                VkBufferCopy indexCopy{};
+                indexCopy.srcOffset = static_cast<VkDeviceSize>(move.srcIndexOffset) * sizeof(uint32_t);
+                indexCopy.dstOffset = static_cast<VkDeviceSize>(move.dstIndexOffset) * sizeof(uint32_t);
+                indexCopy.size = static_cast<VkDeviceSize>(move.indexCount) * sizeof(uint32_t);
+                vkCmdCopyBuffer(m_commandBuffer, src.indexBuffer->getBuffer(), dst.indexBuffer->getBuffer(), 1, &indexCopy);
+            }
+        }
+    }
+
+    //之后提交的绘制和扩容拷贝都要看到新区间的内容
+    VkMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT |
+        VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_TRANSFER_READ_BIT;
+    vkCmdPipelineBarrier(m_commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+        VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+        0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+    vkEndCommandBuffer(m_commandBuffer);
+
+    VkSubmitInfo submitInfo{};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &m_commandBuffer;
+    if (vkQueueSubmit(m_device.graphicsQueue(), 1, &submitInfo, m_fence) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to submit defragmentation copies!");
+    }
+
+    m_inFlightMoves = moves;
+}
+
+VkDeviceSize BufferDefragmenter::chunkBytes(const BufferPool::Chunk& chunk)
+{
+    return static_cast<VkDeviceSize>(chunk.vertexCount) * sizeof(Model::Vertex) +
+        static_cast<VkDeviceSize>(chunk.indexCount) * sizeof(uint32_t);
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+#include "BufferPool.h"
+#include "Device.h"
+
+#include <vector>
+
+//BufferPool 的增量碎片整理：每帧在预算内把chunk搬到段内更低的地址或搬出稀疏段，
+//拷贝在GPU上异步完成，围栏信号后再一次性切换chunk的偏移，不阻塞帧
+class BufferDefragmenter
+{
+public:
+    static constexpr VkDeviceSize DEFAULT_FRAME_BUDGET = 4 * 1024 * 1024;  //每帧最多拷贝的字节数
+    static constexpr float FRAGMENTATION_THRESHOLD = 0.3f;                  //段的碎片率超过它才整理
+    static constexpr float EVACUATE_THRESHOLD = 0.25f;                      //使用率低于它的段整体搬空
+    static constexpr uint32_t MAX_CANDIDATES_PER_FRAME = 256;               //每帧最多尝试的chunk数，限制CPU开销
+    static constexpr uint32_t IDLE_COOLDOWN_FRAMES = 120;                   //一轮没有搬动任何chunk后的冷却帧数
+
+    struct Progress
+    {
+        bool        active{ false };            //当前是否有整理在进行
+        ModelType   type{ ModelType::None };
+        uint32_t    segmentIndex{ 0 };
+        bool        evacuating{ false };        //true 表示正在把整个段搬空
+        uint64_t    passBytes{ 0 };             //本轮候选chunk的总字节数
+        uint64_t    passBytesDone{ 0 };         //已处理（搬完或无法搬动）的字节数
+        uint64_t    passChunksMoved{ 0 };
+        uint64_t    totalBytesMoved{ 0 };
+        uint64_t    totalChunksMoved{ 0 };
+        uint64_t    movesDiscarded{ 0 };        //拷贝期间chunk被删除或重新分配而作废的搬移
+        uint32_t    segmentsReleased{ 0 };
+
+        float passProgress() const { return passBytes > 0 ? static_cast<float>(passBytesDone) / passBytes : 1.f; }
+    };
+
+    BufferDefragmenter(Device& device, BufferPool& bufferPool);
+    ~BufferDefragmenter();
+
+    BufferDefragmenter(const BufferDefragmenter&) = delete;
+    BufferDefragmenter& operator=(const BufferDefragmenter&) = delete;
+
+    //每帧调用一次：提交上一批已完成的搬移，再在预算内录制下一批拷贝
+    void update();
+
+    void setEnabled(bool enabled) { m_enabled = enabled; }
+    bool isEnabled() const { return m_enabled; }
+    void setFrameBudget(VkDeviceSize bytes) { m_frameBudget = bytes; }
+    VkDeviceSize getFrameBudget() const { return m_frameBudget; }
+
+    const Progress& getProgress() const { return m_progress; }
+
+private:
+    //一个chunk从旧区间到新区间的搬移
+    struct Move
+    {
+        ModelType type{ ModelType::None };
+        uint32_t chunkId{ 0 };
+        uint32_t srcSegment{ 0 };
+        uint32_t srcVertexOffset{ 0 };
+        uint32_t srcIndexOffset{ 0 };
+        uint32_t dstSegment{ 0 };
+        uint32_t dstVertexOffset{ 0 };
+        uint32_t dstIndexOffset{ 0 };
+        uint32_t vertexCount{ 0 };
+        uint32_t indexCount{ 0 };
+    };
+
+    //上一批拷贝是否完成，完成则切换chunk偏移；返回 false 表示还在GPU上执行
+    bool completeBatch();
+    //选出碎片最严重的段，按地址从高到低排好待搬的chunk
+    bool beginPass();
+    void recordBatch();
+    void finishPass();
+    //释放已经搬空且没有待回收区间的段，每种类型至少保留一个段
+    void releaseEmptySegments();
+
+    bool planMove(uint32_t chunkId, Move& move);
+    void submitBatch(const std::vector<Move>& moves);
+
+    static VkDeviceSize chunkBytes(const BufferPool::Chunk& chunk);
+
+private:
+    Device& m_device;
+    BufferPool& m_bufferPool;
+
+    VkFence                 m_fence = VK_NULL_HANDLE;
+    VkCommandBuffer         m_commandBuffer = VK_NULL_HANDLE;
+    std::vector<Move>       m_inFlightMoves;
+
+    std::vector<uint32_t>   m_candidates;           //本轮待搬的chunk，从尾部取
+    Progress                m_progress;
+    VkDeviceSize            m_frameBudget{ DEFAULT_FRAME_BUDGET };
+    bool                    m_enabled{ true };
+    uint32_t                m_cooldownFrames{ 0 };
+};
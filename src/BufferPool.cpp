@@ -1,17 +1,33 @@
 #include "BufferPool.h"
 
+#include <algorithm>
+#include <iterator>
+#include <limits>
+
+
 BufferPool::BufferPool(Device& device) :
-    m_device(device),
-    m_nextChunkId(1)
+    m_device(device)
 {
+    //λԴ洢ʽ󶨸ȡɫβܳ maxStorageBufferRange
+    VkDeviceSize maxRange = m_device.properties.limits.maxStorageBufferRange;
+    m_maxSegmentVertices = static_cast<uint32_t>(qMin<VkDeviceSize>(VERTICES_PER_SEGMENGT, maxRange / sizeof(Model::Vertex)));
+    m_maxSegmentIndices = static_cast<uint32_t>(qMin<VkDeviceSize>(INDICES_PER_SEGMENT, maxRange / sizeof(uint32_t)));
+
+    m_stagingRing = std::make_unique<StagingRing>(m_device);
+    publishSnapshotLocked();
 }
 
-uint32_t BufferPool::allocateBuffer(const Object::Builder& builder)
+BufferPool::~BufferPool()
+{
+    delete m_snapshot.exchange(nullptr);
+}
+
+uint32_t BufferPool::allocateBuffer(const Object::Builder& builder, uint32_t* featureIndex)
 {
     std::lock_guard<std::mutex> lock(m_mutex);
 
-    auto vertices = builder.vertices;
-    auto indices = builder.indices;
+    const auto& vertices = builder.vertices;
+    const auto& indices = builder.indices;
     auto type = builder.type;
 
     if (vertices.empty())
@@ -20,148 +36,791 @@ uint32_t BufferPool::allocateBuffer(const Object::Builder& builder)
         return INVALID_CHUNK_ID;
     }
 
+    if (vertices.size() > m_maxSegmentVertices || indices.size() > m_maxSegmentIndices)
+    {
+        qWarning() << "model is larger than a buffer segment: " << vertices.size() << " vertices";
+        return INVALID_CHUNK_ID;
+    }
+
+    //ǰchunkŲȷڣԤҪضռһchunk
+    auto openIt = m_openChunks.find(type);
+    if (openIt != m_openChunks.end() &&
+        !openIt->second.vertices.empty() &&
+        openIt->second.vertices.size() + vertices.size() > m_chunkVertexBudget)
+    {
+        sealChunk(type);
+        openIt = m_openChunks.end();
+    }
+
+    if (openIt == m_openChunks.end())
+    {
+        openChunk(type);
+        openIt = m_openChunks.find(type);
+    }
+
+    OpenChunk& open = openIt->second;
+    open.lastAppendFrame = m_frameCounter;
+    ChunkTable::Ref chunk = m_chunks.at(open.chunkId);
+    auto& chunkFeatures = m_chunkFeatures[open.chunkId];
+
+    FeatureRange feature;
+    feature.vertexOffset = static_cast<uint32_t>(open.vertices.size());
+    feature.indexOffset = static_cast<uint32_t>(open.indices.size());
+    feature.bounds = builder.bounds;
+
+    //һchunkֻһΣҪɫд㣻ʱغ϶㸴chunkе
+    uint32_t colorTag = (static_cast<uint32_t>(qRound(builder.color.x() * 255.f)) & 0xFF) |
+        ((static_cast<uint32_t>(qRound(builder.color.y() * 255.f)) & 0xFF) << 8) |
+        ((static_cast<uint32_t>(qRound(builder.color.z() * 255.f)) & 0xFF) << 16);
+
+    std::vector<uint32_t> remap(vertices.size());
+    for (size_t i = 0; i < vertices.size(); i++)
+    {
+        uint32_t newIndex = static_cast<uint32_t>(open.vertices.size());
+        remap[i] = open.welder ?
+            open.welder->weld(vertices[i].position.x(), vertices[i].position.y(), newIndex, colorTag) :
+            newIndex;
+
+        if (remap[i] == newIndex)
+        {
+            Model::Vertex packed = vertices[i];
+            packed.color = builder.color;
+            open.vertices.push_back(packed);
+        }
+    }
+    //ӺҪõĶ֮ǰҪӵģȡõС
+    auto [minVertex, maxVertex] = std::minmax_element(remap.begin(), remap.end());
+    feature.vertexOffset = *minVertex;
+    feature.vertexCount = *maxVertex - *minVertex + 1;
+
+    //Ϊchunk㣬ûҪز˳֤chunkܰ
+    if (indices.empty())
+    {
+        for (uint32_t index : remap)
+            open.indices.push_back(index);
+    }
+    else
+    {
+        for (uint32_t index : indices)
+            open.indices.push_back(remap[index]);
+    }
+    feature.indexCount = static_cast<uint32_t>(open.indices.size()) - feature.indexOffset;
 
-    auto* segment = getOrCreateSegment(type);
+    float featureSize = qMax(builder.bounds.maxX - builder.bounds.minX, builder.bounds.maxY - builder.bounds.minY);
+    if (chunkFeatures.empty())
+    {
+        chunk.bounds = builder.bounds;
+        chunk.minFeatureSize = featureSize;
+    }
+    else
+    {
+        chunk.bounds.minX = qMin(chunk.bounds.minX, builder.bounds.minX);
+        chunk.bounds.minY = qMin(chunk.bounds.minY, builder.bounds.minY);
+        chunk.bounds.maxX = qMax(chunk.bounds.maxX, builder.bounds.maxX);
+        chunk.bounds.maxY = qMax(chunk.bounds.maxY, builder.bounds.maxY);
+        chunk.minFeatureSize = qMin(chunk.minFeatureSize, featureSize);
+    }
+
+    if (featureIndex)
+        *featureIndex = static_cast<uint32_t>(chunkFeatures.size());
+    chunkFeatures.push_back(feature);
+
+    uint32_t chunkId = open.chunkId;
+    if (open.vertices.size() >= m_chunkVertexBudget)
+    {
+        sealChunk(type);
+    }
+
+    return chunkId;
+}
+
+void BufferPool::flushPendingChunks()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    std::vector<ModelType> types;
+    for (const auto& [type, open] : m_openChunks)
+    {
+        types.push_back(type);
+    }
+
+    for (ModelType type : types)
+    {
+        sealChunk(type);
+    }
+
+    pumpUploads();
+    publishSnapshotLocked();
+}
+
+void BufferPool::setUploadBudget(VkDeviceSize bytes)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_uploadBudget = bytes;
+}
+
+VkDeviceSize BufferPool::getPendingUploadBytes() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_pendingUploadBytes;
+}
+
+void BufferPool::reserve(ModelType type, uint64_t vertexCount, uint64_t indexCount)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    auto& segments = m_bufferPools[type];
+
+    //ԤͬԴԤ㣺ڲɼchunkڳ乻þͲ
+    if (m_memoryPressureHandler && !segments.empty())
+    {
+        VkDeviceSize requestedBytes = static_cast<VkDeviceSize>(vertexCount) * sizeof(Model::Vertex) +
+            static_cast<VkDeviceSize>(indexCount) * sizeof(uint32_t);
+        if (m_memoryPressureHandler(type, requestedBytes))
+            return;
+    }
+
+    if (segments.empty())
+    {
+        createSegment(type,
+            qMax<uint64_t>(vertexCount, INITIAL_SEGMENT_VERTICES),
+            qMax<uint64_t>(indexCount, INITIAL_SEGMENT_INDICES));
+        return;
+    }
+
+    //޵Ĳ½Ķ
+    uint32_t lastIndex = static_cast<uint32_t>(segments.size() - 1);
+    const auto& last = segments[lastIndex];
+    growSegment(type, lastIndex,
+        qMin<uint64_t>(static_cast<uint64_t>(last.usedVertices) + vertexCount, m_maxSegmentVertices),
+        qMin<uint64_t>(static_cast<uint64_t>(last.usedIndices) + indexCount, m_maxSegmentIndices));
+}
+
+uint32_t BufferPool::openChunk(ModelType type)
+{
+    uint32_t chunkId = m_chunks.create(type);
+    if (m_chunkFeatures.size() < m_chunks.slotCount())
+        m_chunkFeatures.resize(m_chunks.slotCount());
+    m_chunkFeatures[chunkId].clear();
+
+    OpenChunk& open = m_openChunks[type];
+    open.chunkId = chunkId;
+    open.vertices.clear();
+    open.indices.clear();
+    open.vertices.reserve(m_chunkVertexBudget);
+    open.welder = m_weldTolerance > 0.f ? std::make_unique<VertexWelder>(m_weldTolerance) : nullptr;
+
+    return chunkId;
+}
+
+void BufferPool::sealChunk(ModelType type)
+{
+    auto openIt = m_openChunks.find(type);
+    if (openIt == m_openChunks.end())
+        return;
+
+    OpenChunk open = std::move(openIt->second);
+    m_openChunks.erase(openIt);
+
+    if (open.vertices.empty())
+        return;
+
+    uint32_t segmentIndex = 0;
+    uint32_t vertexOffset = 0;
+    uint32_t indexOffset = 0;
+    auto* segment = allocateRanges(type, static_cast<uint32_t>(open.vertices.size()),
+        static_cast<uint32_t>(open.indices.size()), segmentIndex, vertexOffset, indexOffset);
     if (!segment)
     {
-        qWarning() << "failed to get or create segment for type " << static_cast<int>(type);
-        return INVALID_CHUNK_ID;
+        qWarning() << "failed to place chunk" << open.chunkId;
+        return;
     }
 
-    //鵱ǰǷ㹻Ŀռ
-    if (segment->usedVertices + vertices.size() > segment->vertexCapacity ||
-        segment->usedIndices + indices.size() > segment->indexCapacity)
+    ChunkTable::Ref chunk = m_chunks.at(open.chunkId);
+    chunk.vertexOffset = vertexOffset;
+    chunk.vertexCount = static_cast<uint32_t>(open.vertices.size());
+    chunk.indexOffset = indexOffset;
+    chunk.indexCount = static_cast<uint32_t>(open.indices.size());
+    chunk.segmentIndex = segmentIndex;
+
+    segment->chunks.push_back(open.chunkId);
+
+    //ռãŶӰÿ֡ԤϴʱῨסһ֡
+    chunk.isPendingUpload = true;
+    m_snapshotDirty = true;
+    m_pendingUploadBytes += geometryBytes(open.vertices.size(), open.indices.size());
+    m_pendingUploads.push_back(PendingUpload{ open.chunkId, std::move(open.vertices), std::move(open.indices) });
+}
+
+bool BufferPool::freeChunk(uint32_t chunkId)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    if (!m_chunks.contains(chunkId))
+        return false;
+
+    ChunkTable::Ref chunk = m_chunks.at(chunkId);
+    ModelType type = chunk.type;
+
+    //ûڵchunkֻ趪CPU
+    auto openIt = m_openChunks.find(type);
+    if (openIt != m_openChunks.end() && openIt->second.chunkId == chunkId)
     {
-        qDebug() << "Buffer Segment full, creating new segment for type: "
-            << static_cast<int>(type);
+        m_openChunks.erase(openIt);
+    }
+    else if (chunk.isPendingUpload)
+    {
+        cancelUpload(chunkId);
+    }
+    else if (chunk.isLoaded)
+    {
+        retireChunkRanges(chunkId);
 
-        m_bufferPools[type].emplace_back();
-        auto& newSegment = m_bufferPools[type].back();
+        auto& chunks = m_bufferPools[type][chunk.segmentIndex].chunks;
+        chunks.erase(std::remove(chunks.begin(), chunks.end(), chunkId), chunks.end());
+    }
 
-        newSegment.vertexCapacity = VERTICES_PER_SEGMENGT;
-        newSegment.indexCapacity = INDICES_PER_SEGMENT;
-        newSegment.usedVertices = 0;
-        newSegment.usedIndices = 0;
-        newSegment.isActive = true;
+    m_evictedChunks[type].erase(chunkId);
+    m_restreamRequests.erase(chunkId);
+    m_cpuCopies.erase(chunkId);
+    m_chunkFeatures[chunkId].clear();
+    m_chunks.destroy(chunkId, m_frameCounter);
+    m_snapshotDirty = true;
+    return true;
+}
 
-        try
+bool BufferPool::reallocateChunk(uint32_t chunkId, const std::vector<Model::Vertex>& vertices,
+    const std::vector<uint32_t>& indices, const std::vector<FeatureRange>& features)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    if (!m_chunks.contains(chunkId) || vertices.empty())
+        return false;
+
+    ChunkTable::Ref chunk = m_chunks.at(chunkId);
+    ModelType type = chunk.type;
+
+    //chunkֻCPU½Ұʱϴ¼
+    if (chunk.isEvicted)
+    {
+        m_cpuCopies[chunkId] = CpuGeometry{ vertices, indices };
+        chunk.vertexCount = static_cast<uint32_t>(vertices.size());
+        chunk.indexCount = static_cast<uint32_t>(indices.size());
+        m_chunkFeatures[chunkId] = features;
+        updateChunkBounds(chunkId);
+        m_snapshotDirty = true;
+        return true;
+    }
+
+    //Ŷӵchunk¼Ŷ
+    if (chunk.isPendingUpload)
+    {
+        cancelUpload(chunkId);
+
+        uint32_t segmentIndex = 0;
+        uint32_t vertexOffset = 0;
+        uint32_t indexOffset = 0;
+        auto* segment = allocateRanges(type, static_cast<uint32_t>(vertices.size()),
+            static_cast<uint32_t>(indices.size()), segmentIndex, vertexOffset, indexOffset);
+        if (!segment)
         {
-            //GPU
-            newSegment.vertexBuffer = std::make_unique<VMABuffer>(
-                m_device,
-                sizeof(Model::Vertex),
-                newSegment.vertexCapacity,
-                VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
-                VMA_MEMORY_USAGE_GPU_ONLY
-            );
-
-            newSegment.indexBuffer = std::make_unique<VMABuffer>(
-                m_device,
-                sizeof(uint32_t),
-                newSegment.indexCapacity,
-                VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
-                VMA_MEMORY_USAGE_GPU_ONLY
-            );
+            qWarning() << "failed to reallocate chunk" << chunkId;
+            return false;
         }
-        catch (const std::exception& e)
+
+        segment->chunks.push_back(chunkId);
+        chunk.vertexOffset = vertexOffset;
+        chunk.vertexCount = static_cast<uint32_t>(vertices.size());
+        chunk.indexOffset = indexOffset;
+        chunk.indexCount = static_cast<uint32_t>(indices.size());
+        chunk.segmentIndex = segmentIndex;
+        chunk.isPendingUpload = true;
+        m_chunkFeatures[chunkId] = features;
+        updateChunkBounds(chunkId);
+
+        m_pendingUploadBytes += geometryBytes(vertices.size(), indices.size());
+        m_pendingUploads.push_back(PendingUpload{ chunkId, vertices, indices });
+        m_snapshotDirty = true;
+        return true;
+    }
+
+    if (!chunk.isLoaded)
+        return false;
+
+    //¼д䣬ܻڱ;֡ȡӳͷ
+    uint32_t segmentIndex = 0;
+    uint32_t vertexOffset = 0;
+    uint32_t indexOffset = 0;
+    auto* segment = allocateRanges(type, static_cast<uint32_t>(vertices.size()),
+        static_cast<uint32_t>(indices.size()), segmentIndex, vertexOffset, indexOffset);
+    if (!segment)
+    {
+        qWarning() << "failed to reallocate chunk" << chunkId;
+        return false;
+    }
+
+    copyDataToSegment(segment, vertices, indices, vertexOffset, indexOffset);
+    m_stagingRing->flush();
+    retireChunkRanges(chunkId);
+
+    if (segmentIndex != chunk.segmentIndex)
+    {
+        auto& oldChunks = m_bufferPools[type][chunk.segmentIndex].chunks;
+        oldChunks.erase(std::remove(oldChunks.begin(), oldChunks.end(), chunkId), oldChunks.end());
+        m_bufferPools[type][segmentIndex].chunks.push_back(chunkId);
+    }
+
+    chunk.vertexOffset = vertexOffset;
+    chunk.vertexCount = static_cast<uint32_t>(vertices.size());
+    chunk.indexOffset = indexOffset;
+    chunk.indexCount = static_cast<uint32_t>(indices.size());
+    chunk.segmentIndex = segmentIndex;
+    m_chunkFeatures[chunkId] = features;
+    updateChunkBounds(chunkId);
+
+    if (m_retainCpuCopies)
+        m_cpuCopies[chunkId] = CpuGeometry{ vertices, indices };
+
+    m_snapshotDirty = true;
+    return true;
+}
+
+void BufferPool::setRetainCpuCopies(bool retain)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    m_retainCpuCopies = retain;
+    if (!retain)
+    {
+        //chunk뱣
+        for (auto it = m_cpuCopies.begin(); it != m_cpuCopies.end();)
         {
-            qWarning() << "failed to create buffers: " << e.what();
-            m_bufferPools[type].pop_back();
-            return INVALID_CHUNK_ID;
+            if (m_chunks.contains(it->first) && m_chunks.evicted()[it->first])
+                ++it;
+            else
+                it = m_cpuCopies.erase(it);
         }
+    }
+}
 
+bool BufferPool::evictChunk(uint32_t chunkId)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return evictChunkLocked(chunkId);
+}
+
+bool BufferPool::evictChunkLocked(uint32_t chunkId)
+{
+    if (!m_chunks.contains(chunkId) || m_cpuCopies.find(chunkId) == m_cpuCopies.end())
+        return false;
+
+    ChunkTable::Ref chunk = m_chunks.at(chunkId);
+    ModelType type = chunk.type;
+    if (!chunk.isLoaded)
+        return false;
 
-        //TODO ʵBufferSegment Copy-Constructor
-        segment = &newSegment;
+    //;֡ûлʱã֡ӳٻ
+    if (m_frameCounter - chunk.lastVisibleFrame > SwapChain::MAX_FRAMES_IN_FLIGHT)
+    {
+        PendingFree ranges;
+        ranges.type = type;
+        ranges.segmentIndex = chunk.segmentIndex;
+        ranges.vertexOffset = chunk.vertexOffset;
+        ranges.vertexCount = chunk.vertexCount;
+        ranges.indexOffset = chunk.indexOffset;
+        ranges.indexCount = chunk.indexCount;
+        releaseRanges(ranges);
+    }
+    else
+    {
+        retireChunkRanges(chunkId);
     }
 
-    Chunk chunk;
-    chunk.vertexOffset = segment->usedVertices;
-    chunk.vertexCount = vertices.size();
-    chunk.indexOffset = segment->usedIndices;
-    chunk.indexCount = indices.size();
-    chunk.isLoaded = true;
-    chunk.bounds = builder.bounds;
+    auto& chunks = m_bufferPools[type][chunk.segmentIndex].chunks;
+    chunks.erase(std::remove(chunks.begin(), chunks.end(), chunkId), chunks.end());
 
-    copyDataToSegment(segment, vertices, indices, chunk.vertexOffset, chunk.indexOffset);
+    chunk.isLoaded = false;
+    chunk.isEvicted = true;
+    m_evictedChunks[type].insert(chunkId);
+    m_snapshotDirty = true;
+    return true;
+}
 
-    segment->usedVertices += vertices.size();
-    segment->usedIndices += indices.size();
+uint32_t BufferPool::restoreChunks(const std::vector<uint32_t>& chunkIds)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
 
-    uint32_t chunkId = m_nextChunkId++;
-    m_chunks[chunkId] = chunk;
-    m_chunkTypes[chunkId] = type;
-    m_chunkToSegmentIndex[chunkId] = m_bufferPools[type].size() - 1;
+    uint32_t restored = 0;
+    for (uint32_t chunkId : chunkIds)
+    {
+        auto copyIt = m_cpuCopies.find(chunkId);
+        if (!m_chunks.contains(chunkId) || copyIt == m_cpuCopies.end())
+            continue;
+
+        ChunkTable::Ref chunk = m_chunks.at(chunkId);
+        ModelType type = chunk.type;
+        if (!chunk.isEvicted)
+            continue;
+        const CpuGeometry& geometry = copyIt->second;
+
+        uint32_t segmentIndex = 0;
+        uint32_t vertexOffset = 0;
+        uint32_t indexOffset = 0;
+        auto* segment = allocateRanges(type, static_cast<uint32_t>(geometry.vertices.size()),
+            static_cast<uint32_t>(geometry.indices.size()), segmentIndex, vertexOffset, indexOffset);
+        if (!segment)
+        {
+            qWarning() << "failed to restore chunk" << chunkId;
+            continue;
+        }
 
-    segment->chunks.push_back(chunkId);
+        copyDataToSegment(segment, geometry.vertices, geometry.indices, vertexOffset, indexOffset);
+        m_uploadedThisFrame += geometryBytes(geometry.vertices.size(), geometry.indices.size());
+        segment->chunks.push_back(chunkId);
+
+        chunk.vertexOffset = vertexOffset;
+        chunk.indexOffset = indexOffset;
+        chunk.segmentIndex = segmentIndex;
+        chunk.isLoaded = true;
+        chunk.isEvicted = false;
+        chunk.lastVisibleFrame = m_frameCounter;
+        m_evictedChunks[type].erase(chunkId);
+        m_restreamRequests.erase(chunkId);
+
+        if (!m_retainCpuCopies)
+            m_cpuCopies.erase(copyIt);
+        restored++;
+        m_snapshotDirty = true;
+    }
 
-    qDebug() << "allocated geometry chunk" << chunkId
-        << " with " << vertices.size() << " vertices ";
+    m_stagingRing->flush();
+    return restored;
+}
 
-    return chunkId;
+std::vector<uint32_t> BufferPool::takeRestreamRequests()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    std::vector<uint32_t> requests(m_restreamRequests.begin(), m_restreamRequests.end());
+    m_restreamRequests.clear();
+    return requests;
 }
 
-std::vector<uint32_t> BufferPool::getVisibleChunks(const Camera& camera, ModelType type)
+void BufferPool::setMemoryPressureHandler(std::function<bool(ModelType type, VkDeviceSize requestedBytes)> handler)
 {
     std::lock_guard<std::mutex> lock(m_mutex);
+    m_memoryPressureHandler = std::move(handler);
+}
 
-    std::vector<uint32_t> visibleChunks;
+void BufferPool::updateChunkBounds(uint32_t chunkId)
+{
+    const auto& features = m_chunkFeatures[chunkId];
+    if (features.empty())
+        return;
 
-    auto typeIt = m_bufferPools.find(type);
-    if (typeIt != m_bufferPools.end())
+    ChunkTable::Ref chunk = m_chunks.at(chunkId);
+    chunk.bounds = features.front().bounds;
+    chunk.minFeatureSize = std::numeric_limits<float>::max();
+    for (const auto& feature : features)
+    {
+        chunk.bounds.minX = qMin(chunk.bounds.minX, feature.bounds.minX);
+        chunk.bounds.minY = qMin(chunk.bounds.minY, feature.bounds.minY);
+        chunk.bounds.maxX = qMax(chunk.bounds.maxX, feature.bounds.maxX);
+        chunk.bounds.maxY = qMax(chunk.bounds.maxY, feature.bounds.maxY);
+        chunk.minFeatureSize = qMin(chunk.minFeatureSize,
+            qMax(feature.bounds.maxX - feature.bounds.minX, feature.bounds.maxY - feature.bounds.minY));
+    }
+}
+
+void BufferPool::collectGarbage()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    //һ֡ü¼Ŀɼдchunk
     {
-        for (const auto& segment : typeIt->second)
+        std::lock_guard<std::mutex> visibilityLock(m_visibilityMutex);
+        //ԾɿգڼchunkѱͷţλҲܱãֻȻ״̬Ч
+        for (uint32_t chunkId : m_visibleFeedback)
         {
-            if (!segment.isActive)
-                continue;
+            if (m_chunks.contains(chunkId))
+                m_chunks.setLastVisibleFrame(chunkId, m_frameCounter);
+        }
+        for (uint32_t chunkId : m_restreamFeedback)
+        {
+            if (m_chunks.contains(chunkId) && m_chunks.evicted()[chunkId])
+                m_restreamRequests.insert(chunkId);
+        }
+        m_visibleFeedback.clear();
+        m_restreamFeedback.clear();
+    }
 
-            for (uint32_t chunkId : segment.chunks)
-            {
-                const auto& chunk = m_chunks[chunkId];
-                if (chunk.isLoaded && !frustumCull(chunk.bounds, camera))
-                {
-                    visibleChunks.push_back(chunkId);
-                }
-            }
+    m_frameCounter++;
+    m_uploadedThisFrame = 0;
+
+    //ɢӵҪزÿ֡ڣchunkд㹻֡ϴchunk
+    std::vector<ModelType> idleTypes;
+    for (const auto& [type, open] : m_openChunks)
+    {
+        if (m_frameCounter - open.lastAppendFrame >= OPEN_CHUNK_IDLE_FRAMES)
+            idleTypes.push_back(type);
+    }
+    for (ModelType type : idleTypes)
+    {
+        sealChunk(type);
+    }
+
+    //ύһ֮֡ɢǼǵϴεĻռ
+    m_stagingRing->flush();
+    m_stagingRing->reclaim();
+    pumpUploads();
+
+    m_retiredBuffers.erase(std::remove_if(m_retiredBuffers.begin(), m_retiredBuffers.end(),
+        [this](const auto& retired) { return m_frameCounter - retired.first > SwapChain::MAX_FRAMES_IN_FLIGHT; }),
+        m_retiredBuffers.end());
+
+    auto it = m_pendingFrees.begin();
+    while (it != m_pendingFrees.end())
+    {
+        if (m_frameCounter - it->frame > SwapChain::MAX_FRAMES_IN_FLIGHT)
+        {
+            releaseRanges(*it);
+            it = m_pendingFrees.erase(it);
+        }
+        else
+        {
+            ++it;
         }
     }
 
-    return  visibleChunks;
+    //ͷŵchunk id ˿ڲŸã;֡ĿɼԻض;ɿղдchunk
+    m_chunks.recycleSlots(m_frameCounter, SNAPSHOT_GRACE_FRAMES);
+
+    //ѹĿղжȡ
+    m_retiredSnapshots.erase(std::remove_if(m_retiredSnapshots.begin(), m_retiredSnapshots.end(),
+        [this](const auto& retired) { return m_frameCounter - retired.first > SNAPSHOT_GRACE_FRAMES; }),
+        m_retiredSnapshots.end());
+
+    publishSnapshotLocked();
 }
 
-void BufferPool::bindBuffersForType(VkCommandBuffer commandBuffer, ModelType type, uint32_t segmentId)
+void BufferPool::publishSnapshot()
 {
     std::lock_guard<std::mutex> lock(m_mutex);
+    publishSnapshotLocked();
+}
 
-    auto typeIt = m_bufferPools.find(type);
-    if (typeIt == m_bufferPools.end() || segmentId >= typeIt->second.size())
+void BufferPool::publishSnapshotLocked()
+{
+    if (!m_snapshotDirty)
         return;
 
+    auto snapshot = std::make_unique<ChunkSnapshot>();
+    snapshot->version = ++m_snapshotVersion;
 
-    const auto& segment = typeIt->second[segmentId];
+    //帴ƣǼڴ濽
+    snapshot->chunks = m_chunks;
+
+    for (const auto& [type, segments] : m_bufferPools)
+    {
+        auto& views = snapshot->segments[type];
+        views.reserve(segments.size());
+        for (const auto& segment : segments)
+        {
+            SegmentView view;
+            view.isActive = segment.isActive && segment.vertexBuffer && segment.indexBuffer;
+            if (view.isActive)
+            {
+                view.vertexBuffer = segment.vertexBuffer->getBuffer();
+                view.indexBuffer = segment.indexBuffer->getBuffer();
+                view.vertexBufferSize = segment.vertexBuffer->getBufferSize();
+                view.indexBufferSize = segment.indexBuffer->getBufferSize();
+            }
+            view.generation = segment.generation;
+            views.push_back(std::move(view));
+        }
+    }
+
+    //ȡžɿգ֡ӳͷ
+    const ChunkSnapshot* previous = m_snapshot.exchange(snapshot.release(), std::memory_order_acq_rel);
+    if (previous)
+        m_retiredSnapshots.emplace_back(m_frameCounter, std::unique_ptr<const ChunkSnapshot>(previous));
+    m_snapshotDirty = false;
+}
 
-    if (!segment.isActive || !segment.vertexBuffer)
+void BufferPool::pumpUploads()
+{
+    while (!m_pendingUploads.empty())
+    {
+        PendingUpload& upload = m_pendingUploads.front();
+        VkDeviceSize bytes = geometryBytes(upload.vertices.size(), upload.indices.size());
+        if (m_uploadBudget > 0 && m_uploadedThisFrame > 0 && m_uploadedThisFrame + bytes > m_uploadBudget)
+            break;
+
+        ChunkTable::Ref chunk = m_chunks.at(upload.chunkId);
+        ModelType type = chunk.type;
+
+        //οŶڼݻ˻壬ǰĶο
+        BufferSegment* segment = &m_bufferPools[type][chunk.segmentIndex];
+        copyDataToSegment(segment, upload.vertices, upload.indices, chunk.vertexOffset, chunk.indexOffset);
+
+        chunk.isPendingUpload = false;
+        chunk.isLoaded = true;
+        chunk.lastVisibleFrame = m_frameCounter;
+        if (m_retainCpuCopies)
+            m_cpuCopies[upload.chunkId] = CpuGeometry{ std::move(upload.vertices), std::move(upload.indices) };
+
+        m_uploadedThisFrame += bytes;
+        m_pendingUploadBytes -= bytes;
+        m_pendingUploads.pop_front();
+        m_snapshotDirty = true;
+    }
+
+    m_stagingRing->flush();
+}
+
+void BufferPool::cancelUpload(uint32_t chunkId)
+{
+    auto uploadIt = std::find_if(m_pendingUploads.begin(), m_pendingUploads.end(),
+        [chunkId](const PendingUpload& upload) { return upload.chunkId == chunkId; });
+    if (uploadIt == m_pendingUploads.end())
         return;
 
-    VkBuffer vertexBuffers[] = { segment.vertexBuffer->getBuffer() };
-    VkDeviceSize offsets[] = { 0 };
-    vkCmdBindVertexBuffers(commandBuffer, 0, 1, vertexBuffers, offsets);
+    m_pendingUploadBytes -= geometryBytes(uploadIt->vertices.size(), uploadIt->indices.size());
+    m_pendingUploads.erase(uploadIt);
+
+    ChunkTable::Ref chunk = m_chunks.at(chunkId);
+    ModelType type = chunk.type;
+
+    PendingFree ranges;
+    ranges.type = type;
+    ranges.segmentIndex = chunk.segmentIndex;
+    ranges.vertexOffset = chunk.vertexOffset;
+    ranges.vertexCount = chunk.vertexCount;
+    ranges.indexOffset = chunk.indexOffset;
+    ranges.indexCount = chunk.indexCount;
+    releaseRanges(ranges);
+
+    auto& chunks = m_bufferPools[type][chunk.segmentIndex].chunks;
+    chunks.erase(std::remove(chunks.begin(), chunks.end(), chunkId), chunks.end());
+    chunk.isPendingUpload = false;
+    m_snapshotDirty = true;
+}
 
-    if (segment.indexBuffer)
+VkDeviceSize BufferPool::geometryBytes(size_t vertexCount, size_t indexCount)
+{
+    return static_cast<VkDeviceSize>(vertexCount) * sizeof(Model::Vertex) +
+        static_cast<VkDeviceSize>(indexCount) * sizeof(uint32_t);
+}
+
+std::vector<uint32_t> BufferPool::getVisibleChunks(const Camera& camera, ModelType type, float minExtent)
+{
+    const ChunkSnapshot& snapshot = currentSnapshot();
+    const auto frustum = camera.getFrustum2D();
+
+    std::vector<uint32_t> visibleChunks;
+    std::vector<uint32_t> restreamChunks;
+
+    // id ˳ɨ͡״̬ͰΧм
+    const auto& types = snapshot.chunks.types();
+    const auto& bounds = snapshot.chunks.bounds();
+    const auto& loaded = snapshot.chunks.loaded();
+    const auto& evicted = snapshot.chunks.evicted();
+    uint32_t slotCount = snapshot.chunks.slotCount();
+    for (uint32_t chunkId = 1; chunkId < slotCount; chunkId++)
+    {
+        if (types[chunkId] != type || !(loaded[chunkId] || evicted[chunkId]))
+            continue;
+        if (!frustum.insersects(bounds[chunkId]))
+            continue;
+        const AABB& box = bounds[chunkId];
+        if (qMax(box.maxX - box.minX, box.maxY - box.minY) < minExtent)
+            continue;
+
+        //chunk½ҰʱǼǣһ֡ϴ
+        if (loaded[chunkId])
+            visibleChunks.push_back(chunkId);
+        else
+            restreamChunks.push_back(chunkId);
+    }
+
+    //ɼֻ collectGarbage ̲߳ﾺ
     {
-        vkCmdBindIndexBuffer(commandBuffer, segment.indexBuffer->getBuffer(), 0, VK_INDEX_TYPE_UINT32);
+        std::lock_guard<std::mutex> visibilityLock(m_visibilityMutex);
+        m_visibleFeedback.insert(m_visibleFeedback.end(), visibleChunks.begin(), visibleChunks.end());
+        m_restreamFeedback.insert(m_restreamFeedback.end(), restreamChunks.begin(), restreamChunks.end());
     }
+
+    return  visibleChunks;
 }
 
-void BufferPool::drawChunk(VkCommandBuffer commandBuffer, uint32_t chunkId, uint32_t instanceCount)
+std::vector<uint32_t> BufferPool::getChunksWithSmallFeatures(const Camera& camera, ModelType type, float minExtent) const
+{
+    const ChunkSnapshot& snapshot = currentSnapshot();
+    const auto frustum = camera.getFrustum2D();
+
+    std::vector<uint32_t> chunkIds;
+    const auto& types = snapshot.chunks.types();
+    const auto& bounds = snapshot.chunks.bounds();
+    const auto& minFeatureSizes = snapshot.chunks.minFeatureSizes();
+    const auto& loaded = snapshot.chunks.loaded();
+    uint32_t slotCount = snapshot.chunks.slotCount();
+    for (uint32_t chunkId = 1; chunkId < slotCount; chunkId++)
+    {
+        if (types[chunkId] != type || !loaded[chunkId] || minFeatureSizes[chunkId] >= minExtent)
+            continue;
+        const AABB& box = bounds[chunkId];
+        if (qMax(box.maxX - box.minX, box.maxY - box.minY) < minExtent)
+            continue;
+        if (frustum.insersects(box))
+            chunkIds.push_back(chunkId);
+    }
+    return chunkIds;
+}
+
+void BufferPool::getFeatureRuns(uint32_t chunkId, float minExtent, std::vector<IndexRun>& runs) const
 {
-    auto it = m_chunks.find(chunkId);
-    if (it == m_chunks.end())
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    runs.clear();
+    if (!m_chunks.contains(chunkId))
         return;
 
-    const auto& chunk = it->second;
+    //Ҫchunkڰ׷˳ţڵıҪغϲһ
+    for (const auto& feature : m_chunkFeatures[chunkId])
+    {
+        const AABB& box = feature.bounds;
+        if (qMax(box.maxX - box.minX, box.maxY - box.minY) < minExtent)
+            continue;
+        if (!runs.empty() && runs.back().firstIndex + runs.back().indexCount == feature.indexOffset)
+            runs.back().indexCount += feature.indexCount;
+        else
+            runs.push_back({ feature.indexOffset, feature.indexCount });
+    }
+}
 
-    if (!chunk.isLoaded)
+void BufferPool::reportVisibility(const std::vector<uint32_t>& visibleChunks, const std::vector<uint32_t>& restreamChunks)
+{
+    std::lock_guard<std::mutex> visibilityLock(m_visibilityMutex);
+    m_visibleFeedback.insert(m_visibleFeedback.end(), visibleChunks.begin(), visibleChunks.end());
+    m_restreamFeedback.insert(m_restreamFeedback.end(), restreamChunks.begin(), restreamChunks.end());
+}
+
+void BufferPool::bindBuffersForType(VkCommandBuffer commandBuffer, ModelType type, uint32_t segmentId)
+{
+    const SegmentView* segment = getSegment(type, segmentId);
+    if (!segment || !segment->isActive)
+        return;
+
+    VkBuffer vertexBuffers[] = { segment->vertexBuffer };
+    VkDeviceSize offsets[] = { 0 };
+    vkCmdBindVertexBuffers(commandBuffer, 0, 1, vertexBuffers, offsets);
+    vkCmdBindIndexBuffer(commandBuffer, segment->indexBuffer, 0, VK_INDEX_TYPE_UINT32);
+}
+
+void BufferPool::drawChunk(VkCommandBuffer commandBuffer, uint32_t chunkId, uint32_t instanceCount)
+{
+    Chunk chunk;
+    if (!getChunk(chunkId, chunk) || !chunk.isLoaded)
         return;
 
     if (chunk.indexCount > 0)
@@ -183,28 +842,184 @@ void BufferPool::drawChunk(VkCommandBuffer commandBuffer, uint32_t chunkId, uint
     }
 }
 
-const BufferPool::Chunk* BufferPool::getChunk(uint32_t chunkId) const
+bool BufferPool::getChunk(uint32_t chunkId, Chunk& chunk) const
 {
-    std::lock_guard<std::mutex> lock(m_mutex);
+    const ChunkSnapshot& snapshot = currentSnapshot();
+    if (!snapshot.chunks.contains(chunkId))
+        return false;
 
-    auto it = m_chunks.find(chunkId);
-    return (it != m_chunks.end()) ? &it->second : nullptr;
+    chunk = snapshot.chunks.get(chunkId);
+    return true;
 }
 
 ModelType BufferPool::getChunkType(uint32_t chunkId) const
+{
+    const ChunkSnapshot& snapshot = currentSnapshot();
+    return snapshot.chunks.contains(chunkId) ? snapshot.chunks.types()[chunkId] : ModelType::None;
+}
+
+uint32_t BufferPool::getChunkBufferIndex(uint32_t chunkId) const
+{
+    const ChunkSnapshot& snapshot = currentSnapshot();
+    if (!snapshot.chunks.contains(chunkId) || !snapshot.chunks.loaded()[chunkId])
+        return UINT32_MAX;
+
+    return snapshot.chunks.get(chunkId).segmentIndex;
+}
+
+const BufferPool::SegmentView* BufferPool::getSegment(ModelType type, uint32_t segmentId) const
+{
+    const ChunkSnapshot& snapshot = currentSnapshot();
+
+    auto typeIt = snapshot.segments.find(type);
+    if (typeIt == snapshot.segments.end() || segmentId >= typeIt->second.size())
+        return nullptr;
+
+    return &typeIt->second[segmentId];
+}
+
+const BufferPool::FeatureRange* BufferPool::getFeature(uint32_t chunkId, uint32_t featureIndex) const
 {
     std::lock_guard<std::mutex> lock(m_mutex);
 
-    auto it = m_chunkTypes.find(chunkId);
-    return (it != m_chunkTypes.end()) ? it->second : ModelType::None;
+    if (!m_chunks.contains(chunkId) || featureIndex >= m_chunkFeatures[chunkId].size())
+        return nullptr;
+
+    return &m_chunkFeatures[chunkId][featureIndex];
 }
 
-uint32_t BufferPool::getChunkBufferIndex(uint32_t chunkId) const
+std::vector<uint32_t> BufferPool::queryFeatures(uint32_t chunkId, const AABB& area) const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    std::vector<uint32_t> result;
+    if (!m_chunks.contains(chunkId))
+        return result;
+
+    const auto& features = m_chunkFeatures[chunkId];
+    for (uint32_t i = 0; i < features.size(); i++)
+    {
+        AABB bounds = features[i].bounds;
+        if (bounds.overlaps(area))
+            result.push_back(i);
+    }
+
+    return result;
+}
+
+std::vector<BufferPool::SegmentStats> BufferPool::getFragmentationStats(ModelType type) const
 {
     std::lock_guard<std::mutex> lock(m_mutex);
 
-    auto it = m_chunkToSegmentIndex.find(chunkId);
-    return (it != m_chunkToSegmentIndex.end()) ? it->second : UINT32_MAX;
+    std::vector<SegmentStats> stats;
+    auto typeIt = m_bufferPools.find(type);
+    if (typeIt == m_bufferPools.end())
+        return stats;
+
+    for (const auto& segment : typeIt->second)
+    {
+        stats.push_back({ segment.vertexAllocator.getStats(), segment.indexAllocator.getStats() });
+    }
+    return stats;
+}
+
+BufferPool::MemoryStats BufferPool::getMemoryStats() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    MemoryStats stats;
+    std::unordered_map<ModelType, TypeMemoryStats> types;
+    auto statsOf = [&](ModelType type) -> TypeMemoryStats& {
+        TypeMemoryStats& typeStats = types[type];
+        typeStats.type = type;
+        return typeStats;
+    };
+
+    for (const auto& [type, segments] : m_bufferPools)
+    {
+        TypeMemoryStats& typeStats = statsOf(type);
+
+        //ƬʰжκϼƣСΰ
+        uint64_t vertexFree = 0, vertexLargest = 0;
+        uint64_t indexFree = 0, indexLargest = 0;
+        for (const auto& segment : segments)
+        {
+            if (!segment.isActive)
+                continue;
+
+            typeStats.segmentCount++;
+            stats.bufferCount += 2;
+            typeStats.allocatedBytes += geometryBytes(segment.vertexCapacity, segment.indexCapacity);
+            typeStats.usedBytes += geometryBytes(segment.vertexAllocator.getUsed(), segment.indexAllocator.getUsed());
+
+            auto vertexStats = segment.vertexAllocator.getStats();
+            auto indexStats = segment.indexAllocator.getStats();
+            vertexFree += vertexStats.free;
+            vertexLargest = std::max(vertexLargest, vertexStats.largestFreeBlock);
+            indexFree += indexStats.free;
+            indexLargest = std::max(indexLargest, indexStats.largestFreeBlock);
+        }
+
+        if (vertexFree > 0)
+            typeStats.vertexFragmentation = 1.f - static_cast<float>(vertexLargest) / vertexFree;
+        if (indexFree > 0)
+            typeStats.indexFragmentation = 1.f - static_cast<float>(indexLargest) / indexFree;
+    }
+
+    const auto& live = m_chunks.live();
+    const auto& chunkTypes = m_chunks.types();
+    const auto& evicted = m_chunks.evicted();
+    for (uint32_t chunkId = 1; chunkId < m_chunks.slotCount(); chunkId++)
+    {
+        if (!live[chunkId])
+            continue;
+
+        TypeMemoryStats& typeStats = statsOf(chunkTypes[chunkId]);
+        typeStats.chunkCount++;
+        typeStats.featureCount += m_chunkFeatures[chunkId].size();
+        if (evicted[chunkId])
+            typeStats.evictedChunkCount++;
+
+        stats.metadataBytes += m_chunkFeatures[chunkId].capacity() * sizeof(FeatureRange);
+    }
+    stats.metadataBytes += static_cast<VkDeviceSize>(m_chunks.slotCount()) * sizeof(Chunk);
+
+    for (const auto& [chunkId, geometry] : m_cpuCopies)
+    {
+        statsOf(chunkTypes[chunkId]).cpuCopyBytes += geometryBytes(geometry.vertices.size(), geometry.indices.size());
+    }
+
+    for (const auto& upload : m_pendingUploads)
+    {
+        TypeMemoryStats& typeStats = statsOf(chunkTypes[upload.chunkId]);
+        typeStats.pendingChunkCount++;
+        typeStats.pendingUploadBytes += geometryBytes(upload.vertices.size(), upload.indices.size());
+    }
+
+    for (const auto& [type, open] : m_openChunks)
+    {
+        statsOf(type).openChunkBytes += geometryBytes(open.vertices.size(), open.indices.size());
+    }
+
+    for (const auto& [frame, buffer] : m_retiredBuffers)
+    {
+        stats.retiredBufferBytes += buffer->getBufferSize();
+        stats.bufferCount++;
+    }
+
+    if (m_stagingRing)
+    {
+        stats.stagingBytes = m_stagingRing->getCapacity();
+        stats.bufferCount++;
+    }
+
+    for (auto& [type, typeStats] : types)
+        stats.types.push_back(typeStats);
+    std::sort(stats.types.begin(), stats.types.end(), [](const TypeMemoryStats& a, const TypeMemoryStats& b) {
+        return a.type < b.type;
+        });
+
+    return stats;
 }
 
 void BufferPool::printPoolStatus() const
@@ -225,9 +1040,13 @@ void BufferPool::printPoolStatus() const
             totalSegments++;
             totalChunks += segment.chunks.size();
 
+            auto vertexStats = segment.vertexAllocator.getStats();
+            auto indexStats = segment.indexAllocator.getStats();
             qDebug() << "  Segment: " << segment.usedVertices << "/" << segment.vertexCapacity
                 << " vertices, " << segment.usedIndices << "/" << segment.indexCapacity
                 << " indices, " << segment.chunks.size() << " chunks";
+            qDebug() << "    free blocks: " << vertexStats.freeBlockCount << " / " << indexStats.freeBlockCount
+                << ", fragmentation: " << vertexStats.fragmentation << " / " << indexStats.fragmentation;
         }
     }
 
@@ -239,90 +1058,285 @@ void BufferPool::printPoolStatus() const
     qDebug() << "VMABuffer objects created: " << totalSegments * 2;
 }
 
-BufferPool::BufferSegment* BufferPool::getOrCreateSegment(ModelType type)
+BufferPool::BufferSegment* BufferPool::allocateRanges(ModelType type, uint32_t vertexCount, uint32_t indexCount,
+    uint32_t& segmentIndex, uint32_t& vertexOffset, uint32_t& indexOffset)
 {
-    auto& segments = m_bufferPools[type];
+    auto tryAllocate = [&](BufferSegment& segment) {
+        if (!segment.isActive)
+            return false;
 
-    //ǰûѾĻˣһ
-    if (segments.empty())
-    {
-        qDebug() << "Creating first buffer segment for type " << static_cast<int>(type);
+        vertexOffset = segment.vertexAllocator.allocate(vertexCount);
+        if (vertexOffset == RangeAllocator::INVALID_OFFSET)
+            return false;
 
-        segments.emplace_back();
-        auto& segment = segments.back();
+        indexOffset = 0;
+        if (indexCount > 0)
+        {
+            indexOffset = segment.indexAllocator.allocate(indexCount);
+            if (indexOffset == RangeAllocator::INVALID_OFFSET)
+            {
+                segment.vertexAllocator.free(vertexOffset, vertexCount);
+                return false;
+            }
+        }
 
-        segment.vertexCapacity = VERTICES_PER_SEGMENGT;
-        segment.indexCapacity = INDICES_PER_SEGMENT;
-        segment.usedVertices = 0;
-        segment.usedIndices = 0;
+        segment.usedVertices = segment.vertexAllocator.getUsed();
+        segment.usedIndices = segment.indexAllocator.getUsed();
+        return true;
+        };
 
-        segment.vertexBuffer = std::make_unique<VMABuffer>(
-            m_device,
-            sizeof(Model::Vertex),
-            segment.vertexCapacity,
-            VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
-            VMA_MEMORY_USAGE_GPU_ONLY
-        );
+    auto& segments = m_bufferPools[type];
+    for (uint32_t i = 0; i < segments.size(); i++)
+    {
+        if (tryAllocate(segments[i]))
+        {
+            segmentIndex = i;
+            return &segments[i];
+        }
+    }
+
+    //ԴʱȻڲɼchunkڳ乻þͲ
+    if (m_memoryPressureHandler)
+    {
+        VkDeviceSize requestedBytes = static_cast<VkDeviceSize>(vertexCount) * sizeof(Model::Vertex) +
+            static_cast<VkDeviceSize>(indexCount) * sizeof(uint32_t);
+        if (m_memoryPressureHandler(type, requestedBytes))
+        {
+            for (uint32_t i = 0; i < segments.size(); i++)
+            {
+                if (tryAllocate(segments[i]))
+                {
+                    segmentIndex = i;
+                    return &segments[i];
+                }
+            }
+        }
+    }
 
-        segment.indexBuffer = std::make_unique<VMABuffer>(
-            m_device,
-            sizeof(uint32_t),
-            segment.indexCapacity,
-            VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
-            VMA_MEMORY_USAGE_GPU_ONLY
-        );
+    //ݺĩβĿռĩβпϲһܷε
+    //ֻŲµһ࣬һ㹻пʱԭ
+    for (uint32_t i = static_cast<uint32_t>(segments.size()); i-- > 0;)
+    {
+        const BufferSegment& segment = segments[i];
+        if (!segment.isActive)
+            continue;
+
+        bool vertexShort = segment.vertexAllocator.getStats().largestFreeBlock < vertexCount;
+        bool indexShort = indexCount > 0 && segment.indexAllocator.getStats().largestFreeBlock < indexCount;
+        uint64_t minVertexCapacity = static_cast<uint64_t>(segment.vertexCapacity) + (vertexShort ? vertexCount : 0);
+        uint64_t minIndexCapacity = static_cast<uint64_t>(segment.indexCapacity) + (indexShort ? indexCount : 0);
+        if (growSegment(type, i, minVertexCapacity, minIndexCapacity) && tryAllocate(segments[i]))
+        {
+            segmentIndex = i;
+            return &segments[i];
+        }
     }
 
-    return &segments.back();
+    qDebug() << "Buffer Segment full, creating new segment for type: "
+        << static_cast<int>(type);
+
+    auto* segment = createSegment(type,
+        qMax<uint64_t>(vertexCount, INITIAL_SEGMENT_VERTICES),
+        qMax<uint64_t>(indexCount, INITIAL_SEGMENT_INDICES));
+    if (!segment || !tryAllocate(*segment))
+        return nullptr;
+
+    segmentIndex = static_cast<uint32_t>(segment - segments.data());
+    return segment;
 }
 
-bool BufferPool::frustumCull(const AABB& bounds, const Camera& camera)
+void BufferPool::releaseRanges(const PendingFree& ranges)
 {
-    auto frustum = camera.getFrustum2D();
-    return !frustum.insersects(bounds);
+    auto& segment = m_bufferPools[ranges.type][ranges.segmentIndex];
+    segment.vertexAllocator.free(ranges.vertexOffset, ranges.vertexCount);
+    segment.indexAllocator.free(ranges.indexOffset, ranges.indexCount);
+    segment.usedVertices = segment.vertexAllocator.getUsed();
+    segment.usedIndices = segment.indexAllocator.getUsed();
 }
 
-void BufferPool::copyDataToSegment(BufferSegment* segment,
-    const std::vector<Model::Vertex>& vertices,
-    const std::vector<uint32_t>& indices,
-    uint32_t vertexOffset,
-    uint32_t indexOffset)
+void BufferPool::retireChunkRanges(uint32_t chunkId)
 {
+    ChunkTable::Ref chunk = m_chunks.at(chunkId);
+
+    PendingFree ranges;
+    ranges.frame = m_frameCounter;
+    ranges.type = chunk.type;
+    ranges.segmentIndex = chunk.segmentIndex;
+    ranges.vertexOffset = chunk.vertexOffset;
+    ranges.vertexCount = chunk.vertexCount;
+    ranges.indexOffset = chunk.indexOffset;
+    ranges.indexCount = chunk.indexCount;
+    m_pendingFrees.push_back(ranges);
+}
 
-    //TODO: ֤segment
+BufferPool::BufferSegment* BufferPool::createSegment(ModelType type, uint64_t vertexCapacity, uint64_t indexCapacity)
+{
+    auto& segments = m_bufferPools[type];
+    auto slot = std::find_if(segments.begin(), segments.end(),
+        [](const BufferSegment& segment) { return !segment.isActive; });
+    bool reused = slot != segments.end();
+    if (!reused)
+    {
+        segments.emplace_back();
+        slot = std::prev(segments.end());
+    }
+    auto& segment = *slot;
 
-    VkDeviceSize vertexDataSize = vertices.size() * sizeof(Model::Vertex);
+    segment.vertexCapacity = static_cast<uint32_t>(qMin<uint64_t>(vertexCapacity, m_maxSegmentVertices));
+    segment.indexCapacity = static_cast<uint32_t>(qMin<uint64_t>(indexCapacity, m_maxSegmentIndices));
+    segment.usedVertices = 0;
+    segment.usedIndices = 0;
+    segment.vertexAllocator = RangeAllocator(segment.vertexCapacity);
+    segment.indexAllocator = RangeAllocator(segment.indexCapacity);
+    segment.isActive = true;
 
-    VMABuffer vertexStagingBuffer(
-        m_device,
-        sizeof(Model::Vertex),
-        vertices.size(),
-        VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-        VMA_MEMORY_USAGE_CPU_TO_GPU
-    );
+    try
+    {
+        //GPU
+        segment.vertexBuffer = createSegmentBuffer(sizeof(Model::Vertex), segment.vertexCapacity,
+            VK_BUFFER_USAGE_VERTEX_BUFFER_BIT);
+        segment.indexBuffer = createSegmentBuffer(sizeof(uint32_t), segment.indexCapacity,
+            VK_BUFFER_USAGE_INDEX_BUFFER_BIT);
+    }
+    catch (const std::exception& e)
+    {
+        qWarning() << "failed to create buffers: " << e.what();
+        if (reused)
+            releaseSegment(type, static_cast<uint32_t>(slot - segments.begin()));
+        else
+            segments.pop_back();
+        return nullptr;
+    }
 
-    vertexStagingBuffer.map();
-    vertexStagingBuffer.writeToBuffer(const_cast<void*>(static_cast<const void*>(vertices.data())));
+    segment.generation++;
+    m_snapshotDirty = true;
 
-    m_device.copyBuffer(vertexStagingBuffer.getBuffer(), segment->vertexBuffer->getBuffer(), vertexDataSize);
+    qDebug() << "Created buffer segment for type " << static_cast<int>(type) << ": "
+        << segment.vertexCapacity << " vertices, " << segment.indexCapacity << " indices";
+    return &segment;
+}
 
-    if (!indices.empty())
+bool BufferPool::growSegment(ModelType type, uint32_t segmentIndex, uint64_t minVertexCapacity, uint64_t minIndexCapacity)
+{
+    auto& segment = m_bufferPools[type][segmentIndex];
+    if (!segment.isActive)
+        return false;
+
+    //Ϊֹ
+    uint64_t vertexCapacity = segment.vertexCapacity;
+    while (vertexCapacity < minVertexCapacity)
+        vertexCapacity *= 2;
+    uint64_t indexCapacity = segment.indexCapacity;
+    while (indexCapacity < minIndexCapacity)
+        indexCapacity *= 2;
+
+    vertexCapacity = qMin<uint64_t>(vertexCapacity, m_maxSegmentVertices);
+    indexCapacity = qMin<uint64_t>(indexCapacity, m_maxSegmentIndices);
+    if (vertexCapacity < minVertexCapacity || indexCapacity < minIndexCapacity)
+        return false;
+    if (vertexCapacity == segment.vertexCapacity && indexCapacity == segment.indexCapacity)
+        return true;
+
+    //һౣԭ
+    bool growVertices = vertexCapacity != segment.vertexCapacity;
+    bool growIndices = indexCapacity != segment.indexCapacity;
+    std::unique_ptr<VMABuffer> vertexBuffer;
+    std::unique_ptr<VMABuffer> indexBuffer;
+    try
+    {
+        if (growVertices)
+            vertexBuffer = createSegmentBuffer(sizeof(Model::Vertex), static_cast<uint32_t>(vertexCapacity),
+                VK_BUFFER_USAGE_VERTEX_BUFFER_BIT);
+        if (growIndices)
+            indexBuffer = createSegmentBuffer(sizeof(uint32_t), static_cast<uint32_t>(indexCapacity),
+                VK_BUFFER_USAGE_INDEX_BUFFER_BIT);
+    }
+    catch (const std::exception& e)
     {
-        VkDeviceSize indexDataSize = indices.size() * sizeof(uint32_t);
+        qWarning() << "failed to grow segment: " << e.what();
+        return false;
+    }
+
+    //GPUֱӿҪ´CPUϴݴ滷ѵǼǵϴ֮첽ύ
+    //ȴУ֮д»ϴͻƶ
+    if (growVertices)
+        m_stagingRing->copyBuffer(segment.vertexBuffer->getBuffer(), vertexBuffer->getBuffer(),
+            static_cast<VkDeviceSize>(segment.vertexCapacity) * sizeof(Model::Vertex));
+    if (growIndices)
+        m_stagingRing->copyBuffer(segment.indexBuffer->getBuffer(), indexBuffer->getBuffer(),
+            static_cast<VkDeviceSize>(segment.indexCapacity) * sizeof(uint32_t));
+
+    //ɻܻ;֡ݿãӳ
+    if (growVertices)
+        m_retiredBuffers.emplace_back(m_frameCounter, std::move(segment.vertexBuffer));
+    if (growIndices)
+        m_retiredBuffers.emplace_back(m_frameCounter, std::move(segment.indexBuffer));
+
+    qDebug() << "Grew buffer segment for type " << static_cast<int>(type) << ": "
+        << segment.vertexCapacity << " -> " << vertexCapacity << " vertices, "
+        << segment.indexCapacity << " -> " << indexCapacity << " indices";
+
+    if (growVertices)
+        segment.vertexBuffer = std::move(vertexBuffer);
+    if (growIndices)
+        segment.indexBuffer = std::move(indexBuffer);
+    segment.vertexCapacity = static_cast<uint32_t>(vertexCapacity);
+    segment.indexCapacity = static_cast<uint32_t>(indexCapacity);
+    segment.vertexAllocator.grow(segment.vertexCapacity);
+    segment.indexAllocator.grow(segment.indexCapacity);
+    segment.generation++;
+    m_snapshotDirty = true;
+    return true;
+}
 
-        VMABuffer indexStagingBuffer(
-            m_device,
-            sizeof(uint32_t),
-            indices.size(),
-            VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-            VMA_MEMORY_USAGE_CPU_TO_GPU
-        );
+void BufferPool::releaseSegment(ModelType type, uint32_t segmentIndex)
+{
+    auto& segment = m_bufferPools[type][segmentIndex];
 
-        indexStagingBuffer.map();
-        indexStagingBuffer.writeToBuffer(const_cast<void*>(static_cast<const void*>(indices.data())));
+    //ܻ;֡εĻ
+    if (segment.vertexBuffer)
+        m_retiredBuffers.emplace_back(m_frameCounter, std::move(segment.vertexBuffer));
+    if (segment.indexBuffer)
+        m_retiredBuffers.emplace_back(m_frameCounter, std::move(segment.indexBuffer));
+
+    segment.vertexCapacity = 0;
+    segment.indexCapacity = 0;
+    segment.usedVertices = 0;
+    segment.usedIndices = 0;
+    segment.vertexAllocator = RangeAllocator();
+    segment.indexAllocator = RangeAllocator();
+    segment.chunks.clear();
+    segment.isActive = false;
+    segment.generation++;
+    m_snapshotDirty = true;
+}
 
-        m_device.copyBuffer(indexStagingBuffer.getBuffer(), segment->indexBuffer->getBuffer(), indexDataSize);
-    }
+std::unique_ptr<VMABuffer> BufferPool::createSegmentBuffer(VkDeviceSize elementSize, uint32_t capacity, VkBufferUsageFlags usage)
+{
+    //ʱǿԴҲǿĿ꣬ȡʱΪ洢
+    return std::make_unique<VMABuffer>(
+        m_device,
+        elementSize,
+        capacity,
+        usage | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+        VMA_MEMORY_USAGE_GPU_ONLY
+    );
+}
 
+void BufferPool::copyDataToSegment(BufferSegment* segment,
+    const std::vector<Model::Vertex>& vertices,
+    const std::vector<uint32_t>& indices,
+    uint32_t vertexOffset,
+    uint32_t indexOffset)
+{
+    m_stagingRing->stage(segment->vertexBuffer->getBuffer(),
+        static_cast<VkDeviceSize>(vertexOffset) * sizeof(Model::Vertex),
+        vertices.data(), vertices.size() * sizeof(Model::Vertex));
 
+    if (!indices.empty())
+    {
+        m_stagingRing->stage(segment->indexBuffer->getBuffer(),
+            static_cast<VkDeviceSize>(indexOffset) * sizeof(uint32_t),
+            indices.data(), indices.size() * sizeof(uint32_t));
+    }
 }
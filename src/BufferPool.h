@@ -1,33 +1,55 @@
 #pragma once
 
+#include <atomic>
+#include <deque>
+#include <functional>
 #include <unordered_map>
+#include <unordered_set>
 #include <vector>
 #include <memory>
 #include <mutex>
 
 #include "Camera.h"
+#include "ChunkTable.h"
 #include "Device.h"
 #include "Model.h"
 #include "Object.h"
+#include "RangeAllocator.h"
+#include "StagingRing.h"
+#include "SwapChain.h"
 #include "VMABuffer.h"
+#include "VertexWelder.h"
 
 #define INVALID_CHUNK_ID -1
 
 class BufferPool
 {
+    friend class BufferDefragmenter;
+    friend class ResidencyManager;
+    friend class BufferPoolBenchmark;
+    friend class GpuCuller;
+
 public:
-    struct Chunk
+    //chunk 内单个要素的子区间，偏移相对于chunk起点，用于编辑和拾取
+    struct FeatureRange
     {
         uint32_t vertexOffset{ 0 };
         uint32_t vertexCount{ 0 };
         uint32_t indexOffset{ 0 };
         uint32_t indexCount{ 0 };
         AABB bounds{ 0,0,0,0 };
-        //uint32_t lodLevel;'
-        bool    isLoaded{ false };
-        uint32_t  segmentIndex{ 0 };
     };
 
+    //chunk 内一段连续索引，firstIndex 相对chunk的 indexOffset
+    struct IndexRun
+    {
+        uint32_t firstIndex{ 0 };
+        uint32_t indexCount{ 0 };
+    };
+
+    //chunk 元数据按列存放在 ChunkTable 里，要素区间单独一列
+    using Chunk = ChunkTable::Chunk;
+
     struct BufferSegment
     {
         std::unique_ptr<VMABuffer> vertexBuffer;
@@ -36,43 +58,252 @@ public:
         uint32_t indexCapacity{ 0 };
         uint32_t usedVertices{ 0 };
         uint32_t usedIndices{ 0 };
+        RangeAllocator vertexAllocator;
+        RangeAllocator indexAllocator;
         std::vector<uint32_t>   chunks;
         bool isActive{ true };
+        uint32_t generation{ 0 };       //每次扩容换缓冲后加一，引用旧缓冲的描述符需要重建
+
+    };
+
+    //快照里的段：只保留绘制需要的缓冲句柄，扩容换下的旧缓冲延迟销毁，句柄在快照退役前有效
+    struct SegmentView
+    {
+        VkBuffer vertexBuffer{ VK_NULL_HANDLE };
+        VkBuffer indexBuffer{ VK_NULL_HANDLE };
+        VkDeviceSize vertexBufferSize{ 0 };
+        VkDeviceSize indexBufferSize{ 0 };
+        uint32_t generation{ 0 };
+        bool isActive{ false };
+    };
+
+    //渲染线程读取的不可变快照。写入方在锁内修改后整体发布，读取方无锁读取；
+    //chunk 表按列整体复制，要素区间不在表里，要素查询仍然走锁
+    struct ChunkSnapshot
+    {
+        uint64_t version{ 0 };
+        ChunkTable chunks;
+        std::unordered_map<ModelType, std::vector<SegmentView>> segments;
+    };
+
+    struct SegmentStats
+    {
+        RangeAllocator::Stats vertices;
+        RangeAllocator::Stats indices;
+    };
+
+    //单个几何类型的内存占用，字节数按顶点和索引的大小换算
+    struct TypeMemoryStats
+    {
+        ModelType type{ ModelType::None };
+        uint32_t segmentCount{ 0 };
+        uint32_t chunkCount{ 0 };
+        uint32_t evictedChunkCount{ 0 };
+        uint32_t pendingChunkCount{ 0 };        //已封口、等待上传
+        uint64_t featureCount{ 0 };
+        VkDeviceSize allocatedBytes{ 0 };       //段缓冲的大小
+        VkDeviceSize usedBytes{ 0 };            //段内已分配的区间
+        float vertexFragmentation{ 0.f };       //所有段合计：1 - 最大空闲块/总空闲
+        float indexFragmentation{ 0.f };
+        VkDeviceSize cpuCopyBytes{ 0 };         //换出用的CPU副本
+        VkDeviceSize pendingUploadBytes{ 0 };
+        VkDeviceSize openChunkBytes{ 0 };       //还在累积要素的chunk
+    };
 
+    struct MemoryStats
+    {
+        std::vector<TypeMemoryStats> types;
+        VkDeviceSize retiredBufferBytes{ 0 };   //扩容换下、等待在途帧结束的旧缓冲
+        uint32_t bufferCount{ 0 };
+        VkDeviceSize metadataBytes{ 0 };        //chunk 表和要素区间
+        VkDeviceSize stagingBytes{ 0 };
     };
 
+    //段的容量上限，实际上限还会受 maxStorageBufferRange 限制
     static constexpr uint32_t VERTICES_PER_SEGMENGT = 50000000;
     static constexpr uint32_t INDICES_PER_SEGMENT = 150000000;
+    //段从小容量开始，按需翻倍扩容
+    static constexpr uint32_t INITIAL_SEGMENT_VERTICES = 1 << 16;
+    static constexpr uint32_t INITIAL_SEGMENT_INDICES = 3 << 16;
+    static constexpr uint32_t DEFAULT_CHUNK_VERTEX_BUDGET = 16384;
+    static constexpr VkDeviceSize DEFAULT_UPLOAD_BUDGET = 16 * 1024 * 1024;
+    //未封口的chunk连续这么多帧没有新要素追加时才封口上传
+    static constexpr uint64_t OPEN_CHUNK_IDLE_FRAMES = 8;
 
     BufferPool(Device& device);
-    ~BufferPool() = default;
+    ~BufferPool();
+
+    //把要素追加到同类型的未封口chunk，超过顶点预算时封口上传；featureIndex 返回要素在chunk内的序号
+    uint32_t allocateBuffer(const Object::Builder& builder, uint32_t* featureIndex = nullptr);
+    //封口所有未满的chunk，并在本帧的上传预算内上传排队的chunk，批量导入结束时调用
+    void flushPendingChunks();
+    //按预估的数据量提前把段扩到合适大小，避免导入过程中反复扩容
+    void reserve(ModelType type, uint64_t vertexCount, uint64_t indexCount);
+
+    void setChunkVertexBudget(uint32_t vertexBudget) { m_chunkVertexBudget = qMax(vertexBudget, 1u); }
+    uint32_t getChunkVertexBudget() const { return m_chunkVertexBudget; }
+
+    //大于0时，同一chunk内容差范围内且颜色相同的顶点只存一份（路网端点、共享边界）
+    void setVertexWeldTolerance(float tolerance) { m_weldTolerance = tolerance; }
+    float getVertexWeldTolerance() const { return m_weldTolerance; }
 
-    uint32_t allocateBuffer(const Object::Builder& builder);
-    std::vector<uint32_t> getVisibleChunks(const Camera& camera, ModelType type);
+    //每帧最多上传的字节数，0 表示不限；超过预算的单个chunk独占一帧
+    void setUploadBudget(VkDeviceSize bytes);
+    VkDeviceSize getUploadBudget() const { return m_uploadBudget; }
+    //排队等待上传的字节数
+    VkDeviceSize getPendingUploadBytes() const;
+
+    //释放chunk占用的段内区间，区间在 MAX_FRAMES_IN_FLIGHT 帧之后才能被复用
+    bool freeChunk(uint32_t chunkId);
+    //用新的几何替换chunk内容，放到新区间后释放旧区间，chunkId 保持不变
+    bool reallocateChunk(uint32_t chunkId, const std::vector<Model::Vertex>& vertices,
+        const std::vector<uint32_t>& indices, const std::vector<FeatureRange>& features);
+    //每帧开始时调用，回收已经没有帧在使用的区间和退役的快照，并发布快照
+    void collectGarbage();
+    //有修改时发布新的快照；flushPendingChunks 和 collectGarbage 会自动调用
+    void publishSnapshot();
+
+    //保留封口chunk的CPU副本，换出后才能重新上传
+    void setRetainCpuCopies(bool retain);
+    //把chunk换出显存，只保留CPU副本；chunkId 和要素区间保持不变
+    bool evictChunk(uint32_t chunkId);
+    //把换出的chunk重新上传，返回成功的个数
+    uint32_t restoreChunks(const std::vector<uint32_t>& chunkIds);
+    //取走上次以来进入视野但不在显存中的chunk
+    std::vector<uint32_t> takeRestreamRequests();
+    //段需要扩容或新建前调用，持有池的锁，返回 true 表示释放了区间可以重试；不能再调用池的公有接口
+    void setMemoryPressureHandler(std::function<bool(ModelType type, VkDeviceSize requestedBytes)> handler);
+
+    //以下读取接口只读最近发布的快照，不加锁；返回的指针在下一次 collectGarbage 之前有效
+    //包围盒宽高都小于 minExtent（世界单位）的chunk投影不到一个像素，当作不可见
+    std::vector<uint32_t> getVisibleChunks(const Camera& camera, ModelType type, float minExtent = 0.f);
+    //裁剪不在 getVisibleChunks 里完成时（GPU裁剪读回），由调用方登记可见和需要重新上传的chunk
+    void reportVisibility(const std::vector<uint32_t>& visibleChunks, const std::vector<uint32_t>& restreamChunks);
+    //在视野内、整体够大但含有小于 minExtent 要素的已加载chunk，需要按要素剔除后绘制
+    std::vector<uint32_t> getChunksWithSmallFeatures(const Camera& camera, ModelType type, float minExtent) const;
+    //chunk 内包围盒不小于 minExtent 的要素合并成的索引区间，全部太小时为空
+    void getFeatureRuns(uint32_t chunkId, float minExtent, std::vector<IndexRun>& runs) const;
 
     void bindBuffersForType(VkCommandBuffer commandBuffer, ModelType type, uint32_t segmentId = 0);
     void drawChunk(VkCommandBuffer commandBuffer, uint32_t chunkId, uint32_t instanceCount = 1);
 
-    const Chunk* getChunk(uint32_t chunkId) const;
+    bool getChunk(uint32_t chunkId, Chunk& chunk) const;
     ModelType getChunkType(uint32_t chunkId) const;
     uint32_t getChunkBufferIndex(uint32_t chunkId) const;
+    const SegmentView* getSegment(ModelType type, uint32_t segmentId) const;
+    const FeatureRange* getFeature(uint32_t chunkId, uint32_t featureIndex) const;
+    //chunk 内包围盒与 area 相交的要素序号
+    std::vector<uint32_t> queryFeatures(uint32_t chunkId, const AABB& area) const;
 
+    std::vector<SegmentStats> getFragmentationStats(ModelType type) const;
+    MemoryStats getMemoryStats() const;
     void printPoolStatus() const;
 
 private:
+    //还在CPU侧累积要素的chunk，封口时才分配段内区间
+    struct OpenChunk
+    {
+        uint32_t chunkId{ 0 };
+        std::vector<Model::Vertex> vertices;
+        std::vector<uint32_t> indices;
+        std::unique_ptr<VertexWelder> welder;
+        uint64_t lastAppendFrame{ 0 };
+    };
+
+    //已封口、等待上传的几何
+    struct PendingUpload
+    {
+        uint32_t chunkId{ 0 };
+        std::vector<Model::Vertex> vertices;
+        std::vector<uint32_t> indices;
+    };
+
+    //等待在途帧结束后才归还的区间
+    struct PendingFree
+    {
+        uint64_t frame{ 0 };
+        ModelType type{ ModelType::None };
+        uint32_t segmentIndex{ 0 };
+        uint32_t vertexOffset{ 0 };
+        uint32_t vertexCount{ 0 };
+        uint32_t indexOffset{ 0 };
+        uint32_t indexCount{ 0 };
+    };
+
     Device& m_device;
     mutable std::mutex                                          m_mutex;
 
     std::unordered_map<ModelType, std::vector<BufferSegment>>   m_bufferPools;
 
-    std::unordered_map<uint32_t, Chunk>                         m_chunks;
-    std::unordered_map<uint32_t, ModelType>                     m_chunkTypes;
-    std::unordered_map<uint32_t, uint32_t>                      m_chunkToSegmentIndex;
+    ChunkTable                                                  m_chunks;
+    std::vector<std::vector<FeatureRange>>                      m_chunkFeatures;    //按 chunk id 下标
+
+    std::unordered_map<ModelType, OpenChunk>                    m_openChunks;
+    std::vector<PendingFree>                                    m_pendingFrees;
+    std::deque<PendingUpload>                                   m_pendingUploads;
+    VkDeviceSize                                                m_pendingUploadBytes{ 0 };
+    VkDeviceSize                                                m_uploadBudget{ DEFAULT_UPLOAD_BUDGET };
+    VkDeviceSize                                                m_uploadedThisFrame{ 0 };
+
+    //换出用的CPU副本
+    struct CpuGeometry
+    {
+        std::vector<Model::Vertex> vertices;
+        std::vector<uint32_t> indices;
+    };
+    std::unordered_map<uint32_t, CpuGeometry>                   m_cpuCopies;
+    std::unordered_map<ModelType, std::unordered_set<uint32_t>> m_evictedChunks;
+    std::unordered_set<uint32_t>                                m_restreamRequests;
+    std::function<bool(ModelType, VkDeviceSize)>                m_memoryPressureHandler;
+    bool                                                        m_retainCpuCopies{ false };
+    //扩容后被替换的旧缓冲，等在途帧结束后再销毁
+    std::vector<std::pair<uint64_t, std::unique_ptr<VMABuffer>>> m_retiredBuffers;
+    uint64_t                                                    m_frameCounter{ 0 };
+
+    uint32_t    m_chunkVertexBudget{ DEFAULT_CHUNK_VERTEX_BUDGET };
+    float       m_weldTolerance{ 0.f };
+    uint32_t    m_maxSegmentVertices{ VERTICES_PER_SEGMENGT };
+    uint32_t    m_maxSegmentIndices{ INDICES_PER_SEGMENT };
+
+    //当前发布的快照，读取方 acquire 读取；替换下来的快照等 SNAPSHOT_GRACE_FRAMES 帧后释放
+    static constexpr uint64_t SNAPSHOT_GRACE_FRAMES = SwapChain::MAX_FRAMES_IN_FLIGHT + 1;
+    std::atomic<const ChunkSnapshot*>                           m_snapshot{ nullptr };
+    std::vector<std::pair<uint64_t, std::unique_ptr<const ChunkSnapshot>>> m_retiredSnapshots;
+    uint64_t                                                    m_snapshotVersion{ 0 };
+    bool                                                        m_snapshotDirty{ true };
+
+    //渲染线程裁剪时记录的可见性，下一次 collectGarbage 时写回chunk，读取路径不碰池的锁
+    std::mutex                                                  m_visibilityMutex;
+    std::vector<uint32_t>                                       m_visibleFeedback;
+    std::vector<uint32_t>                                       m_restreamFeedback;
 
-    uint32_t    m_nextChunkId{ 0 };
+    //所有上传共用的暂存环，放在最后保证最先析构，等完在途拷贝后再销毁段缓冲
+    std::unique_ptr<StagingRing>                                m_stagingRing;
 
-    BufferSegment* getOrCreateSegment(ModelType type);
-    bool frustumCull(const AABB& bounds, const Camera& camera);
+    uint32_t openChunk(ModelType type);
+    void sealChunk(ModelType type);
+    //在本帧剩余预算内上传排队的chunk
+    void pumpUploads();
+    //从上传队列中移除chunk，区间没被GPU用过，立即归还
+    void cancelUpload(uint32_t chunkId);
+    static VkDeviceSize geometryBytes(size_t vertexCount, size_t indexCount);
+    //在已有段中找能同时放下顶点和索引的区间，都放不下时新建段
+    BufferSegment* allocateRanges(ModelType type, uint32_t vertexCount, uint32_t indexCount,
+        uint32_t& segmentIndex, uint32_t& vertexOffset, uint32_t& indexOffset);
+    void releaseRanges(const PendingFree& ranges);
+    void publishSnapshotLocked();
+    const ChunkSnapshot& currentSnapshot() const { return *m_snapshot.load(std::memory_order_acquire); }
+    bool evictChunkLocked(uint32_t chunkId);
+    void retireChunkRanges(uint32_t chunkId);
+    void updateChunkBounds(uint32_t chunkId);
+    //优先复用已释放的段槽位，段序号在段的生命周期内保持不变
+    BufferSegment* createSegment(ModelType type, uint64_t vertexCapacity, uint64_t indexCapacity);
+    //释放已经搬空的段的缓冲，槽位留给后续新建的段
+    void releaseSegment(ModelType type, uint32_t segmentIndex);
+    //在GPU上把段拷贝到更大的缓冲，至少容纳 minVertexCapacity/minIndexCapacity
+    bool growSegment(ModelType type, uint32_t segmentIndex, uint64_t minVertexCapacity, uint64_t minIndexCapacity);
+    std::unique_ptr<VMABuffer> createSegmentBuffer(VkDeviceSize elementSize, uint32_t capacity, VkBufferUsageFlags usage);
+    //经暂存环登记拷贝，批次在 flushPendingChunks/collectGarbage 等处统一提交
     void copyDataToSegment(BufferSegment* segement, const std::vector<Model::Vertex>& vertices,
         const std::vector<uint32_t>& indices, uint32_t vertexOffset, uint32_t indexOffset);
 };
@@ -0,0 +1,192 @@
+#include "BufferPoolBenchmark.h"
+
+#include <algorithm>
+#include <atomic>
+#include <random>
+#include <thread>
+#include <vector>
+
+BufferPoolBenchmark::Result BufferPoolBenchmark::run(Device& device, uint32_t writerThreads, bool lockedReads,
+    std::chrono::milliseconds duration)
+{
+    using Clock = std::chrono::high_resolution_clock;
+
+    BufferPool pool(device);
+    std::atomic<bool> stop{ false };
+    std::atomic<uint64_t> featuresWritten{ 0 };
+
+    std::vector<std::thread> writers;
+    for (uint32_t i = 0; i < writerThreads; i++)
+    {
+        writers.emplace_back([&pool, &stop, &featuresWritten, i]() {
+            uint32_t index = 0;
+            while (!stop.load(std::memory_order_relaxed))
+            {
+                pool.allocateBuffer(makeFeature(i, index++));
+                featuresWritten.fetch_add(1, std::memory_order_relaxed);
+
+                //模拟加载线程分批结束，封口后发布快照
+                if (index % 256 == 0)
+                    pool.flushPendingChunks();
+            }
+            });
+    }
+
+    //覆盖全部要素的正交视图，每帧都要遍历所有chunk
+    Camera camera;
+    camera.setOrthographciProjection(-1.f, 1.f, -1.f, 1.f, 0.1f, 10.f);
+    camera.setViewDirection(QVector3D(0.f, 0.f, -1.f), QVector3D(0.f, 0.f, 1.f));
+
+    Result result;
+    result.writerThreads = writerThreads;
+    result.lockedReads = lockedReads;
+
+    std::vector<double> frameTimes;
+    auto end = Clock::now() + duration;
+    while (Clock::now() < end)
+    {
+        pool.collectGarbage();
+
+        auto frameStart = Clock::now();
+        auto chunkIds = lockedReads ? lockedVisibleChunks(pool, camera, ModelType::Line)
+            : pool.getVisibleChunks(camera, ModelType::Line);
+        for (uint32_t chunkId : chunkIds)
+        {
+            bool read = lockedReads ? lockedChunkRead(pool, ModelType::Line, chunkId)
+                : snapshotChunkRead(pool, ModelType::Line, chunkId);
+            if (read)
+                result.chunksRead++;
+        }
+        frameTimes.push_back(std::chrono::duration<double, std::milli>(Clock::now() - frameStart).count());
+    }
+
+    stop.store(true);
+    for (auto& writer : writers)
+    {
+        writer.join();
+    }
+
+    result.frames = frameTimes.size();
+    result.featuresWritten = featuresWritten.load();
+    if (!frameTimes.empty())
+    {
+        double total = 0.0;
+        for (double time : frameTimes)
+            total += time;
+        result.avgFrameMs = total / frameTimes.size();
+
+        std::sort(frameTimes.begin(), frameTimes.end());
+        result.p99FrameMs = frameTimes[std::min(frameTimes.size() - 1, frameTimes.size() * 99 / 100)];
+        result.maxFrameMs = frameTimes.back();
+    }
+    return result;
+}
+
+void BufferPoolBenchmark::runAll(Device& device)
+{
+    for (uint32_t writerThreads : { 1u, 2u, 4u, 8u })
+    {
+        for (bool lockedReads : { true, false })
+        {
+            Result result = run(device, writerThreads, lockedReads);
+            qDebug() << "buffer pool contention:" << result.writerThreads << "writers,"
+                << (result.lockedReads ? "locked" : "snapshot") << "reads |"
+                << result.frames << "frames, avg" << result.avgFrameMs << "ms, p99" << result.p99FrameMs
+                << "ms, max" << result.maxFrameMs << "ms |" << result.featuresWritten << "features written,"
+                << result.chunksRead << "chunk reads";
+        }
+    }
+}
+
+std::vector<uint32_t> BufferPoolBenchmark::lockedVisibleChunks(BufferPool& pool, const Camera& camera, ModelType type)
+{
+    //旧的 getVisibleChunks 整个扫描都持有池的锁，并在可写的表上记录可见帧
+    std::lock_guard<std::mutex> lock(pool.m_mutex);
+
+    const auto frustum = camera.getFrustum2D();
+    std::vector<uint32_t> visibleChunks;
+    const auto& types = pool.m_chunks.types();
+    const auto& bounds = pool.m_chunks.bounds();
+    const auto& loaded = pool.m_chunks.loaded();
+    for (uint32_t chunkId = 1; chunkId < pool.m_chunks.slotCount(); chunkId++)
+    {
+        if (types[chunkId] != type || !loaded[chunkId] || !frustum.insersects(bounds[chunkId]))
+            continue;
+        pool.m_chunks.setLastVisibleFrame(chunkId, pool.m_frameCounter);
+        visibleChunks.push_back(chunkId);
+    }
+    return visibleChunks;
+}
+
+bool BufferPoolBenchmark::lockedChunkRead(BufferPool& pool, ModelType type, uint32_t chunkId)
+{
+    //旧的 getChunkType、getChunkBufferIndex、getSegment、getChunk 各自加锁
+    {
+        std::lock_guard<std::mutex> lock(pool.m_mutex);
+        if (!pool.m_chunks.contains(chunkId) || pool.m_chunks.types()[chunkId] == ModelType::None)
+            return false;
+    }
+
+    uint32_t segmentIndex = 0;
+    {
+        std::lock_guard<std::mutex> lock(pool.m_mutex);
+        if (!pool.m_chunks.contains(chunkId))
+            return false;
+        segmentIndex = pool.m_chunks.get(chunkId).segmentIndex;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(pool.m_mutex);
+        auto typeIt = pool.m_bufferPools.find(type);
+        if (typeIt == pool.m_bufferPools.end() || segmentIndex >= typeIt->second.size())
+            return false;
+    }
+
+    std::lock_guard<std::mutex> lock(pool.m_mutex);
+    return pool.m_chunks.contains(chunkId);
+}
+
+bool BufferPoolBenchmark::snapshotChunkRead(BufferPool& pool, ModelType type, uint32_t chunkId)
+{
+    if (pool.getChunkType(chunkId) == ModelType::None)
+        return false;
+    BufferPool::Chunk chunk;
+    uint32_t segmentIndex = pool.getChunkBufferIndex(chunkId);
+    return pool.getSegment(type, segmentIndex) && pool.getChunk(chunkId, chunk);
+}
+
+Object::Builder BufferPoolBenchmark::makeFeature(uint32_t seed, uint32_t index)
+{
+    //NDC 范围内的随机折线，按 LINE_LIST 组织索引
+    std::mt19937 random(seed * 7919u + index);
+    std::uniform_real_distribution<float> coord(-0.9f, 0.9f);
+    std::uniform_real_distribution<float> step(-0.01f, 0.01f);
+
+    Object::Builder builder;
+    builder.type = ModelType::Line;
+
+    float x = coord(random);
+    float y = coord(random);
+    builder.bounds = AABB{ x, y, x, y };
+    for (uint32_t i = 0; i < 32; i++)
+    {
+        Model::Vertex vertex;
+        vertex.position = QVector3D(x, y, 0.f);
+        vertex.color = QVector3D(1.f, 1.f, 1.f);
+        builder.vertices.push_back(vertex);
+
+        builder.bounds.minX = qMin(builder.bounds.minX, x);
+        builder.bounds.minY = qMin(builder.bounds.minY, y);
+        builder.bounds.maxX = qMax(builder.bounds.maxX, x);
+        builder.bounds.maxY = qMax(builder.bounds.maxY, y);
+
+        if (i > 0)
+        {
+            builder.indices.push_back(i - 1);
+            builder.indices.push_back(i);
+        }
+        x += step(random);
+        y += step(random);
+    }
+    return builder;
+}
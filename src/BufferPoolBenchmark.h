@@ -0,0 +1,38 @@
+#pragma once
+
+#include "BufferPool.h"
+#include "Device.h"
+
+#include <chrono>
+#include <vector>
+
+//BufferPool 读写竞争测试：N 个加载线程不断追加要素，一个渲染线程模拟每帧的裁剪和逐chunk查询。
+//lockedReads 为 true 时按改成快照之前的方式读取：裁剪持锁扫描chunk表，每次查询各加一次锁
+class BufferPoolBenchmark
+{
+public:
+    struct Result
+    {
+        uint32_t writerThreads{ 0 };
+        bool lockedReads{ false };
+        uint64_t frames{ 0 };
+        uint64_t featuresWritten{ 0 };
+        uint64_t chunksRead{ 0 };
+        double avgFrameMs{ 0.0 };
+        double p99FrameMs{ 0.0 };
+        double maxFrameMs{ 0.0 };
+    };
+
+    static Result run(Device& device, uint32_t writerThreads, bool lockedReads,
+        std::chrono::milliseconds duration = std::chrono::milliseconds(2000));
+    //1/2/4/8 个写线程，快照读取和加锁读取各跑一遍，结果输出到 qDebug
+    static void runAll(Device& device);
+
+private:
+    static Object::Builder makeFeature(uint32_t seed, uint32_t index);
+    //旧的读取路径，直接读池的可写状态
+    static std::vector<uint32_t> lockedVisibleChunks(BufferPool& pool, const Camera& camera, ModelType type);
+    static bool lockedChunkRead(BufferPool& pool, ModelType type, uint32_t chunkId);
+    //快照读取路径，和 RenderManager 绘制一个chunk时的查询一样
+    static bool snapshotChunkRead(BufferPool& pool, ModelType type, uint32_t chunkId);
+};
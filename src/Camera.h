@@ -43,6 +43,12 @@ public:
             }
             return true;
         }
+
+        //可见区域的世界宽高：相对两个平面法向相反且已归一化，间距是两者 c 之和
+        QVector2D extent() const
+        {
+            return QVector2D(planes[0].c + planes[1].c, planes[2].c + planes[3].c);
+        }
     };
 
 
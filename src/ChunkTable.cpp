@@ -0,0 +1,136 @@
+#include "ChunkTable.h"
+
+#include <cassert>
+
+ChunkTable::ChunkTable()
+{
+    //0 号槽位表示“不属于任何chunk”，只占位
+    m_live.push_back(0);
+    m_types.push_back(ModelType::None);
+    m_segmentIndices.push_back(0);
+    m_bounds.push_back(AABB{});
+    m_minFeatureSizes.push_back(0.f);
+    m_vertexOffsets.push_back(0);
+    m_vertexCounts.push_back(0);
+    m_indexOffsets.push_back(0);
+    m_indexCounts.push_back(0);
+    m_loaded.push_back(0);
+    m_evicted.push_back(0);
+    m_pendingUpload.push_back(0);
+    m_lastVisibleFrames.push_back(0);
+    m_revisions.push_back(0);
+}
+
+uint32_t ChunkTable::create(ModelType type)
+{
+    uint32_t chunkId = 0;
+    if (!m_freeSlots.empty())
+    {
+        chunkId = m_freeSlots.back();
+        m_freeSlots.pop_back();
+    }
+    else
+    {
+        chunkId = static_cast<uint32_t>(m_live.size());
+        m_live.push_back(0);
+        m_types.emplace_back();
+        m_segmentIndices.emplace_back();
+        m_bounds.emplace_back();
+        m_minFeatureSizes.emplace_back();
+        m_vertexOffsets.emplace_back();
+        m_vertexCounts.emplace_back();
+        m_indexOffsets.emplace_back();
+        m_indexCounts.emplace_back();
+        m_loaded.emplace_back();
+        m_evicted.emplace_back();
+        m_pendingUpload.emplace_back();
+        m_lastVisibleFrames.emplace_back();
+        m_revisions.emplace_back();
+    }
+
+    resetSlot(chunkId);
+    m_live[chunkId] = 1;
+    m_types[chunkId] = type;
+    m_size++;
+    return chunkId;
+}
+
+void ChunkTable::destroy(uint32_t chunkId, uint64_t frame)
+{
+    if (!contains(chunkId))
+        return;
+
+    resetSlot(chunkId);
+    m_retiredSlots.emplace_back(frame, chunkId);
+    m_size--;
+}
+
+void ChunkTable::recycleSlots(uint64_t frame, uint64_t graceFrames)
+{
+    size_t recycled = 0;
+    while (recycled < m_retiredSlots.size() && frame - m_retiredSlots[recycled].first > graceFrames)
+    {
+        m_freeSlots.push_back(m_retiredSlots[recycled].second);
+        recycled++;
+    }
+    m_retiredSlots.erase(m_retiredSlots.begin(), m_retiredSlots.begin() + recycled);
+}
+
+ChunkTable::Ref ChunkTable::at(uint32_t chunkId)
+{
+    assert(contains(chunkId) && "chunk id is not live");
+    m_revisions[chunkId] = ++m_revision;
+    return Ref{
+        m_vertexOffsets[chunkId],
+        m_vertexCounts[chunkId],
+        m_indexOffsets[chunkId],
+        m_indexCounts[chunkId],
+        m_bounds[chunkId],
+        m_minFeatureSizes[chunkId],
+        m_loaded[chunkId],
+        m_evicted[chunkId],
+        m_pendingUpload[chunkId],
+        m_lastVisibleFrames[chunkId],
+        m_segmentIndices[chunkId],
+        m_types[chunkId]
+    };
+}
+
+ChunkTable::Chunk ChunkTable::get(uint32_t chunkId) const
+{
+    Chunk chunk;
+    if (!contains(chunkId))
+        return chunk;
+
+    chunk.vertexOffset = m_vertexOffsets[chunkId];
+    chunk.vertexCount = m_vertexCounts[chunkId];
+    chunk.indexOffset = m_indexOffsets[chunkId];
+    chunk.indexCount = m_indexCounts[chunkId];
+    chunk.bounds = m_bounds[chunkId];
+    chunk.minFeatureSize = m_minFeatureSizes[chunkId];
+    chunk.isLoaded = m_loaded[chunkId] != 0;
+    chunk.isEvicted = m_evicted[chunkId] != 0;
+    chunk.isPendingUpload = m_pendingUpload[chunkId] != 0;
+    chunk.lastVisibleFrame = m_lastVisibleFrames[chunkId];
+    chunk.segmentIndex = m_segmentIndices[chunkId];
+    chunk.type = m_types[chunkId];
+    return chunk;
+}
+
+void ChunkTable::resetSlot(uint32_t chunkId)
+{
+    m_live[chunkId] = 0;
+    m_types[chunkId] = ModelType::None;
+    m_segmentIndices[chunkId] = 0;
+    m_bounds[chunkId] = AABB{};
+    m_minFeatureSizes[chunkId] = 0.f;
+    m_vertexOffsets[chunkId] = 0;
+    m_vertexCounts[chunkId] = 0;
+    m_indexOffsets[chunkId] = 0;
+    m_indexCounts[chunkId] = 0;
+    m_loaded[chunkId] = 0;
+    m_evicted[chunkId] = 0;
+    m_pendingUpload[chunkId] = 0;
+    m_lastVisibleFrames[chunkId] = 0;
+    m_revisions[chunkId] = ++m_revision;
+}
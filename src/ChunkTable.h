@@ -0,0 +1,104 @@
+#pragma once
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "const.h"
+#include "Model.h"
+
+//按 chunk id 直接下标访问的稠密表，每个字段单独一列连续存放。
+//id 0 保留不用，释放的槽位过了宽限期才复用；裁剪时只需线性扫描包围盒、类型和状态几列
+class ChunkTable
+{
+public:
+    //按值的chunk信息，对外接口和快照读取用
+    struct Chunk
+    {
+        uint32_t vertexOffset{ 0 };
+        uint32_t vertexCount{ 0 };
+        uint32_t indexOffset{ 0 };
+        uint32_t indexCount{ 0 };
+        AABB bounds{ 0,0,0,0 };
+        float   minFeatureSize{ 0.f };          //最小要素包围盒的宽高较大值，判断是否要按要素剔除
+        bool    isLoaded{ false };
+        bool    isEvicted{ false };             //显存紧张时被换出，几何只保留CPU副本
+        bool    isPendingUpload{ false };       //已分配区间，等待按上传预算拷贝
+        uint64_t lastVisibleFrame{ 0 };         //最近一次通过视锥裁剪的帧，用于LRU换出
+        uint32_t  segmentIndex{ 0 };
+        ModelType type{ ModelType::None };
+    };
+
+    //指向某个chunk各列的引用，字段名和 Chunk 相同；新建chunk导致表扩容后失效
+    struct Ref
+    {
+        uint32_t& vertexOffset;
+        uint32_t& vertexCount;
+        uint32_t& indexOffset;
+        uint32_t& indexCount;
+        AABB& bounds;
+        float& minFeatureSize;
+        uint8_t& isLoaded;
+        uint8_t& isEvicted;
+        uint8_t& isPendingUpload;
+        uint64_t& lastVisibleFrame;
+        uint32_t& segmentIndex;
+        ModelType& type;
+    };
+
+    ChunkTable();
+
+    //分配一个槽位，优先复用已过宽限期的id
+    uint32_t create(ModelType type);
+    //释放槽位；id 可能还被在途帧的可见性回读、排队的搬移和渲染批次引用，frame 之后要等宽限期才能复用
+    void destroy(uint32_t chunkId, uint64_t frame);
+    //把释放超过 graceFrames 帧的槽位放回空闲列表
+    void recycleSlots(uint64_t frame, uint64_t graceFrames);
+
+    bool contains(uint32_t chunkId) const { return chunkId < m_live.size() && m_live[chunkId]; }
+    //取可写引用时记一次修改，GPU侧的chunk记录据此只重写改过的槽位
+    Ref at(uint32_t chunkId);
+    //只更新可见帧，不算修改
+    void setLastVisibleFrame(uint32_t chunkId, uint64_t frame) { m_lastVisibleFrames[chunkId] = frame; }
+    Chunk get(uint32_t chunkId) const;
+
+    //包括空槽在内的槽位数，遍历时 id 从 1 到 slotCount()-1
+    uint32_t slotCount() const { return static_cast<uint32_t>(m_live.size()); }
+    uint32_t size() const { return m_size; }
+    //每次修改递增；revisions() 记录每个槽位最后一次修改时的值
+    uint64_t revision() const { return m_revision; }
+
+    //供线性扫描的列
+    const std::vector<uint8_t>& live() const { return m_live; }
+    const std::vector<ModelType>& types() const { return m_types; }
+    const std::vector<AABB>& bounds() const { return m_bounds; }
+    const std::vector<float>& minFeatureSizes() const { return m_minFeatureSizes; }
+    const std::vector<uint8_t>& loaded() const { return m_loaded; }
+    const std::vector<uint8_t>& evicted() const { return m_evicted; }
+    const std::vector<uint64_t>& lastVisibleFrames() const { return m_lastVisibleFrames; }
+    const std::vector<uint64_t>& revisions() const { return m_revisions; }
+
+private:
+    void resetSlot(uint32_t chunkId);
+
+private:
+    std::vector<uint8_t>    m_live;
+    std::vector<ModelType>  m_types;
+    std::vector<uint32_t>   m_segmentIndices;
+    std::vector<AABB>       m_bounds;
+    std::vector<float>      m_minFeatureSizes;
+    std::vector<uint32_t>   m_vertexOffsets;
+    std::vector<uint32_t>   m_vertexCounts;
+    std::vector<uint32_t>   m_indexOffsets;
+    std::vector<uint32_t>   m_indexCounts;
+    std::vector<uint8_t>    m_loaded;
+    std::vector<uint8_t>    m_evicted;
+    std::vector<uint8_t>    m_pendingUpload;
+    std::vector<uint64_t>   m_lastVisibleFrames;
+    std::vector<uint64_t>   m_revisions;
+
+    std::vector<uint32_t>   m_freeSlots;
+    std::vector<std::pair<uint64_t, uint32_t>> m_retiredSlots;     //(释放时的帧, id)，按帧递增
+    uint32_t                m_size{ 0 };
+    uint64_t                m_revision{ 0 };
+};
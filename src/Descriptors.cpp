@@ -171,6 +171,25 @@ DescriptorWriter& DescriptorWriter::writeBuffer(uint32_t binding, VkDescriptorBu
     return *this;
 }
 
+DescriptorWriter& DescriptorWriter::writeBuffers(uint32_t binding, VkDescriptorBufferInfo* infos, uint32_t count)
+{
+    assert(m_setLayout.m_bindings.count(binding) == 1 && "Layout does not contain specified binding");
+
+    auto& bindingDescription = m_setLayout.m_bindings[binding];
+
+    assert(count <= bindingDescription.descriptorCount && "Too many descriptor infos for binding");
+
+    VkWriteDescriptorSet write{};
+    write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    write.descriptorType = bindingDescription.descriptorType;
+    write.dstBinding = binding;
+    write.pBufferInfo = infos;
+    write.descriptorCount = count;
+
+    m_writes.emplace_back(write);
+    return *this;
+}
+
 DescriptorWriter& DescriptorWriter::writeImage(uint32_t binding, VkDescriptorImageInfo* imageInfo)
 {
     assert(m_setLayout.m_bindings.count(binding) == 1 && "Layout does not contain specified binding");
@@ -99,6 +99,8 @@ public:
     DescriptorWriter(DescriptorSetLayout& setLayout, DescriptorPool& pool);
 
     DescriptorWriter& writeBuffer(uint32_t binding, VkDescriptorBufferInfo* info);
+    //数组绑定，一次写入 count 个连续元素
+    DescriptorWriter& writeBuffers(uint32_t binding, VkDescriptorBufferInfo* infos, uint32_t count);
     DescriptorWriter& writeImage(uint32_t binding, VkDescriptorImageInfo* imageInfo);
 
     bool build(VkDescriptorSet& set);
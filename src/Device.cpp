@@ -1,7 +1,9 @@
 #include "Device.h"
 #include "MyVulkanWindow.h"
+#include "PipelineCache.h"
 
 // std headers
+#include <algorithm>
 #include <cstring>
 #include <iostream>
 #include <set>
@@ -56,10 +58,15 @@ Device::Device(MyVulkanWindow& window) : m_window{ window } {
     createLogicalDevice();
     createCommandPool();
     initVulkanMemAllocator();
+    m_pipelineCache = std::make_unique<PipelineCache>(*this);
 }
 
 Device::~Device() {
+    m_pipelineCache.reset();
     vmaDestroyAllocator(m_allocator);
+    if (m_transferCommandPool != VK_NULL_HANDLE) {
+        vkDestroyCommandPool(m_VkDevice, m_transferCommandPool, nullptr);
+    }
     vkDestroyCommandPool(m_VkDevice, m_commandPool, nullptr);
     vkDestroyDevice(m_VkDevice, nullptr);
 
@@ -112,6 +119,11 @@ void Device::createInstance() {
         throw std::runtime_error("failed to create instance!");
     }
 
+    //以实际启用的实例扩展为准
+    m_properties2Enabled = std::any_of(extensions.begin(), extensions.end(), [](const char* name) {
+        return strcmp(name, VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME) == 0;
+        });
+
     hasGflwRequiredInstanceExtensions();
 }
 
@@ -145,6 +157,9 @@ void Device::createLogicalDevice() {
 
     std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
     std::set<uint32_t> uniqueQueueFamilies = { indices.graphicsFamily, indices.presentFamily };
+    if (indices.transferFamilyHasValue) {
+        uniqueQueueFamilies.insert(indices.transferFamily);
+    }
 
     float queuePriority = 1.0f;
     for (uint32_t queueFamily : uniqueQueueFamilies) {
@@ -156,8 +171,20 @@ void Device::createLogicalDevice() {
         queueCreateInfos.push_back(queueCreateInfo);
     }
 
+    VkPhysicalDeviceFeatures supportedFeatures;
+    vkGetPhysicalDeviceFeatures(m_physicalDevice, &supportedFeatures);
+
     VkPhysicalDeviceFeatures deviceFeatures = {};
     deviceFeatures.samplerAnisotropy = VK_TRUE;
+    //顶点拉取按段槽位索引存储缓冲数组，不支持时退回逐段绑定顶点/索引缓冲
+    deviceFeatures.shaderStorageBufferArrayDynamicIndexing = supportedFeatures.shaderStorageBufferArrayDynamicIndexing;
+    //GPU裁剪生成的间接绘制用 firstInstance 传chunk序号，多条命令一次提交
+    deviceFeatures.multiDrawIndirect = supportedFeatures.multiDrawIndirect;
+    deviceFeatures.drawIndirectFirstInstance = supportedFeatures.drawIndirectFirstInstance;
+    //管线统计查询跨越渲染通道，次级命令缓冲执行时要继承这个查询
+    deviceFeatures.pipelineStatisticsQuery = supportedFeatures.pipelineStatisticsQuery;
+    deviceFeatures.inheritedQueries = supportedFeatures.inheritedQueries;
+    m_enabledFeatures = deviceFeatures;
 
     VkDeviceCreateInfo createInfo = {};
     createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
@@ -165,9 +192,23 @@ void Device::createLogicalDevice() {
     createInfo.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size());
     createInfo.pQueueCreateInfos = queueCreateInfos.data();
 
+    //显存预算扩展是可选的，不支持时 VMA 按堆大小估算预算
+    std::vector<const char*> enabledExtensions = deviceExtensions;
+    if (m_properties2Enabled && isExtensionAvailable(m_physicalDevice, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME))
+    {
+        enabledExtensions.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+        m_memoryBudgetEnabled = true;
+    }
+    //间接绘制的条数由GPU写入，不支持时按chunk槽位数提交，裁掉的命令实例数为0
+    if (isExtensionAvailable(m_physicalDevice, VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME))
+    {
+        enabledExtensions.push_back(VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME);
+        m_drawIndirectCountEnabled = true;
+    }
+
     createInfo.pEnabledFeatures = &deviceFeatures;
-    createInfo.enabledExtensionCount = static_cast<uint32_t>(deviceExtensions.size());
-    createInfo.ppEnabledExtensionNames = deviceExtensions.data();
+    createInfo.enabledExtensionCount = static_cast<uint32_t>(enabledExtensions.size());
+    createInfo.ppEnabledExtensionNames = enabledExtensions.data();
 
     // might not really be necessary anymore because device specific validation layers
     // have been deprecated
@@ -185,6 +226,10 @@ void Device::createLogicalDevice() {
 
     vkGetDeviceQueue(m_VkDevice, indices.graphicsFamily, 0, &m_graphicsQueue);
     vkGetDeviceQueue(m_VkDevice, indices.presentFamily, 0, &m_presentQueue);
+    if (indices.transferFamilyHasValue) {
+        m_transferFamily = indices.transferFamily;
+        vkGetDeviceQueue(m_VkDevice, indices.transferFamily, 0, &m_transferQueue);
+    }
 }
 
 void Device::createCommandPool() {
@@ -199,6 +244,14 @@ void Device::createCommandPool() {
     if (vkCreateCommandPool(m_VkDevice, &poolInfo, nullptr, &m_commandPool) != VK_SUCCESS) {
         throw std::runtime_error("failed to create command pool!");
     }
+
+    if (m_transferQueue != VK_NULL_HANDLE) {
+        VkCommandPoolCreateInfo transferPoolInfo = poolInfo;
+        transferPoolInfo.queueFamilyIndex = m_transferFamily;
+        if (vkCreateCommandPool(m_VkDevice, &transferPoolInfo, nullptr, &m_transferCommandPool) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create transfer command pool!");
+        }
+    }
 }
 
 void Device::initVulkanMemAllocator()
@@ -207,6 +260,10 @@ void Device::initVulkanMemAllocator()
     allocInfo.physicalDevice = m_physicalDevice;
     allocInfo.device = m_VkDevice;
     allocInfo.instance = m_instance;
+    if (m_memoryBudgetEnabled)
+    {
+        allocInfo.flags |= VMA_ALLOCATOR_CREATE_EXT_MEMORY_BUDGET_BIT;
+    }
     if (vmaCreateAllocator(&allocInfo, &m_allocator) != VK_SUCCESS)
     {
         throw std::runtime_error("Failed to create WMA");
@@ -298,6 +355,12 @@ std::vector<const char*> Device::getRequiredExtensions() {
         extensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
     }
 
+    //可选：VK_EXT_memory_budget 在 Vulkan 1.0 下依赖它
+    if (isExtensionAvailable(VK_NULL_HANDLE, VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME))
+    {
+        extensions.push_back(VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME);
+    }
+
     return extensions;
 }
 
@@ -324,24 +387,35 @@ void Device::hasGflwRequiredInstanceExtensions() {
     }
 }
 
-bool Device::checkDeviceExtensionSupport(VkPhysicalDevice device) {
-    uint32_t extensionCount;
-    vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, nullptr);
-
-    std::vector<VkExtensionProperties> availableExtensions(extensionCount);
-    vkEnumerateDeviceExtensionProperties(
-        device,
-        nullptr,
-        &extensionCount,
-        availableExtensions.data());
-
-    std::set<std::string> requiredExtensions(deviceExtensions.begin(), deviceExtensions.end());
+bool Device::isExtensionAvailable(VkPhysicalDevice device, const char* extensionName) {
+    uint32_t extensionCount = 0;
+    std::vector<VkExtensionProperties> extensions;
+    if (device == VK_NULL_HANDLE) {
+        vkEnumerateInstanceExtensionProperties(nullptr, &extensionCount, nullptr);
+        extensions.resize(extensionCount);
+        vkEnumerateInstanceExtensionProperties(nullptr, &extensionCount, extensions.data());
+    }
+    else {
+        vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, nullptr);
+        extensions.resize(extensionCount);
+        vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, extensions.data());
+    }
 
-    for (const auto& extension : availableExtensions) {
-        requiredExtensions.erase(extension.extensionName);
+    for (const auto& extension : extensions) {
+        if (strcmp(extension.extensionName, extensionName) == 0) {
+            return true;
+        }
     }
+    return false;
+}
 
-    return requiredExtensions.empty();
+bool Device::checkDeviceExtensionSupport(VkPhysicalDevice device) {
+    for (const char* required : deviceExtensions) {
+        if (!isExtensionAvailable(device, required)) {
+            return false;
+        }
+    }
+    return true;
 }
 
 QueueFamilyIndices Device::findQueueFamilies(VkPhysicalDevice device) {
@@ -372,6 +446,23 @@ QueueFamilyIndices Device::findQueueFamilies(VkPhysicalDevice device) {
         i++;
     }
 
+    //优先选只有传输能力的队列族（通常对应独立的DMA引擎），其次是不带图形能力的
+    int bestScore = 0;
+    for (uint32_t family = 0; family < queueFamilyCount; family++) {
+        VkQueueFlags flags = queueFamilies[family].queueFlags;
+        if (queueFamilies[family].queueCount == 0 || !(flags & VK_QUEUE_TRANSFER_BIT) ||
+            (flags & VK_QUEUE_GRAPHICS_BIT)) {
+            continue;
+        }
+
+        int score = (flags & VK_QUEUE_COMPUTE_BIT) ? 1 : 2;
+        if (score > bestScore) {
+            bestScore = score;
+            indices.transferFamily = family;
+            indices.transferFamilyHasValue = true;
+        }
+    }
+
     return indices;
 }
 
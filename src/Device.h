@@ -3,6 +3,7 @@
 #include "MyVulkanWindow.h"
 
 // std lib headers
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -10,6 +11,8 @@
 #include "vma/vk_mem_alloc.h"
 
 
+class PipelineCache;
+
 struct SwapChainSupportDetails {
     VkSurfaceCapabilitiesKHR capabilities;
     std::vector<VkSurfaceFormatKHR> formats;
@@ -19,8 +22,10 @@ struct SwapChainSupportDetails {
 struct QueueFamilyIndices {
     uint32_t graphicsFamily;
     uint32_t presentFamily;
+    uint32_t transferFamily;
     bool graphicsFamilyHasValue = false;
     bool presentFamilyHasValue = false;
+    bool transferFamilyHasValue = false;    //只有存在不带图形能力的独立传输队列族时才有值
     bool isComplete() { return graphicsFamilyHasValue && presentFamilyHasValue; }
 };
 
@@ -48,8 +53,21 @@ public:
     VkSurfaceKHR surface() { return m_VkSurface; }
     VkQueue graphicsQueue() { return m_graphicsQueue; }
     VkQueue presentQueue() { return m_presentQueue; }
+    //没有独立传输队列时 transferQueue 为空，上传走图形队列
+    bool hasDedicatedTransferQueue() const { return m_transferQueue != VK_NULL_HANDLE; }
+    VkQueue transferQueue() { return m_transferQueue; }
+    VkCommandPool getTransferCommandPool() { return m_transferCommandPool; }
+    uint32_t getTransferQueueFamily() const { return m_transferFamily; }
     VkPhysicalDevice physicalDevice() { return m_physicalDevice; }
     VmaAllocator allocator() const { return m_allocator; }
+    //启用了 VK_EXT_memory_budget 时，VMA 报告的堆预算来自驱动，否则只是按堆大小估算
+    bool memoryBudgetEnabled() const { return m_memoryBudgetEnabled; }
+    //创建逻辑设备时实际启用的可选特性
+    const VkPhysicalDeviceFeatures& enabledFeatures() const { return m_enabledFeatures; }
+    //启用了 VK_KHR_draw_indirect_count，可以用 vkCmdDrawIndirectCountKHR
+    bool drawIndirectCountEnabled() const { return m_drawIndirectCountEnabled; }
+    //所有管线共用的持久化管线缓存，设备销毁前写回磁盘
+    PipelineCache& pipelineCache() { return *m_pipelineCache; }
 
     // 添加获取图形队列族索引的方法
     uint32_t getGraphicsQueueFamily() { 
@@ -113,6 +131,8 @@ private:
     void populateDebugMessengerCreateInfo(VkDebugUtilsMessengerCreateInfoEXT& createInfo);
     void hasGflwRequiredInstanceExtensions();
     bool checkDeviceExtensionSupport(VkPhysicalDevice device);
+    //device 为 VK_NULL_HANDLE 时查询实例扩展
+    bool isExtensionAvailable(VkPhysicalDevice device, const char* extensionName);
     SwapChainSupportDetails querySwapChainSupport(VkPhysicalDevice device);
 
     std::vector<const char*> getRequiredExtensions();
@@ -125,11 +145,19 @@ private:
     VkCommandPool m_commandPool;
 
     VmaAllocator    m_allocator;
+    bool            m_properties2Enabled = false;
+    bool            m_memoryBudgetEnabled = false;
+    VkPhysicalDeviceFeatures m_enabledFeatures{};
+    bool            m_drawIndirectCountEnabled = false;
+    std::unique_ptr<PipelineCache> m_pipelineCache;
 
     VkDevice m_VkDevice;
     VkSurfaceKHR m_VkSurface;
     VkQueue m_graphicsQueue;
     VkQueue m_presentQueue;
+    VkQueue m_transferQueue = VK_NULL_HANDLE;
+    VkCommandPool m_transferCommandPool = VK_NULL_HANDLE;
+    uint32_t m_transferFamily = 0;
 
     const std::vector<const char*> validationLayers = { "VK_LAYER_KHRONOS_validation" };
     const std::vector<const char*> deviceExtensions = { VK_KHR_SWAPCHAIN_EXTENSION_NAME };
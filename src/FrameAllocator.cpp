@@ -0,0 +1,144 @@
+#include "FrameAllocator.h"
+
+#include <cstring>
+#include <stdexcept>
+
+FrameAllocator::FrameAllocator(Device& device, VkDeviceSize frameCapacity) :
+    m_device(device)
+{
+    const VkPhysicalDeviceLimits& limits = m_device.properties.limits;
+    m_defaultAlignment = qMax<VkDeviceSize>(16,
+        qMax(limits.minStorageBufferOffsetAlignment, limits.minUniformBufferOffsetAlignment));
+    //非一致内存的刷新范围要按 nonCoherentAtomSize 对齐
+    m_usageAlignment = qMax<VkDeviceSize>(m_defaultAlignment, limits.nonCoherentAtomSize);
+
+    for (auto& frame : m_frames)
+    {
+        frame.blocks.push_back(createBlock(frameCapacity));
+    }
+    m_stats.capacity = frameCapacity;
+}
+
+void FrameAllocator::beginFrame(int frameIndex)
+{
+    m_frameIndex = frameIndex;
+    FrameBlocks& frame = m_frames[m_frameIndex];
+
+    //上次这一帧放不下时追加过块，合并成一块足够大的，之后不再溢出
+    if (frame.blocks.size() > 1)
+    {
+        VkDeviceSize total = 0;
+        for (const Block& block : frame.blocks)
+        {
+            total += block.capacity;
+        }
+        frame.blocks.clear();
+        frame.blocks.push_back(createBlock(total));
+    }
+
+    Block& block = frame.blocks.back();
+    block.head = 0;
+    block.flushed = 0;
+
+    m_stats.capacity = block.capacity;
+    m_stats.used = 0;
+    m_stats.overflowBlocks = 0;
+}
+
+void FrameAllocator::flush()
+{
+    for (Block& block : m_frames[m_frameIndex].blocks)
+    {
+        if (block.head <= block.flushed)
+            continue;
+
+        block.buffer->flush(block.head - block.flushed, block.flushed);
+        block.flushed = block.head;
+    }
+}
+
+FrameAllocator::Allocation FrameAllocator::allocate(VkDeviceSize size, VkDeviceSize alignment)
+{
+    if (size == 0)
+        return {};
+
+    if (alignment == 0)
+        alignment = m_defaultAlignment;
+
+    std::lock_guard<std::mutex> lock(m_allocateMutex);
+    FrameBlocks& frame = m_frames[m_frameIndex];
+    Block* block = &frame.blocks.back();
+
+    VkDeviceSize offset = (block->head + alignment - 1) / alignment * alignment;
+    if (offset + size > block->capacity)
+    {
+        //当前帧可能还在录制，已经分配出去的块不能换掉，只能追加
+        VkDeviceSize capacity = qMax(block->capacity * 2, size + alignment);
+        frame.blocks.push_back(createBlock(capacity));
+        block = &frame.blocks.back();
+        offset = 0;
+
+        m_stats.capacity += capacity;
+        m_stats.overflowBlocks++;
+        qDebug() << "frame allocator overflow, added block of" << capacity << "bytes";
+    }
+
+    block->head = (offset + size + m_usageAlignment - 1) / m_usageAlignment * m_usageAlignment;
+    block->head = qMin(block->head, block->capacity);
+
+    m_stats.used += size;
+    m_stats.peakUsed = qMax(m_stats.peakUsed, m_stats.used);
+
+    Allocation allocation;
+    allocation.buffer = block->buffer->getBuffer();
+    allocation.offset = offset;
+    allocation.size = size;
+    allocation.mapped = static_cast<char*>(block->buffer->getMappedMemory()) + offset;
+    return allocation;
+}
+
+FrameAllocator::Allocation FrameAllocator::write(const void* data, VkDeviceSize size, VkDeviceSize alignment)
+{
+    Allocation allocation = allocate(size, alignment);
+    if (allocation.isValid())
+        memcpy(allocation.mapped, data, size);
+    return allocation;
+}
+
+VkDeviceSize FrameAllocator::getTotalCapacity(uint32_t* blockCount) const
+{
+    VkDeviceSize capacity = 0;
+    uint32_t count = 0;
+    for (const auto& frame : m_frames)
+    {
+        for (const auto& block : frame.blocks)
+        {
+            capacity += block.capacity;
+            count++;
+        }
+    }
+
+    if (blockCount)
+        *blockCount = count;
+    return capacity;
+}
+
+FrameAllocator::Block FrameAllocator::createBlock(VkDeviceSize capacity)
+{
+    Block block;
+    block.capacity = capacity;
+    block.buffer = std::make_unique<VMABuffer>(
+        m_device,
+        1,
+        static_cast<uint32_t>(capacity),
+        VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT |
+        VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+        VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+        VMA_MEMORY_USAGE_CPU_TO_GPU
+    );
+    if (block.buffer->map() != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to map frame allocator block!");
+    }
+    return block;
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include "Device.h"
+#include "SwapChain.h"
+#include "VMABuffer.h"
+
+#include <array>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+//每个在途帧一块常驻映射的缓冲，帧内按偏移线性分配，帧的围栏信号后整体重置。
+//实例数据、逐次绘制常量和间接绘制命令都写在这里，不再 map/unmap，也不会改写上一帧正在读取的数据；
+//录在帧命令缓冲上的拷贝也从这里取源数据
+class FrameAllocator
+{
+public:
+    static constexpr VkDeviceSize DEFAULT_FRAME_CAPACITY = 8 * 1024 * 1024;
+
+    struct Allocation
+    {
+        VkBuffer buffer{ VK_NULL_HANDLE };
+        VkDeviceSize offset{ 0 };
+        VkDeviceSize size{ 0 };
+        void* mapped{ nullptr };
+
+        bool isValid() const { return buffer != VK_NULL_HANDLE; }
+    };
+
+    struct Stats
+    {
+        VkDeviceSize capacity{ 0 };         //当前帧所有块的容量
+        VkDeviceSize used{ 0 };             //当前帧已分配的字节
+        VkDeviceSize peakUsed{ 0 };
+        uint32_t overflowBlocks{ 0 };       //当前帧容量不够时追加的块数
+    };
+
+    FrameAllocator(Device& device, VkDeviceSize frameCapacity = DEFAULT_FRAME_CAPACITY);
+    ~FrameAllocator() = default;
+
+    FrameAllocator(const FrameAllocator&) = delete;
+    FrameAllocator& operator=(const FrameAllocator&) = delete;
+
+    //Renderer::beginFrame 等到该帧的围栏之后调用，重置该帧的全部分配
+    void beginFrame(int frameIndex);
+    //提交前调用，把写入的范围刷到设备可见
+    void flush();
+
+    //alignment 为 0 时按存储/uniform缓冲的最小偏移对齐；多个录制线程可以同时分配
+    Allocation allocate(VkDeviceSize size, VkDeviceSize alignment = 0);
+    //分配并拷贝数据
+    Allocation write(const void* data, VkDeviceSize size, VkDeviceSize alignment = 0);
+
+    const Stats& getStats() const { return m_stats; }
+    //所有在途帧的块容量之和
+    VkDeviceSize getTotalCapacity(uint32_t* blockCount = nullptr) const;
+
+private:
+    struct Block
+    {
+        std::unique_ptr<VMABuffer> buffer;
+        VkDeviceSize capacity{ 0 };
+        VkDeviceSize head{ 0 };
+        VkDeviceSize flushed{ 0 };          //已刷新到的位置
+    };
+
+    struct FrameBlocks
+    {
+        std::vector<Block> blocks;          //最后一块是当前分配的块
+    };
+
+    Block createBlock(VkDeviceSize capacity);
+
+private:
+    Device& m_device;
+
+    std::array<FrameBlocks, SwapChain::MAX_FRAMES_IN_FLIGHT> m_frames;
+    int             m_frameIndex{ 0 };
+    VkDeviceSize    m_defaultAlignment{ 16 };
+    VkDeviceSize    m_usageAlignment{ 16 };
+
+    Stats           m_stats;
+    std::mutex      m_allocateMutex;
+};
@@ -0,0 +1,309 @@
+#include "GeometryRenderSystem.h"
+
+#include "ObjectDataBuffer.h"
+#include "SwapChain.h"
+
+#include <algorithm>
+#include <cassert>
+#include <stdexcept>
+
+#ifdef min
+#undef min
+#endif
+
+namespace
+{
+    const ModelType SLOT_TYPES[GeometryRenderSystem::TYPE_COUNT] = {
+        ModelType::Point, ModelType::Line, ModelType::Polygon
+    };
+}
+
+GeometryRenderSystem::GeometryRenderSystem(Device& device, VkRenderPass renderPass, VkDescriptorSetLayout globalSetLayout,
+    VkDescriptorSetLayout objectSetLayout) :
+    m_device(device),
+    m_objectSetLayout(objectSetLayout)
+{
+    createDescriptorResources();
+    createPipelineLayout(globalSetLayout, objectSetLayout);
+    createPipelines(renderPass);
+}
+
+GeometryRenderSystem::~GeometryRenderSystem()
+{
+    vkDestroyPipelineLayout(m_device.device(), m_pipelineLayout, nullptr);
+}
+
+bool GeometryRenderSystem::isSupported(Device& device)
+{
+    if (!device.enabledFeatures().shaderStorageBufferArrayDynamicIndexing)
+        return false;
+
+    const VkPhysicalDeviceLimits& limits = device.properties.limits;
+    return limits.maxPerStageDescriptorStorageBuffers >= SEGMENT_SLOTS * 2 &&
+        limits.maxDescriptorSetStorageBuffers >= SEGMENT_SLOTS * 2;
+}
+
+VkPrimitiveTopology GeometryRenderSystem::topologyOf(ModelType type)
+{
+    switch (type)
+    {
+    case ModelType::Point:
+        return VK_PRIMITIVE_TOPOLOGY_POINT_LIST;
+    case ModelType::Line:
+        return VK_PRIMITIVE_TOPOLOGY_LINE_LIST;
+    default:
+        return VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+    }
+}
+
+void GeometryRenderSystem::setShaderConstants(PipelineConfigInfo& configInfo)
+{
+    const uint32_t constants[] = { SEGMENT_SLOTS, ObjectDataBuffer::DEFAULT_SLOT };
+    configInfo.specializationEntries.clear();
+    for (uint32_t i = 0; i < 2; i++)
+    {
+        configInfo.specializationEntries.push_back({ i, i * static_cast<uint32_t>(sizeof(uint32_t)), sizeof(uint32_t) });
+    }
+    configInfo.specializationData.assign(reinterpret_cast<const uint8_t*>(constants),
+        reinterpret_cast<const uint8_t*>(constants) + sizeof(constants));
+}
+
+uint32_t GeometryRenderSystem::segmentSlot(ModelType type, uint32_t segmentIndex)
+{
+    if (type == ModelType::None || segmentIndex >= SEGMENTS_PER_TYPE)
+        return INVALID_SLOT;
+
+    return static_cast<uint32_t>(type) * SEGMENTS_PER_TYPE + segmentIndex;
+}
+
+void GeometryRenderSystem::update(const BufferPool& bufferPool)
+{
+    bool changed = m_geometrySet == VK_NULL_HANDLE;
+
+    for (ModelType type : SLOT_TYPES)
+    {
+        for (uint32_t segmentIndex = 0; segmentIndex < SEGMENTS_PER_TYPE; segmentIndex++)
+        {
+            SlotState state{};
+            const BufferPool::SegmentView* segment = bufferPool.getSegment(type, segmentIndex);
+            if (segment && segment->isActive)
+            {
+                //描述符范围不能超过 maxStorageBufferRange
+                VkDeviceSize maxRange = m_device.properties.limits.maxStorageBufferRange;
+                state.vertexBuffer = segment->vertexBuffer;
+                state.indexBuffer = segment->indexBuffer;
+                state.vertexBufferSize = std::min(segment->vertexBufferSize, maxRange);
+                state.indexBufferSize = std::min(segment->indexBufferSize, maxRange);
+            }
+
+            SlotState& slot = m_slots[segmentSlot(type, segmentIndex)];
+            if (slot.vertexBuffer != state.vertexBuffer || slot.indexBuffer != state.indexBuffer ||
+                slot.vertexBufferSize != state.vertexBufferSize || slot.indexBufferSize != state.indexBufferSize)
+            {
+                slot = state;
+                changed = true;
+            }
+        }
+    }
+
+    if (changed)
+        rebuildGeometrySet();
+}
+
+void GeometryRenderSystem::collectGarbage()
+{
+    m_frameCounter++;
+
+    std::vector<VkDescriptorSet> expiredSets;
+    auto it = std::remove_if(m_retiredSets.begin(), m_retiredSets.end(), [&](const auto& retired) {
+        if (m_frameCounter - retired.first <= SwapChain::MAX_FRAMES_IN_FLIGHT)
+            return false;
+        expiredSets.push_back(retired.second);
+        return true;
+        });
+    m_retiredSets.erase(it, m_retiredSets.end());
+
+    if (!expiredSets.empty())
+        m_geometryPool->freeDescriptors(expiredSets);
+}
+
+void GeometryRenderSystem::bind(VkCommandBuffer commandBuffer, ModelType type, VkDescriptorSet globalDescriptorSet,
+    VkDescriptorSet objectDescriptorSet)
+{
+    if (type == ModelType::None)
+        return;
+
+    m_pipelines[static_cast<uint32_t>(type)]->bind(commandBuffer);
+
+    if (globalDescriptorSet != VK_NULL_HANDLE)
+    {
+        vkCmdBindDescriptorSets(
+            commandBuffer,
+            VK_PIPELINE_BIND_POINT_GRAPHICS,
+            m_pipelineLayout,
+            0, 1, &globalDescriptorSet,
+            0, nullptr
+        );
+    }
+
+    VkDescriptorSet descriptorSets[] = { m_geometrySet, objectDescriptorSet };
+    vkCmdBindDescriptorSets(
+        commandBuffer,
+        VK_PIPELINE_BIND_POINT_GRAPHICS,
+        m_pipelineLayout,
+        1, 2, descriptorSets,
+        0, nullptr
+    );
+}
+
+bool GeometryRenderSystem::drawChunk(VkCommandBuffer commandBuffer, ModelType type, const BufferPool::Chunk& chunk)
+{
+    uint32_t slot = segmentSlot(type, chunk.segmentIndex);
+    if (slot == INVALID_SLOT || m_slots[slot].vertexBuffer == VK_NULL_HANDLE)
+        return false;
+
+    if (!chunk.isLoaded)
+        return true;
+
+    GeometryPushConstantData push{};
+    push.segmentSlot = slot;
+    push.vertexOffset = static_cast<int32_t>(chunk.vertexOffset);
+    push.firstIndex = chunk.indexOffset;
+    push.indexed = chunk.indexCount > 0 ? 1 : 0;
+
+    vkCmdPushConstants(
+        commandBuffer,
+        m_pipelineLayout,
+        VK_SHADER_STAGE_VERTEX_BIT,
+        0,
+        sizeof(GeometryPushConstantData),
+        &push);
+
+    //和逐段绑定的路径一样，整个chunk绘制时读取默认的逐对象数据槽位
+    vkCmdDraw(commandBuffer, chunk.indexCount > 0 ? chunk.indexCount : chunk.vertexCount, 1, 0, ObjectDataBuffer::DEFAULT_SLOT);
+    return true;
+}
+
+void GeometryRenderSystem::createDescriptorResources()
+{
+    m_geometrySetLayout = DescriptorSetLayout::Builder(m_device)
+        .addBinding(0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_VERTEX_BIT, SEGMENT_SLOTS)
+        .addBinding(1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_VERTEX_BIT, SEGMENT_SLOTS)
+        .build();
+
+    //段缓冲变化时整组重建，旧的集合等在途帧结束后释放
+    m_geometryPool = DescriptorPool::Builder(m_device)
+        .setPoolFlags(VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT)
+        .setMaxSets(MAX_GEOMETRY_SETS)
+        .addPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, MAX_GEOMETRY_SETS * SEGMENT_SLOTS * 2)
+        .build();
+
+    //没有段的槽位也必须写入有效的描述符
+    m_emptyBuffer = std::make_unique<Buffer>(
+        m_device,
+        sizeof(Model::Vertex),
+        1,
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+}
+
+void GeometryRenderSystem::createPipelineLayout(VkDescriptorSetLayout globalSetLayout, VkDescriptorSetLayout objectSetLayout)
+{
+    VkPushConstantRange pushConstantRange{};
+    pushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+    pushConstantRange.offset = 0;
+    pushConstantRange.size = sizeof(GeometryPushConstantData);
+
+    std::vector<VkDescriptorSetLayout> descriptorSetLayout{
+        globalSetLayout,
+        m_geometrySetLayout->getDescriptorSetLayout(),
+        objectSetLayout
+    };
+
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutInfo.setLayoutCount = static_cast<uint32_t>(descriptorSetLayout.size());
+    pipelineLayoutInfo.pSetLayouts = descriptorSetLayout.data();
+    pipelineLayoutInfo.pushConstantRangeCount = 1;
+    pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+    if (vkCreatePipelineLayout(m_device.device(), &pipelineLayoutInfo,
+        nullptr, &m_pipelineLayout) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to create geometry pipeline layout!");
+    }
+}
+
+bool GeometryRenderSystem::pipelinesReady() const
+{
+    for (ModelType type : SLOT_TYPES)
+    {
+        if (!m_pipelines[static_cast<uint32_t>(type)]->isReady())
+            return false;
+    }
+    return true;
+}
+
+void GeometryRenderSystem::createPipelines(VkRenderPass renderPass)
+{
+    assert(m_pipelineLayout != nullptr && "Cannot create pipeline before pipeline layout");
+
+    for (ModelType type : SLOT_TYPES)
+    {
+        PipelineConfigInfo pipelineConfigInfo{};
+        Pipeline::setPipelineConfigInfo(pipelineConfigInfo, topologyOf(type));
+
+        //顶点全部从存储缓冲中拉取
+        pipelineConfigInfo.bindingDescriptions.clear();
+        pipelineConfigInfo.attributeDescriptions.clear();
+        setShaderConstants(pipelineConfigInfo);
+
+        pipelineConfigInfo.renderPass = renderPass;
+        pipelineConfigInfo.pipelineLayout = m_pipelineLayout;
+        m_pipelines[static_cast<uint32_t>(type)] = std::make_unique<Pipeline>(
+            m_device,
+            "pulled_geometry.vert.spv",
+            "pulled_geometry.frag.spv",
+            pipelineConfigInfo,
+            true
+        );
+    }
+}
+
+void GeometryRenderSystem::rebuildGeometrySet()
+{
+    std::array<VkDescriptorBufferInfo, SEGMENT_SLOTS> vertexInfos{};
+    std::array<VkDescriptorBufferInfo, SEGMENT_SLOTS> indexInfos{};
+    for (uint32_t slot = 0; slot < SEGMENT_SLOTS; slot++)
+    {
+        const SlotState& state = m_slots[slot];
+        if (state.vertexBuffer != VK_NULL_HANDLE)
+        {
+            vertexInfos[slot] = { state.vertexBuffer, 0, state.vertexBufferSize };
+            indexInfos[slot] = { state.indexBuffer, 0, state.indexBufferSize };
+        }
+        else
+        {
+            vertexInfos[slot] = m_emptyBuffer->descriptorInfo();
+            indexInfos[slot] = m_emptyBuffer->descriptorInfo();
+        }
+    }
+
+    VkDescriptorSet geometrySet = VK_NULL_HANDLE;
+    bool success = DescriptorWriter(*m_geometrySetLayout, *m_geometryPool)
+        .writeBuffers(0, vertexInfos.data(), SEGMENT_SLOTS)
+        .writeBuffers(1, indexInfos.data(), SEGMENT_SLOTS)
+        .build(geometrySet);
+
+    //旧描述符集可能还在在途帧的命令缓冲里，延迟释放
+    if (m_geometrySet != VK_NULL_HANDLE)
+        m_retiredSets.emplace_back(m_frameCounter, m_geometrySet);
+    m_geometrySet = geometrySet;
+
+    if (!success)
+    {
+        //旧集合引用的缓冲可能已经换掉，本帧退回逐段绑定，下一帧重试
+        qWarning() << "failed to allocate geometry descriptor set";
+        m_geometrySet = VK_NULL_HANDLE;
+        m_slots = {};
+    }
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include "Buffer.h"
+#include "BufferPool.h"
+#include "Descriptors.h"
+#include "Device.h"
+#include "Pipeline.h"
+
+#include <array>
+#include <memory>
+#include <vector>
+
+//顶点拉取渲染：着色器按段槽位从存储缓冲数组里读取顶点和索引，不再绑定顶点/索引缓冲。
+//所有类型的所有段共用一个描述符集，段切换只改推送常量，连续的chunk之间不需要任何重新绑定
+class GeometryRenderSystem
+{
+public:
+    static constexpr uint32_t TYPE_COUNT = 3;                  //Point/Line/Polygon
+    static constexpr uint32_t SEGMENTS_PER_TYPE = 16;
+    //以特化常量传给 pulled_geometry.vert 和 indirect_geometry.vert
+    static constexpr uint32_t SEGMENT_SLOTS = TYPE_COUNT * SEGMENTS_PER_TYPE;
+    static constexpr uint32_t INVALID_SLOT = UINT32_MAX;
+    static constexpr uint32_t MAX_GEOMETRY_SETS = 8;
+
+    struct GeometryPushConstantData
+    {
+        uint32_t segmentSlot;
+        int32_t vertexOffset;
+        uint32_t firstIndex;
+        uint32_t indexed;           //0 表示chunk没有索引，按顶点序号直接读取
+    };
+
+    GeometryRenderSystem(Device& device, VkRenderPass renderPass, VkDescriptorSetLayout globalSetLayout,
+        VkDescriptorSetLayout objectSetLayout);
+    ~GeometryRenderSystem();
+
+    GeometryRenderSystem(const GeometryRenderSystem&) = delete;
+    GeometryRenderSystem& operator=(const GeometryRenderSystem&) = delete;
+
+    //需要存储缓冲数组的动态索引，且每个着色器阶段能容纳全部槽位；不满足时调用方逐段绑定缓冲绘制
+    static bool isSupported(Device& device);
+    static uint32_t segmentSlot(ModelType type, uint32_t segmentIndex);
+    static VkPrimitiveTopology topologyOf(ModelType type);
+    //顶点拉取着色器的特化常量：0 为段槽位数，1 为默认的逐对象数据槽位
+    static void setShaderConstants(PipelineConfigInfo& configInfo);
+
+    //绘制前调用：段新建、扩容或释放后缓冲句柄变化，重建描述符集
+    void update(const BufferPool& bufferPool);
+    //释放在途帧已结束的旧描述符集，每帧调用一次
+    void collectGarbage();
+    //还没有可用的描述符集时不能绑定
+    bool isReady() const { return m_geometrySet != VK_NULL_HANDLE; }
+    //管线在后台编译，全部完成之前调用方继续走逐段绑定的路径
+    bool pipelinesReady() const;
+    //GPU裁剪的间接绘制管线复用同一个几何描述符集
+    VkDescriptorSetLayout getGeometrySetLayout() const { return m_geometrySetLayout->getDescriptorSetLayout(); }
+    VkDescriptorSet getGeometrySet() const { return m_geometrySet; }
+    VkDescriptorSetLayout getObjectSetLayout() const { return m_objectSetLayout; }
+
+    //绑定类型对应的管线和三个描述符集；各管线布局相同，切换类型时描述符集保持有效
+    void bind(VkCommandBuffer commandBuffer, ModelType type, VkDescriptorSet globalDescriptorSet,
+        VkDescriptorSet objectDescriptorSet);
+    //段超出槽位范围时返回 false，调用方改用逐段绑定的路径
+    bool drawChunk(VkCommandBuffer commandBuffer, ModelType type, const BufferPool::Chunk& chunk);
+
+private:
+    void createDescriptorResources();
+    void createPipelineLayout(VkDescriptorSetLayout globalSetLayout, VkDescriptorSetLayout objectSetLayout);
+    void createPipelines(VkRenderPass renderPass);
+    void rebuildGeometrySet();
+
+private:
+    Device& m_device;
+
+    struct SlotState
+    {
+        VkBuffer vertexBuffer = VK_NULL_HANDLE;
+        VkBuffer indexBuffer = VK_NULL_HANDLE;
+        VkDeviceSize vertexBufferSize{ 0 };
+        VkDeviceSize indexBufferSize{ 0 };
+    };
+
+    std::unique_ptr<DescriptorSetLayout>            m_geometrySetLayout;
+    std::unique_ptr<DescriptorPool>                 m_geometryPool;
+    std::unique_ptr<Buffer>                         m_emptyBuffer;      //空槽位指向的占位缓冲
+    std::array<SlotState, SEGMENT_SLOTS>            m_slots{};
+    VkDescriptorSet                                 m_geometrySet = VK_NULL_HANDLE;
+    std::vector<std::pair<uint64_t, VkDescriptorSet>> m_retiredSets;
+    uint64_t                                        m_frameCounter{ 0 };
+
+    VkDescriptorSetLayout                           m_objectSetLayout = VK_NULL_HANDLE;
+    std::array<std::unique_ptr<Pipeline>, TYPE_COUNT> m_pipelines;
+    VkPipelineLayout                                m_pipelineLayout;
+};
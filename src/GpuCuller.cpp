@@ -0,0 +1,420 @@
+#include "GpuCuller.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <stdexcept>
+
+GpuCuller::GpuCuller(Device& device, BufferPool& bufferPool, GeometryRenderSystem& geometryRenderSystem,
+    VkRenderPass renderPass, VkDescriptorSetLayout globalSetLayout) :
+    m_device(device),
+    m_bufferPool(bufferPool),
+    m_geometryRenderSystem(geometryRenderSystem)
+{
+    if (m_device.drawIndirectCountEnabled())
+    {
+        m_drawIndirectCount = reinterpret_cast<PFN_vkCmdDrawIndirectCountKHR>(
+            vkGetDeviceProcAddr(m_device.device(), "vkCmdDrawIndirectCountKHR"));
+    }
+
+    createDescriptorResources();
+    createPipelineLayouts(globalSetLayout);
+    createPipelines(renderPass);
+}
+
+GpuCuller::~GpuCuller()
+{
+    vkDestroyPipelineLayout(m_device.device(), m_cullPipelineLayout, nullptr);
+    vkDestroyPipelineLayout(m_device.device(), m_drawPipelineLayout, nullptr);
+}
+
+bool GpuCuller::isSupported(Device& device)
+{
+    return GeometryRenderSystem::isSupported(device) && device.enabledFeatures().drawIndirectFirstInstance;
+}
+
+bool GpuCuller::cull(VkCommandBuffer commandBuffer, int frameIndex, const Camera& camera, float minExtent)
+{
+    FrameResources& frame = m_frames[frameIndex];
+
+    //围栏已经等过，上一轮写入的可见位可以读取
+    readbackVisibility(frame);
+
+    m_geometryRenderSystem.update(m_bufferPool);
+    if (!m_geometryRenderSystem.isReady() || !pipelinesReady())
+        return false;
+
+    const BufferPool::ChunkSnapshot& snapshot = m_bufferPool.currentSnapshot();
+    ensureCapacity(frame, snapshot.chunks.slotCount());
+    if (frame.snapshotVersion != snapshot.version)
+        writeRecords(frame, snapshot);
+
+    vkCmdFillBuffer(commandBuffer, frame.counts->getBuffer(), 0, VK_WHOLE_SIZE, 0);
+
+    VkMemoryBarrier clearBarrier{};
+    clearBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    clearBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    clearBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    vkCmdPipelineBarrier(commandBuffer,
+        VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        0, 1, &clearBarrier, 0, nullptr, 0, nullptr);
+
+    const auto frustum = camera.getFrustum2D();
+    CullPushConstantData push{};
+    for (size_t i = 0; i < frustum.planes.size(); i++)
+    {
+        push.planes[i][0] = frustum.planes[i].a;
+        push.planes[i][1] = frustum.planes[i].b;
+        push.planes[i][2] = frustum.planes[i].c;
+        push.planes[i][3] = 0.f;
+    }
+    push.chunkCount = frame.chunkCount;
+    push.commandsPerType = frame.capacity;
+    push.compact = m_drawIndirectCount ? 1 : 0;
+    push.bitWords = bitWords(frame.capacity);
+    push.minExtent = minExtent;
+
+    m_cullPipeline->bind(commandBuffer);
+    vkCmdBindDescriptorSets(
+        commandBuffer,
+        VK_PIPELINE_BIND_POINT_COMPUTE,
+        m_cullPipelineLayout,
+        0, 1, &frame.descriptorSet,
+        0, nullptr
+    );
+    vkCmdPushConstants(commandBuffer, m_cullPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT,
+        0, sizeof(CullPushConstantData), &push);
+    vkCmdDispatch(commandBuffer, (frame.chunkCount + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE, 1, 1);
+
+    //命令和计数给间接绘制读取，可见位在帧结束后由CPU读回
+    VkMemoryBarrier cullBarrier{};
+    cullBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    cullBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    cullBarrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_HOST_READ_BIT;
+    vkCmdPipelineBarrier(commandBuffer,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_HOST_BIT,
+        0, 1, &cullBarrier, 0, nullptr, 0, nullptr);
+
+    frame.hasVisibility = true;
+    m_frameIndex = frameIndex;
+    return true;
+}
+
+bool GpuCuller::draw(VkCommandBuffer commandBuffer, ModelType type, VkDescriptorSet globalDescriptorSet,
+    VkDescriptorSet objectDescriptorSet)
+{
+    if (m_frameIndex < 0 || type == ModelType::None)
+        return false;
+
+    FrameResources& frame = m_frames[m_frameIndex];
+    uint32_t typeIndex = static_cast<uint32_t>(type);
+
+    m_drawPipelines[typeIndex]->bind(commandBuffer);
+    if (globalDescriptorSet != VK_NULL_HANDLE)
+    {
+        vkCmdBindDescriptorSets(
+            commandBuffer,
+            VK_PIPELINE_BIND_POINT_GRAPHICS,
+            m_drawPipelineLayout,
+            0, 1, &globalDescriptorSet,
+            0, nullptr
+        );
+    }
+
+    VkDescriptorSet descriptorSets[] = { m_geometryRenderSystem.getGeometrySet(), frame.descriptorSet, objectDescriptorSet };
+    vkCmdBindDescriptorSets(
+        commandBuffer,
+        VK_PIPELINE_BIND_POINT_GRAPHICS,
+        m_drawPipelineLayout,
+        1, 3, descriptorSets,
+        0, nullptr
+    );
+
+    const VkDeviceSize stride = sizeof(VkDrawIndirectCommand);
+    VkDeviceSize offset = static_cast<VkDeviceSize>(typeIndex) * frame.capacity * stride;
+    VkBuffer commands = frame.commands->getBuffer();
+
+    if (m_drawIndirectCount)
+    {
+        m_drawIndirectCount(commandBuffer, commands, offset, frame.counts->getBuffer(),
+            typeIndex * sizeof(uint32_t), frame.chunkCount, stride);
+    }
+    else if (m_device.enabledFeatures().multiDrawIndirect)
+    {
+        //没有计数时按槽位提交，裁掉的命令实例数为0
+        vkCmdDrawIndirect(commandBuffer, commands, offset, frame.chunkCount, stride);
+    }
+    else
+    {
+        for (uint32_t i = 0; i < frame.chunkCount; i++)
+            vkCmdDrawIndirect(commandBuffer, commands, offset + i * stride, 1, stride);
+    }
+
+    return true;
+}
+
+void GpuCuller::createDescriptorResources()
+{
+    m_cullSetLayout = DescriptorSetLayout::Builder(m_device)
+        .addBinding(0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT | VK_SHADER_STAGE_VERTEX_BIT)
+        .addBinding(1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT)
+        .addBinding(2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT)
+        .addBinding(3, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT)
+        .build();
+
+    m_cullPool = DescriptorPool::Builder(m_device)
+        .setMaxSets(SwapChain::MAX_FRAMES_IN_FLIGHT)
+        .addPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, SwapChain::MAX_FRAMES_IN_FLIGHT * 4)
+        .build();
+
+    for (auto& frame : m_frames)
+    {
+        if (!m_cullPool->allocateDescriptorSet(m_cullSetLayout->getDescriptorSetLayout(), frame.descriptorSet))
+            throw std::runtime_error("failed to allocate cull descriptor set!");
+    }
+}
+
+void GpuCuller::createPipelineLayouts(VkDescriptorSetLayout globalSetLayout)
+{
+    VkPushConstantRange pushConstantRange{};
+    pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    pushConstantRange.offset = 0;
+    pushConstantRange.size = sizeof(CullPushConstantData);
+
+    VkDescriptorSetLayout cullSetLayout = m_cullSetLayout->getDescriptorSetLayout();
+
+    VkPipelineLayoutCreateInfo cullLayoutInfo{};
+    cullLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    cullLayoutInfo.setLayoutCount = 1;
+    cullLayoutInfo.pSetLayouts = &cullSetLayout;
+    cullLayoutInfo.pushConstantRangeCount = 1;
+    cullLayoutInfo.pPushConstantRanges = &pushConstantRange;
+    if (vkCreatePipelineLayout(m_device.device(), &cullLayoutInfo,
+        nullptr, &m_cullPipelineLayout) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to create cull pipeline layout!");
+    }
+
+    //绘制时 set 1 是顶点拉取的几何集合，set 2 只用到chunk记录，set 3 是逐对象数据
+    std::vector<VkDescriptorSetLayout> drawSetLayouts{
+        globalSetLayout,
+        m_geometryRenderSystem.getGeometrySetLayout(),
+        cullSetLayout,
+        m_geometryRenderSystem.getObjectSetLayout()
+    };
+
+    VkPipelineLayoutCreateInfo drawLayoutInfo{};
+    drawLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    drawLayoutInfo.setLayoutCount = static_cast<uint32_t>(drawSetLayouts.size());
+    drawLayoutInfo.pSetLayouts = drawSetLayouts.data();
+    if (vkCreatePipelineLayout(m_device.device(), &drawLayoutInfo,
+        nullptr, &m_drawPipelineLayout) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to create indirect draw pipeline layout!");
+    }
+}
+
+bool GpuCuller::pipelinesReady() const
+{
+    if (!m_cullPipeline->isReady())
+        return false;
+    for (const auto& pipeline : m_drawPipelines)
+    {
+        if (!pipeline->isReady())
+            return false;
+    }
+    return true;
+}
+
+void GpuCuller::createPipelines(VkRenderPass renderPass)
+{
+    //全部在后台编译，完成之前 cull 返回 false，调用方走CPU裁剪
+    m_cullPipeline = std::make_unique<Pipeline>(m_device, "cull_chunks.comp.spv", m_cullPipelineLayout, true);
+
+    for (uint32_t typeIndex = 0; typeIndex < GeometryRenderSystem::TYPE_COUNT; typeIndex++)
+    {
+        PipelineConfigInfo pipelineConfigInfo{};
+        Pipeline::setPipelineConfigInfo(pipelineConfigInfo,
+            GeometryRenderSystem::topologyOf(static_cast<ModelType>(typeIndex)));
+
+        //顶点全部从存储缓冲中拉取
+        pipelineConfigInfo.bindingDescriptions.clear();
+        pipelineConfigInfo.attributeDescriptions.clear();
+        GeometryRenderSystem::setShaderConstants(pipelineConfigInfo);
+
+        pipelineConfigInfo.renderPass = renderPass;
+        pipelineConfigInfo.pipelineLayout = m_drawPipelineLayout;
+        m_drawPipelines[typeIndex] = std::make_unique<Pipeline>(
+            m_device,
+            "indirect_geometry.vert.spv",
+            "pulled_geometry.frag.spv",
+            pipelineConfigInfo,
+            true
+        );
+    }
+}
+
+void GpuCuller::ensureCapacity(FrameResources& frame, uint32_t chunkCount)
+{
+    frame.chunkCount = chunkCount;
+    if (chunkCount <= frame.capacity)
+        return;
+
+    //该帧的围栏已经等过，旧缓冲不再被GPU使用，可以直接替换
+    uint32_t capacity = std::max(frame.capacity, MIN_RECORD_CAPACITY);
+    while (capacity < chunkCount)
+        capacity *= 2;
+
+    frame.records = std::make_unique<VMABuffer>(
+        m_device,
+        sizeof(ChunkRecord),
+        capacity,
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+        VMA_MEMORY_USAGE_CPU_TO_GPU);
+    frame.records->map();
+    frame.tableRevision = 0;
+
+    frame.commands = std::make_unique<VMABuffer>(
+        m_device,
+        sizeof(VkDrawIndirectCommand),
+        capacity * GeometryRenderSystem::TYPE_COUNT,
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+        VMA_MEMORY_USAGE_GPU_ONLY);
+
+    if (!frame.counts)
+    {
+        frame.counts = std::make_unique<VMABuffer>(
+            m_device,
+            sizeof(uint32_t),
+            GeometryRenderSystem::TYPE_COUNT,
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+            VMA_MEMORY_USAGE_GPU_ONLY);
+    }
+
+    //前一半是可见且驻留的chunk，后一半是可见但已换出的chunk
+    frame.visibility = std::make_unique<VMABuffer>(
+        m_device,
+        sizeof(uint32_t),
+        bitWords(capacity) * 2,
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+        VMA_MEMORY_USAGE_GPU_TO_CPU);
+    frame.visibility->map();
+    std::memset(frame.visibility->getMappedMemory(), 0, frame.visibility->getBufferSize());
+    frame.visibility->flush();
+
+    frame.capacity = capacity;
+    frame.snapshotVersion = UINT64_MAX;
+    frame.hasVisibility = false;
+
+    VkDescriptorBufferInfo recordInfo = frame.records->descriptorInfo();
+    VkDescriptorBufferInfo commandInfo = frame.commands->descriptorInfo();
+    VkDescriptorBufferInfo countInfo = frame.counts->descriptorInfo();
+    VkDescriptorBufferInfo visibilityInfo = frame.visibility->descriptorInfo();
+    DescriptorWriter(*m_cullSetLayout, *m_cullPool)
+        .writeBuffer(0, &recordInfo)
+        .writeBuffer(1, &commandInfo)
+        .writeBuffer(2, &countInfo)
+        .writeBuffer(3, &visibilityInfo)
+        .overwrite(frame.descriptorSet);
+}
+
+void GpuCuller::writeRecords(FrameResources& frame, const BufferPool::ChunkSnapshot& snapshot)
+{
+    auto* records = static_cast<ChunkRecord*>(frame.records->getMappedMemory());
+    bool slotOverflow = false;
+
+    //快照版本变化时只重写这一帧上次写入之后改过的槽位，新建的缓冲整表写一次
+    const auto& live = snapshot.chunks.live();
+    const auto& revisions = snapshot.chunks.revisions();
+    bool fullRewrite = frame.tableRevision == 0;
+    uint32_t dirtyBegin = frame.chunkCount;
+    uint32_t dirtyEnd = 0;
+    for (uint32_t chunkId = 0; chunkId < frame.chunkCount; chunkId++)
+    {
+        if (!fullRewrite && revisions[chunkId] <= frame.tableRevision)
+            continue;
+
+        dirtyBegin = std::min(dirtyBegin, chunkId);
+        dirtyEnd = chunkId + 1;
+
+        ChunkRecord& record = records[chunkId];
+        record = ChunkRecord{};
+        if (chunkId == 0 || !live[chunkId])
+            continue;
+
+        BufferPool::Chunk chunk = snapshot.chunks.get(chunkId);
+        if (chunk.type == ModelType::None)
+            continue;
+
+        record.bounds[0] = chunk.bounds.minX;
+        record.bounds[1] = chunk.bounds.minY;
+        record.bounds[2] = chunk.bounds.maxX;
+        record.bounds[3] = chunk.bounds.maxY;
+        record.type = static_cast<uint32_t>(chunk.type);
+        record.state = chunk.isLoaded ? 1 : (chunk.isEvicted ? 2 : 0);
+        record.minFeatureSize = chunk.minFeatureSize;
+
+        record.segmentSlot = GeometryRenderSystem::segmentSlot(chunk.type, chunk.segmentIndex);
+        if (record.segmentSlot == GeometryRenderSystem::INVALID_SLOT)
+        {
+            //超出槽位的段画不出来，但仍参与可见性统计
+            record.segmentSlot = 0;
+            slotOverflow = true;
+            continue;
+        }
+
+        record.vertexOffset = static_cast<int32_t>(chunk.vertexOffset);
+        record.firstIndex = chunk.indexOffset;
+        record.indexed = chunk.indexCount > 0 ? 1 : 0;
+        record.drawCount = chunk.indexCount > 0 ? chunk.indexCount : chunk.vertexCount;
+    }
+
+    //VMA 会把刷新范围扩到 nonCoherentAtomSize 对齐
+    if (dirtyBegin < dirtyEnd)
+    {
+        frame.records->flush(static_cast<VkDeviceSize>(dirtyEnd - dirtyBegin) * sizeof(ChunkRecord),
+            static_cast<VkDeviceSize>(dirtyBegin) * sizeof(ChunkRecord));
+    }
+    frame.snapshotVersion = snapshot.version;
+    frame.tableRevision = snapshot.chunks.revision();
+
+    if (slotOverflow)
+        qWarning() << "GPU culling: segments beyond" << GeometryRenderSystem::SEGMENTS_PER_TYPE << "per type are not drawn";
+}
+
+void GpuCuller::readbackVisibility(FrameResources& frame)
+{
+    if (!frame.hasVisibility)
+        return;
+
+    frame.visibility->invalidate();
+    auto* bits = static_cast<uint32_t*>(frame.visibility->getMappedMemory());
+    uint32_t words = bitWords(frame.capacity);
+
+    std::vector<uint32_t> visibleChunks;
+    std::vector<uint32_t> restreamChunks;
+    auto collect = [&](const uint32_t* wordBits, std::vector<uint32_t>& chunks) {
+        for (uint32_t word = 0; word < words; word++)
+        {
+            uint32_t mask = wordBits[word];
+            while (mask)
+            {
+                uint32_t bit = 0;
+                while ((mask & (1u << bit)) == 0)
+                    bit++;
+                chunks.push_back(word * 32 + bit);
+                mask &= mask - 1;
+            }
+        }
+    };
+    collect(bits, visibleChunks);
+    collect(bits + words, restreamChunks);
+
+    //chunk 序号来自写记录时的快照，池在 collectGarbage 里会重新校验
+    if (!visibleChunks.empty() || !restreamChunks.empty())
+        m_bufferPool.reportVisibility(visibleChunks, restreamChunks);
+
+    std::memset(bits, 0, frame.visibility->getBufferSize());
+    frame.visibility->flush();
+    frame.hasVisibility = false;
+}
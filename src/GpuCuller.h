@@ -0,0 +1,112 @@
+#pragma once
+
+#include "BufferPool.h"
+#include "Camera.h"
+#include "Descriptors.h"
+#include "Device.h"
+#include "GeometryRenderSystem.h"
+#include "Pipeline.h"
+#include "SwapChain.h"
+#include "VMABuffer.h"
+
+#include <array>
+#include <memory>
+#include <vector>
+
+//GPU裁剪：计算着色器读取chunk包围盒，和相机视锥求交后把可见chunk压缩写成间接绘制命令，
+//每种类型一次 vkCmdDrawIndirectCountKHR 画完，CPU每帧的开销与chunk数量无关。
+//可见性按位写回，帧的围栏信号后读回，继续驱动换出和重新上传
+class GpuCuller
+{
+public:
+    static constexpr uint32_t WORKGROUP_SIZE = 64;             //与 cull_chunks.comp 的 local_size_x 一致
+    static constexpr uint32_t MIN_RECORD_CAPACITY = 1024;
+
+    //与着色器中的 ChunkRecord 布局一致（std430）
+    struct ChunkRecord
+    {
+        float bounds[4];            //minX, minY, maxX, maxY
+        uint32_t segmentSlot;
+        int32_t vertexOffset;
+        uint32_t firstIndex;
+        uint32_t indexed;
+        uint32_t drawCount;         //有索引时是索引数，否则是顶点数
+        uint32_t type;
+        uint32_t state;             //0 无效，1 驻留显存，2 已换出
+        float minFeatureSize;       //小于 minExtent 时由CPU按要素剔除后绘制，这里只记可见
+    };
+    static_assert(sizeof(ChunkRecord) == 48, "ChunkRecord must match the std430 layout");
+
+    struct CullPushConstantData
+    {
+        float planes[4][4];
+        uint32_t chunkCount;
+        uint32_t commandsPerType;
+        uint32_t compact;
+        uint32_t bitWords;
+        float minExtent;            //包围盒宽高都小于它的chunk不绘制
+    };
+
+    //需要顶点拉取、firstInstance 非0的间接绘制；没有 drawIndirectCount 时按槽位数提交
+    static bool isSupported(Device& device);
+
+    GpuCuller(Device& device, BufferPool& bufferPool, GeometryRenderSystem& geometryRenderSystem,
+        VkRenderPass renderPass, VkDescriptorSetLayout globalSetLayout);
+    ~GpuCuller();
+
+    GpuCuller(const GpuCuller&) = delete;
+    GpuCuller& operator=(const GpuCuller&) = delete;
+
+    //每帧开始时调用，本帧没有派发裁剪时不能绘制
+    void resetFrame() { m_frameIndex = -1; }
+    //在渲染通道开始之前录制，frameIndex 的围栏必须已经等过：
+    //读回该帧上一轮的可见性，chunk有变化时重写记录，清零计数后派发裁剪；几何描述符集不可用或管线还在编译时返回 false
+    //minExtent 为世界单位下的最小尺寸，投影小于阈值像素的chunk不绘制
+    bool cull(VkCommandBuffer commandBuffer, int frameIndex, const Camera& camera, float minExtent = 0.f);
+    //在渲染通道内绘制本帧裁剪后的一种类型，返回 false 表示本帧没有裁剪结果
+    bool draw(VkCommandBuffer commandBuffer, ModelType type, VkDescriptorSet globalDescriptorSet,
+        VkDescriptorSet objectDescriptorSet);
+
+private:
+    struct FrameResources
+    {
+        std::unique_ptr<VMABuffer> records;         //CPU写入，按chunk序号下标
+        std::unique_ptr<VMABuffer> commands;        //每种类型 capacity 条命令
+        std::unique_ptr<VMABuffer> counts;          //每种类型的命令条数
+        std::unique_ptr<VMABuffer> visibility;      //可见位，读回后清零
+        VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+        uint32_t capacity{ 0 };
+        uint32_t chunkCount{ 0 };
+        uint64_t snapshotVersion{ UINT64_MAX };
+        uint64_t tableRevision{ 0 };                //上次写记录时chunk表的修改计数，0 表示整表重写
+        bool hasVisibility{ false };                //上一轮派发过，可见位有效
+    };
+
+    void createDescriptorResources();
+    void createPipelineLayouts(VkDescriptorSetLayout globalSetLayout);
+    bool pipelinesReady() const;
+    void createPipelines(VkRenderPass renderPass);
+
+    void ensureCapacity(FrameResources& frame, uint32_t chunkCount);
+    void writeRecords(FrameResources& frame, const BufferPool::ChunkSnapshot& snapshot);
+    void readbackVisibility(FrameResources& frame);
+
+    static uint32_t bitWords(uint32_t capacity) { return (capacity + 31) / 32; }
+
+private:
+    Device& m_device;
+    BufferPool& m_bufferPool;
+    GeometryRenderSystem& m_geometryRenderSystem;
+
+    std::unique_ptr<DescriptorSetLayout>            m_cullSetLayout;
+    std::unique_ptr<DescriptorPool>                 m_cullPool;
+    std::array<FrameResources, SwapChain::MAX_FRAMES_IN_FLIGHT> m_frames;
+
+    std::unique_ptr<Pipeline>                       m_cullPipeline;
+    VkPipelineLayout                                m_cullPipelineLayout;
+    std::array<std::unique_ptr<Pipeline>, GeometryRenderSystem::TYPE_COUNT> m_drawPipelines;
+    VkPipelineLayout                                m_drawPipelineLayout;
+
+    PFN_vkCmdDrawIndirectCountKHR                   m_drawIndirectCount = nullptr;
+    int                                             m_frameIndex{ -1 };    //本帧已裁剪的帧序号
+};
@@ -0,0 +1,70 @@
+#include "HilbertCurve.h"
+
+#include <algorithm>
+#include <numeric>
+#include <utility>
+
+uint32_t HilbertCurve::encode(uint32_t x, uint32_t y, uint32_t order)
+{
+    uint32_t key = 0;
+    for (uint32_t s = 1u << (order - 1); s > 0; s >>= 1)
+    {
+        uint32_t rx = (x & s) > 0 ? 1u : 0u;
+        uint32_t ry = (y & s) > 0 ? 1u : 0u;
+        key += s * s * ((3u * rx) ^ ry);
+
+        //旋转象限，使子曲线首尾相接
+        if (ry == 0)
+        {
+            if (rx == 1)
+            {
+                x = s - 1 - x;
+                y = s - 1 - y;
+            }
+            std::swap(x, y);
+        }
+    }
+    return key;
+}
+
+uint32_t HilbertCurve::keyForPoint(float x, float y, const AABB& bounds, uint32_t order)
+{
+    const float cells = static_cast<float>((1u << order) - 1);
+    float width = bounds.maxX - bounds.minX;
+    float height = bounds.maxY - bounds.minY;
+
+    float nx = width > 0.f ? (x - bounds.minX) / width : 0.f;
+    float ny = height > 0.f ? (y - bounds.minY) / height : 0.f;
+    nx = std::clamp(nx, 0.f, 1.f);
+    ny = std::clamp(ny, 0.f, 1.f);
+
+    return encode(static_cast<uint32_t>(nx * cells), static_cast<uint32_t>(ny * cells), order);
+}
+
+void HilbertCurve::sortBuilders(std::vector<Object::Builder>& builders, const AABB& bounds)
+{
+    if (builders.size() < 2)
+        return;
+
+    //先算键值再排下标，避免在比较时反复计算和搬动顶点数据
+    std::vector<uint32_t> keys(builders.size());
+    for (size_t i = 0; i < builders.size(); i++)
+    {
+        const AABB& box = builders[i].bounds;
+        keys[i] = keyForPoint((box.minX + box.maxX) * 0.5f, (box.minY + box.maxY) * 0.5f, bounds);
+    }
+
+    std::vector<size_t> order(builders.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&keys](size_t a, size_t b) {
+        return keys[a] < keys[b];
+        });
+
+    std::vector<Object::Builder> sorted;
+    sorted.reserve(builders.size());
+    for (size_t index : order)
+    {
+        sorted.push_back(std::move(builders[index]));
+    }
+    builders = std::move(sorted);
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <vector>
+
+#include "Object.h"
+#include "const.h"
+
+//希尔伯特曲线编码：空间上相邻的要素得到相近的键值，用来在上传前重排要素
+class HilbertCurve
+{
+public:
+    static constexpr uint32_t DEFAULT_ORDER = 16;      //每个方向 2^16 个格子，键值正好放进32位
+
+    //网格坐标 (x, y) 在 2^order x 2^order 网格上的希尔伯特序号
+    static uint32_t encode(uint32_t x, uint32_t y, uint32_t order = DEFAULT_ORDER);
+
+    //把 bounds 内的点量化到网格后编码，超出范围的点夹到边缘
+    static uint32_t keyForPoint(float x, float y, const AABB& bounds, uint32_t order = DEFAULT_ORDER);
+
+    //按包围盒中心的希尔伯特键值稳定排序
+    static void sortBuilders(std::vector<Object::Builder>& builders, const AABB& bounds);
+};
@@ -102,10 +102,8 @@ void Layer::recordVisibleTileCommands(FrameInfo& frameInfo, VkPipelineLayout pip
 
             for (auto* obj : tile.objects)
             {
-                SimplePushConstantData push{};
-                push.color = obj->getColor();
-
-                push.modelMatrix = obj->getTransform().mat4f();
+                SimplePushConstantData push = SimplePushConstantData::fromMatrix(
+                    obj->getTransform().mat4f(), obj->getColor(), 1.0f);
                 vkCmdPushConstants(
                     tile.secondaryCommandBuffer,
                     pipelineLayout,
@@ -0,0 +1,207 @@
+#include "LineRenderSystem.h"
+
+#include "SwapChain.h"
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <stdexcept>
+
+#ifdef min
+#undef min
+#endif
+
+LineRenderSystem::LineRenderSystem(Device& device, VkRenderPass renderPass, VkDescriptorSetLayout globalSetLayout) :
+    m_device(device)
+{
+    createDescriptorResources();
+    createPipelineLayout(globalSetLayout);
+    createPipeline(renderPass);
+}
+
+LineRenderSystem::~LineRenderSystem()
+{
+    vkDestroyPipelineLayout(m_device.device(), m_pipelineLayout, nullptr);
+}
+
+void LineRenderSystem::bind(VkCommandBuffer commandBuffer, VkDescriptorSet globalDescriptorSet)
+{
+    m_pipeline->bind(commandBuffer);
+
+    if (globalDescriptorSet != VK_NULL_HANDLE)
+    {
+        vkCmdBindDescriptorSets(
+            commandBuffer,
+            VK_PIPELINE_BIND_POINT_GRAPHICS,
+            m_pipelineLayout,
+            0, 1, &globalDescriptorSet,
+            0, nullptr
+        );
+    }
+}
+
+void LineRenderSystem::bindSegment(VkCommandBuffer commandBuffer, uint32_t segmentId, const BufferPool::SegmentView& segment)
+{
+    VkDescriptorSet geometrySet = getOrCreateGeometrySet(segmentId, segment);
+    if (geometrySet == VK_NULL_HANDLE)
+        return;
+
+    vkCmdBindDescriptorSets(
+        commandBuffer,
+        VK_PIPELINE_BIND_POINT_GRAPHICS,
+        m_pipelineLayout,
+        1, 1, &geometrySet,
+        0, nullptr
+    );
+}
+
+void LineRenderSystem::drawChunk(VkCommandBuffer commandBuffer, const BufferPool::Chunk& chunk,
+    const QVector3D& tint, VkExtent2D viewportExtent)
+{
+    //只支持 LINE_LIST 形式的索引，每两个索引构成一条线段
+    uint32_t segmentCount = chunk.indexCount / 2;
+    if (!chunk.isLoaded || segmentCount == 0)
+        return;
+
+    LinePushConstantData push{};
+    push.color[0] = tint.x();
+    push.color[1] = tint.y();
+    push.color[2] = tint.z();
+    push.color[3] = 1.f;
+    push.viewportSize[0] = static_cast<float>(viewportExtent.width);
+    push.viewportSize[1] = static_cast<float>(viewportExtent.height);
+    push.width = m_lineStyle.width;
+    push.feather = m_lineStyle.feather;
+    push.vertexOffset = static_cast<int32_t>(chunk.vertexOffset);
+    push.firstIndex = chunk.indexOffset;
+
+    vkCmdPushConstants(
+        commandBuffer,
+        m_pipelineLayout,
+        VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT,
+        0,
+        sizeof(LinePushConstantData),
+        &push);
+
+    vkCmdDraw(commandBuffer, 6, segmentCount, 0, 0);
+}
+
+void LineRenderSystem::collectGarbage()
+{
+    m_frameCounter++;
+
+    std::vector<VkDescriptorSet> expiredSets;
+    auto it = std::remove_if(m_retiredSets.begin(), m_retiredSets.end(), [&](const auto& retired) {
+        if (m_frameCounter - retired.first <= SwapChain::MAX_FRAMES_IN_FLIGHT)
+            return false;
+        expiredSets.push_back(retired.second);
+        return true;
+        });
+    m_retiredSets.erase(it, m_retiredSets.end());
+
+    if (!expiredSets.empty())
+        m_geometryPool->freeDescriptors(expiredSets);
+}
+
+void LineRenderSystem::createDescriptorResources()
+{
+    m_geometrySetLayout = DescriptorSetLayout::Builder(m_device)
+        .addBinding(0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_VERTEX_BIT)
+        .addBinding(1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_VERTEX_BIT)
+        .build();
+
+    //段扩容后要重建描述符集，池需要支持单独释放
+    m_geometryPool = DescriptorPool::Builder(m_device)
+        .setPoolFlags(VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT)
+        .setMaxSets(MAX_GEOMETRY_SETS)
+        .addPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, MAX_GEOMETRY_SETS * 2)
+        .build();
+}
+
+void LineRenderSystem::createPipelineLayout(VkDescriptorSetLayout globalSetLayout)
+{
+    VkPushConstantRange pushConstantRange{};
+    pushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+    pushConstantRange.offset = 0;
+    pushConstantRange.size = sizeof(LinePushConstantData);
+
+    std::vector<VkDescriptorSetLayout> descriptorSetLayout{
+        globalSetLayout,
+        m_geometrySetLayout->getDescriptorSetLayout()
+    };
+
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutInfo.setLayoutCount = static_cast<uint32_t>(descriptorSetLayout.size());
+    pipelineLayoutInfo.pSetLayouts = descriptorSetLayout.data();
+    pipelineLayoutInfo.pushConstantRangeCount = 1;
+    pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+    if (vkCreatePipelineLayout(m_device.device(), &pipelineLayoutInfo,
+        nullptr, &m_pipelineLayout) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to create line pipeline layout!");
+    }
+}
+
+void LineRenderSystem::createPipeline(VkRenderPass renderPass)
+{
+    assert(m_pipelineLayout != nullptr && "Cannot create pipeline before pipeline layout");
+
+    PipelineConfigInfo pipelineConfigInfo{};
+    Pipeline::setPipelineConfigInfo(pipelineConfigInfo, VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST);
+    Pipeline::enableAlphaBlending(pipelineConfigInfo);
+
+    //顶点全部从存储缓冲中拉取
+    pipelineConfigInfo.bindingDescriptions.clear();
+    pipelineConfigInfo.attributeDescriptions.clear();
+
+    //半透明的羽化边不写深度，避免遮挡相邻线段
+    pipelineConfigInfo.depthStencilInfo.depthWriteEnable = VK_FALSE;
+
+    pipelineConfigInfo.renderPass = renderPass;
+    pipelineConfigInfo.pipelineLayout = m_pipelineLayout;
+    m_pipeline = std::make_unique<Pipeline>(
+        m_device,
+        "wide_line.vert.spv",
+        "wide_line.frag.spv",
+        pipelineConfigInfo,
+        true
+    );
+}
+
+VkDescriptorSet LineRenderSystem::getOrCreateGeometrySet(uint32_t segmentId, const BufferPool::SegmentView& segment)
+{
+    auto it = m_geometrySets.find(segmentId);
+    if (it != m_geometrySets.end())
+    {
+        if (it->second.generation == segment.generation)
+            return it->second.set;
+
+        //旧描述符集可能还在在途帧的命令缓冲里，延迟释放
+        m_retiredSets.emplace_back(m_frameCounter, it->second.set);
+        m_geometrySets.erase(it);
+    }
+
+    if (!segment.isActive)
+        return VK_NULL_HANDLE;
+
+    //描述符范围不能超过 maxStorageBufferRange
+    VkDeviceSize maxRange = m_device.properties.limits.maxStorageBufferRange;
+    VkDescriptorBufferInfo vertexInfo{ segment.vertexBuffer, 0, std::min(segment.vertexBufferSize, maxRange) };
+    VkDescriptorBufferInfo indexInfo{ segment.indexBuffer, 0, std::min(segment.indexBufferSize, maxRange) };
+
+    VkDescriptorSet geometrySet = VK_NULL_HANDLE;
+    bool success = DescriptorWriter(*m_geometrySetLayout, *m_geometryPool)
+        .writeBuffer(0, &vertexInfo)
+        .writeBuffer(1, &indexInfo)
+        .build(geometrySet);
+
+    if (!success)
+    {
+        qWarning() << "failed to allocate line geometry descriptor set for segment" << segmentId;
+        return VK_NULL_HANDLE;
+    }
+
+    m_geometrySets[segmentId] = GeometrySet{ geometrySet, segment.generation };
+    return geometrySet;
+}
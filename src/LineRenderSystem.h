@@ -0,0 +1,82 @@
+#pragma once
+
+#include "BufferPool.h"
+#include "Descriptors.h"
+#include "Device.h"
+#include "Pipeline.h"
+
+#include <memory>
+#include <unordered_map>
+
+//宽线渲染：每条线段一个实例，在顶点着色器里扩展成屏幕空间四边形，片元着色器做解析抗锯齿
+class LineRenderSystem
+{
+public:
+    struct LineStyle
+    {
+        float width{ 2.f };         //线宽（像素）
+        float feather{ 1.f };       //抗锯齿羽化宽度（像素）
+    };
+
+    struct LinePushConstantData
+    {
+        float color[4];
+        float viewportSize[2];
+        float width;
+        float feather;
+        int32_t vertexOffset;
+        uint32_t firstIndex;
+    };
+
+    static constexpr uint32_t MAX_GEOMETRY_SETS = 64;
+
+    LineRenderSystem(Device& device, VkRenderPass renderPass, VkDescriptorSetLayout globalSetLayout);
+    ~LineRenderSystem();
+
+    LineRenderSystem(const LineRenderSystem&) = delete;
+    LineRenderSystem& operator=(const LineRenderSystem&) = delete;
+
+    void bind(VkCommandBuffer commandBuffer, VkDescriptorSet globalDescriptorSet);
+    void bindSegment(VkCommandBuffer commandBuffer, uint32_t segmentId, const BufferPool::SegmentView& segment);
+    //多线程录制之前在主线程建好段的描述符集，录制时 bindSegment 只做查找
+    void prepareSegment(uint32_t segmentId, const BufferPool::SegmentView& segment) { getOrCreateGeometrySet(segmentId, segment); }
+    //整个chunk一次绘制，颜色取自顶点，tint 作为整层的色调
+    void drawChunk(VkCommandBuffer commandBuffer, const BufferPool::Chunk& chunk,
+        const QVector3D& tint, VkExtent2D viewportExtent);
+
+    //释放在途帧已结束的旧描述符集，每帧调用一次
+    void collectGarbage();
+
+    void setLineStyle(const LineStyle& style) { m_lineStyle = style; }
+    const LineStyle& getLineStyle() const { return m_lineStyle; }
+
+    VkPipelineLayout getPipelineLayout() { return m_pipelineLayout; }
+    //管线在后台编译，完成之前线图层退回 LINE_LIST 的1像素线
+    bool isReady() const { return m_pipeline->isReady(); }
+
+private:
+    void createDescriptorResources();
+    void createPipelineLayout(VkDescriptorSetLayout globalSetLayout);
+    void createPipeline(VkRenderPass renderPass);
+
+    VkDescriptorSet getOrCreateGeometrySet(uint32_t segmentId, const BufferPool::SegmentView& segment);
+
+private:
+    Device& m_device;
+
+    std::unique_ptr<DescriptorSetLayout>            m_geometrySetLayout;
+    std::unique_ptr<DescriptorPool>                 m_geometryPool;
+    struct GeometrySet
+    {
+        VkDescriptorSet set = VK_NULL_HANDLE;
+        uint32_t generation{ 0 };       //段扩容后缓冲被替换，代数不一致时重建
+    };
+    std::unordered_map<uint32_t, GeometrySet>       m_geometrySets;      //segmentId -> 顶点/索引存储缓冲
+    std::vector<std::pair<uint64_t, VkDescriptorSet>> m_retiredSets;
+    uint64_t                                        m_frameCounter{ 0 };
+
+    std::unique_ptr<Pipeline>                       m_pipeline;
+    VkPipelineLayout                                m_pipelineLayout;
+
+    LineStyle                                       m_lineStyle{};
+};
@@ -0,0 +1,236 @@
+#include "MemoryReport.h"
+
+#include <QDebug>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+
+namespace
+{
+    qint64 toJsonBytes(VkDeviceSize bytes)
+    {
+        return static_cast<qint64>(bytes);
+    }
+
+    double toMB(VkDeviceSize bytes)
+    {
+        return bytes / (1024.0 * 1024.0);
+    }
+}
+
+void MemoryReport::collectHeaps(const Device& device, bool detailed)
+{
+    VmaAllocator allocator = device.allocator();
+
+    const VkPhysicalDeviceMemoryProperties* memoryProperties = nullptr;
+    vmaGetMemoryProperties(allocator, &memoryProperties);
+
+    VmaBudget budgets[VK_MAX_MEMORY_HEAPS] = {};
+    vmaGetHeapBudgets(allocator, budgets);
+
+    VmaTotalStatistics statistics{};
+    vmaCalculateStatistics(allocator, &statistics);
+
+    m_heaps.clear();
+    for (uint32_t index = 0; index < memoryProperties->memoryHeapCount; index++)
+    {
+        const VmaDetailedStatistics& detail = statistics.memoryHeap[index];
+
+        Heap heap;
+        heap.index = index;
+        heap.deviceLocal = (memoryProperties->memoryHeaps[index].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) != 0;
+        heap.size = memoryProperties->memoryHeaps[index].size;
+        heap.budget = budgets[index].budget;
+        heap.usage = budgets[index].usage;
+        heap.blockCount = detail.statistics.blockCount;
+        heap.allocationCount = detail.statistics.allocationCount;
+        heap.blockBytes = detail.statistics.blockBytes;
+        heap.allocationBytes = detail.statistics.allocationBytes;
+        heap.unusedRangeCount = detail.unusedRangeCount;
+        heap.largestUnusedRange = detail.unusedRangeCount > 0 ? detail.unusedRangeSizeMax : 0;
+
+        VkDeviceSize unusedBytes = heap.blockBytes - heap.allocationBytes;
+        if (unusedBytes > 0)
+            heap.fragmentation = 1.f - static_cast<float>(heap.largestUnusedRange) / unusedBytes;
+
+        m_heaps.push_back(heap);
+    }
+
+    m_vmaDetail = QJsonObject();
+    if (detailed)
+    {
+        char* statsString = nullptr;
+        vmaBuildStatsString(allocator, &statsString, VK_TRUE);
+        if (statsString)
+        {
+            QJsonParseError error;
+            QJsonDocument document = QJsonDocument::fromJson(QByteArray(statsString), &error);
+            if (error.error == QJsonParseError::NoError)
+                m_vmaDetail = document.object();
+            else
+                qWarning() << "failed to parse VMA stats string:" << error.errorString();
+
+            vmaFreeStatsString(allocator, statsString);
+        }
+    }
+}
+
+void MemoryReport::addSubsystem(const QString& name, VkDeviceSize gpuBytes, VkDeviceSize cpuBytes, uint32_t bufferCount)
+{
+    m_subsystems.push_back({ name, gpuBytes, cpuBytes, bufferCount });
+}
+
+VkDeviceSize MemoryReport::totalGpuBytes() const
+{
+    VkDeviceSize total = 0;
+    for (const auto& subsystem : m_subsystems)
+        total += subsystem.gpuBytes;
+    return total;
+}
+
+VkDeviceSize MemoryReport::totalCpuBytes() const
+{
+    VkDeviceSize total = 0;
+    for (const auto& subsystem : m_subsystems)
+        total += subsystem.cpuBytes;
+    return total;
+}
+
+double MemoryReport::gpuBytesPerMillionFeatures() const
+{
+    if (m_featureCount == 0)
+        return 0.0;
+    return static_cast<double>(totalGpuBytes()) * 1000000.0 / m_featureCount;
+}
+
+double MemoryReport::cpuBytesPerMillionFeatures() const
+{
+    if (m_featureCount == 0)
+        return 0.0;
+    return static_cast<double>(totalCpuBytes()) * 1000000.0 / m_featureCount;
+}
+
+QJsonObject MemoryReport::toJson() const
+{
+    QJsonArray heaps;
+    for (const auto& heap : m_heaps)
+    {
+        QJsonObject object;
+        object["index"] = static_cast<int>(heap.index);
+        object["deviceLocal"] = heap.deviceLocal;
+        object["size"] = toJsonBytes(heap.size);
+        object["budget"] = toJsonBytes(heap.budget);
+        object["usage"] = toJsonBytes(heap.usage);
+        object["blockCount"] = static_cast<int>(heap.blockCount);
+        object["allocationCount"] = static_cast<int>(heap.allocationCount);
+        object["blockBytes"] = toJsonBytes(heap.blockBytes);
+        object["allocationBytes"] = toJsonBytes(heap.allocationBytes);
+        object["unusedRangeCount"] = static_cast<int>(heap.unusedRangeCount);
+        object["largestUnusedRange"] = toJsonBytes(heap.largestUnusedRange);
+        object["fragmentation"] = heap.fragmentation;
+        heaps.append(object);
+    }
+
+    QJsonArray subsystems;
+    for (const auto& subsystem : m_subsystems)
+    {
+        QJsonObject object;
+        object["name"] = subsystem.name;
+        object["gpuBytes"] = toJsonBytes(subsystem.gpuBytes);
+        object["cpuBytes"] = toJsonBytes(subsystem.cpuBytes);
+        object["bufferCount"] = static_cast<int>(subsystem.bufferCount);
+        subsystems.append(object);
+    }
+
+    QJsonArray geometry;
+    for (const auto& type : m_geometry)
+    {
+        QJsonObject object;
+        object["type"] = typeName(type.type);
+        object["segmentCount"] = static_cast<int>(type.segmentCount);
+        object["chunkCount"] = static_cast<int>(type.chunkCount);
+        object["evictedChunkCount"] = static_cast<int>(type.evictedChunkCount);
+        object["pendingChunkCount"] = static_cast<int>(type.pendingChunkCount);
+        object["featureCount"] = static_cast<qint64>(type.featureCount);
+        object["allocatedBytes"] = toJsonBytes(type.allocatedBytes);
+        object["usedBytes"] = toJsonBytes(type.usedBytes);
+        object["vertexFragmentation"] = type.vertexFragmentation;
+        object["indexFragmentation"] = type.indexFragmentation;
+        object["cpuCopyBytes"] = toJsonBytes(type.cpuCopyBytes);
+        object["pendingUploadBytes"] = toJsonBytes(type.pendingUploadBytes);
+        object["openChunkBytes"] = toJsonBytes(type.openChunkBytes);
+        geometry.append(object);
+    }
+
+    QJsonObject totals;
+    totals["gpuBytes"] = toJsonBytes(totalGpuBytes());
+    totals["cpuBytes"] = toJsonBytes(totalCpuBytes());
+    totals["featureCount"] = static_cast<qint64>(m_featureCount);
+    totals["gpuBytesPerMillionFeatures"] = gpuBytesPerMillionFeatures();
+    totals["cpuBytesPerMillionFeatures"] = cpuBytesPerMillionFeatures();
+
+    QJsonObject root;
+    root["totals"] = totals;
+    root["subsystems"] = subsystems;
+    root["geometry"] = geometry;
+    root["heaps"] = heaps;
+    if (!m_vmaDetail.isEmpty())
+        root["vma"] = m_vmaDetail;
+
+    return root;
+}
+
+bool MemoryReport::writeJson(const QString& path) const
+{
+    QFile file(path);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+    {
+        qWarning() << "failed to open memory report file:" << path;
+        return false;
+    }
+
+    file.write(QJsonDocument(toJson()).toJson(QJsonDocument::Indented));
+    return true;
+}
+
+void MemoryReport::print() const
+{
+    qDebug() << "=== Memory Report ===";
+    for (const auto& subsystem : m_subsystems)
+    {
+        qDebug() << "  " << subsystem.name << ": GPU" << toMB(subsystem.gpuBytes) << "MB, CPU"
+            << toMB(subsystem.cpuBytes) << "MB," << subsystem.bufferCount << "buffers";
+    }
+
+    for (const auto& type : m_geometry)
+    {
+        qDebug() << "  " << typeName(type.type) << ":" << type.chunkCount << "chunks," << type.featureCount << "features,"
+            << toMB(type.usedBytes) << "/" << toMB(type.allocatedBytes) << "MB, fragmentation"
+            << type.vertexFragmentation << "/" << type.indexFragmentation;
+    }
+
+    for (const auto& heap : m_heaps)
+    {
+        qDebug() << "  heap" << heap.index << (heap.deviceLocal ? "(device local)" : "") << ": usage"
+            << toMB(heap.usage) << "/" << toMB(heap.budget) << "MB," << heap.allocationCount << "allocations in"
+            << heap.blockCount << "blocks, fragmentation" << heap.fragmentation;
+    }
+
+    qDebug() << "Total: GPU" << toMB(totalGpuBytes()) << "MB, CPU" << toMB(totalCpuBytes()) << "MB,"
+        << m_featureCount << "features," << gpuBytesPerMillionFeatures() / (1024.0 * 1024.0) << "MB GPU per million features";
+}
+
+const char* MemoryReport::typeName(ModelType type)
+{
+    switch (type)
+    {
+    case ModelType::Point:
+        return "Point";
+    case ModelType::Line:
+        return "Line";
+    case ModelType::Polygon:
+        return "Polygon";
+    default:
+        return "None";
+    }
+}
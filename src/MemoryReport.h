@@ -0,0 +1,74 @@
+#pragma once
+
+#include "BufferPool.h"
+#include "Device.h"
+
+#include <QJsonObject>
+#include <QString>
+
+#include <vector>
+
+//内存占用报告：按子系统、几何类型和显存堆汇总，运行时查询，也可以导出为JSON，
+//用来对比不同数据集和配置下每百万要素的内存开销
+class MemoryReport
+{
+public:
+    //VMA 按堆统计的块和分配，预算和用量来自 vmaGetHeapBudgets
+    struct Heap
+    {
+        uint32_t index{ 0 };
+        bool deviceLocal{ false };
+        VkDeviceSize size{ 0 };
+        VkDeviceSize budget{ 0 };
+        VkDeviceSize usage{ 0 };                //进程在该堆上的全部用量，包括VMA以外的分配
+        uint32_t blockCount{ 0 };
+        uint32_t allocationCount{ 0 };
+        VkDeviceSize blockBytes{ 0 };
+        VkDeviceSize allocationBytes{ 0 };
+        uint32_t unusedRangeCount{ 0 };
+        VkDeviceSize largestUnusedRange{ 0 };
+        float fragmentation{ 0.f };             //1 - 最大空闲区间/块内总空闲
+    };
+
+    //gpuBytes 包括设备本地和主机可见的缓冲，cpuBytes 只算数据本身，不含容器开销
+    struct Subsystem
+    {
+        QString name;
+        VkDeviceSize gpuBytes{ 0 };
+        VkDeviceSize cpuBytes{ 0 };
+        uint32_t bufferCount{ 0 };
+    };
+
+    MemoryReport() = default;
+
+    //读取VMA的堆统计；detailed 为 true 时附带 vmaBuildStatsString 的完整JSON，开销较大
+    void collectHeaps(const Device& device, bool detailed = false);
+    void addSubsystem(const QString& name, VkDeviceSize gpuBytes, VkDeviceSize cpuBytes, uint32_t bufferCount = 0);
+    void setGeometry(std::vector<BufferPool::TypeMemoryStats> geometry) { m_geometry = std::move(geometry); }
+    void setFeatureCount(uint64_t featureCount) { m_featureCount = featureCount; }
+
+    const std::vector<Heap>& getHeaps() const { return m_heaps; }
+    const std::vector<Subsystem>& getSubsystems() const { return m_subsystems; }
+    const std::vector<BufferPool::TypeMemoryStats>& getGeometry() const { return m_geometry; }
+    uint64_t getFeatureCount() const { return m_featureCount; }
+
+    VkDeviceSize totalGpuBytes() const;
+    VkDeviceSize totalCpuBytes() const;
+    //每百万要素占用的字节，没有要素时为0
+    double gpuBytesPerMillionFeatures() const;
+    double cpuBytesPerMillionFeatures() const;
+
+    QJsonObject toJson() const;
+    bool writeJson(const QString& path) const;
+    void print() const;
+
+private:
+    static const char* typeName(ModelType type);
+
+private:
+    std::vector<Heap>                           m_heaps;
+    std::vector<Subsystem>                      m_subsystems;
+    std::vector<BufferPool::TypeMemoryStats>    m_geometry;
+    uint64_t                                    m_featureCount{ 0 };
+    QJsonObject                                 m_vmaDetail;
+};
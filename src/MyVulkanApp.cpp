@@ -1,10 +1,12 @@
 #include "MyVulkanApp.h"
 
 #include <array>
+#include <iterator>
 #include <QApplication>
 #include <qtimer.h>
 #include <random>
 #include "Buffer.h"
+#include "BufferPoolBenchmark.h"
 #include "Movement_Controller.h"
 #include "Object.h"
 //#define EXPEND_100
@@ -15,6 +17,7 @@
 #undef max
 #endif
 constexpr float MAX_FRAME_TIME = 0.01666666666;
+constexpr float WELD_TOLERANCE = 1e-6f;         //NDC空间的焊接容差
 
 float degressToRadians(float degress)
 {
@@ -81,6 +84,9 @@ MyVulkanApp::MyVulkanApp() :
 
 
     m_sceneManager = std::make_unique<SceneManager>(m_window, m_device, m_globalSetLayout->getDescriptorSetLayout(), AABB{ -100,-100,100,100 });
+    //统计查询在通道外开启，通道内执行的次级命令缓冲要声明同样的统计项
+    if (m_statsQueryPool != VK_NULL_HANDLE)
+        m_sceneManager->getRenderManager().setPipelineStatistics(STATS_FLAGS);
 
     connect(&m_window, &MyVulkanWindow::drawAddVertex, this, &MyVulkanApp::onAddDrawVertex);
     connect(&m_window, &MyVulkanWindow::drawEnd, this, &MyVulkanApp::onDrawEnd);
@@ -102,6 +108,11 @@ void MyVulkanApp::run()
     m_widget.resize(800, 600);
     m_widget.show();
 
+#ifdef BUFFERPOOL_CONTENTION_BENCHMARK
+    //加载线程和渲染线程争用池的锁时每帧读取的耗时，msbuild /p:BufferPoolBenchmark=true 时编进来
+    BufferPoolBenchmark::runAll(m_device);
+#endif
+
     loadObjects();
     m_camera.setViewDirection(QVector3D(0.f, 0.f, 0.f), QVector3D(0.f, 0.f, 1.f));
     m_lastFrameTime = std::chrono::high_resolution_clock::now();
@@ -110,7 +121,8 @@ void MyVulkanApp::run()
             if (!m_window.isExposed())
                 return;
 
-            Renderer& renderer = m_sceneManager->getRenderManager().getRenderer();
+            RenderManager& renderManager = m_sceneManager->getRenderManager();
+            Renderer& renderer = renderManager.getRenderer();
 
             float aspect = renderer.getAspectRatio();;
             m_camera.setPrespectiveProjection(degressToRadians(50.f), aspect, 0.001f, 200.f);
@@ -134,11 +146,12 @@ void MyVulkanApp::run()
                 m_mouseController.zoom(ndcAndSteps, frameTime);
                 });
             //render
-            if (auto commandBuffer = renderer.beginFrame())
+            if (auto commandBuffer = renderManager.beginFrame())
             {
                 //update
                 vkCmdResetQueryPool(commandBuffer, m_timestampQueryPool, 0, TIMESTAMP_QUERIES);
-                vkCmdResetQueryPool(commandBuffer, m_statsQueryPool, 0, STATS_QUERIES);
+                if (m_statsQueryPool != VK_NULL_HANDLE)
+                    vkCmdResetQueryPool(commandBuffer, m_statsQueryPool, 0, STATS_QUERIES);
 
 
                 int frameIndex = renderer.getFrameIndex();
@@ -161,23 +174,27 @@ void MyVulkanApp::run()
                 vkCmdWriteTimestamp(commandBuffer,
                     VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
                     m_timestampQueryPool, 0);
+                //计算派发和拷贝不能放在渲染通道里
+                m_sceneManager->prepareFrame(frameInfo);
                 //render
                // 同时开启管线统计
-                vkCmdBeginQuery(commandBuffer, m_statsQueryPool, 0, 0);
-                renderer.beginSwapChainRenderPass(commandBuffer);
+                if (m_statsQueryPool != VK_NULL_HANDLE)
+                    vkCmdBeginQuery(commandBuffer, m_statsQueryPool, 0, 0);
+                renderManager.beginSwapChainRenderPass(commandBuffer);
 
                 m_sceneManager->render(frameInfo);
                 //m_pointRenderSystem->renderScene(frameInfo, m_scene);
                 //m_lineRenderSystem->renderScene(frameInfo, m_scene);
                 //m_polygonRenderSystem->renderScene(frameInfo, m_scene);
 
-                renderer.endSwapChainRenderPass(commandBuffer);
-                vkCmdEndQuery(commandBuffer, m_statsQueryPool, 0);
+                renderManager.endSwapChainRenderPass(commandBuffer);
+                if (m_statsQueryPool != VK_NULL_HANDLE)
+                    vkCmdEndQuery(commandBuffer, m_statsQueryPool, 0);
                 vkCmdWriteTimestamp(commandBuffer,
                     VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
                     m_timestampQueryPool, 1);
 
-                renderer.endFrame();
+                renderManager.endFrame();
 
                 readbackQueryResults();
             }
@@ -192,11 +209,13 @@ void MyVulkanApp::onAddDrawVertex(QVector3D vertexPos)
     switch (mode)
     {
     case DrawMode::Point:
-    Model::Builder modelBuilder;
-    Model::Vertex vertex;
-    vertex.position = vertexPos;
-    vertex.color = { 1,0,0 };
-    modelBuilder.vertices.push_back(vertex);
+    {
+        m_sceneManager->addPoint(PointLayer::makeInstance(
+            QVector2D(vertexPos.x(), vertexPos.y()), SymbolAtlas::Circle, 0.5f, QVector3D{ 1.f,0.f,0.f }));
+    }
+    break;
+    default:
+    break;
     }
 }
 
@@ -231,6 +250,14 @@ void MyVulkanApp::loadObjects()
       m_lineObjects.push_back(std::move(obj));*/
     std::string strPath = "E:\\Kontur_prj.gdb";
     computeGeoBounds(strPath);
+
+    //点图层的瓦片网格覆盖数据实际的NDC范围
+    auto minCorner = geoToNDC(m_minX, m_minY).position;
+    auto maxCorner = geoToNDC(m_maxX, m_maxY).position;
+    m_sceneManager->getPointLayer().setWorldBounds(AABB{
+        qMin(minCorner.x(), maxCorner.x()), qMin(minCorner.y(), maxCorner.y()),
+        qMax(minCorner.x(), maxCorner.x()), qMax(minCorner.y(), maxCorner.y()) });
+
     loadShpObjects(strPath);
     //m_scene.finish();
 }
@@ -249,6 +276,11 @@ void MyVulkanApp::loadShpObjects(const std::string path)
     {
         std::runtime_error("failed to open shapefile");
     }
+    //路网端点、共享边界的重合顶点在chunk内只存一份
+    m_sceneManager->getRenderManager().setVertexWeldTolerance(WELD_TOLERANCE);
+    if (m_topologyEncodingEnabled)
+        m_topologyEncoder = std::make_unique<TopologyEncoder>(WELD_TOLERANCE);
+
     int count = 0;
     auto layer = ds->GetLayer(0);
     layer->ResetReading();
@@ -266,6 +298,27 @@ void MyVulkanApp::loadShpObjects(const std::string path)
 #endif
     }
 
+    if (m_topologyEncoder)
+    {
+        //面的边界切成共享弧段，每个面按弧段引用生成一个要素，公共边的顶点在chunk内只存一次
+        auto topology = m_topologyEncoder->encode();
+        size_t arcVertexCount = 0;
+        for (const auto& arc : topology.arcs)
+            arcVertexCount += arc.size();
+        qDebug() << "topology encoded:" << m_topologyEncoder->getInputVertexCount() << "input vertices ->"
+            << topology.vertices.size() << "welded vertices," << topology.arcs.size() << "arcs," << arcVertexCount << "arc vertices";
+
+        TransformComponent transform{};
+        transform.translation = QVector3D(0.f, 0.f, 2.5f);
+        auto polygonBuilders = TopologyEncoder::buildPolygonBuilders(topology, QVector3D{ 1.f,0.f,0.f }, transform);
+        std::move(polygonBuilders.begin(), polygonBuilders.end(), std::back_inserter(m_pendingBuilders));
+        m_topologyEncoder.reset();
+    }
+
+    //按空间顺序上传，相邻要素落在相邻的chunk和缓冲区间
+    m_sceneManager->addObjects(std::move(m_pendingBuilders));
+    m_pendingBuilders.clear();
+
 }
 
 void MyVulkanApp::parseFeature(OGRGeometry* geom)
@@ -276,8 +329,14 @@ void MyVulkanApp::parseFeature(OGRGeometry* geom)
     switch (geoType)
     {
     case wkbPoint:
+    case wkbPoint25D:
     {
+        auto point = geom->toPoint();
+        auto ver = geoToNDC(point->getX(), point->getY());
 
+        //点要素只写一条16字节的实例记录
+        m_sceneManager->addPoint(PointLayer::makeInstance(
+            QVector2D(ver.position.x(), ver.position.y()), SymbolAtlas::Circle, 0.25f, QVector3D{ 0.f,0.f,1.f }));
     }
     break;
     case wkbLineString:
@@ -326,13 +385,23 @@ void MyVulkanApp::parseFeature(OGRGeometry* geom)
             builder.color = QVector3D{ 1.f,0.f,0.f };
             builder.transform.translation = QVector3D(0.f, 0.f, 2.5f);
             builder.bounds = boundingBox;
-            m_sceneManager->addObject(builder);
+            m_pendingBuilders.push_back(std::move(builder));
         }
     }
     break;
     case wkbPolygon:
+    case wkbPolygon25D:
     {
-
+        parsePolygon(geom->toPolygon());
+    }
+    break;
+    case wkbMultiPolygon:
+    case wkbMultiPolygon25D:
+    {
+        auto mp = geom->toMultiPolygon();
+        for (int i = 0; i < mp->getNumGeometries(); ++i) {
+            parsePolygon(mp->getGeometryRef(i)->toPolygon());
+        }
     }
     break;
     default:
@@ -343,6 +412,68 @@ void MyVulkanApp::parseFeature(OGRGeometry* geom)
     }
 }
 
+void MyVulkanApp::parsePolygon(OGRPolygon* polygon)
+{
+    if (!polygon || !polygon->getExteriorRing())
+        return;
+
+    std::vector<OGRLinearRing*> ogrRings{ polygon->getExteriorRing() };
+    for (int i = 0; i < polygon->getNumInteriorRings(); ++i) {
+        ogrRings.push_back(polygon->getInteriorRing(i));
+    }
+
+    std::vector<std::vector<QVector2D>> rings;
+    for (auto* ring : ogrRings)
+    {
+        auto& points = rings.emplace_back();
+        for (int i = 0; i < ring->getNumPoints(); i++)
+        {
+            auto ver = geoToNDC(ring->getX(i), ring->getY(i));
+            points.emplace_back(ver.position.x(), ver.position.y());
+        }
+    }
+
+    if (m_topologyEncoder)
+    {
+        m_topologyEncoder->addPolygon(rings);
+        return;
+    }
+
+    //暂无三角化，面按边界线绘制，每个环一个线要素
+    for (const auto& points : rings)
+    {
+        if (points.size() < 2)
+            continue;
+
+        AABB  boundingBox{ std::numeric_limits<float>::infinity(), std::numeric_limits<float>::infinity(),
+            -std::numeric_limits<float>::infinity(), -std::numeric_limits<float>::infinity() };
+
+        Object::Builder builder{};
+        builder.type = ModelType::Line;
+        for (uint32_t i = 0; i < static_cast<uint32_t>(points.size()); i++)
+        {
+            Model::Vertex ver;
+            ver.position = QVector3D(points[i].x(), points[i].y(), 0.f);
+            boundingBox.minX = qMin(boundingBox.minX, ver.position.x());
+            boundingBox.minY = qMin(boundingBox.minY, ver.position.y());
+            boundingBox.maxX = qMax(boundingBox.maxX, ver.position.x());
+            boundingBox.maxY = qMax(boundingBox.maxY, ver.position.y());
+            builder.vertices.push_back(ver);
+
+            if (i + 1 < points.size())
+            {
+                builder.indices.push_back(i);
+                builder.indices.push_back(i + 1);
+            }
+        }
+
+        builder.color = QVector3D{ 1.f,0.f,0.f };
+        builder.transform.translation = QVector3D(0.f, 0.f, 2.5f);
+        builder.bounds = boundingBox;
+        m_pendingBuilders.push_back(std::move(builder));
+    }
+}
+
 void MyVulkanApp::computeGeoBounds(const std::string& path)
 {
     GDALAllRegister();
@@ -399,12 +530,14 @@ void MyVulkanApp::createQueryPools()
     vkCreateQueryPool(m_device.device(), &tsInfo, nullptr, &m_timestampQueryPool);
 
 
+    //设备不支持管线统计查询时只计时
+    if (!m_device.enabledFeatures().pipelineStatisticsQuery)
+        return;
+
     VkQueryPoolCreateInfo statsInfo{ VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO };
     statsInfo.queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS;
     statsInfo.queryCount = STATS_QUERIES;
-    statsInfo.pipelineStatistics =
-        VK_QUERY_PIPELINE_STATISTIC_VERTEX_SHADER_INVOCATIONS_BIT |
-        VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT;
+    statsInfo.pipelineStatistics = STATS_FLAGS;
 
     vkCreateQueryPool(m_device.device(), &statsInfo, nullptr, &m_statsQueryPool);
 
@@ -440,6 +573,9 @@ void MyVulkanApp::readbackQueryResults()
     qDebug() << QString().asprintf("[GPU] RenderPass time: %.3f ms\n", ms);
 
     // 3) 读管线统计
+    if (m_statsQueryPool == VK_NULL_HANDLE)
+        return;
+
     struct Stats { uint64_t vsInvocs, fsInvocs; } stats;
     vkGetQueryPoolResults(
         m_device.device(),
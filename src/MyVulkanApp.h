@@ -14,6 +14,7 @@
 #include "Scene.h"
 #include "SwapChain.h"
 #include "SceneManager.h"
+#include "TopologyEncoder.h"
 #include "qobject.h"
 
 
@@ -37,6 +38,8 @@ public:
     MyVulkanApp& operator=(MyVulkanApp&&) = delete;
 
     void run();
+    //ʱ߽˱룬run ֮ǰ
+    void setTopologyEncodingEnabled(bool enabled) { m_topologyEncodingEnabled = enabled; }
 
     static constexpr size_t             MAX_VERTICES = 20000000;
 
@@ -50,6 +53,7 @@ private:
     void loadObjects();
     void loadShpObjects(const std::string path);
     void parseFeature(OGRGeometry* geom);
+    void parsePolygon(OGRPolygon* polygon);
     void computeGeoBounds(const std::string& path);
     void updateBounds(OGRGeometry* geom);
     Model::Vertex geoToNDC(double lon, double lat);
@@ -84,6 +88,9 @@ private:
     //Scene                                                   m_scene;
 
     uint32_t                                                m_offset;
+    std::vector<Object::Builder>                            m_pendingBuilders;      //ʱռͳһϴ
+    std::unique_ptr<TopologyEncoder>                        m_topologyEncoder;      //߽Ĺα
+    bool                                                    m_topologyEncodingEnabled{ true };  //رʱÿϴ
     //Model::Builder                                          m_builder;
     //std::vector<Model::Builder>                             m_builders;
 
@@ -101,6 +108,9 @@ private:
     // ÿ֡ timestamp һ pipeline-statistics
     static constexpr uint32_t TIMESTAMP_QUERIES = 2;
     static constexpr uint32_t STATS_QUERIES = 1;
+    static constexpr VkQueryPipelineStatisticFlags STATS_FLAGS =
+        VK_QUERY_PIPELINE_STATISTIC_VERTEX_SHADER_INVOCATIONS_BIT |
+        VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT;
 
 
 
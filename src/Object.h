@@ -107,6 +107,7 @@ public:
     std::shared_ptr<Model> getModel() const { return m_model; }
 
     uint32_t  getChunkID() const { return m_chunkId; }
+    uint32_t  getFeatureIndex() const { return m_featureIndex; }
     QVector3D getColor() const { return m_color; }
     QVector3D getTranslation() const { return m_transform.translation; }
     QVector3D getScale() const { return m_transform.scale; }
@@ -114,6 +115,7 @@ public:
     TransformComponent getTransform() const { return m_transform; }
 
     void setChunkId(uint32_t chunkId) { m_chunkId = chunkId; }
+    void setFeatureIndex(uint32_t featureIndex) { m_featureIndex = featureIndex; }
 
     void setPosition(const QVector3D& position) { setTranslation(position); }
 
@@ -173,6 +175,7 @@ private:
     QVector3D   m_color{};
     TransformComponent m_transform{};
     uint32_t    m_chunkId{ 0 };
+    uint32_t    m_featureIndex{ 0 };      //chunk 内的要素序号
     uint32_t    m_updateFlags{ 0 };
     ObjectID    m_id{ 0 };
     std::shared_ptr<Model>  m_model{ nullptr };
@@ -0,0 +1,70 @@
+#include "ObjectDataBuffer.h"
+
+#include <cstring>
+#include <stdexcept>
+
+ObjectDataBuffer::ObjectDataBuffer(Device& device, FrameAllocator& frameAllocator, uint32_t capacity) :
+    m_device(device),
+    m_frameAllocator(frameAllocator),
+    m_capacity(qMax(capacity, 1u))
+{
+    m_setLayout = DescriptorSetLayout::Builder(m_device)
+        .addBinding(0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_VERTEX_BIT)
+        .build();
+
+    m_pool = DescriptorPool::Builder(m_device)
+        .setMaxSets(SwapChain::MAX_FRAMES_IN_FLIGHT)
+        .addPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, SwapChain::MAX_FRAMES_IN_FLIGHT)
+        .build();
+
+    //描述符集先分配出来，第一次 beginFrame 时写入本帧的区间
+    for (auto& frame : m_frames)
+    {
+        if (!m_pool->allocateDescriptorSet(m_setLayout->getDescriptorSetLayout(), frame.descriptorSet))
+            throw std::runtime_error("failed to allocate object data descriptor set!");
+    }
+}
+
+void ObjectDataBuffer::beginFrame(int frameIndex)
+{
+    m_frameIndex = frameIndex;
+    FrameBuffer& frame = m_frames[m_frameIndex];
+
+    //上一轮写满过，从这一帧起取更大的区间
+    while (m_capacity < m_requiredCapacity)
+        m_capacity *= 2;
+
+    //帧分配器刚重置，这一段通常落在本帧块的开头；块合并或扩容后才需要重写描述符集，
+    //这一帧上一轮的命令已经执行完，描述符集不再被读取
+    FrameAllocator::Allocation allocation = m_frameAllocator.allocate(static_cast<VkDeviceSize>(m_capacity) * sizeof(ObjectData));
+    if (allocation.buffer != frame.bufferInfo.buffer || allocation.offset != frame.bufferInfo.offset ||
+        allocation.size != frame.bufferInfo.range)
+    {
+        frame.bufferInfo = { allocation.buffer, allocation.offset, allocation.size };
+        DescriptorWriter writer(*m_setLayout, *m_pool);
+        writer.writeBuffer(0, &frame.bufferInfo);
+        writer.overwrite(frame.descriptorSet);
+    }
+    frame.mapped = static_cast<char*>(allocation.mapped);
+    frame.count = 0;
+
+    ObjectData defaultObject{};
+    defaultObject.linear[0] = 1.f;
+    defaultObject.linear[3] = 1.f;
+    write(&defaultObject, 1);
+}
+
+uint32_t ObjectDataBuffer::write(const ObjectData* objects, uint32_t count)
+{
+    FrameBuffer& frame = m_frames[m_frameIndex];
+    if (!frame.mapped || frame.count + count > m_capacity)
+    {
+        m_requiredCapacity = qMax(m_requiredCapacity, frame.count + count);
+        return INVALID_SLOT;
+    }
+
+    uint32_t firstSlot = frame.count;
+    std::memcpy(frame.mapped + firstSlot * sizeof(ObjectData), objects, count * sizeof(ObjectData));
+    frame.count += count;
+    return firstSlot;
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include "Descriptors.h"
+#include "Device.h"
+#include "FrameAllocator.h"
+#include "SwapChain.h"
+#include "const.h"
+
+#include <array>
+#include <memory>
+
+//逐对象数据的存储缓冲，着色器按 gl_InstanceIndex 读取变换和颜色。
+//每帧开始时从帧分配器取一段作为本帧的对象数组，帧内线性追加，随帧分配器一起刷新和重置；
+//每个在途帧一个描述符集，取到的区间变化时重写。容量不够时本帧的对象退回默认槽位，下一帧扩容
+class ObjectDataBuffer
+{
+public:
+    static constexpr uint32_t DEFAULT_CAPACITY = 4096;
+    static constexpr uint32_t DEFAULT_SLOT = 0;                 //单位变换，不覆盖顶点颜色
+    static constexpr uint32_t INVALID_SLOT = UINT32_MAX;
+
+    //与 simple_shader.vert 中的 ObjectData 布局一致
+    using ObjectData = InstanceData2D;
+
+    ObjectDataBuffer(Device& device, FrameAllocator& frameAllocator, uint32_t capacity = DEFAULT_CAPACITY);
+    ~ObjectDataBuffer() = default;
+
+    ObjectDataBuffer(const ObjectDataBuffer&) = delete;
+    ObjectDataBuffer& operator=(const ObjectDataBuffer&) = delete;
+
+    //FrameAllocator::beginFrame 之后调用：按上一轮的需求扩容，取本帧的区间并写入默认槽位
+    void beginFrame(int frameIndex);
+
+    //追加 count 个对象，返回第一个槽位；容量不够时返回 INVALID_SLOT。只在录制线程之外调用
+    uint32_t write(const ObjectData* objects, uint32_t count);
+
+    VkDescriptorSetLayout getDescriptorSetLayout() const { return m_setLayout->getDescriptorSetLayout(); }
+    VkDescriptorSet getDescriptorSet() const { return m_frames[m_frameIndex].descriptorSet; }
+    uint32_t getCapacity() const { return m_capacity; }
+
+private:
+    struct FrameBuffer
+    {
+        VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+        VkDescriptorBufferInfo bufferInfo{};        //描述符集当前指向的区间
+        char* mapped = nullptr;
+        uint32_t count{ 0 };
+    };
+
+private:
+    Device& m_device;
+    FrameAllocator& m_frameAllocator;
+
+    std::unique_ptr<DescriptorSetLayout>    m_setLayout;
+    std::unique_ptr<DescriptorPool>         m_pool;
+    std::array<FrameBuffer, SwapChain::MAX_FRAMES_IN_FLIGHT> m_frames;
+    int                                     m_frameIndex{ 0 };
+    uint32_t                                m_capacity{ 0 };
+    uint32_t                                m_requiredCapacity{ 0 };    //写满时记下的需求，下一帧扩容
+};
@@ -1,5 +1,7 @@
 #include "ObjectManager.h"
 
+#include <unordered_set>
+
 ObjectManager::ObjectManager(Device& device, const AABB& worldBounds)
     :m_device(device),
     m_spatialIndex(worldBounds)
@@ -21,10 +23,11 @@ Object::ObjectID ObjectManager::createObject(const Object::Builder& builder, uin
     //object
     object.setModel(model);
     auto id = object.getId();
-    m_objects[id] = object;
-    m_spatialIndex.insert(&object);
+    //صͿռҪָеĶmap Ԫصĵַɾǰ
+    Object& stored = m_objects[id] = object;
+    m_spatialIndex.insert(&stored);
 
-    object.setUpdateCallback(std::bind(&ObjectManager::onObjectUpdate, this, &object));
+    stored.setUpdateCallback(std::bind(&ObjectManager::onObjectUpdate, this, &stored));
 
     return id;
 }
@@ -53,8 +56,8 @@ void ObjectManager::updateObject(Object::ObjectID id, const UpdateFunc& updateFu
 
         updateFunc(object);
 
-        //
-        m_spatialIndex.insert(&object);
+        //ӣsetter ĻصѾһΣɾٲ
+        m_spatialIndex.update(&object);
 
     }
 }
@@ -97,12 +100,30 @@ std::vector<Object*> ObjectManager::getAllObjects()
     return result;
 }
 
+size_t ObjectManager::getCpuBytes() const
+{
+    size_t bytes = m_objects.size() * (sizeof(Object::ObjectID) + sizeof(Object));
+
+    std::unordered_set<const Model*> counted;
+    for (const auto& [id, object] : m_objects)
+    {
+        auto model = object.getModel();
+        if (!model || !counted.insert(model.get()).second)
+            continue;
+
+        bytes += sizeof(Model) + model->getVerticeRef().capacity() * sizeof(Model::Vertex) +
+            model->getIndicesRef().capacity() * sizeof(uint32_t);
+    }
+
+    return bytes;
+}
+
 void ObjectManager::onObjectUpdate(Object* object)
 {
     if (object && object->needsUpdate())
     {
         //ռ
-        m_spatialIndex.insert(object);
+        m_spatialIndex.update(object);
 
         //֪ͨϲ
         if (m_updateCallback)
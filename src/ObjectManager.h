@@ -27,6 +27,9 @@ public:
     std::vector<Object*> getVisibleObjects(const AABB& bounds);
     std::vector<Object*> getObjectByType(ModelType type);
     std::vector<Object*> getAllObjects();
+    size_t getObjectCount() const { return m_objects.size(); }
+    //Object 和 Model 的CPU侧副本，共享的 Model 只算一次
+    size_t getCpuBytes() const;
 
     void setObjectUpdateCallback(UpdateCallback&& callback)
     {
@@ -0,0 +1,189 @@
+#include "ParallelRecorder.h"
+
+#include <stdexcept>
+
+ParallelRecorder::ParallelRecorder(Device& device, uint32_t workerCount) :
+    m_device(device)
+{
+    if (workerCount == 0)
+    {
+        uint32_t hardwareThreads = qMax(std::thread::hardware_concurrency(), 1u);
+        workerCount = qMin(hardwareThreads - 1, MAX_WORKERS);
+    }
+
+    m_contexts.resize(workerCount + 1);
+
+    VkCommandPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    poolInfo.queueFamilyIndex = m_device.findPhysicalQueueFamilies().graphicsFamily;
+    //整池重置，不需要单独重置命令缓冲
+    poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+
+    for (auto& context : m_contexts)
+    {
+        for (auto& pool : context.pools)
+        {
+            if (vkCreateCommandPool(m_device.device(), &poolInfo, nullptr, &pool) != VK_SUCCESS)
+                throw std::runtime_error("failed to create recording command pool!");
+        }
+    }
+
+    for (uint32_t i = 0; i < workerCount; i++)
+    {
+        m_workers.emplace_back(&ParallelRecorder::workerLoop, this, i);
+    }
+}
+
+ParallelRecorder::~ParallelRecorder()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    m_startCondition.notify_all();
+    for (auto& worker : m_workers)
+    {
+        worker.join();
+    }
+
+    //销毁命令池时其中的命令缓冲一起释放
+    for (auto& context : m_contexts)
+    {
+        for (VkCommandPool pool : context.pools)
+            vkDestroyCommandPool(m_device.device(), pool, nullptr);
+    }
+}
+
+void ParallelRecorder::beginFrame(int frameIndex)
+{
+    m_frameIndex = frameIndex;
+
+    for (auto& context : m_contexts)
+    {
+        vkResetCommandPool(m_device.device(), context.pools[m_frameIndex], 0);
+        context.usedCount = 0;
+    }
+}
+
+std::vector<VkCommandBuffer> ParallelRecorder::record(uint32_t taskCount,
+    const VkCommandBufferInheritanceInfo& inheritanceInfo, const RecordFunc& recordFunc)
+{
+    if (taskCount == 0)
+        return {};
+
+    m_results.assign(taskCount, VK_NULL_HANDLE);
+
+    //只有一个任务时不唤醒工作线程
+    bool wakeWorkers = taskCount > 1 && !m_workers.empty();
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_recordFunc = &recordFunc;
+        m_inheritanceInfo = &inheritanceInfo;
+        m_taskCount = taskCount;
+        m_nextTask = 0;
+        m_error = nullptr;
+        if (wakeWorkers)
+        {
+            m_activeWorkers = static_cast<uint32_t>(m_workers.size());
+            m_generation++;
+        }
+    }
+    if (wakeWorkers)
+        m_startCondition.notify_all();
+
+    //调用线程用最后一个上下文，和工作线程一起领取任务
+    runTasks(static_cast<uint32_t>(m_contexts.size()) - 1);
+
+    std::exception_ptr error;
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_doneCondition.wait(lock, [this] { return m_activeWorkers == 0; });
+        m_recordFunc = nullptr;
+        m_inheritanceInfo = nullptr;
+        error = m_error;
+    }
+
+    if (error)
+        std::rethrow_exception(error);
+
+    return m_results;
+}
+
+void ParallelRecorder::workerLoop(uint32_t contextIndex)
+{
+    uint64_t generation = 0;
+    while (true)
+    {
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_startCondition.wait(lock, [&] { return m_stopping || m_generation != generation; });
+            if (m_stopping)
+                return;
+            generation = m_generation;
+        }
+
+        runTasks(contextIndex);
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_activeWorkers--;
+        }
+        m_doneCondition.notify_one();
+    }
+}
+
+void ParallelRecorder::runTasks(uint32_t contextIndex)
+{
+    ThreadContext& context = m_contexts[contextIndex];
+
+    VkCommandBufferBeginInfo beginInfo{};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+    beginInfo.pInheritanceInfo = m_inheritanceInfo;
+
+    try
+    {
+        for (uint32_t task = m_nextTask++; task < m_taskCount; task = m_nextTask++)
+        {
+            VkCommandBuffer commandBuffer = acquireCommandBuffer(context);
+            if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS)
+                throw std::runtime_error("failed to begin secondary command buffer!");
+
+            (*m_recordFunc)(task, commandBuffer);
+
+            if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS)
+                throw std::runtime_error("failed to record secondary command buffer!");
+
+            m_results[task] = commandBuffer;
+        }
+    }
+    catch (...)
+    {
+        //异常交给调用线程抛出，剩下的任务不再领取
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_error)
+            m_error = std::current_exception();
+        m_nextTask = m_taskCount;
+    }
+}
+
+VkCommandBuffer ParallelRecorder::acquireCommandBuffer(ThreadContext& context)
+{
+    auto& commandBuffers = context.commandBuffers[m_frameIndex];
+    if (context.usedCount < commandBuffers.size())
+        return commandBuffers[context.usedCount++];
+
+    VkCommandBufferAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+    allocInfo.commandPool = context.pools[m_frameIndex];
+    allocInfo.commandBufferCount = 1;
+
+    VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+    if (vkAllocateCommandBuffers(m_device.device(), &allocInfo, &commandBuffer) != VK_SUCCESS)
+        throw std::runtime_error("failed to allocate secondary command buffer!");
+
+    commandBuffers.push_back(commandBuffer);
+    context.usedCount++;
+    return commandBuffer;
+}
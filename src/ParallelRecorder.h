@@ -0,0 +1,77 @@
+#pragma once
+
+#include "Device.h"
+#include "SwapChain.h"
+
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+//多线程录制次级命令缓冲。命令池不能被多个线程同时使用，每个工作线程（以及调用线程）
+//每个在途帧各有一个命令池，帧的围栏信号后整池重置，命令缓冲按需分配后反复复用。
+//任务按序号动态领取，结果按任务顺序返回，调用方用一次 vkCmdExecuteCommands 合并
+class ParallelRecorder
+{
+public:
+    static constexpr uint32_t MAX_WORKERS = 8;
+
+    using RecordFunc = std::function<void(uint32_t taskIndex, VkCommandBuffer commandBuffer)>;
+
+    //workerCount 为 0 时按CPU核数决定，调用线程也参与录制
+    ParallelRecorder(Device& device, uint32_t workerCount = 0);
+    ~ParallelRecorder();
+
+    ParallelRecorder(const ParallelRecorder&) = delete;
+    ParallelRecorder& operator=(const ParallelRecorder&) = delete;
+
+    //该帧的围栏已经等过之后调用，重置所有线程该帧的命令池
+    void beginFrame(int frameIndex);
+
+    //并行录制 taskCount 个次级命令缓冲，每个都已 begin/end，继承渲染通道；阻塞到全部录完
+    std::vector<VkCommandBuffer> record(uint32_t taskCount,
+        const VkCommandBufferInheritanceInfo& inheritanceInfo, const RecordFunc& recordFunc);
+
+    //包括调用线程在内的录制线程数
+    uint32_t getThreadCount() const { return static_cast<uint32_t>(m_contexts.size()); }
+
+private:
+    //一个录制线程的命令池和已分配的命令缓冲
+    struct ThreadContext
+    {
+        std::array<VkCommandPool, SwapChain::MAX_FRAMES_IN_FLIGHT> pools{};
+        std::array<std::vector<VkCommandBuffer>, SwapChain::MAX_FRAMES_IN_FLIGHT> commandBuffers;
+        uint32_t usedCount{ 0 };        //当前帧已取用的命令缓冲数
+    };
+
+    void workerLoop(uint32_t contextIndex);
+    //领取并录制任务，直到全部领完
+    void runTasks(uint32_t contextIndex);
+    VkCommandBuffer acquireCommandBuffer(ThreadContext& context);
+
+private:
+    Device& m_device;
+
+    std::vector<ThreadContext>      m_contexts;         //最后一个属于调用线程
+    std::vector<std::thread>        m_workers;
+    int                             m_frameIndex{ 0 };
+
+    std::mutex                      m_mutex;
+    std::condition_variable         m_startCondition;
+    std::condition_variable         m_doneCondition;
+    uint64_t                        m_generation{ 0 };  //每次 record 加一，唤醒工作线程
+    uint32_t                        m_activeWorkers{ 0 };
+    bool                            m_stopping{ false };
+
+    //当前这一轮的任务
+    const RecordFunc*                       m_recordFunc = nullptr;
+    const VkCommandBufferInheritanceInfo*   m_inheritanceInfo = nullptr;
+    uint32_t                                m_taskCount{ 0 };
+    std::atomic<uint32_t>                   m_nextTask{ 0 };
+    std::vector<VkCommandBuffer>            m_results;
+    std::exception_ptr                      m_error;            //录制线程抛出的第一个异常
+};
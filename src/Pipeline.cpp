@@ -1,9 +1,8 @@
 #include "pipeline.h"
+#include "PipelineCache.h"
 
-#include <fstream>
 #include <iostream> 
 #include <qdebug.h>
-#include <qdir.h>
 
 
 
@@ -11,23 +10,101 @@ Pipeline::Pipeline(
     Device& device,
     const std::string& vertFilePath,
     const std::string& fragFilePath,
-    const PipelineConfigInfo& config) :
+    const PipelineConfigInfo& config,
+    bool compileAsync) :
     m_device(device)
 {
-    createGraphicPipeline(device, vertFilePath, fragFilePath, config);
+    if (!compileAsync)
+    {
+        createGraphicPipeline(device, vertFilePath, fragFilePath, config);
+        m_ready.store(true, std::memory_order_release);
+        return;
+    }
+
+    m_pendingConfig = copyConfigInfo(config);
+    compileInBackground([this, vertFilePath, fragFilePath]() {
+        createGraphicPipeline(m_device, vertFilePath, fragFilePath, *m_pendingConfig);
+    });
+}
+
+Pipeline::Pipeline(Device& device, const std::string& compFilePath, VkPipelineLayout pipelineLayout, bool compileAsync) :
+    m_device(device),
+    m_bindPoint(VK_PIPELINE_BIND_POINT_COMPUTE)
+{
+    if (!compileAsync)
+    {
+        createComputePipeline(compFilePath, pipelineLayout);
+        m_ready.store(true, std::memory_order_release);
+        return;
+    }
+
+    compileInBackground([this, compFilePath, pipelineLayout]() {
+        createComputePipeline(compFilePath, pipelineLayout);
+    });
 }
 
 Pipeline::~Pipeline()
 {
+    if (m_compileTask.valid())
+        m_compileTask.wait();
+
     vkDestroyShaderModule(m_device.device(), m_vertShaderModule, nullptr);
     vkDestroyShaderModule(m_device.device(), m_fragShaderModule, nullptr);
+    vkDestroyShaderModule(m_device.device(), m_compShaderModule, nullptr);
     vkDestroyPipeline(m_device.device(), m_graphicsPipeline, nullptr);
+    vkDestroyPipeline(m_device.device(), m_computePipeline, nullptr);
 }
 
 void Pipeline::bind(VkCommandBuffer commandBuffer)
 {
-    if (m_graphicsPipeline)
-        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_graphicsPipeline);
+    VkPipeline pipeline = m_bindPoint == VK_PIPELINE_BIND_POINT_COMPUTE ? m_computePipeline : m_graphicsPipeline;
+    if (isReady() && pipeline)
+        vkCmdBindPipeline(commandBuffer, m_bindPoint, pipeline);
+}
+
+std::unique_ptr<PipelineConfigInfo> Pipeline::copyConfigInfo(const PipelineConfigInfo& configInfo)
+{
+    std::unique_ptr<PipelineConfigInfo> copy(new PipelineConfigInfo{});
+    copy->viewportInfo = configInfo.viewportInfo;
+    copy->inputAssemblyInfo = configInfo.inputAssemblyInfo;
+    copy->rasterizationInfo = configInfo.rasterizationInfo;
+    copy->multisampleInfo = configInfo.multisampleInfo;
+    copy->colorBlendAttachment = configInfo.colorBlendAttachment;
+    copy->colorBlendInfo = configInfo.colorBlendInfo;
+    copy->colorBlendInfo.pAttachments = &copy->colorBlendAttachment;
+    copy->depthStencilInfo = configInfo.depthStencilInfo;
+
+    copy->dynamicStateEnables = configInfo.dynamicStateEnables;
+    copy->dynamicStateInfo = configInfo.dynamicStateInfo;
+    copy->dynamicStateInfo.pDynamicStates = copy->dynamicStateEnables.data();
+
+    copy->bindingDescriptions = configInfo.bindingDescriptions;
+    copy->attributeDescriptions = configInfo.attributeDescriptions;
+    copy->specializationEntries = configInfo.specializationEntries;
+    copy->specializationData = configInfo.specializationData;
+    copy->pipelineLayout = configInfo.pipelineLayout;
+    copy->renderPass = configInfo.renderPass;
+    copy->subpass = configInfo.subpass;
+    return copy;
+}
+
+void Pipeline::compileInBackground(std::function<void()> create)
+{
+    m_device.pipelineCache().beginAsyncCompile();
+    m_compileTask = std::async(std::launch::async, [this, create]() {
+        try
+        {
+            create();
+            m_ready.store(true, std::memory_order_release);
+        }
+        catch (const std::exception& e)
+        {
+            //ʧʱһֱʹû˹
+            qWarning() << "background pipeline compilation failed:" << e.what();
+        }
+        //һ̨ʱѻдش
+        m_device.pipelineCache().endAsyncCompile();
+    });
 }
 
 void Pipeline::setPipelineConfigInfo(PipelineConfigInfo& configInfo, VkPrimitiveTopology topology)
@@ -105,26 +182,20 @@ void Pipeline::setPipelineConfigInfo(PipelineConfigInfo& configInfo, VkPrimitive
     configInfo.dynamicStateInfo.pDynamicStates = configInfo.dynamicStateEnables.data();
     configInfo.dynamicStateInfo.dynamicStateCount = static_cast<uint32_t>(configInfo.dynamicStateEnables.size());
     configInfo.dynamicStateInfo.flags = 0;
+
+    configInfo.bindingDescriptions = Model::Vertex::getBindingDescription();
+    configInfo.attributeDescriptions = Model::Vertex::getAttributeDescription();
 }
 
-std::vector<char> Pipeline::readFile(const std::string& filePath)
+void Pipeline::enableAlphaBlending(PipelineConfigInfo& configInfo)
 {
-    qDebug() << "Current Path" << QDir::currentPath();
-    std::string fullFilePath = QDir::toNativeSeparators(QDir::currentPath() + "/" + QString::fromStdString(filePath)).toLocal8Bit().toStdString();
-
-    std::ifstream file(fullFilePath, std::ios::ate | std::ios::binary);
-
-    if (!file.is_open())
-    {
-        throw std::runtime_error("failed to open file: " + filePath);
-    }
-
-    size_t fileSize = static_cast<size_t>(file.tellg());
-    std::vector<char> buffer(fileSize);
-    file.seekg(0);
-    file.read(buffer.data(), fileSize);
-    file.close();
-    return buffer;
+    configInfo.colorBlendAttachment.blendEnable = VK_TRUE;
+    configInfo.colorBlendAttachment.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
+    configInfo.colorBlendAttachment.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+    configInfo.colorBlendAttachment.colorBlendOp = VK_BLEND_OP_ADD;
+    configInfo.colorBlendAttachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+    configInfo.colorBlendAttachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+    configInfo.colorBlendAttachment.alphaBlendOp = VK_BLEND_OP_ADD;
 }
 
 void Pipeline::createGraphicPipeline(const Device& device,
@@ -138,12 +209,19 @@ void Pipeline::createGraphicPipeline(const Device& device,
     assert(configInfo.renderPass != VK_NULL_HANDLE &&
         "Cannot create graphic pipeline:: no renderPass provided in configInfo");
 
-    auto vertCode = readFile(vertFilePath);
-    auto  fragCode = readFile(fragFilePath);
+    //SPIR-V ɹ߻һκ
+    const auto& vertCode = m_device.pipelineCache().getShaderCode(vertFilePath);
+    const auto& fragCode = m_device.pipelineCache().getShaderCode(fragFilePath);
 
     createShaderModule(vertCode, &m_vertShaderModule);
     createShaderModule(fragCode, &m_fragShaderModule);
 
+    VkSpecializationInfo specializationInfo{};
+    specializationInfo.mapEntryCount = static_cast<uint32_t>(configInfo.specializationEntries.size());
+    specializationInfo.pMapEntries = configInfo.specializationEntries.data();
+    specializationInfo.dataSize = configInfo.specializationData.size();
+    specializationInfo.pData = configInfo.specializationData.data();
+
     VkPipelineShaderStageCreateInfo shaderStatges[2];
     shaderStatges[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
     shaderStatges[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
@@ -151,7 +229,7 @@ void Pipeline::createGraphicPipeline(const Device& device,
     shaderStatges[0].pName = "main";
     shaderStatges[0].flags = 0;
     shaderStatges[0].pNext = nullptr;
-    shaderStatges[0].pSpecializationInfo = nullptr;
+    shaderStatges[0].pSpecializationInfo = configInfo.specializationEntries.empty() ? nullptr : &specializationInfo;
 
     shaderStatges[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
     shaderStatges[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
@@ -161,8 +239,8 @@ void Pipeline::createGraphicPipeline(const Device& device,
     shaderStatges[1].pNext = nullptr;
     shaderStatges[1].pSpecializationInfo = nullptr;
 
-    auto bindingDescriptions = Model::Vertex::getBindingDescription();
-    auto attributeDescription = Model::Vertex::getAttributeDescription();
+    auto& bindingDescriptions = configInfo.bindingDescriptions;
+    auto& attributeDescription = configInfo.attributeDescriptions;
 
 
     VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
@@ -202,7 +280,7 @@ void Pipeline::createGraphicPipeline(const Device& device,
     pipelineInfo.basePipelineIndex = -1;
     pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
 
-    if (vkCreateGraphicsPipelines(m_device.device(), VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &m_graphicsPipeline) != VK_SUCCESS)
+    if (vkCreateGraphicsPipelines(m_device.device(), m_device.pipelineCache().getCache(), 1, &pipelineInfo, nullptr, &m_graphicsPipeline) != VK_SUCCESS)
     {
         throw std::runtime_error("failed to create graphic pipeline");
     }
@@ -211,6 +289,33 @@ void Pipeline::createGraphicPipeline(const Device& device,
     std::cout << "Fragment Shader Code Size: " << fragCode.size() << std::endl;
 }
 
+void Pipeline::createComputePipeline(const std::string& compFilePath, VkPipelineLayout pipelineLayout)
+{
+    assert(pipelineLayout != VK_NULL_HANDLE &&
+        "Cannot create compute pipeline:: no pipelineLayout provided");
+
+    const auto& compCode = m_device.pipelineCache().getShaderCode(compFilePath);
+    createShaderModule(compCode, &m_compShaderModule);
+
+    VkPipelineShaderStageCreateInfo shaderStage{};
+    shaderStage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    shaderStage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    shaderStage.module = m_compShaderModule;
+    shaderStage.pName = "main";
+
+    VkComputePipelineCreateInfo pipelineInfo{};
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipelineInfo.stage = shaderStage;
+    pipelineInfo.layout = pipelineLayout;
+    pipelineInfo.basePipelineIndex = -1;
+    pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
+
+    if (vkCreateComputePipelines(m_device.device(), m_device.pipelineCache().getCache(), 1, &pipelineInfo, nullptr, &m_computePipeline) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to create compute pipeline");
+    }
+}
+
 void Pipeline::createShaderModule(const std::vector<char>& code, VkShaderModule* shaderModule)
 {
     VkShaderModuleCreateInfo createInfo{};
@@ -1,5 +1,9 @@
 #pragma once
 
+#include <atomic>
+#include <functional>
+#include <future>
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -23,39 +27,67 @@ struct PipelineConfigInfo
     std::vector<VkDynamicState> dynamicStateEnables;
     VkPipelineDynamicStateCreateInfo dynamicStateInfo;
 
+    //顶点输入，默认使用Model::Vertex，顶点拉取(vertex pulling)的管线可以置空
+    std::vector<VkVertexInputBindingDescription> bindingDescriptions{};
+    std::vector<VkVertexInputAttributeDescription> attributeDescriptions{};
+
+    //顶点着色器的特化常量，entries 中的偏移指向 specializationData
+    std::vector<VkSpecializationMapEntry> specializationEntries{};
+    std::vector<uint8_t> specializationData{};
+
     VkPipelineLayout pipelineLayout = nullptr;
     VkRenderPass renderPass = nullptr;
     uint32_t subpass = 0;
 };
 
+//管线统一通过设备的持久化管线缓存创建。compileAsync 为 true 时在后台线程编译，
+//编译完成之前 isReady 返回 false、bind 不做任何事，调用方先用回退的管线绘制
 class Pipeline
 {
 public:
     Pipeline(Device& device, const std::string& vertFilePath,
-        const std::string& fragFilePath, const PipelineConfigInfo& config);
+        const std::string& fragFilePath, const PipelineConfigInfo& config, bool compileAsync = false);
+    //计算管线，只有一个计算着色器
+    Pipeline(Device& device, const std::string& compFilePath, VkPipelineLayout pipelineLayout, bool compileAsync = false);
 
+    //等待未完成的后台编译
     ~Pipeline();
 
-    Pipeline(const Pipeline&) = default;
-    Pipeline& operator=(const Pipeline&) = default;
+    Pipeline(const Pipeline&) = delete;
+    Pipeline& operator=(const Pipeline&) = delete;
 
+    //可以在录制线程上调用
+    bool isReady() const { return m_ready.load(std::memory_order_acquire); }
     void bind(VkCommandBuffer commandBuffer);
 
     static void setPipelineConfigInfo(PipelineConfigInfo& configInfo, VkPrimitiveTopology topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST);
+    static void enableAlphaBlending(PipelineConfigInfo& configInfo);
 
 private:
-    static std::vector<char> readFile(const std::string& filePath);
+    //后台编译时配置要活过构造函数，拷贝一份并修正其中指向自身的指针
+    static std::unique_ptr<PipelineConfigInfo> copyConfigInfo(const PipelineConfigInfo& configInfo);
+    //在后台线程上运行 create，失败时打印警告，管线保持未就绪
+    void compileInBackground(std::function<void()> create);
 
     void createGraphicPipeline(const Device& device,
         const std::string& vertFilePath,
         const std::string& fragFilePath,
         const PipelineConfigInfo& config);
 
+    void createComputePipeline(const std::string& compFilePath, VkPipelineLayout pipelineLayout);
+
     void createShaderModule(const std::vector<char>& code, VkShaderModule* shaderModule);
 
     Device& m_device;
-    VkPipeline      m_graphicsPipeline;
-    VkShaderModule  m_vertShaderModule;
-    VkShaderModule  m_fragShaderModule;
+    VkPipelineBindPoint m_bindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+    VkPipeline      m_graphicsPipeline = VK_NULL_HANDLE;
+    VkPipeline      m_computePipeline = VK_NULL_HANDLE;
+    VkShaderModule  m_vertShaderModule = VK_NULL_HANDLE;
+    VkShaderModule  m_fragShaderModule = VK_NULL_HANDLE;
+    VkShaderModule  m_compShaderModule = VK_NULL_HANDLE;
+
+    std::atomic<bool>                   m_ready{ false };
+    std::unique_ptr<PipelineConfigInfo> m_pendingConfig;        //后台编译期间持有的配置副本
+    std::future<void>                   m_compileTask;
 };
 
@@ -0,0 +1,153 @@
+#include "PipelineCache.h"
+
+#include <cstring>
+#include <stdexcept>
+#include <qdebug.h>
+#include <qdir.h>
+#include <qfile.h>
+#include <qsavefile.h>
+
+PipelineCache::PipelineCache(Device& device, const std::string& filePath) :
+    m_device(device),
+    m_filePath(filePath)
+{
+    std::vector<char> initialData = loadCacheData();
+
+    VkPipelineCacheCreateInfo cacheInfo{};
+    cacheInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+    cacheInfo.initialDataSize = initialData.size();
+    cacheInfo.pInitialData = initialData.empty() ? nullptr : initialData.data();
+
+    if (vkCreatePipelineCache(m_device.device(), &cacheInfo, nullptr, &m_cache) != VK_SUCCESS)
+    {
+        //驱动拒绝旧数据时退回空缓存
+        cacheInfo.initialDataSize = 0;
+        cacheInfo.pInitialData = nullptr;
+        if (vkCreatePipelineCache(m_device.device(), &cacheInfo, nullptr, &m_cache) != VK_SUCCESS)
+            throw std::runtime_error("failed to create pipeline cache!");
+    }
+
+    qDebug() << "pipeline cache loaded" << initialData.size() << "bytes from" << QString::fromStdString(m_filePath);
+}
+
+PipelineCache::~PipelineCache()
+{
+    save();
+    vkDestroyPipelineCache(m_device.device(), m_cache, nullptr);
+}
+
+const std::vector<char>& PipelineCache::getShaderCode(const std::string& filePath)
+{
+    std::lock_guard<std::mutex> lock(m_shaderMutex);
+
+    auto it = m_shaderCode.find(filePath);
+    if (it != m_shaderCode.end())
+        return it->second;
+
+    QFile file(fullPath(filePath));
+    if (!file.open(QIODevice::ReadOnly))
+        throw std::runtime_error("failed to open file: " + filePath);
+
+    QByteArray bytes = file.readAll();
+    std::vector<char> code(bytes.begin(), bytes.end());
+    return m_shaderCode.emplace(filePath, std::move(code)).first->second;
+}
+
+void PipelineCache::endAsyncCompile()
+{
+    if (m_pendingCompiles.fetch_sub(1, std::memory_order_acq_rel) == 1)
+        save();
+}
+
+bool PipelineCache::save()
+{
+    std::lock_guard<std::mutex> lock(m_saveMutex);
+
+    size_t dataSize = 0;
+    if (vkGetPipelineCacheData(m_device.device(), m_cache, &dataSize, nullptr) != VK_SUCCESS || dataSize == 0)
+        return false;
+
+    std::vector<char> data(dataSize);
+    if (vkGetPipelineCacheData(m_device.device(), m_cache, &dataSize, data.data()) != VK_SUCCESS)
+        return false;
+    data.resize(dataSize);
+
+    const VkPhysicalDeviceProperties& properties = m_device.properties;
+    FileHeader header{};
+    header.magic = FILE_MAGIC;
+    header.dataSize = static_cast<uint32_t>(dataSize);
+    header.vendorID = properties.vendorID;
+    header.deviceID = properties.deviceID;
+    header.driverVersion = properties.driverVersion;
+    std::memcpy(header.pipelineCacheUUID, properties.pipelineCacheUUID, VK_UUID_SIZE);
+
+    //先写临时文件再替换，写到一半退出不会留下损坏的缓存
+    QSaveFile file(fullPath(m_filePath));
+    if (!file.open(QIODevice::WriteOnly))
+    {
+        qWarning() << "failed to open pipeline cache for writing:" << file.fileName();
+        return false;
+    }
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.write(data.data(), static_cast<qint64>(data.size()));
+    if (!file.commit())
+    {
+        qWarning() << "failed to write pipeline cache:" << file.fileName();
+        return false;
+    }
+    return true;
+}
+
+std::vector<char> PipelineCache::loadCacheData() const
+{
+    QFile file(fullPath(m_filePath));
+    if (!file.open(QIODevice::ReadOnly))
+        return {};
+
+    QByteArray bytes = file.readAll();
+    if (bytes.size() < static_cast<qsizetype>(sizeof(FileHeader)))
+        return {};
+
+    FileHeader header{};
+    std::memcpy(&header, bytes.constData(), sizeof(header));
+    if (bytes.size() - sizeof(FileHeader) != header.dataSize)
+        return {};
+
+    std::vector<char> data(bytes.begin() + sizeof(FileHeader), bytes.end());
+    if (!isCompatible(header, data))
+    {
+        qDebug() << "pipeline cache was written by another device or driver, discarding";
+        return {};
+    }
+    return data;
+}
+
+bool PipelineCache::isCompatible(const FileHeader& header, const std::vector<char>& data) const
+{
+    const VkPhysicalDeviceProperties& properties = m_device.properties;
+    if (header.magic != FILE_MAGIC ||
+        header.vendorID != properties.vendorID ||
+        header.deviceID != properties.deviceID ||
+        header.driverVersion != properties.driverVersion ||
+        std::memcmp(header.pipelineCacheUUID, properties.pipelineCacheUUID, VK_UUID_SIZE) != 0)
+    {
+        return false;
+    }
+
+    //驱动自己的数据头也要对得上：长度、版本、厂商、设备和 UUID
+    VkPipelineCacheHeaderVersionOne cacheHeader{};
+    if (data.size() < sizeof(cacheHeader))
+        return false;
+    std::memcpy(&cacheHeader, data.data(), sizeof(cacheHeader));
+
+    return cacheHeader.headerSize >= sizeof(cacheHeader) &&
+        cacheHeader.headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE &&
+        cacheHeader.vendorID == properties.vendorID &&
+        cacheHeader.deviceID == properties.deviceID &&
+        std::memcmp(cacheHeader.pipelineCacheUUID, properties.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+}
+
+QString PipelineCache::fullPath(const std::string& filePath) const
+{
+    return QDir::toNativeSeparators(QDir::currentPath() + "/" + QString::fromStdString(filePath));
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include "Device.h"
+
+#include <atomic>
+#include <mutex>
+#include <QString>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+//持久化的管线缓存：启动时从磁盘读回，文件头记录的设备 UUID、厂商/设备号和驱动版本
+//与当前设备不一致时丢弃，后台编译全部完成后和析构时写回。所有管线共用，vkCreate*Pipelines 可以在多个线程上同时使用它。
+//同一个 SPIR-V 文件只从磁盘读一次
+class PipelineCache
+{
+public:
+    static constexpr const char* DEFAULT_FILE_NAME = "pipeline_cache.bin";
+
+    PipelineCache(Device& device, const std::string& filePath = DEFAULT_FILE_NAME);
+    ~PipelineCache();
+
+    PipelineCache(const PipelineCache&) = delete;
+    PipelineCache& operator=(const PipelineCache&) = delete;
+
+    VkPipelineCache getCache() const { return m_cache; }
+
+    //返回 SPIR-V 文件内容，第一次读取后缓存；可以在编译线程上调用
+    const std::vector<char>& getShaderCode(const std::string& filePath);
+
+    //把当前缓存数据写到磁盘，失败时只打印警告；可以在编译线程上调用
+    bool save();
+
+    //后台编译开始和结束时调用，进行中的编译全部结束后写一次磁盘，异常退出时也不丢新编译的管线
+    void beginAsyncCompile() { m_pendingCompiles.fetch_add(1, std::memory_order_relaxed); }
+    void endAsyncCompile();
+
+private:
+    //文件头，后面紧跟 vkGetPipelineCacheData 的数据
+    struct FileHeader
+    {
+        uint32_t magic;
+        uint32_t dataSize;
+        uint32_t vendorID;
+        uint32_t deviceID;
+        uint32_t driverVersion;
+        uint8_t  pipelineCacheUUID[VK_UUID_SIZE];
+    };
+
+    static constexpr uint32_t FILE_MAGIC = 0x50434143;     //"CACP"
+
+    //读出文件中与当前设备匹配的缓存数据，不匹配或损坏时返回空
+    std::vector<char> loadCacheData() const;
+    bool isCompatible(const FileHeader& header, const std::vector<char>& data) const;
+    //相对路径按当前目录解析，与着色器文件一致
+    QString fullPath(const std::string& filePath) const;
+
+private:
+    Device& m_device;
+
+    std::string         m_filePath;
+    VkPipelineCache     m_cache{ VK_NULL_HANDLE };
+
+    std::mutex                                          m_saveMutex;
+    std::atomic<uint32_t>                               m_pendingCompiles{ 0 };
+
+    std::mutex                                          m_shaderMutex;
+    std::unordered_map<std::string, std::vector<char>>  m_shaderCode;
+};
@@ -0,0 +1,212 @@
+#include "PointLayer.h"
+
+#include <algorithm>
+#include <limits>
+
+#include <qdebug.h>
+
+#ifdef max
+#undef max
+#endif
+
+#ifdef min
+#undef min
+#endif
+
+namespace
+{
+    uint8_t toUnorm8(float value)
+    {
+        return static_cast<uint8_t>(std::clamp(value, 0.f, 1.f) * 255.f + 0.5f);
+    }
+
+    AABB emptyBounds()
+    {
+        return AABB{ std::numeric_limits<float>::infinity(), std::numeric_limits<float>::infinity(),
+            -std::numeric_limits<float>::infinity(), -std::numeric_limits<float>::infinity() };
+    }
+}
+
+PointLayer::PointLayer(Device& device, const AABB& worldBounds) :
+    m_device(device),
+    m_worldBounds(worldBounds),
+    m_tiles(TILE_GRID* TILE_GRID)
+{
+    for (auto& tile : m_tiles)
+    {
+        tile.bounds = emptyBounds();
+    }
+}
+
+bool PointLayer::setWorldBounds(const AABB& worldBounds)
+{
+    if (m_pointCount != 0)
+    {
+        qWarning() << "cannot change point layer bounds after points are added";
+        return false;
+    }
+
+    m_worldBounds = worldBounds;
+    return true;
+}
+
+PointLayer::PointInstance PointLayer::makeInstance(const QVector2D& position, uint16_t symbolId, float scale, const QVector3D& color)
+{
+    PointInstance instance{};
+    instance.position[0] = position.x();
+    instance.position[1] = position.y();
+    instance.color = static_cast<uint32_t>(toUnorm8(color.x())) |
+        (static_cast<uint32_t>(toUnorm8(color.y())) << 8) |
+        (static_cast<uint32_t>(toUnorm8(color.z())) << 16) |
+        (0xFFu << 24);
+    instance.symbolId = symbolId;
+    instance.scale = static_cast<uint16_t>(std::clamp(scale * 256.f + 0.5f, 0.f, 65535.f));
+    return instance;
+}
+
+void PointLayer::addPoint(const PointInstance& point)
+{
+    uint32_t tileIndex = tileIndexOf(point.position[0], point.position[1]);
+    Tile& tile = m_tiles[tileIndex];
+
+    //第一次变脏时记录，flush 时只处理这些瓦片
+    if (tile.points.size() == tile.uploadedCount)
+        m_dirtyTiles.push_back(tileIndex);
+
+    tile.points.push_back(point);
+    tile.bounds.minX = std::min(tile.bounds.minX, point.position[0]);
+    tile.bounds.minY = std::min(tile.bounds.minY, point.position[1]);
+    tile.bounds.maxX = std::max(tile.bounds.maxX, point.position[0]);
+    tile.bounds.maxY = std::max(tile.bounds.maxY, point.position[1]);
+    m_pointCount++;
+}
+
+void PointLayer::addPoints(const std::vector<PointInstance>& points)
+{
+    for (const auto& point : points)
+    {
+        addPoint(point);
+    }
+}
+
+void PointLayer::flush(VkCommandBuffer commandBuffer, FrameAllocator& staging)
+{
+    m_frameCounter++;
+    m_retiredBuffers.erase(std::remove_if(m_retiredBuffers.begin(), m_retiredBuffers.end(),
+        [this](const auto& retired) { return m_frameCounter - retired.first > SwapChain::MAX_FRAMES_IN_FLIGHT; }),
+        m_retiredBuffers.end());
+
+    if (m_dirtyTiles.empty())
+        return;
+
+    //在途帧只读各瓦片已上传的部分，新点追加在其后，拷贝不会改写正在读取的数据
+    for (uint32_t tileIndex : m_dirtyTiles)
+    {
+        Tile& tile = m_tiles[tileIndex];
+        uint32_t pointCount = static_cast<uint32_t>(tile.points.size());
+
+        if (pointCount > tile.capacity)
+        {
+            uint32_t newCapacity = std::max(MIN_TILE_CAPACITY, std::max(pointCount, tile.capacity * 2));
+            auto newBuffer = std::make_unique<VMABuffer>(
+                m_device,
+                sizeof(PointInstance),
+                newCapacity,
+                VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                VMA_MEMORY_USAGE_GPU_ONLY
+            );
+
+            if (tile.instanceBuffer && tile.uploadedCount > 0)
+            {
+                VkBufferCopy copyRegion{};
+                copyRegion.size = tile.uploadedCount * sizeof(PointInstance);
+                vkCmdCopyBuffer(commandBuffer, tile.instanceBuffer->getBuffer(), newBuffer->getBuffer(), 1, &copyRegion);
+            }
+
+            if (tile.instanceBuffer)
+                m_retiredBuffers.emplace_back(m_frameCounter, std::move(tile.instanceBuffer));
+            tile.instanceBuffer = std::move(newBuffer);
+            tile.capacity = newCapacity;
+        }
+
+        VkDeviceSize newBytes = (pointCount - tile.uploadedCount) * sizeof(PointInstance);
+        auto allocation = staging.write(&tile.points[tile.uploadedCount], newBytes, sizeof(PointInstance));
+        if (!allocation.isValid())
+            continue;
+
+        VkBufferCopy copyRegion{};
+        copyRegion.srcOffset = allocation.offset;
+        copyRegion.dstOffset = tile.uploadedCount * sizeof(PointInstance);
+        copyRegion.size = newBytes;
+        vkCmdCopyBuffer(commandBuffer, allocation.buffer, tile.instanceBuffer->getBuffer(), 1, &copyRegion);
+
+        tile.uploadedCount = pointCount;
+        tile.version++;
+    }
+
+    VkMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
+        0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+    m_dirtyTiles.clear();
+}
+
+std::vector<const PointLayer::Tile*> PointLayer::getVisibleTiles(const Camera& camera) const
+{
+    std::vector<const Tile*> visibleTiles;
+    auto frustum = camera.getFrustum2D();
+
+    for (const auto& tile : m_tiles)
+    {
+        if (tile.uploadedCount == 0 || !tile.instanceBuffer)
+            continue;
+
+        if (frustum.insersects(tile.bounds))
+            visibleTiles.push_back(&tile);
+    }
+
+    return visibleTiles;
+}
+
+VkDeviceSize PointLayer::getGpuBytes(uint32_t* bufferCount) const
+{
+    VkDeviceSize bytes = 0;
+    uint32_t count = 0;
+    for (const auto& tile : m_tiles)
+    {
+        if (!tile.instanceBuffer)
+            continue;
+
+        bytes += tile.instanceBuffer->getBufferSize();
+        count++;
+    }
+
+    if (bufferCount)
+        *bufferCount = count;
+    return bytes;
+}
+
+VkDeviceSize PointLayer::getCpuBytes() const
+{
+    VkDeviceSize bytes = 0;
+    for (const auto& tile : m_tiles)
+        bytes += tile.points.capacity() * sizeof(PointInstance);
+    return bytes;
+}
+
+uint32_t PointLayer::tileIndexOf(float x, float y) const
+{
+    float width = m_worldBounds.maxX - m_worldBounds.minX;
+    float height = m_worldBounds.maxY - m_worldBounds.minY;
+
+    //超出世界范围的点夹到边缘瓦片
+    int tileX = width > 0.f ? static_cast<int>((x - m_worldBounds.minX) / width * TILE_GRID) : 0;
+    int tileY = height > 0.f ? static_cast<int>((y - m_worldBounds.minY) / height * TILE_GRID) : 0;
+    tileX = std::clamp(tileX, 0, static_cast<int>(TILE_GRID) - 1);
+    tileY = std::clamp(tileY, 0, static_cast<int>(TILE_GRID) - 1);
+
+    return static_cast<uint32_t>(tileY) * TILE_GRID + static_cast<uint32_t>(tileX);
+}
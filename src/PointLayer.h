@@ -0,0 +1,79 @@
+#pragma once
+
+#include "Camera.h"
+#include "Device.h"
+#include "FrameAllocator.h"
+#include "VMABuffer.h"
+#include "const.h"
+
+#include <memory>
+#include <vector>
+
+//点图层：点要素以紧凑的实例记录存储，按规则网格分瓦片，每个可见瓦片一次实例化绘制
+class PointLayer
+{
+public:
+    static constexpr uint32_t TILE_GRID = 64;                  //每个方向的瓦片数
+    static constexpr uint32_t MIN_TILE_CAPACITY = 1024;        //瓦片实例缓冲的最小容量
+
+    //每个点16字节，顶点输入按实例步进
+    struct PointInstance
+    {
+        float       position[2];
+        uint32_t    color;          //RGBA8
+        uint16_t    symbolId;
+        uint16_t    scale;          //8.8定点数，相对符号原始像素尺寸的缩放
+    };
+    static_assert(sizeof(PointInstance) == 16, "PointInstance must stay 16 bytes");
+
+    struct Tile
+    {
+        AABB bounds;                                    //瓦片内点的实际范围
+        std::vector<PointInstance> points;              //CPU侧副本，扩容时用来追加
+        std::unique_ptr<VMABuffer> instanceBuffer;
+        uint32_t capacity{ 0 };
+        uint32_t uploadedCount{ 0 };                    //已上传到GPU的点数
+        uint64_t version{ 0 };                          //实例缓冲或点数变化时加一，缓存的绘制命令据此失效
+    };
+
+    PointLayer(Device& device, const AABB& worldBounds);
+
+    PointLayer(const PointLayer&) = delete;
+    PointLayer& operator=(const PointLayer&) = delete;
+
+    //图层为空时才能调整瓦片网格覆盖的范围
+    bool setWorldBounds(const AABB& worldBounds);
+
+    static PointInstance makeInstance(const QVector2D& position, uint16_t symbolId, float scale, const QVector3D& color);
+
+    void addPoint(const PointInstance& point);
+    void addPoints(const std::vector<PointInstance>& points);
+
+    //把新增的点的拷贝录到帧命令缓冲上，源数据写在本帧的临时缓冲里；每帧在渲染通道开始之前调用一次
+    void flush(VkCommandBuffer commandBuffer, FrameAllocator& staging);
+
+    std::vector<const Tile*> getVisibleTiles(const Camera& camera) const;
+
+    //实例缓冲和CPU侧点副本的大小
+    VkDeviceSize getGpuBytes(uint32_t* bufferCount = nullptr) const;
+    VkDeviceSize getCpuBytes() const;
+
+    size_t getPointCount() const { return m_pointCount; }
+    float getPlaneZ() const { return m_planeZ; }
+    void setPlaneZ(float z) { m_planeZ = z; }
+
+private:
+    uint32_t tileIndexOf(float x, float y) const;
+
+private:
+    Device& m_device;
+
+    AABB                        m_worldBounds;
+    std::vector<Tile>           m_tiles;
+    std::vector<uint32_t>       m_dirtyTiles;
+    //扩容换下的实例缓冲，在途帧都结束后释放
+    std::vector<std::pair<uint64_t, std::unique_ptr<VMABuffer>>> m_retiredBuffers;
+    uint64_t                    m_frameCounter{ 0 };
+    size_t                      m_pointCount{ 0 };
+    float                       m_planeZ{ 2.5f };       //与线要素的平移保持一致
+};
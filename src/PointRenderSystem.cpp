@@ -0,0 +1,250 @@
+#include "PointRenderSystem.h"
+
+#include <array>
+#include <cassert>
+#include <cstddef>
+#include <stdexcept>
+
+PointRenderSystem::PointRenderSystem(Device& device, VkRenderPass renderPass, VkDescriptorSetLayout globalSetLayout) :
+    m_device(device)
+{
+    m_symbolAtlas = std::make_unique<SymbolAtlas>(device);
+    createDescriptorResources();
+    createPipelineLayout(globalSetLayout);
+    createPipeline(renderPass);
+    createTileCommandPool();
+}
+
+PointRenderSystem::~PointRenderSystem()
+{
+    //销毁命令池时缓存的命令缓冲一起释放
+    vkDestroyCommandPool(m_device.device(), m_tileCommandPool, nullptr);
+    vkDestroyPipelineLayout(m_device.device(), m_pipelineLayout, nullptr);
+}
+
+void PointRenderSystem::render(VkCommandBuffer commandBuffer, VkDescriptorSet globalDescriptorSet,
+    const std::vector<const PointLayer::Tile*>& tiles, float planeZ, VkExtent2D viewportExtent)
+{
+    if (tiles.empty())
+        return;
+
+    bindState(commandBuffer, globalDescriptorSet, planeZ, viewportExtent);
+
+    for (const PointLayer::Tile* tile : tiles)
+    {
+        VkBuffer instanceBuffer = tile->instanceBuffer->getBuffer();
+        VkDeviceSize offsets[] = { 0 };
+        vkCmdBindVertexBuffers(commandBuffer, 0, 1, &instanceBuffer, offsets);
+        vkCmdDraw(commandBuffer, 6, tile->uploadedCount, 0, 0);
+    }
+}
+
+std::vector<VkCommandBuffer> PointRenderSystem::getTileCommandBuffers(int frameIndex, VkDescriptorSet globalDescriptorSet,
+    const std::vector<const PointLayer::Tile*>& tiles, float planeZ, VkExtent2D viewportExtent, VkRenderPass renderPass,
+    VkQueryPipelineStatisticFlags pipelineStatistics)
+{
+    m_tileCacheStats = {};
+
+    std::vector<VkCommandBuffer> commandBuffers;
+    if (tiles.empty())
+        return commandBuffers;
+
+    TileDrawState state;
+    state.globalDescriptorSet = globalDescriptorSet;
+    state.renderPass = renderPass;
+    state.viewportExtent = viewportExtent;
+    state.planeZ = planeZ;
+    state.pipelineStatistics = pipelineStatistics;
+
+    commandBuffers.reserve(tiles.size());
+    for (const PointLayer::Tile* tile : tiles)
+    {
+        //只改这一帧的副本，另一帧的副本可能还在执行
+        TileCommands& commands = m_tileCommands[tile][frameIndex];
+        if (commands.commandBuffer == VK_NULL_HANDLE || commands.version != tile->version || !(commands.state == state))
+        {
+            recordTile(commands, *tile, state);
+            m_tileCacheStats.recorded++;
+        }
+        else
+        {
+            m_tileCacheStats.reused++;
+        }
+
+        commandBuffers.push_back(commands.commandBuffer);
+    }
+
+    return commandBuffers;
+}
+
+void PointRenderSystem::bindState(VkCommandBuffer commandBuffer, VkDescriptorSet globalDescriptorSet,
+    float planeZ, VkExtent2D viewportExtent)
+{
+    m_pipeline->bind(commandBuffer);
+
+    std::array<VkDescriptorSet, 2> descriptorSets{ globalDescriptorSet, m_atlasSet };
+    vkCmdBindDescriptorSets(
+        commandBuffer,
+        VK_PIPELINE_BIND_POINT_GRAPHICS,
+        m_pipelineLayout,
+        0, static_cast<uint32_t>(descriptorSets.size()), descriptorSets.data(),
+        0, nullptr
+    );
+
+    PointPushConstantData push{};
+    push.viewportSize[0] = static_cast<float>(viewportExtent.width);
+    push.viewportSize[1] = static_cast<float>(viewportExtent.height);
+    push.planeZ = planeZ;
+    vkCmdPushConstants(
+        commandBuffer,
+        m_pipelineLayout,
+        VK_SHADER_STAGE_VERTEX_BIT,
+        0,
+        sizeof(PointPushConstantData),
+        &push);
+}
+
+void PointRenderSystem::recordTile(TileCommands& commands, const PointLayer::Tile& tile, const TileDrawState& state)
+{
+    if (commands.commandBuffer == VK_NULL_HANDLE)
+    {
+        VkCommandBufferAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        allocInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+        allocInfo.commandPool = m_tileCommandPool;
+        allocInfo.commandBufferCount = 1;
+        if (vkAllocateCommandBuffers(m_device.device(), &allocInfo, &commands.commandBuffer) != VK_SUCCESS)
+            throw std::runtime_error("failed to allocate tile command buffer!");
+    }
+    else
+    {
+        vkResetCommandBuffer(commands.commandBuffer, 0);
+    }
+
+    //帧缓冲随交换链图像变化，不写入继承信息，缓存的命令缓冲可以用于任意图像
+    VkCommandBufferInheritanceInfo inheritanceInfo{};
+    inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+    inheritanceInfo.renderPass = state.renderPass;
+    inheritanceInfo.subpass = 0;
+    inheritanceInfo.pipelineStatistics = state.pipelineStatistics;
+
+    //每个在途帧一份副本，不需要 SIMULTANEOUS_USE
+    VkCommandBufferBeginInfo beginInfo{};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+    beginInfo.pInheritanceInfo = &inheritanceInfo;
+    if (vkBeginCommandBuffer(commands.commandBuffer, &beginInfo) != VK_SUCCESS)
+        throw std::runtime_error("failed to begin tile command buffer!");
+
+    VkViewport viewport{};
+    viewport.width = static_cast<float>(state.viewportExtent.width);
+    viewport.height = static_cast<float>(state.viewportExtent.height);
+    viewport.minDepth = 0.0f;
+    viewport.maxDepth = 1.0f;
+    VkRect2D scissor{ {0,0}, state.viewportExtent };
+    vkCmdSetViewport(commands.commandBuffer, 0, 1, &viewport);
+    vkCmdSetScissor(commands.commandBuffer, 0, 1, &scissor);
+
+    bindState(commands.commandBuffer, state.globalDescriptorSet, state.planeZ, state.viewportExtent);
+
+    VkBuffer instanceBuffer = tile.instanceBuffer->getBuffer();
+    VkDeviceSize offsets[] = { 0 };
+    vkCmdBindVertexBuffers(commands.commandBuffer, 0, 1, &instanceBuffer, offsets);
+    vkCmdDraw(commands.commandBuffer, 6, tile.uploadedCount, 0, 0);
+
+    if (vkEndCommandBuffer(commands.commandBuffer) != VK_SUCCESS)
+        throw std::runtime_error("failed to record tile command buffer!");
+
+    commands.version = tile.version;
+    commands.state = state;
+}
+
+void PointRenderSystem::createTileCommandPool()
+{
+    VkCommandPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    poolInfo.queueFamilyIndex = m_device.findPhysicalQueueFamilies().graphicsFamily;
+    //缓存的命令缓冲各自重置后重新录制
+    poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+    if (vkCreateCommandPool(m_device.device(), &poolInfo, nullptr, &m_tileCommandPool) != VK_SUCCESS)
+        throw std::runtime_error("failed to create tile command pool!");
+}
+
+void PointRenderSystem::createDescriptorResources()
+{
+    m_atlasSetLayout = DescriptorSetLayout::Builder(m_device)
+        .addBinding(0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT)
+        .addBinding(1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_VERTEX_BIT)
+        .build();
+
+    m_atlasPool = DescriptorPool::Builder(m_device)
+        .setMaxSets(1)
+        .addPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1)
+        .addPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1)
+        .build();
+
+    auto imageInfo = m_symbolAtlas->imageInfo();
+    auto rectInfo = m_symbolAtlas->rectInfo();
+    if (!DescriptorWriter(*m_atlasSetLayout, *m_atlasPool)
+        .writeImage(0, &imageInfo)
+        .writeBuffer(1, &rectInfo)
+        .build(m_atlasSet))
+    {
+        throw std::runtime_error("failed to allocate symbol atlas descriptor set!");
+    }
+}
+
+void PointRenderSystem::createPipelineLayout(VkDescriptorSetLayout globalSetLayout)
+{
+    VkPushConstantRange pushConstantRange{};
+    pushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+    pushConstantRange.offset = 0;
+    pushConstantRange.size = sizeof(PointPushConstantData);
+
+    std::vector<VkDescriptorSetLayout> descriptorSetLayout{
+        globalSetLayout,
+        m_atlasSetLayout->getDescriptorSetLayout()
+    };
+
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutInfo.setLayoutCount = static_cast<uint32_t>(descriptorSetLayout.size());
+    pipelineLayoutInfo.pSetLayouts = descriptorSetLayout.data();
+    pipelineLayoutInfo.pushConstantRangeCount = 1;
+    pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+    if (vkCreatePipelineLayout(m_device.device(), &pipelineLayoutInfo,
+        nullptr, &m_pipelineLayout) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to create point pipeline layout!");
+    }
+}
+
+void PointRenderSystem::createPipeline(VkRenderPass renderPass)
+{
+    assert(m_pipelineLayout != nullptr && "Cannot create pipeline before pipeline layout");
+
+    PipelineConfigInfo pipelineConfigInfo{};
+    Pipeline::setPipelineConfigInfo(pipelineConfigInfo, VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST);
+    Pipeline::enableAlphaBlending(pipelineConfigInfo);
+
+    //只有一个按实例步进的绑定，四边形顶点由 gl_VertexIndex 生成
+    pipelineConfigInfo.bindingDescriptions = {
+        { 0, sizeof(PointLayer::PointInstance), VK_VERTEX_INPUT_RATE_INSTANCE }
+    };
+    pipelineConfigInfo.attributeDescriptions = {
+        { 0, 0, VK_FORMAT_R32G32_SFLOAT, offsetof(PointLayer::PointInstance, position) },
+        { 1, 0, VK_FORMAT_R8G8B8A8_UNORM, offsetof(PointLayer::PointInstance, color) },
+        { 2, 0, VK_FORMAT_R16G16_UINT, offsetof(PointLayer::PointInstance, symbolId) }
+    };
+
+    pipelineConfigInfo.depthStencilInfo.depthWriteEnable = VK_FALSE;
+
+    pipelineConfigInfo.renderPass = renderPass;
+    pipelineConfigInfo.pipelineLayout = m_pipelineLayout;
+    m_pipeline = std::make_unique<Pipeline>(
+        m_device,
+        "point_symbol.vert.spv",
+        "point_symbol.frag.spv",
+        pipelineConfigInfo
+    );
+}
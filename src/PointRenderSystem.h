@@ -0,0 +1,104 @@
+#pragma once
+
+#include "Descriptors.h"
+#include "Device.h"
+#include "Pipeline.h"
+#include "PointLayer.h"
+#include "SwapChain.h"
+#include "SymbolAtlas.h"
+
+#include <array>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+//点符号渲染：每个点一个实例，顶点着色器扩展成屏幕空间四边形并从符号图集采样
+class PointRenderSystem
+{
+public:
+    struct PointPushConstantData
+    {
+        float viewportSize[2];
+        float planeZ;
+        float padding;
+    };
+
+    PointRenderSystem(Device& device, VkRenderPass renderPass, VkDescriptorSetLayout globalSetLayout);
+    ~PointRenderSystem();
+
+    PointRenderSystem(const PointRenderSystem&) = delete;
+    PointRenderSystem& operator=(const PointRenderSystem&) = delete;
+
+    struct TileCacheStats
+    {
+        uint32_t recorded{ 0 };         //本帧重新录制的瓦片
+        uint32_t reused{ 0 };           //本帧直接重放的瓦片
+    };
+
+    //每个可见瓦片一次绘制
+    void render(VkCommandBuffer commandBuffer, VkDescriptorSet globalDescriptorSet,
+        const std::vector<const PointLayer::Tile*>& tiles, float planeZ, VkExtent2D viewportExtent);
+
+    //瓦片命令缓存：每个瓦片每个在途帧一份次级命令缓冲，相机只通过全局UBO影响绘制，
+    //只有瓦片内容版本或绘制状态变化时才重新录制，平移缩放时直接重放。
+    //frameIndex 的围栏必须已经等过；返回的命令缓冲按瓦片顺序，在以次级命令缓冲开始的渲染通道内执行。
+    //pipelineStatistics 是执行时主命令缓冲上开着的统计查询的统计项
+    std::vector<VkCommandBuffer> getTileCommandBuffers(int frameIndex, VkDescriptorSet globalDescriptorSet,
+        const std::vector<const PointLayer::Tile*>& tiles, float planeZ, VkExtent2D viewportExtent, VkRenderPass renderPass,
+        VkQueryPipelineStatisticFlags pipelineStatistics = 0);
+    const TileCacheStats& getTileCacheStats() const { return m_tileCacheStats; }
+
+    SymbolAtlas& getSymbolAtlas() { return *m_symbolAtlas; }
+    VkPipelineLayout getPipelineLayout() { return m_pipelineLayout; }
+
+private:
+    //录制时的绘制状态，任何一项变化都要重新录制
+    struct TileDrawState
+    {
+        VkDescriptorSet globalDescriptorSet = VK_NULL_HANDLE;
+        VkRenderPass renderPass = VK_NULL_HANDLE;
+        VkExtent2D viewportExtent{ 0, 0 };
+        float planeZ{ 0.f };
+        VkQueryPipelineStatisticFlags pipelineStatistics{ 0 };     //继承的统计查询
+
+        bool operator==(const TileDrawState& other) const
+        {
+            return globalDescriptorSet == other.globalDescriptorSet && renderPass == other.renderPass &&
+                viewportExtent.width == other.viewportExtent.width &&
+                viewportExtent.height == other.viewportExtent.height && planeZ == other.planeZ &&
+                pipelineStatistics == other.pipelineStatistics;
+        }
+    };
+
+    struct TileCommands
+    {
+        VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+        uint64_t version{ UINT64_MAX };         //录制时瓦片的内容版本
+        TileDrawState state;
+    };
+
+    void createDescriptorResources();
+    void createPipelineLayout(VkDescriptorSetLayout globalSetLayout);
+    void createPipeline(VkRenderPass renderPass);
+    void createTileCommandPool();
+
+    //绑定管线、描述符集和推送常量
+    void bindState(VkCommandBuffer commandBuffer, VkDescriptorSet globalDescriptorSet, float planeZ, VkExtent2D viewportExtent);
+    void recordTile(TileCommands& commands, const PointLayer::Tile& tile, const TileDrawState& state);
+
+private:
+    Device& m_device;
+
+    std::unique_ptr<SymbolAtlas>            m_symbolAtlas;
+    std::unique_ptr<DescriptorSetLayout>    m_atlasSetLayout;
+    std::unique_ptr<DescriptorPool>         m_atlasPool;
+    VkDescriptorSet                         m_atlasSet = VK_NULL_HANDLE;
+
+    std::unique_ptr<Pipeline>               m_pipeline;
+    VkPipelineLayout                        m_pipelineLayout;
+
+    //只在主线程录制，按瓦片缓存
+    VkCommandPool                           m_tileCommandPool = VK_NULL_HANDLE;
+    std::unordered_map<const PointLayer::Tile*, std::array<TileCommands, SwapChain::MAX_FRAMES_IN_FLIGHT>> m_tileCommands;
+    TileCacheStats                          m_tileCacheStats;
+};
@@ -0,0 +1,173 @@
+#include "RangeAllocator.h"
+
+#include <cassert>
+#include <iterator>
+
+RangeAllocator::RangeAllocator(uint32_t capacity) :
+    m_capacity(capacity)
+{
+    if (capacity > 0)
+        insertFreeBlock(0, capacity);
+}
+
+uint32_t RangeAllocator::allocate(uint32_t size)
+{
+    if (size == 0 || size > m_capacity - m_used)
+        return INVALID_OFFSET;
+
+    //本级内找最小的够用块，找不到再取更高级别里的任意块（都不小于size）
+    uint32_t offset = INVALID_OFFSET;
+    uint32_t blockSize = 0;
+    for (uint32_t level = sizeClass(size); level < SIZE_CLASS_COUNT; level++)
+    {
+        auto& bin = m_freeBySize[level];
+        auto it = bin.lower_bound({ size, 0 });
+        if (it != bin.end())
+        {
+            blockSize = it->first;
+            offset = it->second;
+            break;
+        }
+    }
+
+    if (offset == INVALID_OFFSET)
+        return INVALID_OFFSET;
+
+    eraseFreeBlock(m_freeByOffset.find(offset));
+    if (blockSize > size)
+        insertFreeBlock(offset + size, blockSize - size);
+
+    m_used += size;
+    m_allocationCount++;
+    return offset;
+}
+
+uint32_t RangeAllocator::allocateBelow(uint32_t size, uint32_t limit)
+{
+    if (size == 0 || size > m_capacity - m_used)
+        return INVALID_OFFSET;
+
+    for (auto it = m_freeByOffset.begin(); it != m_freeByOffset.end() && it->first < limit; ++it)
+    {
+        if (it->second < size || it->first + size > limit)
+            continue;
+
+        uint32_t offset = it->first;
+        uint32_t blockSize = it->second;
+        eraseFreeBlock(it);
+        if (blockSize > size)
+            insertFreeBlock(offset + size, blockSize - size);
+
+        m_used += size;
+        m_allocationCount++;
+        return offset;
+    }
+
+    return INVALID_OFFSET;
+}
+
+void RangeAllocator::free(uint32_t offset, uint32_t size)
+{
+    if (size == 0)
+        return;
+
+    assert(offset + size <= m_capacity && "freed range is out of bounds");
+
+    uint32_t start = offset;
+    uint32_t end = offset + size;
+
+    //与后面的空闲块合并
+    auto next = m_freeByOffset.lower_bound(offset);
+    if (next != m_freeByOffset.end() && next->first == end)
+    {
+        end += next->second;
+        eraseFreeBlock(next);
+    }
+
+    //与前面的空闲块合并
+    auto prev = m_freeByOffset.lower_bound(offset);
+    if (prev != m_freeByOffset.begin())
+    {
+        --prev;
+        assert(prev->first + prev->second <= offset && "double free in range allocator");
+        if (prev->first + prev->second == start)
+        {
+            start = prev->first;
+            eraseFreeBlock(prev);
+        }
+    }
+
+    insertFreeBlock(start, end - start);
+    m_used -= size;
+    m_allocationCount--;
+}
+
+void RangeAllocator::grow(uint32_t newCapacity)
+{
+    if (newCapacity <= m_capacity)
+        return;
+
+    uint32_t start = m_capacity;
+    uint32_t size = newCapacity - m_capacity;
+    m_capacity = newCapacity;
+
+    if (!m_freeByOffset.empty())
+    {
+        auto last = std::prev(m_freeByOffset.end());
+        if (last->first + last->second == start)
+        {
+            start = last->first;
+            size += last->second;
+            eraseFreeBlock(last);
+        }
+    }
+
+    insertFreeBlock(start, size);
+}
+
+RangeAllocator::Stats RangeAllocator::getStats() const
+{
+    Stats stats;
+    stats.capacity = m_capacity;
+    stats.used = m_used;
+    stats.free = m_capacity - m_used;
+    stats.freeBlockCount = static_cast<uint32_t>(m_freeByOffset.size());
+    stats.allocationCount = m_allocationCount;
+
+    for (auto level = SIZE_CLASS_COUNT; level-- > 0;)
+    {
+        if (!m_freeBySize[level].empty())
+        {
+            stats.largestFreeBlock = m_freeBySize[level].rbegin()->first;
+            break;
+        }
+    }
+
+    if (stats.free > 0)
+        stats.fragmentation = 1.f - static_cast<float>(stats.largestFreeBlock) / static_cast<float>(stats.free);
+
+    return stats;
+}
+
+uint32_t RangeAllocator::sizeClass(uint32_t size)
+{
+    uint32_t level = 0;
+    while (size > 1)
+    {
+        size >>= 1;
+        level++;
+    }
+    return level;
+}
+
+void RangeAllocator::insertFreeBlock(uint32_t offset, uint32_t size)
+{
+    m_freeByOffset[offset] = size;
+    m_freeBySize[sizeClass(size)].insert({ size, offset });
+}
+
+void RangeAllocator::eraseFreeBlock(std::map<uint32_t, uint32_t>::iterator it)
+{
+    m_freeBySize[sizeClass(it->second)].erase({ it->second, it->first });
+    m_freeByOffset.erase(it);
+}
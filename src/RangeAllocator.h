@@ -0,0 +1,54 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <map>
+#include <set>
+
+//段内区间分配器：按2的幂分级的空闲链表，释放时与相邻空闲块合并
+class RangeAllocator
+{
+public:
+    static constexpr uint32_t INVALID_OFFSET = UINT32_MAX;
+    static constexpr uint32_t SIZE_CLASS_COUNT = 32;
+
+    struct Stats
+    {
+        uint64_t capacity{ 0 };
+        uint64_t used{ 0 };
+        uint64_t free{ 0 };
+        uint64_t largestFreeBlock{ 0 };
+        uint32_t freeBlockCount{ 0 };
+        uint32_t allocationCount{ 0 };
+        //1 - 最大空闲块/总空闲，0 表示空闲空间完全连续
+        float fragmentation{ 0.f };
+    };
+
+    RangeAllocator(uint32_t capacity = 0);
+
+    //分配 size 个单元，失败返回 INVALID_OFFSET
+    uint32_t allocate(uint32_t size);
+    //在 limit 之前找地址最低的够用块，用于碎片整理时把区间往前挪
+    uint32_t allocateBelow(uint32_t size, uint32_t limit);
+    void free(uint32_t offset, uint32_t size);
+    //扩大容量，新增部分作为空闲块并与末尾的空闲块合并
+    void grow(uint32_t newCapacity);
+
+    uint32_t getCapacity() const { return m_capacity; }
+    uint32_t getUsed() const { return m_used; }
+    Stats getStats() const;
+
+private:
+    static uint32_t sizeClass(uint32_t size);
+
+    void insertFreeBlock(uint32_t offset, uint32_t size);
+    void eraseFreeBlock(std::map<uint32_t, uint32_t>::iterator it);
+
+private:
+    uint32_t                                                m_capacity;
+    uint32_t                                                m_used{ 0 };
+    uint32_t                                                m_allocationCount{ 0 };
+
+    std::map<uint32_t, uint32_t>                            m_freeByOffset;     //offset -> size，用于合并
+    std::array<std::set<std::pair<uint32_t, uint32_t>>, SIZE_CLASS_COUNT> m_freeBySize; //每级内 (size, offset) 有序
+};
@@ -1,14 +1,23 @@
 #include "RenderManager.h"
 
+#include <algorithm>
+#include <limits>
+
 RenderManager::RenderManager(MyVulkanWindow& window, Device& device, VkDescriptorSetLayout globalSetLayout) :
     m_device(device),
     m_renderer(window, device),
     m_BufferPool(device)
 {
+    //ݵȾϵͳֵ߲ set 1ҪȾϵͳÿ֡֡ȡ
+    m_frameAllocator = std::make_unique<FrameAllocator>(device);
+    m_objectDataBuffer = std::make_unique<ObjectDataBuffer>(device, *m_frameAllocator);
+    VkDescriptorSetLayout objectSetLayout = m_objectDataBuffer->getDescriptorSetLayout();
+
     m_pointRenderSystem = std::make_unique<RenderSystem>(
         device,
         m_renderer.getSwapChainRenderPass(),
         globalSetLayout,
+        objectSetLayout,
         VK_PRIMITIVE_TOPOLOGY_POINT_LIST
     );
 
@@ -16,6 +25,7 @@ RenderManager::RenderManager(MyVulkanWindow& window, Device& device, VkDescripto
         device,
         m_renderer.getSwapChainRenderPass(),
         globalSetLayout,
+        objectSetLayout,
         VK_PRIMITIVE_TOPOLOGY_LINE_LIST
     );
 
@@ -23,24 +33,100 @@ RenderManager::RenderManager(MyVulkanWindow& window, Device& device, VkDescripto
         device,
         m_renderer.getSwapChainRenderPass(),
         globalSetLayout,
+        objectSetLayout,
         VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST
     );
 
+    m_wideLineRenderSystem = std::make_unique<LineRenderSystem>(
+        device,
+        m_renderer.getSwapChainRenderPass(),
+        globalSetLayout
+    );
+
+    //ȡҪβλ̬洢飬֧ʱΰ󶨵·
+    if (GeometryRenderSystem::isSupported(device))
+    {
+        m_geometryRenderSystem = std::make_unique<GeometryRenderSystem>(
+            device,
+            m_renderer.getSwapChainRenderPass(),
+            globalSetLayout,
+            objectSetLayout
+        );
+    }
+    else
+    {
+        qDebug() << "vertex pulling unsupported, binding vertex/index buffers per segment";
+    }
+
+    m_pointSymbolRenderSystem = std::make_unique<PointRenderSystem>(
+        device,
+        m_renderer.getSwapChainRenderPass(),
+        globalSetLayout
+    );
+
+    m_defragmenter = std::make_unique<BufferDefragmenter>(device, m_BufferPool);
+    m_residencyManager = std::make_unique<ResidencyManager>(device, m_BufferPool);
+    m_parallelRecorder = std::make_unique<ParallelRecorder>(device);
+
+    //chunkʱCPU󽻺ύƳΪƿɫüɼӻ
+    if (m_geometryRenderSystem && GpuCuller::isSupported(device))
+    {
+        m_gpuCuller = std::make_unique<GpuCuller>(
+            device,
+            m_BufferPool,
+            *m_geometryRenderSystem,
+            m_renderer.getSwapChainRenderPass(),
+            globalSetLayout
+        );
+    }
 }
 
 VkCommandBuffer RenderManager::beginFrame()
 {
-    return m_renderer.beginFrame();
+    VkCommandBuffer commandBuffer = m_renderer.beginFrame();
+
+    //beginFrame Ѿȹһ֡Χϴдʱݲٱȡ
+    if (commandBuffer)
+    {
+        m_frameAllocator->beginFrame(m_renderer.getFrameIndex());
+        m_objectDataBuffer->beginFrame(m_renderer.getFrameIndex());
+    }
+
+    m_gpuCulled = false;
+    if (m_gpuCuller)
+        m_gpuCuller->resetFrame();
+    m_featureRuns.clear();
+
+    m_recordSecondary = false;
+    m_recordParallel = false;
+    if (commandBuffer)
+        m_parallelRecorder->beginFrame(m_renderer.getFrameIndex());
+    return commandBuffer;
 }
 
 void RenderManager::endFrame()
 {
+    //Ҳ֡һˢ
+    m_frameAllocator->flush();
     m_renderer.endFrame();
 }
 
 void RenderManager::beginSwapChainRenderPass(VkCommandBuffer commandBuffer)
 {
-    m_renderer.beginSwapChainRenderPass(commandBuffer);
+    m_renderer.beginSwapChainRenderPass(commandBuffer,
+        m_recordSecondary ? VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS : VK_SUBPASS_CONTENTS_INLINE);
+}
+
+void RenderManager::planRecording(const RenderQueue& queue)
+{
+    //ͳƲѯŶ豸ܼ̳вѯʱμ岻ִͨУȫ¼
+    bool secondaryAllowed = m_pipelineStatistics == 0 || m_device.enabledFeatures().inheritedQueries;
+
+    //ֻе߳ʱû棬̫ʱ߳¼
+    m_recordParallel = secondaryAllowed && m_parallelRecordingEnabled && m_parallelRecorder->getThreadCount() > 1 &&
+        queue.size() >= PARALLEL_RECORD_THRESHOLD;
+    //ƬֻڴμִͨУҲҪ¼μ
+    m_recordSecondary = secondaryAllowed && (m_recordParallel || m_tileCachingEnabled);
 }
 
 void RenderManager::endSwapChainRenderPass(VkCommandBuffer commandBuffer)
@@ -48,203 +134,809 @@ void RenderManager::endSwapChainRenderPass(VkCommandBuffer commandBuffer)
     m_renderer.endSwapChainRenderPass(commandBuffer);
 }
 
-uint32_t RenderManager::allocateRenderBuffer(const Object::Builder& builder)
+void RenderManager::collectGarbage()
+{
+    m_BufferPool.collectGarbage();
+    m_wideLineRenderSystem->collectGarbage();
+    if (m_geometryRenderSystem)
+        m_geometryRenderSystem->collectGarbage();
+    m_residencyManager->update();
+    m_defragmenter->update();
+}
+
+uint32_t RenderManager::allocateRenderBuffer(const Object::Builder& builder, uint32_t* featureIndex)
 {
-    return m_BufferPool.allocateBuffer(builder);
+    return m_BufferPool.allocateBuffer(builder, featureIndex);
 
 }
 
-void RenderManager::renderObjects(const std::vector<Object*>& objects, FrameInfo& frameInfo)
+void RenderManager::collectMemoryStats(MemoryReport& report) const
 {
-    if (objects.empty())
-        return;
+    BufferPool::MemoryStats poolStats = m_BufferPool.getMemoryStats();
+
+    VkDeviceSize poolGpuBytes = poolStats.retiredBufferBytes;
+    VkDeviceSize poolCpuBytes = poolStats.metadataBytes;
+    uint64_t featureCount = 0;
+    for (const auto& type : poolStats.types)
+    {
+        poolGpuBytes += type.allocatedBytes;
+        poolCpuBytes += type.cpuCopyBytes + type.pendingUploadBytes + type.openChunkBytes;
+        featureCount += type.featureCount;
+    }
+    //ݴ滷гڳصĶλ
+    uint32_t poolBufferCount = poolStats.bufferCount - (poolStats.stagingBytes > 0 ? 1 : 0);
+    report.addSubsystem("geometryPool", poolGpuBytes, poolCpuBytes, poolBufferCount);
+    report.addSubsystem("stagingRing", poolStats.stagingBytes, 0, poolStats.stagingBytes > 0 ? 1 : 0);
+    report.setGeometry(poolStats.types);
+    report.setFeatureCount(featureCount);
+
+    uint32_t frameBlockCount = 0;
+    VkDeviceSize frameCapacity = m_frameAllocator->getTotalCapacity(&frameBlockCount);
+    report.addSubsystem("frameAllocator", frameCapacity, 0, frameBlockCount);
+
+    VkDeviceSize instanceBytes = 0;
+    for (const auto& [chunkId, batch] : m_renderBatches)
+        instanceBytes += batch.objectData.capacity() * sizeof(ObjectDataBuffer::ObjectData);
+    //ݵԴ frameAllocator 
+    report.addSubsystem("instanceBatches", 0, instanceBytes);
+
+    const SymbolAtlas& atlas = m_pointSymbolRenderSystem->getSymbolAtlas();
+    report.addSubsystem("symbolAtlas", atlas.getGpuBytes(), atlas.getCpuBytes(), 1);
+}
 
-    //Chunk
-    std::unordered_map<uint32_t, std::vector<Object*>> objectsByChunk;
-    devideObjectByChunks(objectsByChunk, objects);
+bool RenderManager::freeRenderBuffer(uint32_t chunkId)
+{
+    m_overriddenChunks.erase(chunkId);
+    m_renderBatches.erase(chunkId);
+    return m_BufferPool.freeChunk(chunkId);
+}
 
-    renderObjectsByChunk(objectsByChunk, frameInfo);
+bool RenderManager::reallocateRenderBuffer(uint32_t chunkId, const std::vector<Model::Vertex>& vertices,
+    const std::vector<uint32_t>& indices, const std::vector<BufferPool::FeatureRange>& features)
+{
+    if (!m_BufferPool.reallocateChunk(chunkId, vertices, indices, features))
+        return false;
 
+    //ҪˣƵĻҪؽ
+    auto it = m_renderBatches.find(chunkId);
+    if (it != m_renderBatches.end() && it->second.overridden && !it->second.needsUpdate)
+    {
+        it->second.needsUpdate = true;
+        m_dirtyBatches.push_back(chunkId);
+    }
+    return true;
 }
 
-void RenderManager::devideObjectByChunks(std::unordered_map<uint32_t, std::vector<Object*>>& objectsByChunk, const std::vector<Object*>& objects)
+void RenderManager::addChunkObject(Object* object)
 {
-    for (Object* obj : objects) {
-        if (obj && obj->getChunkID() != 0) {
-            objectsByChunk[obj->getChunkID()].push_back(obj);
-        }
+    if (!object || object->getChunkID() == 0)
+        return;
+
+    //ǼʱɫѾд㣬ֻд任Ķ֮ǰѾƵchunkҪؽ
+    //chunkܻûзȡԶģ
+    RenderBatch& batch = getOrCreateBatch(object->getChunkID(),
+        object->getModel() ? object->getModel()->type() : ModelType::None);
+    batch.objects.push_back(object);
+    batch.baseColors.push_back(object->getColor());
+    bool transformed = !ObjectDataBuffer::ObjectData::fromMatrix(
+        object->getTransform().mat4f(), object->getColor(), 0.f).isIdentityTransform();
+    if (!batch.needsUpdate && (batch.overridden || transformed))
+    {
+        batch.needsUpdate = true;
+        m_dirtyBatches.push_back(object->getChunkID());
     }
 }
 
-void RenderManager::renderObjectsByChunk(const std::unordered_map<uint32_t, std::vector<Object*>>& objectsByChunk, FrameInfo& frameInfo)
+bool RenderManager::removeChunkObject(Object* object)
 {
-    for (const auto& [chunkId, chunkObjects] : objectsByChunk)
+    if (!object || object->getChunkID() == 0)
+        return false;
+
+    uint32_t chunkId = object->getChunkID();
+    auto batchIt = m_renderBatches.find(chunkId);
+    if (batchIt == m_renderBatches.end())
+        return false;
+
+    RenderBatch& batch = batchIt->second;
+    auto objectIt = std::find(batch.objects.begin(), batch.objects.end(), object);
+    if (objectIt == batch.objects.end())
+        return false;
+
+    size_t removed = objectIt - batch.objects.begin();
+    if (batch.objects.size() == 1)
+        return freeRenderBuffer(chunkId);
+
+    //ʣµҪشӶģƴchunkΣɫõǼʱɫٺӣҪŰʣµ˳
+    std::vector<Model::Vertex> vertices;
+    std::vector<uint32_t> indices;
+    std::vector<BufferPool::FeatureRange> features;
+    features.reserve(batch.objects.size() - 1);
+    for (size_t i = 0; i < batch.objects.size(); i++)
     {
-        if (chunkId != 0 && !chunkObjects.empty())
+        if (i == removed)
+            continue;
+        Object* remaining = batch.objects[i];
+        const BufferPool::FeatureRange* oldFeature = m_BufferPool.getFeature(chunkId, remaining->getFeatureIndex());
+        const auto& modelVertices = remaining->getModel()->getVerticeRef();
+        const auto& modelIndices = remaining->getModel()->getIndicesRef();
+
+        BufferPool::FeatureRange feature;
+        feature.vertexOffset = static_cast<uint32_t>(vertices.size());
+        feature.vertexCount = static_cast<uint32_t>(modelVertices.size());
+        feature.indexOffset = static_cast<uint32_t>(indices.size());
+        feature.bounds = oldFeature ? oldFeature->bounds : AABB{};
+
+        for (Model::Vertex vertex : modelVertices)
         {
-            renderChunkBatch(chunkId, chunkObjects, frameInfo);
+            vertex.color = batch.baseColors[i];
+            vertices.push_back(vertex);
         }
+        // allocateBuffer һûҪز˳
+        if (modelIndices.empty())
+        {
+            for (uint32_t index = 0; index < feature.vertexCount; index++)
+                indices.push_back(feature.vertexOffset + index);
+        }
+        else
+        {
+            for (uint32_t index : modelIndices)
+                indices.push_back(feature.vertexOffset + index);
+        }
+        feature.indexCount = static_cast<uint32_t>(indices.size()) - feature.indexOffset;
+        features.push_back(feature);
+    }
+
+    //ŵchunkû滻ȷڣ滻ʧʱchunkαԭ
+    m_BufferPool.flushPendingChunks();
+    if (!reallocateRenderBuffer(chunkId, vertices, indices, features))
+        return false;
+
+    batch.objects.erase(batch.objects.begin() + removed);
+    batch.baseColors.erase(batch.baseColors.begin() + removed);
+    for (size_t i = 0; i < batch.objects.size(); i++)
+        batch.objects[i]->setFeatureIndex(static_cast<uint32_t>(i));
+
+    //ҪŶˣƵҪؽ
+    if (!batch.needsUpdate)
+    {
+        batch.needsUpdate = true;
+        m_dirtyBatches.push_back(chunkId);
     }
+    return true;
 }
 
-void RenderManager::renderChunkBatch(uint32_t chunkId, const std::vector<Object*>& objects, FrameInfo& frameInfo)
+void RenderManager::markObjectChanged(Object* object)
 {
-    if (objects.empty())
+    if (!object)
         return;
 
-    ModelType type = m_BufferPool.getChunkType(chunkId);
-    if (type == ModelType::None)
+    auto it = m_renderBatches.find(object->getChunkID());
+    if (it == m_renderBatches.end() || it->second.needsUpdate)
+        return;
+
+    it->second.needsUpdate = true;
+    m_dirtyBatches.push_back(object->getChunkID());
+}
+
+void RenderManager::enqueueVisibleChunks(ModelType type, const Camera& camera, RenderQueue& queue)
+{
+    updateDirtyBatches();
+
+    //߰߶ʵչCPUüchunkƣ
+    //GPUüɵλchunkҪʱһҲCPUü
+    bool wideLines = type == ModelType::Line && wideLinesActive();
+    if (m_gpuCulled && !wideLines && !hasOverriddenChunks(type))
     {
+        queue.push(RenderQueue::makeKey(type, RenderQueue::PipelineId::GpuCulled, 0, 0, 0));
+
+        //СֵҪصchunkɫCPUҪ޳󲹻
+        float minExtent = minWorldExtent(camera);
+        if (minExtent > 0.f)
+            enqueueChunks(m_BufferPool.getChunksWithSmallFeatures(camera, type, minExtent), camera, queue);
         return;
     }
 
-    auto* renderSystem = getRenderSystemByType(type);
-    if (!renderSystem)
-        return;
+    float minExtent = minWorldExtent(camera);
+    std::vector<uint32_t> chunkIds = m_BufferPool.getVisibleChunks(camera, type, minExtent);
+
+    //Ƶchunk任ķΧϣԭΧвɼƽҰҲҪ
+    if (hasOverriddenChunks(type))
+    {
+        std::unordered_set<uint32_t> listed(chunkIds.begin(), chunkIds.end());
+        std::vector<uint32_t> visibleChunks;
+        std::vector<uint32_t> restreamChunks;
+        const auto frustum = camera.getFrustum2D();
+        for (uint32_t chunkId : m_overriddenChunks)
+        {
+            const RenderBatch& batch = m_renderBatches.at(chunkId);
+            if (batch.modelType != type || listed.count(chunkId) || !frustum.insersects(batch.bounds))
+                continue;
+            if (qMax(batch.bounds.maxX - batch.bounds.minX, batch.bounds.maxY - batch.bounds.minY) < minExtent)
+                continue;
+
+            BufferPool::Chunk chunk;
+            if (!m_BufferPool.getChunk(chunkId, chunk))
+                continue;
+            if (chunk.isLoaded)
+                visibleChunks.push_back(chunkId);
+            else if (chunk.isEvicted)
+                restreamChunks.push_back(chunkId);
+        }
+        // getVisibleChunks һǼǿɼԣⱻ
+        m_BufferPool.reportVisibility(visibleChunks, restreamChunks);
+        chunkIds.insert(chunkIds.end(), visibleChunks.begin(), visibleChunks.end());
+    }
+
+    enqueueChunks(chunkIds, camera, queue);
+}
+
+void RenderManager::enqueueChunks(const std::vector<uint32_t>& chunkIds, const Camera& camera, RenderQueue& queue)
+{
+    bool pulling = prepareVertexPulling();
+    float minExtent = minWorldExtent(camera);
+    uint32_t preparedLineSegment = UINT32_MAX;
+
+    for (uint32_t chunkId : chunkIds)
+    {
+        BufferPool::Chunk chunk;
+        if (!m_BufferPool.getChunk(chunkId, chunk) || chunk.type == ModelType::None)
+            continue;
+        ModelType type = chunk.type;
+
+        //ȡֶΣͬ͵chunkidƣ·һ𣬶лʱ°󶨡
+        //ڿߺͶȡ·ɫ
+        RenderQueue::PipelineId pipeline = RenderQueue::PipelineId::Bound;
+        uint32_t segment = chunk.segmentIndex;
+        auto batchIt = m_overriddenChunks.count(chunkId) ? m_renderBatches.find(chunkId) : m_renderBatches.end();
+        if (batchIt != m_renderBatches.end() && prepareBatchFrame(batchIt->second, camera, minExtent))
+        {
+            if (batchIt->second.drawList.empty())
+                continue;
+            pipeline = RenderQueue::PipelineId::Instanced;
+        }
+        else if (type == ModelType::Line && wideLinesActive())
+        {
+            pipeline = RenderQueue::PipelineId::WideLine;
+            if (chunk.segmentIndex != preparedLineSegment)
+            {
+                const BufferPool::SegmentView* view = m_BufferPool.getSegment(ModelType::Line, chunk.segmentIndex);
+                if (view)
+                    m_wideLineRenderSystem->prepareSegment(chunk.segmentIndex, *view);
+                preparedLineSegment = chunk.segmentIndex;
+            }
+        }
+        else if (pulling && GeometryRenderSystem::segmentSlot(type, chunk.segmentIndex) != GeometryRenderSystem::INVALID_SLOT)
+        {
+            pipeline = RenderQueue::PipelineId::Pulled;
+            segment = 0;
+        }
+
+        //ƵchunkҪͶӰֵʱֻʣµҪ䣬ȫ̫С
+        bool wholeChunk = pipeline == RenderQueue::PipelineId::Bound || pipeline == RenderQueue::PipelineId::Pulled;
+        if (wholeChunk && chunk.indexCount > 0 && chunk.minFeatureSize < minExtent)
+        {
+            std::vector<BufferPool::IndexRun> runs;
+            m_BufferPool.getFeatureRuns(chunkId, minExtent, runs);
+            //Ҫбܱȿ£Χ䲻
+            runs.erase(std::remove_if(runs.begin(), runs.end(), [&](const BufferPool::IndexRun& run) {
+                return run.firstIndex + run.indexCount > chunk.indexCount;
+            }), runs.end());
+            if (runs.empty())
+                continue;
+            if (runs.size() > 1 || runs.front().indexCount != chunk.indexCount)
+                m_featureRuns[chunkId] = std::move(runs);
+        }
 
-    renderSystem->bind(frameInfo.commandBuffer);
+        //ֶηŶβλȡʱֶΪ 0λͬһεchunk
+        uint32_t slot = GeometryRenderSystem::segmentSlot(type, chunk.segmentIndex);
+        queue.push(RenderQueue::makeKey(type, pipeline, segment, qMin<uint32_t>(slot, 0xFF), chunkId));
+    }
+}
 
-    uint32_t segmentIndex = m_BufferPool.getChunkBufferIndex(chunkId);
-    m_BufferPool.bindBuffersForType(frameInfo.commandBuffer, type, segmentIndex);
+void RenderManager::renderQueue(const RenderQueue& queue, FrameInfo& frameInfo)
+{
+    recordQueueRange(queue, 0, queue.size(), frameInfo.commandBuffer, frameInfo.globalDescriptorSet);
+}
 
-    RenderBatch& batch = getOrCreateBatch(chunkId);
+void RenderManager::renderScene(const RenderQueue& queue, PointLayer& pointLayer, FrameInfo& frameInfo)
+{
+    if (!m_recordSecondary)
+    {
+        renderQueue(queue, frameInfo);
+        renderPointLayer(pointLayer, frameInfo);
+        return;
+    }
 
-    updateInstanceBuffer(batch, objects);
-    // 2.7 ʵ
-    if (batch.instanceBuffer) {
-        VkBuffer instanceBuffer = batch.instanceBuffer->getBuffer();
-        VkDeviceSize offsets[] = { 0 };
-        vkCmdBindVertexBuffers(frameInfo.commandBuffer, 1, 1, &instanceBuffer, offsets);
+    //ͼ prepareFrame ϴ¼ֻ߳
+    auto tiles = pointLayer.getVisibleTiles(frameInfo.camera);
+
+    //аз֣ÿδͷ״̬̫ʱл󶨵Ŀе
+    size_t itemCount = queue.size();
+    uint32_t maxRanges = m_recordParallel ? m_parallelRecorder->getThreadCount() * 2 : 1;
+    uint32_t rangeCount = itemCount == 0 ? 0 : static_cast<uint32_t>(qBound<size_t>(1,
+        (itemCount + MIN_ITEMS_PER_RANGE - 1) / MIN_ITEMS_PER_RANGE, maxRanges));
+    size_t itemsPerRange = rangeCount == 0 ? 0 : (itemCount + rangeCount - 1) / rangeCount;
+    //ƬʱͼطŻ壬Ϊһ¼
+    uint32_t taskCount = rangeCount + (m_tileCachingEnabled ? 0 : 1);
+
+    VkCommandBufferInheritanceInfo inheritanceInfo{};
+    inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+    inheritanceInfo.renderPass = m_renderer.getSwapChainRenderPass();
+    inheritanceInfo.subpass = 0;
+    inheritanceInfo.framebuffer = m_renderer.getSwapChainFrameBuffer();
+    //ͳƲѯͨ⿪μҪͬͳ
+    inheritanceInfo.pipelineStatistics = m_pipelineStatistics;
+
+    //ͼ󣬱֤
+    auto commandBuffers = m_parallelRecorder->record(taskCount, inheritanceInfo,
+        [&](uint32_t taskIndex, VkCommandBuffer commandBuffer) {
+            m_renderer.setViewportAndScissor(commandBuffer);
+            if (taskIndex < rangeCount)
+            {
+                size_t begin = taskIndex * itemsPerRange;
+                size_t end = qMin(begin + itemsPerRange, itemCount);
+                recordQueueRange(queue, begin, end, commandBuffer, frameInfo.globalDescriptorSet);
+            }
+            else
+            {
+                m_pointSymbolRenderSystem->render(commandBuffer, frameInfo.globalDescriptorSet,
+                    tiles, pointLayer.getPlaneZ(), m_renderer.getSwapChainExtent());
+            }
+        });
+
+    if (m_tileCachingEnabled)
+    {
+        auto tileCommandBuffers = m_pointSymbolRenderSystem->getTileCommandBuffers(frameInfo.frameIndex,
+            frameInfo.globalDescriptorSet, tiles, pointLayer.getPlaneZ(), m_renderer.getSwapChainExtent(),
+            m_renderer.getSwapChainRenderPass(), m_pipelineStatistics);
+        commandBuffers.insert(commandBuffers.end(), tileCommandBuffers.begin(), tileCommandBuffers.end());
     }
 
-    // ====================== Ĳͳ ======================
-    // 2.8 ȫյȣ
-    if (frameInfo.globalDescriptorSet != VK_NULL_HANDLE) {
+    if (!commandBuffers.empty())
+        vkCmdExecuteCommands(frameInfo.commandBuffer, static_cast<uint32_t>(commandBuffers.size()), commandBuffers.data());
+}
+
+void RenderManager::recordQueueRange(const RenderQueue& queue, size_t begin, size_t end,
+    VkCommandBuffer commandBuffer, VkDescriptorSet globalDescriptorSet)
+{
+    uint64_t boundState = UINT64_MAX;
+    RenderSystem* renderSystem = nullptr;
+
+    //ͬεchunkռл߻֮ǰϳһμӻ
+    std::vector<BufferPool::Chunk> segmentChunks;
+    auto flushSegment = [&]() {
+        drawChunksIndirect(commandBuffer, segmentChunks);
+        segmentChunks.clear();
+    };
+
+    //Ҫ޳chunkɼchunkƣԭ׷
+    std::vector<BufferPool::Chunk> chunkParts;
+    auto appendDrawRanges = [&](uint32_t chunkId, const BufferPool::Chunk& chunk, std::vector<BufferPool::Chunk>& parts) {
+        auto runsIt = m_featureRuns.find(chunkId);
+        if (runsIt == m_featureRuns.end())
+        {
+            parts.push_back(chunk);
+            return;
+        }
+        for (const auto& run : runsIt->second)
+        {
+            BufferPool::Chunk part = chunk;
+            part.indexOffset += run.firstIndex;
+            part.indexCount = run.indexCount;
+            parts.push_back(part);
+        }
+    };
+
+    //ΰ·Ĺߺ
+    auto bindRenderSystem = [&](ModelType type) -> RenderSystem* {
+        RenderSystem* system = getRenderSystemByType(type);
+        if (!system)
+            return nullptr;
+
+        system->bind(commandBuffer);
+        if (globalDescriptorSet != VK_NULL_HANDLE) {
+            vkCmdBindDescriptorSets(
+                commandBuffer,
+                VK_PIPELINE_BIND_POINT_GRAPHICS,
+                system->getPipelineLayout(),
+                0, 1, &globalDescriptorSet,
+                0, nullptr
+            );
+        }
+        //chunk ʱʵ±Ϊ 0ȡĬϲλʱ firstInstance ָԵĲλ
+        VkDescriptorSet objectDescriptorSet = m_objectDataBuffer->getDescriptorSet();
         vkCmdBindDescriptorSets(
-            frameInfo.commandBuffer,
+            commandBuffer,
             VK_PIPELINE_BIND_POINT_GRAPHICS,
-            renderSystem->getPipelineLayout(),
-            0, 1, &frameInfo.globalDescriptorSet,
+            system->getPipelineLayout(),
+            1, 1, &objectDescriptorSet,
             0, nullptr
         );
+        return system;
+    };
+
+    const auto& keys = queue.getKeys();
+    for (size_t i = begin; i < end; i++)
+    {
+        uint64_t key = keys[i];
+        uint64_t state = RenderQueue::stateOf(key);
+        bool pipelineChanged = boundState == UINT64_MAX ||
+            RenderQueue::pipelineStateOf(key) != (boundState >> 24);
+        bool stateChanged = state != boundState;
+        if (stateChanged)
+            flushSegment();
+
+        ModelType type = RenderQueue::typeOf(key);
+        RenderQueue::PipelineId pipeline = RenderQueue::pipelineOf(key);
+        uint32_t segmentIndex = RenderQueue::segmentOf(key);
+
+        if (pipeline == RenderQueue::PipelineId::GpuCulled)
+        {
+            m_gpuCuller->draw(commandBuffer, type, globalDescriptorSet, m_objectDataBuffer->getDescriptorSet());
+            boundState = UINT64_MAX;
+            continue;
+        }
+
+        BufferPool::Chunk chunk;
+        if (!m_BufferPool.getChunk(RenderQueue::chunkOf(key), chunk))
+            continue;
+
+        switch (pipeline)
+        {
+        case RenderQueue::PipelineId::WideLine:
+        {
+            const BufferPool::SegmentView* segment = m_BufferPool.getSegment(ModelType::Line, segmentIndex);
+            if (!segment)
+                continue;
+
+            if (pipelineChanged)
+                m_wideLineRenderSystem->bind(commandBuffer, globalDescriptorSet);
+            if (stateChanged)
+                m_wideLineRenderSystem->bindSegment(commandBuffer, segmentIndex, *segment);
+
+            //߶ζ˵ɫֱӴӶλжȡchunkһʵ
+            m_wideLineRenderSystem->drawChunk(commandBuffer, chunk, QVector3D(1.f, 1.f, 1.f),
+                m_renderer.getSwapChainExtent());
+            break;
+        }
+        case RenderQueue::PipelineId::Pulled:
+        {
+            //жͬһͬ͵chunkֻ֮ͳ
+            if (pipelineChanged)
+                m_geometryRenderSystem->bind(commandBuffer, type, globalDescriptorSet, m_objectDataBuffer->getDescriptorSet());
+            chunkParts.clear();
+            appendDrawRanges(RenderQueue::chunkOf(key), chunk, chunkParts);
+            //λchunkжϣһʧܺҲһ
+            bool drawn = true;
+            for (const auto& part : chunkParts)
+            {
+                if (!m_geometryRenderSystem->drawChunk(commandBuffer, type, part))
+                {
+                    drawn = false;
+                    break;
+                }
+            }
+            if (drawn)
+                break;
+
+            //֮εĲλʧЧͷŻؽʧܣchunk˻ΰ󶨣һ°󶨹
+            renderSystem = bindRenderSystem(type);
+            if (renderSystem)
+            {
+                m_BufferPool.bindBuffersForType(commandBuffer, type, chunk.segmentIndex);
+                drawChunksIndirect(commandBuffer, chunkParts);
+            }
+            boundState = UINT64_MAX;
+            continue;
+        }
+        default:
+            if (pipelineChanged)
+            {
+                renderSystem = bindRenderSystem(type);
+                if (!renderSystem)
+                    continue;
+            }
+            if (stateChanged)
+                m_BufferPool.bindBuffersForType(commandBuffer, type, segmentIndex);
+
+            if (pipeline == RenderQueue::PipelineId::Instanced)
+            {
+                //ʱѾ׼ã¼ڼ䲻ɾ
+                auto batchIt = m_renderBatches.find(RenderQueue::chunkOf(key));
+                if (batchIt != m_renderBatches.end())
+                    drawChunkObjects(commandBuffer, chunk, batchIt->second);
+            }
+            else
+            {
+                appendDrawRanges(RenderQueue::chunkOf(key), chunk, segmentChunks);
+            }
+            break;
+        }
+
+        boundState = state;
     }
-    uint32_t instanceCount = static_cast<uint32_t>(objects.size());
-    m_BufferPool.drawChunk(frameInfo.commandBuffer, chunkId, instanceCount);
 
+    flushSegment();
 }
 
-RenderManager::RenderBatch& RenderManager::getOrCreateBatch(uint32_t chunkId)
+void RenderManager::drawChunksIndirect(VkCommandBuffer commandBuffer, const std::vector<BufferPool::Chunk>& chunks)
 {
-    auto it = m_renderBatches.find(chunkId);
-    if (it == m_renderBatches.end()) {
-        // µȾ
-        RenderBatch newBatch;
-        newBatch.modelType = m_BufferPool.getChunkType(chunkId);
-        newBatch.needsUpdate = true;
-        newBatch.bufferCapacity = 0;
-        newBatch.instanceCount = 0;
+    std::vector<VkDrawIndexedIndirectCommand> indexedCommands;
+    std::vector<VkDrawIndirectCommand> commands;
+    for (const auto& chunk : chunks)
+    {
+        if (!chunk.isLoaded)
+            continue;
 
-        m_renderBatches[chunkId] = std::move(newBatch);
+        if (chunk.indexCount > 0)
+            indexedCommands.push_back({ chunk.indexCount, 1, chunk.indexOffset, static_cast<int32_t>(chunk.vertexOffset), 0 });
+        else
+            commands.push_back({ chunk.vertexCount, 1, chunk.vertexOffset, 0 });
+    }
 
-        qDebug() << "Created new render batch for chunk:" << chunkId;
+    if (!indexedCommands.empty())
+    {
+        auto allocation = m_frameAllocator->write(indexedCommands.data(),
+            indexedCommands.size() * sizeof(VkDrawIndexedIndirectCommand), sizeof(uint32_t));
+        submitIndirect(commandBuffer, allocation, static_cast<uint32_t>(indexedCommands.size()),
+            sizeof(VkDrawIndexedIndirectCommand), true);
     }
 
-    return m_renderBatches[chunkId];
+    if (!commands.empty())
+    {
+        auto allocation = m_frameAllocator->write(commands.data(),
+            commands.size() * sizeof(VkDrawIndirectCommand), sizeof(uint32_t));
+        submitIndirect(commandBuffer, allocation, static_cast<uint32_t>(commands.size()),
+            sizeof(VkDrawIndirectCommand), false);
+    }
 }
 
-void RenderManager::updateInstanceBuffer(RenderBatch& batch, const std::vector<Object*>& objects)
+void RenderManager::submitIndirect(VkCommandBuffer commandBuffer, const FrameAllocator::Allocation& allocation,
+    uint32_t drawCount, uint32_t stride, bool indexed)
 {
-    if (!needInstanceBufferUpdate(batch, objects))
+    //֧ multiDrawIndirect ʱÿֻύһ
+    uint32_t maxDrawCount = m_device.enabledFeatures().multiDrawIndirect ?
+        m_device.properties.limits.maxDrawIndirectCount : 1;
+
+    for (uint32_t first = 0; first < drawCount; first += maxDrawCount)
     {
-        return;
+        uint32_t count = qMin(drawCount - first, maxDrawCount);
+        VkDeviceSize offset = allocation.offset + static_cast<VkDeviceSize>(first) * stride;
+        if (indexed)
+            vkCmdDrawIndexedIndirect(commandBuffer, allocation.buffer, offset, count, stride);
+        else
+            vkCmdDrawIndirect(commandBuffer, allocation.buffer, offset, count, stride);
     }
+}
+
+void RenderManager::cullChunks(FrameInfo& frameInfo)
+{
+    if (!m_gpuCuller || !m_gpuCullingEnabled)
+        return;
+
+    m_gpuCulled = m_gpuCuller->cull(frameInfo.commandBuffer, frameInfo.frameIndex, frameInfo.camera,
+        minWorldExtent(frameInfo.camera));
+}
+
+float RenderManager::minWorldExtent(const Camera& camera) const
+{
+    VkExtent2D extent = m_renderer.getSwapChainExtent();
+    if (m_minScreenSize <= 0.f || extent.width == 0 || extent.height == 0)
+        return 0.f;
+
+    //ȡÿߴСһٲ
+    QVector2D worldExtent = camera.getFrustum2D().extent();
+    float unitsPerPixel = qMin(qAbs(worldExtent.x()) / extent.width, qAbs(worldExtent.y()) / extent.height);
+    return m_minScreenSize * unitsPerPixel;
+}
 
-    size_t requiredSize = objects.size() * sizeof(InstanceData);
+void RenderManager::drawChunkObjects(VkCommandBuffer commandBuffer, const BufferPool::Chunk& chunk, const RenderBatch& batch)
+{
+    if (!chunk.isLoaded)
+        return;
 
-    if (!batch.instanceBuffer || batch.bufferCapacity < requiredSize)
+    std::vector<VkDrawIndexedIndirectCommand> indexedCommands;
+    std::vector<VkDrawIndirectCommand> commands;
+    for (uint32_t objectIndex : batch.drawList)
     {
-        allocateInstanceBuffer(batch, requiredSize);
+        const BufferPool::FeatureRange& feature = batch.features[objectIndex];
+        uint32_t slot = batch.frameSlot + objectIndex;
+        if (chunk.indexCount > 0)
+            indexedCommands.push_back({ feature.indexCount, 1, chunk.indexOffset + feature.indexOffset,
+                static_cast<int32_t>(chunk.vertexOffset), slot });
+        else
+            commands.push_back({ feature.vertexCount, 1, chunk.vertexOffset + feature.vertexOffset, slot });
     }
 
-    // 3.4 ʵ
-    std::vector<InstanceData> instanceData;
-    instanceData.reserve(objects.size());
-
-    for (Object* obj : objects) {
-        if (obj) {
-            InstanceData data;
-            data.transform = obj->getTransform().mat4f();
-            data.color = obj->getColor();
-            data.padding = 0.0f;
-            instanceData.push_back(data);
+    //ַ֧ firstInstance ļʱֱӻ
+    if (!m_device.enabledFeatures().drawIndirectFirstInstance)
+    {
+        for (const auto& command : indexedCommands)
+            vkCmdDrawIndexed(commandBuffer, command.indexCount, 1, command.firstIndex,
+                command.vertexOffset, command.firstInstance);
+        for (const auto& command : commands)
+            vkCmdDraw(commandBuffer, command.vertexCount, 1, command.firstVertex, command.firstInstance);
+        return;
+    }
 
-            // ĸ±
-            obj->clearUpdateFlags();
-        }
+    if (!indexedCommands.empty())
+    {
+        auto allocation = m_frameAllocator->write(indexedCommands.data(),
+            indexedCommands.size() * sizeof(VkDrawIndexedIndirectCommand), sizeof(uint32_t));
+        submitIndirect(commandBuffer, allocation, static_cast<uint32_t>(indexedCommands.size()),
+            sizeof(VkDrawIndexedIndirectCommand), true);
     }
 
-    // 3.5 ϴʵݵGPU
-    if (!instanceData.empty()) {
-        batch.instanceBuffer->map();
-        batch.instanceBuffer->writeToBuffer(instanceData.data(),
-            instanceData.size() * sizeof(InstanceData));
-        batch.instanceBuffer->unmap();
+    if (!commands.empty())
+    {
+        auto allocation = m_frameAllocator->write(commands.data(),
+            commands.size() * sizeof(VkDrawIndirectCommand), sizeof(uint32_t));
+        submitIndirect(commandBuffer, allocation, static_cast<uint32_t>(commands.size()),
+            sizeof(VkDrawIndirectCommand), false);
     }
+}
 
-    // 3.6 ״̬
-    batch.objects = objects;
-    batch.instanceCount = static_cast<uint32_t>(objects.size());
-    batch.needsUpdate = false;
+void RenderManager::uploadPointLayer(PointLayer& pointLayer, FrameInfo& frameInfo)
+{
+    //¼֡ϣԴ汾֡ʱһգٵύ͵ȴ
+    pointLayer.flush(frameInfo.commandBuffer, *m_frameAllocator);
+    m_pointSymbolRenderSystem->getSymbolAtlas().upload(frameInfo.commandBuffer, *m_frameAllocator);
+}
+
+void RenderManager::renderPointLayer(PointLayer& pointLayer, FrameInfo& frameInfo)
+{
+    auto tiles = pointLayer.getVisibleTiles(frameInfo.camera);
+    m_pointSymbolRenderSystem->render(frameInfo.commandBuffer, frameInfo.globalDescriptorSet,
+        tiles, pointLayer.getPlaneZ(), m_renderer.getSwapChainExtent());
+}
 
-    qDebug() << "Updated instance buffer with" << objects.size() << "instances";
+bool RenderManager::prepareVertexPulling()
+{
+    if (!m_geometryRenderSystem)
+        return false;
+
+    m_geometryRenderSystem->update(m_BufferPool);
+    return m_geometryRenderSystem->isReady() && m_geometryRenderSystem->pipelinesReady();
 }
 
-bool RenderManager::needInstanceBufferUpdate(const RenderBatch& batch, const std::vector<Object*>& objects)
+RenderManager::RenderBatch& RenderManager::getOrCreateBatch(uint32_t chunkId, ModelType type)
 {
-    // ǷΪҪ
-    if (batch.needsUpdate) {
-        return true;
+    auto it = m_renderBatches.find(chunkId);
+    if (it == m_renderBatches.end()) {
+        // µȾ
+        RenderBatch newBatch;
+        newBatch.chunkId = chunkId;
+        newBatch.modelType = type != ModelType::None ? type : m_BufferPool.getChunkType(chunkId);
+        newBatch.needsUpdate = false;
+        newBatch.instanceCount = 0;
+
+        m_renderBatches[chunkId] = std::move(newBatch);
     }
 
-    // Ƿ仯
-    if (batch.objects.size() != objects.size()) {
-        return true;
+    return m_renderBatches[chunkId];
+}
+
+void RenderManager::updateDirtyBatches()
+{
+    for (uint32_t chunkId : m_dirtyBatches)
+    {
+        auto it = m_renderBatches.find(chunkId);
+        if (it != m_renderBatches.end() && it->second.needsUpdate)
+            rebuildBatch(it->second);
     }
+    m_dirtyBatches.clear();
+}
 
-    // Ƿб仯
-    for (size_t i = 0; i < objects.size(); ++i) {
-        if (i >= batch.objects.size() ||
-            batch.objects[i] != objects[i] ||
-            (objects[i] && objects[i]->needsUpdate())) {
-            return true;
+void RenderManager::rebuildBatch(RenderBatch& batch)
+{
+    // ݵ˳ batch.objects һ£ i Ĳλ frameSlot + i
+    batch.objectData.clear();
+    batch.features.clear();
+    batch.objectData.reserve(batch.objects.size());
+    batch.features.reserve(batch.objects.size());
+
+    //Ǽʱchunkܻû鲻ͣȡһ
+    if (batch.modelType == ModelType::None)
+        batch.modelType = m_BufferPool.getChunkType(batch.chunkId);
+
+    bool overridden = false;
+    batch.bounds = AABB{ std::numeric_limits<float>::max(), std::numeric_limits<float>::max(),
+        -std::numeric_limits<float>::max(), -std::numeric_limits<float>::max() };
+    for (size_t i = 0; i < batch.objects.size(); i++)
+    {
+        Object* obj = batch.objects[i];
+        const BufferPool::FeatureRange* feature = m_BufferPool.getFeature(batch.chunkId, obj->getFeatureIndex());
+        batch.features.push_back(feature ? *feature : BufferPool::FeatureRange{});
+
+        //ɫ͵ǼʱͬöɫȨΪ 0
+        QMatrix4x4 transform = obj->getTransform().mat4f();
+        bool colorChanged = obj->getColor() != batch.baseColors[i];
+        batch.objectData.push_back(ObjectDataBuffer::ObjectData::fromMatrix(
+            transform, obj->getColor(), colorChanged ? 1.0f : 0.0f));
+
+        overridden = overridden || colorChanged || !batch.objectData.back().isIdentityTransform();
+
+        //chunkĲüñ任ķΧܱƳԭİΧ
+        if (feature)
+        {
+            AABB box = transformBounds(feature->bounds, batch.objectData.back());
+            batch.bounds.minX = qMin(batch.bounds.minX, box.minX);
+            batch.bounds.minY = qMin(batch.bounds.minY, box.minY);
+            batch.bounds.maxX = qMax(batch.bounds.maxX, box.maxX);
+            batch.bounds.maxY = qMax(batch.bounds.maxY, box.maxY);
         }
     }
 
-    return false;
+    //ûиĶchunkȻƣGPUüȡͿߣ
+    batch.overridden = overridden;
+    if (overridden)
+    {
+        m_overriddenChunks.insert(batch.chunkId);
+    }
+    else
+    {
+        m_overriddenChunks.erase(batch.chunkId);
+        batch.objectData = {};
+        batch.features = {};
+    }
+
+    batch.instanceCount = static_cast<uint32_t>(batch.objectData.size());
+    batch.needsUpdate = false;
 }
 
-void RenderManager::allocateInstanceBuffer(RenderBatch& batch, size_t requiredSize)
+bool RenderManager::prepareBatchFrame(RenderBatch& batch, const Camera& camera, float minExtent)
 {
-    // ҪĴһЩĻƵ·
-    size_t newCapacity = qMax(requiredSize * 2, size_t(100 * sizeof(InstanceData)));
+    batch.drawList.clear();
+    batch.frameSlot = m_objectDataBuffer->write(batch.objectData.data(), static_cast<uint32_t>(batch.objectData.size()));
+    if (batch.frameSlot == ObjectDataBuffer::INVALID_SLOT)
+        return false;
+
+    //ҪذΧаķ任緶Χ׶ֵ
+    const auto frustum = camera.getFrustum2D();
+    for (uint32_t i = 0; i < batch.objectData.size(); i++)
+    {
+        const BufferPool::FeatureRange& feature = batch.features[i];
+        if (feature.vertexCount == 0 && feature.indexCount == 0)
+            continue;
 
-    try {
-        batch.instanceBuffer = std::make_unique<VMABuffer>(
-            m_device,
-            sizeof(InstanceData),
-            newCapacity / sizeof(InstanceData),
-            VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
-            VMA_MEMORY_USAGE_CPU_TO_GPU
-        );
-        batch.bufferCapacity = newCapacity;
+        AABB box = transformBounds(feature.bounds, batch.objectData[i]);
+        if (!frustum.insersects(box))
+            continue;
+        if (minExtent > 0.f && qMax(box.maxX - box.minX, box.maxY - box.minY) < minExtent)
+            continue;
+
+        batch.drawList.push_back(i);
+    }
+    return true;
+}
 
-        qDebug() << "Allocated instance buffer with capacity:" << (newCapacity / sizeof(InstanceData));
+AABB RenderManager::transformBounds(const AABB& box, const ObjectDataBuffer::ObjectData& data)
+{
+    AABB result{ std::numeric_limits<float>::max(), std::numeric_limits<float>::max(),
+        -std::numeric_limits<float>::max(), -std::numeric_limits<float>::max() };
+    for (int corner = 0; corner < 4; corner++)
+    {
+        float x = (corner & 1) ? box.maxX : box.minX;
+        float y = (corner & 2) ? box.maxY : box.minY;
+        float px = data.linear[0] * x + data.linear[2] * y + data.translation[0];
+        float py = data.linear[1] * x + data.linear[3] * y + data.translation[1];
+        result.minX = qMin(result.minX, px);
+        result.minY = qMin(result.minY, py);
+        result.maxX = qMax(result.maxX, px);
+        result.maxY = qMax(result.maxY, py);
     }
-    catch (const std::exception& e) {
-        qDebug() << "Failed to allocate instance buffer:" << e.what();
-        batch.instanceBuffer.reset();
-        batch.bufferCapacity = 0;
+    return result;
+}
+
+bool RenderManager::hasOverriddenChunks(ModelType type) const
+{
+    for (uint32_t chunkId : m_overriddenChunks)
+    {
+        auto it = m_renderBatches.find(chunkId);
+        if (it != m_renderBatches.end() && it->second.modelType == type)
+            return true;
     }
+    return false;
 }
 
 RenderSystem* RenderManager::getRenderSystemByType(ModelType type)
@@ -2,33 +2,48 @@
 
 #include <memory>
 #include <unordered_map>
+#include <unordered_set>
 
 #include "Renderer.h"
 #include "RenderSystem.h"
+#include "BufferDefragmenter.h"
+#include "FrameAllocator.h"
+#include "GeometryRenderSystem.h"
+#include "GpuCuller.h"
+#include "LineRenderSystem.h"
+#include "ObjectDataBuffer.h"
+#include "ParallelRecorder.h"
+#include "PointRenderSystem.h"
+#include "RenderQueue.h"
+#include "ResidencyManager.h"
 #include "BufferPool.h"
 #include "Object.h"
 #include "FrameInfo.h"
+#include "MemoryReport.h"
 
 
 class RenderManager
 {
 public:
-    struct InstanceData
-    {
-        QMatrix4x4 transform;
-        QVector3D color;
-        float padding;
-    };
+    static constexpr size_t PARALLEL_RECORD_THRESHOLD = 512;   //ʱ¼
+    static constexpr size_t MIN_ITEMS_PER_RANGE = 128;         //ÿμ¼ƵĶ
 
     struct RenderBatch
     {
         uint32_t chunkId{ 0 };
         ModelType modelType{ ModelType::None };
         std::vector<Object*> objects;
-        std::unique_ptr<VMABuffer> instanceBuffer;
-        size_t bufferCapacity{ 0 };
+        std::vector<QVector3D> baseColors;                      //ǼʱɫѾдڶ
+        std::vector<BufferPool::FeatureRange> features;         // objects һһӦƫchunk
+        std::vector<ObjectDataBuffer::ObjectData> objectData;   //CPU໺棬󲻱ʱÿֱ֡ӿ󻺳
         uint32_t instanceCount{ 0 };
         bool needsUpdate{ true };
+        bool overridden{ false };                               //жĹ任ɫҪ
+        AABB bounds;                                            //任ķΧʱchunkü
+
+        //ʱ߳ã¼ֻ߳
+        uint32_t frameSlot{ ObjectDataBuffer::INVALID_SLOT };   //֡ݵĵһλ
+        std::vector<uint32_t> drawList;                         //֡ͨüĶ±
 
         uint32_t frameLastUsed{ 0 };
         uint32_t renderCallCount{ 0 };
@@ -57,33 +72,104 @@ public:
     void endSwapChainRenderPass(VkCommandBuffer commandBuffer);
 
     //=================  =========================
-    uint32_t allocateRenderBuffer(const Object::Builder& builder);
-    std::vector<uint32_t> getVisibleChunks(const Camera& camera, ModelType type) { return m_BufferPool.getVisibleChunks(camera, type); }
-
-    const BufferPool::Chunk* getChunk(uint32_t chunkId) { return m_BufferPool.getChunk(chunkId); }
-    //TODO: ɾ޸߼
-
+    uint32_t allocateRenderBuffer(const Object::Builder& builder, uint32_t* featureIndex = nullptr);
+    void flushPendingChunks() { m_BufferPool.flushPendingChunks(); }
+    void reserveRenderBuffers(ModelType type, uint64_t vertexCount, uint64_t indexCount) { m_BufferPool.reserve(type, vertexCount, indexCount); }
+    //ÿ֡ʼʱ;֡ѲõĻ
+    void collectGarbage();
+    void setChunkVertexBudget(uint32_t vertexBudget) { m_BufferPool.setChunkVertexBudget(vertexBudget); }
+    //ÿ֡ϴļֽ0 ʾ
+    void setUploadBudget(VkDeviceSize bytes) { m_BufferPool.setUploadBudget(bytes); }
+    void setVertexWeldTolerance(float tolerance) { m_BufferPool.setVertexWeldTolerance(tolerance); }
+    std::vector<uint32_t> getVisibleChunks(const Camera& camera, ModelType type) { return m_BufferPool.getVisibleChunks(camera, type, minWorldExtent(camera)); }
+
+    bool getChunk(uint32_t chunkId, BufferPool::Chunk& chunk) { return m_BufferPool.getChunk(chunkId, chunk); }
+    bool freeRenderBuffer(uint32_t chunkId);
+    bool reallocateRenderBuffer(uint32_t chunkId, const std::vector<Model::Vertex>& vertices,
+        const std::vector<uint32_t>& indices, const std::vector<BufferPool::FeatureRange>& features);
+    BufferPool& getBufferPool() { return m_BufferPool; }
+    //̨Ƭÿ֡ collectGarbage ƽһ
+    BufferDefragmenter& getDefragmenter() { return *m_defragmenter; }
+    //ԴԤڲɼchunk
+    ResidencyManager& getResidencyManager() { return *m_residencyManager; }
+    //ǰ֡ʱݣʵλƳ֡Χźź
+    FrameAllocator& getFrameAllocator() { return *m_frameAllocator; }
+    //ı任ɫɫʵ±ȡ
+    ObjectDataBuffer& getObjectDataBuffer() { return *m_objectDataBuffer; }
+    //Ѽγءݴ滷֡ʵݺͷͼռд뱨
+    void collectMemoryStats(MemoryReport& report) const;
+
+
+    //=================  =========================
+    //ǼchunkеĶ󣬱任ɫıchunkΪ
+    void addChunkObject(Object* object);
+    //ı任ɫ仯ãһʱؽchunkĶ
+    void markObjectChanged(Object* object);
+    //ɾǰãchunkֻʣʱͷchunkʣµҪؽchunk
+    bool removeChunkObject(Object* object);
 
    //=================Ⱦ ߼ =========================
-    void renderObjects(const std::vector<Object*>& objects, FrameInfo& frameInfo);
+    //GPUüȾͨʼ֮ǰ¼Ƽɷɱ֡ļӻ
+    void cullChunks(FrameInfo& frameInfo);
+    //һͱ֡ҪݼУѾGPUüʱֻһӻƣCPUüchunk
+    void enqueueVisibleChunks(ModelType type, const Camera& camera, RenderQueue& queue);
+    //chunkƣÿchunkҪأֻһλƣжĹ任ɫchunk
+    void enqueueChunks(const std::vector<uint32_t>& chunkIds, const Camera& camera, RenderQueue& queue);
+    //źĶ¼ƣֻ֮仯˵İ
+    void renderQueue(const RenderQueue& queue, FrameInfo& frameInfo);
+    //Ⱦͨʼ֮ǰã㹻ʱ֡Ϊ߳¼ƴμ
+    void planRecording(const RenderQueue& queue);
+    //ƶк͵ͼ㣻߳¼ʱִֻͨкϲĴμ
+    void renderScene(const RenderQueue& queue, PointLayer& pointLayer, FrameInfo& frameInfo);
+    void setParallelRecordingEnabled(bool enabled) { m_parallelRecordingEnabled = enabled; }
+    //Ⱦͨ⿪ĹͳƲѯͳμ̳豸ּ֧̳вѯʱ¼μ
+    void setPipelineStatistics(VkQueryPipelineStatisticFlags statistics) { m_pipelineStatistics = statistics; }
+    //ͼƬ尴ݰ汾棬ƶʱֱط
+    void setTileCachingEnabled(bool enabled) { m_tileCachingEnabled = enabled; }
+    void setGpuCullingEnabled(bool enabled) { m_gpuCullingEnabled = enabled; }
+    //ͶӰ߶СڸchunkƣƵchunkٰҪزԣ0 ʾر
+    void setMinScreenSize(float pixels) { m_minScreenSize = qMax(pixels, 0.f); }
 
     Renderer& getRenderer() { return m_renderer; }
     RenderSystem* getRenderSystemByType(ModelType type);
-private:
-    //Object chunk
-    void devideObjectByChunks(std::unordered_map<uint32_t, std::vector<Object*>>& objectsByChunk, const std::vector<Object*>& objects);
-    //ChunkȾ
-    void renderObjectsByChunk(const std::unordered_map<uint32_t, std::vector<Object*>>& objectsByChunk, FrameInfo& frameInfo);
-    //ȾChunkBatch
-    void renderChunkBatch(uint32_t chunkId, const std::vector<Object*>& objects, FrameInfo& frameInfo);
-
-    RenderBatch& getOrCreateBatch(uint32_t chunkId);
 
-    void updateInstanceBuffer(RenderBatch& batch, const std::vector<Object*>& objects);
+    ///ߣرʱ˻ LINE_LIST 1
+    void setWideLinesEnabled(bool enabled) { m_wideLinesEnabled = enabled; }
+    void setLineStyle(const LineRenderSystem::LineStyle& style) { m_wideLineRenderSystem->setLineStyle(style); }
 
-    bool needInstanceBufferUpdate(const RenderBatch& batch, const std::vector<Object*>& objects);
-
-    void allocateInstanceBuffer(RenderBatch& batch, size_t requiredSize);
+    //Ⱦͨʼ֮ǰãϴĵͷ
+    void uploadPointLayer(PointLayer& pointLayer, FrameInfo& frameInfo);
+    //ͼ㰴ƬʵƣĵѾϴ
+    void renderPointLayer(PointLayer& pointLayer, FrameInfo& frameInfo);
+    SymbolAtlas& getSymbolAtlas() { return m_pointSymbolRenderSystem->getSymbolAtlas(); }
+private:
+    //λб仯ʱ¶ȡرܷ֡߶ȡ
+    bool prepareVertexPulling();
+    //¼ƶ [begin, end) һΣ¼߳ϵ
+    void recordQueueRange(const RenderQueue& queue, size_t begin, size_t end,
+        VkCommandBuffer commandBuffer, VkDescriptorSet globalDescriptorSet);
+    //ͬһڵchunkдɵǰ֡ļĸύһ
+    void drawChunksIndirect(VkCommandBuffer commandBuffer, const std::vector<BufferPool::Chunk>& chunks);
+    void submitIndirect(VkCommandBuffer commandBuffer, const FrameAllocator::Allocation& allocation,
+        uint32_t drawCount, uint32_t stride, bool indexed);
+    //ƵchunkÿԼҪ䣬firstInstance ָĲλ
+    void drawChunkObjects(VkCommandBuffer commandBuffer, const BufferPool::Chunk& chunk, const RenderBatch& batch);
+
+    RenderBatch& getOrCreateBatch(uint32_t chunkId, ModelType type = ModelType::None);
+    //Ѵҹ߱
+    bool wideLinesActive() const { return m_wideLinesEnabled && m_wideLineRenderSystem->isReady(); }
+    //ǰ m_minScreenSize ضӦߴ
+    float minWorldExtent(const Camera& camera) const;
+
+    //ؽб仯chunkĶݣ¼֮ǰ߳ϵ
+    void updateDirtyBatches();
+    void rebuildBatch(RenderBatch& batch);
+    //д뱾֡Ķݲü󻺳дʱ false֡
+    bool prepareBatchFrame(RenderBatch& batch, const Camera& camera, float minExtent);
+    //ҪذΧо任緶Χ
+    static AABB transformBounds(const AABB& box, const ObjectDataBuffer::ObjectData& data);
+    //ǷchunkҪ
+    bool hasOverriddenChunks(ModelType type) const;
 private:
     Device& m_device;
 
@@ -92,10 +178,31 @@ private:
     std::unique_ptr<RenderSystem>                   m_pointRenderSystem;
     std::unique_ptr<RenderSystem>                   m_lineRenderSystem;
     std::unique_ptr<RenderSystem>                   m_polygonRenderSystem;
+    std::unique_ptr<LineRenderSystem>               m_wideLineRenderSystem;
+    std::unique_ptr<GeometryRenderSystem>           m_geometryRenderSystem;     //豸֧ʱΪ
+    bool                                            m_wideLinesEnabled{ true };
+    std::unique_ptr<PointRenderSystem>              m_pointSymbolRenderSystem;
 
 
     BufferPool                                      m_BufferPool;
+    std::unique_ptr<BufferDefragmenter>             m_defragmenter;
+    std::unique_ptr<ResidencyManager>               m_residencyManager;
+    std::unique_ptr<GpuCuller>                      m_gpuCuller;                //üγغͶȡ֮
+    bool                                            m_gpuCullingEnabled{ true };
+    bool                                            m_gpuCulled{ false };       //֡Ƿɷü
+    float                                           m_minScreenSize{ 1.f };     //
+    std::unique_ptr<ParallelRecorder>               m_parallelRecorder;
+    bool                                            m_parallelRecordingEnabled{ true };
+    bool                                            m_recordSecondary{ false }; //֡ͨǷִֻдμ
+    bool                                            m_recordParallel{ false };  //֡Ƿֶ߳¼
+    bool                                            m_tileCachingEnabled{ true };
+    VkQueryPipelineStatisticFlags                   m_pipelineStatistics{ 0 };  //ͨ⿪ͳƲѯ
+    std::unique_ptr<FrameAllocator>                 m_frameAllocator;
+    std::unique_ptr<ObjectDataBuffer>               m_objectDataBuffer;         //ÿ֡һ飬ʵ±
     std::unordered_map<uint32_t, RenderBatch>       m_renderBatches;
+    std::vector<uint32_t>                           m_dirtyBatches;             //б仯ȴؽchunk
+    std::unordered_set<uint32_t>                    m_overriddenChunks;         //ҪƵchunk
+    std::unordered_map<uint32_t, std::vector<BufferPool::IndexRun>> m_featureRuns; //֡Ҫ޳ʣµ
 
     RenderBatch& getBatch(Model* model);
     void updateBatch(RenderBatch& batch, const std::vector<Object*>& objects);
@@ -0,0 +1,47 @@
+#include "RenderQueue.h"
+
+#include <algorithm>
+
+uint64_t RenderQueue::makeKey(ModelType type, PipelineId pipeline, uint32_t segment, uint32_t descriptor, uint32_t chunkId)
+{
+    return (static_cast<uint64_t>(layerOf(type) & 0xF) << 60) |
+        (static_cast<uint64_t>(static_cast<uint8_t>(pipeline) & 0xF) << 56) |
+        (static_cast<uint64_t>(segment & 0xFFFF) << 40) |
+        (static_cast<uint64_t>(descriptor & 0xFF) << 32) |
+        chunkId;
+}
+
+ModelType RenderQueue::typeOf(uint64_t key)
+{
+    switch (key >> 60)
+    {
+    case 0:
+        return ModelType::Polygon;
+    case 1:
+        return ModelType::Line;
+    case 2:
+        return ModelType::Point;
+    default:
+        return ModelType::None;
+    }
+}
+
+void RenderQueue::sort()
+{
+    std::sort(m_keys.begin(), m_keys.end());
+}
+
+uint32_t RenderQueue::layerOf(ModelType type)
+{
+    switch (type)
+    {
+    case ModelType::Polygon:
+        return 0;
+    case ModelType::Line:
+        return 1;
+    case ModelType::Point:
+        return 2;
+    default:
+        return 3;
+    }
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "Model.h"
+
+//每帧收集一次绘制项，按64位键排序后顺序录制。键从高到低依次是
+//图层(4) | 管线(4) | 段(16) | 描述符(8) | chunk id(32)，
+//相邻两项只有变化的部分需要重新绑定，图层在最高位保证面、线、点的叠放顺序
+class RenderQueue
+{
+public:
+    //同一图层内的绘制路径，与图层一起确定实际使用的管线
+    enum class PipelineId : uint8_t
+    {
+        GpuCulled = 0,      //GPU裁剪后的间接绘制，一个图层只有一项
+        Pulled,             //顶点拉取，段之间不需要重新绑定
+        Bound,              //逐段绑定顶点/索引缓冲
+        Instanced,          //逐段绑定，按对象槽位逐要素绘制
+        WideLine            //线段实例化的宽线
+    };
+
+    static uint64_t makeKey(ModelType type, PipelineId pipeline, uint32_t segment, uint32_t descriptor, uint32_t chunkId);
+
+    static ModelType typeOf(uint64_t key);
+    static PipelineId pipelineOf(uint64_t key) { return static_cast<PipelineId>((key >> 56) & 0xF); }
+    static uint32_t segmentOf(uint64_t key) { return static_cast<uint32_t>((key >> 40) & 0xFFFF); }
+    static uint32_t chunkOf(uint64_t key) { return static_cast<uint32_t>(key & 0xFFFFFFFF); }
+    //去掉chunk id后的绑定状态，相同时只需发出绘制
+    static uint64_t stateOf(uint64_t key) { return key >> 32; }
+    //图层和管线，相同时不需要重新绑定管线
+    static uint64_t pipelineStateOf(uint64_t key) { return key >> 56; }
+
+    void clear() { m_keys.clear(); }
+    void reserve(size_t count) { m_keys.reserve(count); }
+    void push(uint64_t key) { m_keys.push_back(key); }
+    void sort();
+
+    bool empty() const { return m_keys.empty(); }
+    size_t size() const { return m_keys.size(); }
+    const std::vector<uint64_t>& getKeys() const { return m_keys; }
+
+private:
+    //面在下、线在中间、点在最上
+    static uint32_t layerOf(ModelType type);
+
+private:
+    std::vector<uint64_t>   m_keys;
+};
@@ -9,11 +9,12 @@
 RenderSystem::RenderSystem(Device& device,
     VkRenderPass renderPass,
     VkDescriptorSetLayout globalSetLayout,
+    VkDescriptorSetLayout objectSetLayout,
     VkPrimitiveTopology topology /*= VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST*/)
     :m_device(device),
     m_topology(topology)
 {
-    createPipelineLayout(globalSetLayout);
+    createPipelineLayout(globalSetLayout, objectSetLayout);
     createPipeline(renderPass, topology);
 }
 
@@ -22,21 +23,17 @@ RenderSystem::~RenderSystem()
     vkDestroyPipelineLayout(m_device.device(), m_pipelineLayout, nullptr);
 }
 
-void RenderSystem::createPipelineLayout(VkDescriptorSetLayout globalSetLayout)
+void RenderSystem::createPipelineLayout(VkDescriptorSetLayout globalSetLayout, VkDescriptorSetLayout objectSetLayout)
 {
-    VkPushConstantRange pushConstantRange{};
-    pushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
-    pushConstantRange.offset = 0;
-    pushConstantRange.size = sizeof(SimplePushConstantData);
-
-    std::vector<VkDescriptorSetLayout> descriptorSetLayout{ globalSetLayout };
+    //逐对象的变换和颜色放在 set 1 的存储缓冲里，不再用推送常量
+    std::vector<VkDescriptorSetLayout> descriptorSetLayout{ globalSetLayout, objectSetLayout };
 
     VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
     pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
     pipelineLayoutInfo.setLayoutCount = static_cast<uint32_t>(descriptorSetLayout.size());
     pipelineLayoutInfo.pSetLayouts = descriptorSetLayout.data();
-    pipelineLayoutInfo.pushConstantRangeCount = 1;
-    pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+    pipelineLayoutInfo.pushConstantRangeCount = 0;
+    pipelineLayoutInfo.pPushConstantRanges = nullptr;
     if (vkCreatePipelineLayout(m_device.device(), &pipelineLayoutInfo,
         nullptr, &m_pipelineLayout) != VK_SUCCESS)
     {
@@ -18,6 +18,7 @@ public:
     RenderSystem(Device& device,
         VkRenderPass renderPass,
         VkDescriptorSetLayout globalSetLayout,
+        VkDescriptorSetLayout objectSetLayout,
         VkPrimitiveTopology topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST);
     ~RenderSystem();
 
@@ -37,7 +38,7 @@ public:
     VkPipelineLayout getPipelineLayout() { return m_pipelineLayout; }
 
 private:
-    void createPipelineLayout(VkDescriptorSetLayout globalSetLayout);
+    void createPipelineLayout(VkDescriptorSetLayout globalSetLayout, VkDescriptorSetLayout objectSetLayout);
     void createPipeline(VkRenderPass renderPass, VkPrimitiveTopology topology);
 
 
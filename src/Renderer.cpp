@@ -78,7 +78,7 @@ void Renderer::endFrame()
     m_currentFrameIndex = (m_currentFrameIndex + 1) % Renderer::MAX_FRAMES_IN_FLIGHT;
 }
 
-void Renderer::beginSwapChainRenderPass(VkCommandBuffer commandBuffer)
+void Renderer::beginSwapChainRenderPass(VkCommandBuffer commandBuffer, VkSubpassContents contents)
 {
     assert(m_isFrameStarted && "Cannot call beginSwapChainRendererPass if frame is not in progress");
     assert(
@@ -101,8 +101,14 @@ void Renderer::beginSwapChainRenderPass(VkCommandBuffer commandBuffer)
     renderPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
     renderPassInfo.pClearValues = clearValues.data();
 
-    vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+    vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, contents);
 
+    if (contents == VK_SUBPASS_CONTENTS_INLINE)
+        setViewportAndScissor(commandBuffer);
+}
+
+void Renderer::setViewportAndScissor(VkCommandBuffer commandBuffer)
+{
     VkViewport viewport{};
     viewport.x = 0.0f;
     viewport.y = 0.0f;
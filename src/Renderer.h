@@ -34,10 +34,11 @@ public:
     Renderer& operator=(Renderer&&) = delete;
 
     VkRenderPass getSwapChainRenderPass() const { return m_swapChain->getRenderPass(); }
-    VkFramebuffer getSwapChainFrameBuffer() const { return m_swapChain->getFrameBuffer(m_currentFrameIndex); }
+    VkFramebuffer getSwapChainFrameBuffer() const { return m_swapChain->getFrameBuffer(m_currentImageIndex); }
     bool isFrameInProgress() const { return m_isFrameStarted; }
 
     float  getAspectRatio() const { return m_swapChain->extentAspectRatio(); }
+    VkExtent2D getSwapChainExtent() const { return m_swapChain->getSwapChainExtent(); }
 
     VkCommandBuffer getCurrentCommandBuffer() const {
         assert(isFrameInProgress() && "Cannot get command buffer when frame not in progress");
@@ -52,8 +53,10 @@ public:
 
     VkCommandBuffer beginFrame();
     void endFrame();
-    void beginSwapChainRenderPass(VkCommandBuffer commandBuffer);
+    //contents 为 SECONDARY_COMMAND_BUFFERS 时主命令缓冲在通道内只能执行次级命令缓冲，视口由次级命令缓冲自己设置
+    void beginSwapChainRenderPass(VkCommandBuffer commandBuffer, VkSubpassContents contents = VK_SUBPASS_CONTENTS_INLINE);
     void endSwapChainRenderPass(VkCommandBuffer commandBuffer);
+    void setViewportAndScissor(VkCommandBuffer commandBuffer);
 
 private:
     void createCommandBuffers();
@@ -0,0 +1,180 @@
+#include "ResidencyManager.h"
+
+#include <algorithm>
+
+ResidencyManager::ResidencyManager(Device& device, BufferPool& bufferPool) :
+    m_device(device),
+    m_bufferPool(bufferPool)
+{
+    //换出前必须有CPU副本，要在加载数据之前打开
+    m_bufferPool.setRetainCpuCopies(true);
+    m_bufferPool.setMemoryPressureHandler([this](ModelType type, VkDeviceSize requestedBytes) {
+        return onMemoryPressure(type, requestedBytes);
+        });
+    m_stats.driverBudget = m_device.memoryBudgetEnabled();
+}
+
+ResidencyManager::~ResidencyManager()
+{
+    m_bufferPool.setMemoryPressureHandler(nullptr);
+}
+
+void ResidencyManager::update()
+{
+    //先把重新进入视野的chunk传回来，按字节预算分摊到多帧，没轮到的下一帧还会再登记
+    auto requests = m_bufferPool.takeRestreamRequests();
+    if (!requests.empty())
+    {
+        std::vector<uint32_t> batch;
+        VkDeviceSize batchBytes = 0;
+        for (uint32_t chunkId : requests)
+        {
+            BufferPool::Chunk chunk;
+            if (!m_bufferPool.getChunk(chunkId, chunk))
+                continue;
+
+            VkDeviceSize bytes = chunkBytes(chunk);
+            if (!batch.empty() && batchBytes + bytes > m_restreamBudget)
+                break;
+
+            batch.push_back(chunkId);
+            batchBytes += bytes;
+        }
+
+        m_stats.totalRestreams += m_bufferPool.restoreChunks(batch);
+    }
+
+    std::lock_guard<std::mutex> lock(m_bufferPool.m_mutex);
+    refreshStatsLocked();
+
+    VkDeviceSize available = availableForPool();
+    if (m_stats.poolAllocated <= static_cast<VkDeviceSize>(available * HIGH_WATERMARK))
+        return;
+
+    //区间腾出来后由碎片整理把稀疏段搬空释放，显存才真正归还
+    VkDeviceSize target = static_cast<VkDeviceSize>(available * LOW_WATERMARK);
+    if (m_stats.poolUsed > target)
+    {
+        VkDeviceSize freed = evictLeastRecentlyUsed(ModelType::None, m_stats.poolUsed - target);
+        if (freed > 0)
+        {
+            qDebug() << "residency: evicted" << freed << "bytes, pool" << m_stats.poolAllocated
+                << "of" << available << "bytes available";
+        }
+    }
+}
+
+void ResidencyManager::refreshStatsLocked()
+{
+    VmaAllocator allocator = m_device.allocator();
+
+    const VkPhysicalDeviceMemoryProperties* memoryProperties = nullptr;
+    vmaGetMemoryProperties(allocator, &memoryProperties);
+
+    VmaBudget budgets[VK_MAX_MEMORY_HEAPS] = {};
+    vmaGetHeapBudgets(allocator, budgets);
+
+    m_stats.budget = 0;
+    m_stats.usage = 0;
+    for (uint32_t heap = 0; heap < memoryProperties->memoryHeapCount; heap++)
+    {
+        if ((memoryProperties->memoryHeaps[heap].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) == 0)
+            continue;
+
+        m_stats.budget += budgets[heap].budget;
+        m_stats.usage += budgets[heap].usage;
+    }
+
+    m_stats.poolAllocated = 0;
+    m_stats.poolUsed = 0;
+    for (const auto& [type, segments] : m_bufferPool.m_bufferPools)
+    {
+        for (const auto& segment : segments)
+        {
+            if (!segment.isActive)
+                continue;
+
+            m_stats.poolAllocated += static_cast<VkDeviceSize>(segment.vertexCapacity) * sizeof(Model::Vertex) +
+                static_cast<VkDeviceSize>(segment.indexCapacity) * sizeof(uint32_t);
+            m_stats.poolUsed += static_cast<VkDeviceSize>(segment.vertexAllocator.getUsed()) * sizeof(Model::Vertex) +
+                static_cast<VkDeviceSize>(segment.indexAllocator.getUsed()) * sizeof(uint32_t);
+        }
+    }
+
+    m_stats.evictedChunks = 0;
+    for (const auto& [type, evicted] : m_bufferPool.m_evictedChunks)
+    {
+        m_stats.evictedChunks += static_cast<uint32_t>(evicted.size());
+    }
+    m_stats.residentChunks = m_bufferPool.m_chunks.size() - m_stats.evictedChunks;
+}
+
+VkDeviceSize ResidencyManager::availableForPool() const
+{
+    VkDeviceSize budget = m_budgetOverride > 0 ? m_budgetOverride : m_stats.budget;
+
+    //池以外的用量（交换链、纹理、点图层等）不受管理，只能从预算里扣掉
+    VkDeviceSize otherUsage = m_stats.usage > m_stats.poolAllocated ? m_stats.usage - m_stats.poolAllocated : 0;
+    if (m_budgetOverride > 0)
+        otherUsage = 0;
+
+    return budget > otherUsage ? budget - otherUsage : 0;
+}
+
+VkDeviceSize ResidencyManager::evictLeastRecentlyUsed(ModelType type, VkDeviceSize bytesToFree)
+{
+    uint64_t frame = m_bufferPool.m_frameCounter;
+
+    const ChunkTable& chunks = m_bufferPool.m_chunks;
+    const auto& loaded = chunks.loaded();
+    const auto& types = chunks.types();
+    const auto& lastVisibleFrames = chunks.lastVisibleFrames();
+
+    std::vector<std::pair<uint64_t, uint32_t>> candidates;
+    for (uint32_t chunkId = 1; chunkId < chunks.slotCount(); chunkId++)
+    {
+        if (!loaded[chunkId] || frame - lastVisibleFrames[chunkId] < MIN_IDLE_FRAMES)
+            continue;
+        if (type != ModelType::None && types[chunkId] != type)
+            continue;
+
+        candidates.push_back({ lastVisibleFrames[chunkId], chunkId });
+    }
+    std::sort(candidates.begin(), candidates.end());
+
+    VkDeviceSize freed = 0;
+    for (const auto& [lastVisibleFrame, chunkId] : candidates)
+    {
+        if (freed >= bytesToFree)
+            break;
+
+        VkDeviceSize bytes = chunkBytes(chunks.get(chunkId));
+        if (m_bufferPool.evictChunkLocked(chunkId))
+        {
+            freed += bytes;
+            m_stats.totalEvictions++;
+        }
+    }
+
+    return freed;
+}
+
+bool ResidencyManager::onMemoryPressure(ModelType type, VkDeviceSize requestedBytes)
+{
+    refreshStatsLocked();
+
+    //扩容后仍在高水位以下就直接扩容
+    VkDeviceSize available = availableForPool();
+    if (m_stats.poolAllocated + requestedBytes <= static_cast<VkDeviceSize>(available * HIGH_WATERMARK))
+        return false;
+
+    //只换出同类型的chunk，腾出的区间才能给这次请求用；多腾一些减少碎片导致的失败
+    VkDeviceSize freed = evictLeastRecentlyUsed(type, requestedBytes * 2);
+    return freed >= requestedBytes;
+}
+
+VkDeviceSize ResidencyManager::chunkBytes(const BufferPool::Chunk& chunk)
+{
+    return static_cast<VkDeviceSize>(chunk.vertexCount) * sizeof(Model::Vertex) +
+        static_cast<VkDeviceSize>(chunk.indexCount) * sizeof(uint32_t);
+}
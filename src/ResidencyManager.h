@@ -0,0 +1,63 @@
+#pragma once
+
+#include "BufferPool.h"
+#include "Device.h"
+
+//显存驻留管理：按VMA报告的堆预算换出最久未可见的chunk，重新进入视野时再上传，
+//使显存中的工作集只取决于视野而不是整个数据集
+class ResidencyManager
+{
+public:
+    static constexpr float HIGH_WATERMARK = 0.9f;       //池占用超过可用预算的这个比例开始换出
+    static constexpr float LOW_WATERMARK = 0.75f;       //换出到已用区间低于这个比例为止
+    static constexpr uint64_t MIN_IDLE_FRAMES = 120;    //最近这么多帧内可见过的chunk不换出
+    static constexpr VkDeviceSize DEFAULT_RESTREAM_BUDGET = 8 * 1024 * 1024;   //每帧最多重新上传的字节数
+
+    struct Stats
+    {
+        VkDeviceSize budget{ 0 };           //设备本地堆的预算总和
+        VkDeviceSize usage{ 0 };            //设备本地堆的当前用量
+        VkDeviceSize poolAllocated{ 0 };    //池里所有段缓冲的大小
+        VkDeviceSize poolUsed{ 0 };         //段内已分配区间的大小
+        uint32_t residentChunks{ 0 };
+        uint32_t evictedChunks{ 0 };
+        uint64_t totalEvictions{ 0 };
+        uint64_t totalRestreams{ 0 };
+        bool driverBudget{ false };         //预算来自 VK_EXT_memory_budget 而不是估算
+    };
+
+    ResidencyManager(Device& device, BufferPool& bufferPool);
+    ~ResidencyManager();
+
+    ResidencyManager(const ResidencyManager&) = delete;
+    ResidencyManager& operator=(const ResidencyManager&) = delete;
+
+    //每帧调用一次：上传重新可见的chunk，超过高水位时换出最久未可见的chunk
+    void update();
+
+    //非0时用它代替驱动报告的预算，便于在大显存机器上验证换出
+    void setBudgetOverride(VkDeviceSize bytes) { m_budgetOverride = bytes; }
+    void setRestreamBudget(VkDeviceSize bytes) { m_restreamBudget = bytes; }
+
+    const Stats& getStats() const { return m_stats; }
+
+private:
+    //刷新预算和池的占用，需持有池的锁
+    void refreshStatsLocked();
+    //池可以使用的显存：预算减去池以外的用量
+    VkDeviceSize availableForPool() const;
+    //按LRU换出，直到释放 bytesToFree 字节；type 为 None 时不限类型。需持有池的锁
+    VkDeviceSize evictLeastRecentlyUsed(ModelType type, VkDeviceSize bytesToFree);
+    //段扩容前由池回调，持有池的锁
+    bool onMemoryPressure(ModelType type, VkDeviceSize requestedBytes);
+
+    static VkDeviceSize chunkBytes(const BufferPool::Chunk& chunk);
+
+private:
+    Device& m_device;
+    BufferPool& m_bufferPool;
+
+    Stats           m_stats;
+    VkDeviceSize    m_budgetOverride{ 0 };
+    VkDeviceSize    m_restreamBudget{ DEFAULT_RESTREAM_BUDGET };
+};
@@ -1,11 +1,18 @@
 #include "SceneManager.h"
 
+#include <limits>
+#include <unordered_map>
+
+#include "HilbertCurve.h"
+
 SceneManager::SceneManager(MyVulkanWindow& window,
     Device& device,
     VkDescriptorSetLayout globalSetLayout,
     const AABB& worldBounds) :
+    m_device(device),
     m_objectManager(device, worldBounds),
-    m_renderManager(window, device, globalSetLayout)
+    m_renderManager(window, device, globalSetLayout),
+    m_pointLayer(device, worldBounds)
 {
     m_objectManager.setObjectUpdateCallback(
         std::bind(&SceneManager::onObjectChanged,
@@ -17,51 +24,134 @@ SceneManager::SceneManager(MyVulkanWindow& window,
 Object::ObjectID SceneManager::addObject(const Object::Builder& builder)
 {
 
-    // renderManager Ϊ Object 仺
-    uint32_t chunkId = m_renderManager.allocateRenderBuffer(builder);
+    // renderManager Ϊ Object 仺壬Ҫػᱻϲͬ͵chunk
+    uint32_t featureIndex = 0;
+    uint32_t chunkId = m_renderManager.allocateRenderBuffer(builder, &featureIndex);
 
     // ȻObjectManager Object ʵҽй 
     Object::ObjectID objectId = m_objectManager.createObject(builder, chunkId);
     //TODO: ߼ ҲֱӷcreateObjectо
-    m_objectManager.updateObject(objectId, [&builder](Object& object)
+    m_objectManager.updateObject(objectId, [&builder, chunkId, featureIndex](Object& object)
         {
             object.setColor(builder.color);
             object.setTransform(builder.transform);
+            object.setChunkId(chunkId);
+            object.setFeatureIndex(featureIndex);
         });
+    m_renderManager.addChunkObject(m_objectManager.getObject(objectId));
 
     return objectId;
 }
 
-void SceneManager::render(FrameInfo& frameInfo)
+std::vector<Object::ObjectID> SceneManager::addObjects(std::vector<Object::Builder>&& builders)
 {
-    std::vector<Object*> objectsToRender;
-    auto chunks = m_renderManager.getVisibleChunks(frameInfo.camera, ModelType::Line);
+    std::vector<Object::ObjectID> objectIds;
+    if (builders.empty())
+        return objectIds;
 
-    for (auto chunkId : chunks)
+    AABB bounds{ std::numeric_limits<float>::infinity(), std::numeric_limits<float>::infinity(),
+        -std::numeric_limits<float>::infinity(), -std::numeric_limits<float>::infinity() };
+    for (const auto& builder : builders)
     {
+        bounds.minX = qMin(bounds.minX, builder.bounds.minX);
+        bounds.minY = qMin(bounds.minY, builder.bounds.minY);
+        bounds.maxX = qMax(bounds.maxX, builder.bounds.maxX);
+        bounds.maxY = qMax(bounds.maxY, builder.bounds.maxY);
+    }
+
+    HilbertCurve::sortBuilders(builders, bounds);
 
-        const BufferPool::Chunk* chunk = m_renderManager.getChunk(chunkId);
-        std::vector<Object*> chunkObjects = m_objectManager.getVisibleObjects(chunk->bounds);
-
-        for (Object* obj : chunkObjects) {
-            if (obj &&
-                obj->getChunkID() == chunkId &&
-                obj->getModel()->type() == ModelType::Line)
-            {
-                objectsToRender.push_back(obj);
-            }
-        }
-
-        if (!objectsToRender.empty()) {
-            // 3.1 RenderManagerȾ
-            m_renderManager.renderObjects(objectsToRender, frameInfo);
-        }
+    //һ԰ѶλҪش
+    std::unordered_map<ModelType, std::pair<uint64_t, uint64_t>> totals;
+    for (const auto& builder : builders)
+    {
+        auto& total = totals[builder.type];
+        total.first += builder.vertices.size();
+        total.second += builder.indices.size();
+    }
+    for (const auto& [type, total] : totals)
+    {
+        m_renderManager.reserveRenderBuffers(type, total.first, total.second);
     }
+
+    objectIds.reserve(builders.size());
+    for (const auto& builder : builders)
+    {
+        objectIds.push_back(addObject(builder));
+    }
+    m_renderManager.flushPendingChunks();
+
+    builders.clear();
+    return objectIds;
 }
 
-void SceneManager::onObjectChanged(Object* object)
+void SceneManager::prepareFrame(FrameInfo& frameInfo)
+{
+    //;֡õ䣻õδchunkϴ addObjects ĩβ
+    m_renderManager.collectGarbage();
+
+    m_renderManager.cullChunks(frameInfo);
+    //¼Ⱦͨڣͷͼϴ
+    m_renderManager.uploadPointLayer(m_pointLayer, frameInfo);
+
+    //һֻ֡ռһΣλͼ㣬¡м䡢
+    m_renderQueue.clear();
+    for (ModelType type : { ModelType::Polygon, ModelType::Line })
+        m_renderManager.enqueueVisibleChunks(type, frameInfo.camera, m_renderQueue);
+
+    m_renderQueue.sort();
+    m_renderManager.planRecording(m_renderQueue);
+}
+
+void SceneManager::render(FrameInfo& frameInfo)
+{
+    m_renderManager.renderScene(m_renderQueue, m_pointLayer, frameInfo);
+}
+
+MemoryReport SceneManager::collectMemoryReport(bool detailed)
+{
+    MemoryReport report;
+    m_renderManager.collectMemoryStats(report);
+
+    uint32_t tileBufferCount = 0;
+    VkDeviceSize pointGpuBytes = m_pointLayer.getGpuBytes(&tileBufferCount);
+    report.addSubsystem("pointLayer", pointGpuBytes, m_pointLayer.getCpuBytes(), tileBufferCount);
+    report.addSubsystem("objects", 0, m_objectManager.getCpuBytes());
+
+    //ҪزγأҲÿҪصĿ
+    report.setFeatureCount(report.getFeatureCount() + m_pointLayer.getPointCount());
+    report.collectHeaps(m_device, detailed);
+    return report;
+}
+
+bool SceneManager::dumpMemoryReport(const QString& path, bool detailed)
 {
+    MemoryReport report = collectMemoryReport(detailed);
+    report.print();
+    return report.writeJson(path);
+}
 
+void SceneManager::updateObject(Object::ObjectID id, const UpdateFunc& updateFunc)
+{
+    m_objectManager.updateObject(id, updateFunc);
+    //setTransform صͳһһ
+    m_renderManager.markObjectChanged(m_objectManager.getObject(id));
+}
+
+void SceneManager::removeObject(Object::ObjectID id)
+{
+    Object* object = m_objectManager.getObject(id);
+    if (!object)
+        return;
+
+    //ȸchunkObjectManager ɾָʧЧ
+    m_renderManager.removeChunkObject(object);
+    m_objectManager.removeObject(id);
+}
+
+void SceneManager::onObjectChanged(Object* object)
+{
+    m_renderManager.markObjectChanged(object);
 }
 
 
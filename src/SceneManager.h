@@ -3,6 +3,8 @@
 #include "ObjectManager.h"
 #include "RenderManager.h"
 #include "FrameInfo.h"
+#include "PointLayer.h"
+#include "MemoryReport.h"
 
 class SceneManager
 {
@@ -12,21 +14,36 @@ public:
 
     /**/
     Object::ObjectID addObject(const Object::Builder& builder);
-    //TODO: ºɾӿ
-    //void removeObject(Object::ObjectID id);
-    //void updateObject(Object::ObjectID id,const UpdateFunc& updateFunc);
-
+    //룺ȰΧĵϣؼֵη仺壬ʹҪڵĻ
+    std::vector<Object::ObjectID> addObjects(std::vector<Object::Builder>&& builders);
+    //ҪزObjectֱдͼ
+    void addPoint(const PointLayer::PointInstance& point) { m_pointLayer.addPoint(point); }
+    //޸Ķı任ɫchunkһ֡Ϊ
+    void updateObject(Object::ObjectID id, const UpdateFunc& updateFunc);
+    //ɾ󣬲Ҫشchunkȥ
+    void removeObject(Object::ObjectID id);
+
+    //Ⱦͨʼ֮ǰãաϴΣ¼GPUüռ֡Ļƶ
+    void prepareFrame(FrameInfo& frameInfo);
     void render(FrameInfo& frameInfo);
 
     ObjectManager& getOBjectManager() { return m_objectManager; }
     RenderManager& getRenderManager() { return m_renderManager; }
+    PointLayer& getPointLayer() { return m_pointLayer; }
+
+    //ܸϵͳͺԴѵռãdetailed ʱVMAͳ
+    MemoryReport collectMemoryReport(bool detailed = false);
+    bool dumpMemoryReport(const QString& path, bool detailed = true);
 
 
 private:
     void onObjectChanged(Object* object);
 
 private:
+    Device& m_device;
     ObjectManager m_objectManager;
     RenderManager m_renderManager;
+    PointLayer m_pointLayer;
+    RenderQueue m_renderQueue;      //ÿ֡ã
 };
 
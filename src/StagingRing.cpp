@@ -0,0 +1,429 @@
+#include "StagingRing.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+StagingRing::StagingRing(Device& device, VkDeviceSize capacity) :
+    m_device(device),
+    m_capacity(capacity)
+{
+    //按字节分配，常驻映射，整个生命周期内不再 map/unmap
+    m_buffer = std::make_unique<VMABuffer>(
+        m_device,
+        1,
+        static_cast<uint32_t>(m_capacity),
+        VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+        VMA_MEMORY_USAGE_CPU_ONLY
+    );
+    if (m_buffer->map() != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to map staging ring!");
+    }
+    m_mapped = static_cast<char*>(m_buffer->getMappedMemory());
+}
+
+StagingRing::~StagingRing()
+{
+    //未提交的拷贝直接丢弃，目标缓冲可能已经销毁
+    m_pendingCopies.clear();
+    while (!m_inFlight.empty())
+    {
+        waitOldest();
+    }
+
+    for (VkFence fence : m_freeFences)
+    {
+        vkDestroyFence(m_device.device(), fence, nullptr);
+    }
+    for (VkSemaphore semaphore : m_freeSemaphores)
+    {
+        vkDestroySemaphore(m_device.device(), semaphore, nullptr);
+    }
+    //没有传输批次等待过的信号量，发出信号的拷贝在上面已经完成
+    for (VkSemaphore semaphore : m_transferWaitSemaphores)
+    {
+        vkDestroySemaphore(m_device.device(), semaphore, nullptr);
+    }
+    m_buffer->unmap();
+}
+
+void StagingRing::stage(VkBuffer dstBuffer, VkDeviceSize dstOffset, const void* data, VkDeviceSize size)
+{
+    //大块数据拆开，让前面的分段提交后环上的空间可以流水复用
+    const VkDeviceSize maxPiece = m_capacity / 4;
+    const char* src = static_cast<const char*>(data);
+
+    while (size > 0)
+    {
+        VkDeviceSize piece = std::min(size, maxPiece);
+        VkDeviceSize alignedSize = (piece + COPY_ALIGNMENT - 1) & ~(COPY_ALIGNMENT - 1);
+
+        VkDeviceSize offset = 0;
+        while (!tryAllocate(alignedSize, offset))
+        {
+            //先提交当前批次再回收，仍然不够时才等待GPU
+            flush();
+            reclaim();
+            if (tryAllocate(alignedSize, offset))
+                break;
+
+            m_stats.stalls++;
+            waitOldest();
+        }
+
+        memcpy(m_mapped + offset, src, piece);
+
+        VkBufferCopy region{};
+        region.srcOffset = offset;
+        region.dstOffset = dstOffset;
+        region.size = piece;
+        m_pendingCopies.push_back({ dstBuffer, region });
+
+        m_stats.bytesStaged += piece;
+        src += piece;
+        dstOffset += piece;
+        size -= piece;
+    }
+}
+
+void StagingRing::flush()
+{
+    if (m_pendingCopies.empty())
+        return;
+
+    //同一目标缓冲的区间排在一起，录制时合成一次 vkCmdCopyBuffer
+    std::stable_sort(m_pendingCopies.begin(), m_pendingCopies.end(),
+        [](const PendingCopy& a, const PendingCopy& b) { return a.dstBuffer < b.dstBuffer; });
+
+    InFlightBatch batch;
+    batch.fence = acquireFence();
+    batch.end = m_head;
+    batch.bytes = m_batchBytes;
+
+    if (m_device.hasDedicatedTransferQueue())
+        submitOnTransferQueue(batch);
+    else
+        submitOnGraphicsQueue(batch);
+
+    m_inFlight.push_back(batch);
+    m_batchBytes = 0;
+    m_pendingCopies.clear();
+    m_stats.batchesSubmitted++;
+}
+
+void StagingRing::submitOnGraphicsQueue(InFlightBatch& batch)
+{
+    batch.commandBuffer = beginCommandBuffer(m_device.getCommandPool());
+    recordCopies(batch.commandBuffer);
+    recordGraphicsBarrier(batch.commandBuffer);
+    vkEndCommandBuffer(batch.commandBuffer);
+
+    VkSubmitInfo submitInfo{};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &batch.commandBuffer;
+    if (vkQueueSubmit(m_device.graphicsQueue(), 1, &submitInfo, batch.fence) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to submit staging copies!");
+    }
+}
+
+void StagingRing::copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size)
+{
+    //还没提交的上传可能写 srcBuffer，先提交，排在这次拷贝之前
+    flush();
+
+    InFlightBatch batch;
+    batch.fence = acquireFence();
+    batch.end = m_head;
+
+    batch.commandBuffer = beginCommandBuffer(m_device.getCommandPool());
+    VkBufferCopy region{};
+    region.size = size;
+    vkCmdCopyBuffer(batch.commandBuffer, srcBuffer, dstBuffer, 1, &region);
+    recordGraphicsBarrier(batch.commandBuffer);
+    vkEndCommandBuffer(batch.commandBuffer);
+
+    VkSubmitInfo submitInfo{};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &batch.commandBuffer;
+
+    //之后传输队列写入 dstBuffer 的区间可能是旧内容里已释放的部分，要排在这次拷贝之后
+    VkSemaphore semaphore = VK_NULL_HANDLE;
+    if (m_device.hasDedicatedTransferQueue())
+    {
+        semaphore = acquireSemaphore();
+        submitInfo.signalSemaphoreCount = 1;
+        submitInfo.pSignalSemaphores = &semaphore;
+    }
+    if (vkQueueSubmit(m_device.graphicsQueue(), 1, &submitInfo, batch.fence) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to submit buffer copy!");
+    }
+
+    if (semaphore != VK_NULL_HANDLE)
+        m_transferWaitSemaphores.push_back(semaphore);
+    m_inFlight.push_back(batch);
+    m_stats.batchesSubmitted++;
+}
+
+void StagingRing::recordGraphicsBarrier(VkCommandBuffer commandBuffer)
+{
+    //之后提交的绘制、扩容和碎片整理拷贝都要看到写入的内容
+    VkMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT |
+        VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+        VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+        0, 1, &barrier, 0, nullptr, 0, nullptr);
+}
+
+void StagingRing::submitOnTransferQueue(InFlightBatch& batch)
+{
+    uint32_t transferFamily = m_device.getTransferQueueFamily();
+    uint32_t graphicsFamily = m_device.getGraphicsQueueFamily();
+
+    //只转移写入的区间，同一缓冲里其它区间仍归图形队列所有，正在被绘制读取
+    std::vector<VkBufferMemoryBarrier> releaseBarriers;
+    std::vector<VkBufferMemoryBarrier> acquireBarriers;
+    releaseBarriers.reserve(m_pendingCopies.size());
+    acquireBarriers.reserve(m_pendingCopies.size());
+    for (const PendingCopy& copy : m_pendingCopies)
+    {
+        VkBufferMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+        barrier.srcQueueFamilyIndex = transferFamily;
+        barrier.dstQueueFamilyIndex = graphicsFamily;
+        barrier.buffer = copy.dstBuffer;
+        barrier.offset = copy.region.dstOffset;
+        barrier.size = copy.region.size;
+
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = 0;
+        releaseBarriers.push_back(barrier);
+
+        barrier.srcAccessMask = 0;
+        barrier.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT |
+            VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+        acquireBarriers.push_back(barrier);
+    }
+
+    //目标区间的旧内容不需要保留，传输队列写入前不必先从图形队列获取
+    batch.transferCommandBuffer = beginCommandBuffer(m_device.getTransferCommandPool());
+    recordCopies(batch.transferCommandBuffer);
+    vkCmdPipelineBarrier(batch.transferCommandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+        0, 0, nullptr, static_cast<uint32_t>(releaseBarriers.size()), releaseBarriers.data(), 0, nullptr);
+    vkEndCommandBuffer(batch.transferCommandBuffer);
+
+    const VkPipelineStageFlags acquireStages =
+        VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT;
+    batch.commandBuffer = beginCommandBuffer(m_device.getCommandPool());
+    //源阶段与信号量等待的阶段相同，传输队列的拷贝经信号量接到之后的读取上
+    vkCmdPipelineBarrier(batch.commandBuffer, acquireStages, acquireStages,
+        0, 0, nullptr, static_cast<uint32_t>(acquireBarriers.size()), acquireBarriers.data(), 0, nullptr);
+    vkEndCommandBuffer(batch.commandBuffer);
+
+    batch.semaphore = acquireSemaphore();
+
+    VkSubmitInfo transferSubmit{};
+    transferSubmit.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    transferSubmit.commandBufferCount = 1;
+    transferSubmit.pCommandBuffers = &batch.transferCommandBuffer;
+    //图形队列上还没被等待过的缓冲拷贝，写入前先等它们完成
+    std::vector<VkPipelineStageFlags> waitStages(m_transferWaitSemaphores.size(), VK_PIPELINE_STAGE_TRANSFER_BIT);
+    transferSubmit.waitSemaphoreCount = static_cast<uint32_t>(m_transferWaitSemaphores.size());
+    transferSubmit.pWaitSemaphores = m_transferWaitSemaphores.data();
+    transferSubmit.pWaitDstStageMask = waitStages.data();
+    transferSubmit.signalSemaphoreCount = 1;
+    transferSubmit.pSignalSemaphores = &batch.semaphore;
+    if (vkQueueSubmit(m_device.transferQueue(), 1, &transferSubmit, VK_NULL_HANDLE) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to submit staging copies to transfer queue!");
+    }
+    batch.waitSemaphores = std::move(m_transferWaitSemaphores);
+    m_transferWaitSemaphores.clear();
+
+    //获取放在图形队列上单独提交，排在之后提交的帧前面，绘制命令不需要改动
+    VkSubmitInfo acquireSubmit{};
+    acquireSubmit.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    acquireSubmit.waitSemaphoreCount = 1;
+    acquireSubmit.pWaitSemaphores = &batch.semaphore;
+    acquireSubmit.pWaitDstStageMask = &acquireStages;
+    acquireSubmit.commandBufferCount = 1;
+    acquireSubmit.pCommandBuffers = &batch.commandBuffer;
+    if (vkQueueSubmit(m_device.graphicsQueue(), 1, &acquireSubmit, batch.fence) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to submit staging ownership acquire!");
+    }
+}
+
+VkCommandBuffer StagingRing::beginCommandBuffer(VkCommandPool commandPool)
+{
+    VkCommandBufferAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    allocInfo.commandPool = commandPool;
+    allocInfo.commandBufferCount = 1;
+
+    VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+    if (vkAllocateCommandBuffers(m_device.device(), &allocInfo, &commandBuffer) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to allocate staging command buffer!");
+    }
+
+    VkCommandBufferBeginInfo beginInfo{};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    vkBeginCommandBuffer(commandBuffer, &beginInfo);
+    return commandBuffer;
+}
+
+void StagingRing::recordCopies(VkCommandBuffer commandBuffer)
+{
+    std::vector<VkBufferCopy> regions;
+    for (size_t i = 0; i < m_pendingCopies.size();)
+    {
+        VkBuffer dstBuffer = m_pendingCopies[i].dstBuffer;
+        regions.clear();
+        for (; i < m_pendingCopies.size() && m_pendingCopies[i].dstBuffer == dstBuffer; i++)
+        {
+            regions.push_back(m_pendingCopies[i].region);
+        }
+
+        vkCmdCopyBuffer(commandBuffer, m_buffer->getBuffer(), dstBuffer,
+            static_cast<uint32_t>(regions.size()), regions.data());
+        m_stats.copyRegions += regions.size();
+    }
+}
+
+void StagingRing::waitIdle()
+{
+    flush();
+    while (!m_inFlight.empty())
+    {
+        waitOldest();
+    }
+}
+
+void StagingRing::reclaim()
+{
+    while (!m_inFlight.empty() &&
+        vkGetFenceStatus(m_device.device(), m_inFlight.front().fence) == VK_SUCCESS)
+    {
+        waitOldest();
+    }
+}
+
+bool StagingRing::tryAllocate(VkDeviceSize size, VkDeviceSize& offset)
+{
+    if (size > m_capacity)
+        return false;
+
+    if (m_used == 0)
+    {
+        m_head = 0;
+        m_tail = 0;
+    }
+
+    //写指针在读指针之后（或环为空）时，空闲区是 [head, capacity) 和 [0, tail)
+    if (m_head > m_tail || (m_head == m_tail && m_used == 0))
+    {
+        if (m_capacity - m_head >= size)
+        {
+            offset = m_head;
+            m_head += size;
+            m_used += size;
+            m_batchBytes += size;
+            return true;
+        }
+
+        //尾部放不下就回绕，跳过的尾部算进本批次，完成时一起回收
+        if (m_tail >= size)
+        {
+            VkDeviceSize skipped = m_capacity - m_head;
+            offset = 0;
+            m_head = size;
+            m_used += skipped + size;
+            m_batchBytes += skipped + size;
+            return true;
+        }
+        return false;
+    }
+
+    //已回绕，空闲区是 [head, tail)
+    if (m_tail - m_head >= size)
+    {
+        offset = m_head;
+        m_head += size;
+        m_used += size;
+        m_batchBytes += size;
+        return true;
+    }
+    return false;
+}
+
+void StagingRing::waitOldest()
+{
+    if (m_inFlight.empty())
+        return;
+
+    InFlightBatch batch = m_inFlight.front();
+    m_inFlight.pop_front();
+
+    vkWaitForFences(m_device.device(), 1, &batch.fence, VK_TRUE, UINT64_MAX);
+    vkResetFences(m_device.device(), 1, &batch.fence);
+    m_freeFences.push_back(batch.fence);
+    vkFreeCommandBuffers(m_device.device(), m_device.getCommandPool(), 1, &batch.commandBuffer);
+
+    //图形队列的获取等待过信号量，围栏信号时传输队列一侧也已完成
+    if (batch.transferCommandBuffer != VK_NULL_HANDLE)
+        vkFreeCommandBuffers(m_device.device(), m_device.getTransferCommandPool(), 1, &batch.transferCommandBuffer);
+    if (batch.semaphore != VK_NULL_HANDLE)
+        m_freeSemaphores.push_back(batch.semaphore);
+    m_freeSemaphores.insert(m_freeSemaphores.end(), batch.waitSemaphores.begin(), batch.waitSemaphores.end());
+
+    m_tail = batch.end;
+    m_used -= batch.bytes;
+}
+
+VkSemaphore StagingRing::acquireSemaphore()
+{
+    if (!m_freeSemaphores.empty())
+    {
+        VkSemaphore semaphore = m_freeSemaphores.back();
+        m_freeSemaphores.pop_back();
+        return semaphore;
+    }
+
+    VkSemaphoreCreateInfo semaphoreInfo{};
+    semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+    VkSemaphore semaphore = VK_NULL_HANDLE;
+    if (vkCreateSemaphore(m_device.device(), &semaphoreInfo, nullptr, &semaphore) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to create staging semaphore!");
+    }
+    return semaphore;
+}
+
+VkFence StagingRing::acquireFence()
+{
+    if (!m_freeFences.empty())
+    {
+        VkFence fence = m_freeFences.back();
+        m_freeFences.pop_back();
+        return fence;
+    }
+
+    VkFenceCreateInfo fenceInfo{};
+    fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+    VkFence fence = VK_NULL_HANDLE;
+    if (vkCreateFence(m_device.device(), &fenceInfo, nullptr, &fence) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to create staging fence!");
+    }
+    return fence;
+}
@@ -0,0 +1,100 @@
+#pragma once
+
+#include "Device.h"
+#include "VMABuffer.h"
+
+#include <deque>
+#include <memory>
+#include <vector>
+
+//常驻映射的暂存环形缓冲：上传数据先拷进环里，多个目标区间合成一个命令缓冲批量提交，
+//用围栏跟踪完成情况，拷贝完成后回收环上的空间。
+//有独立传输队列时拷贝在传输队列上执行，再通过信号量和队列族所有权转移交给图形队列
+class StagingRing
+{
+public:
+    static constexpr VkDeviceSize DEFAULT_CAPACITY = 32 * 1024 * 1024;
+    static constexpr VkDeviceSize COPY_ALIGNMENT = 16;
+
+    struct Stats
+    {
+        uint64_t bytesStaged{ 0 };
+        uint64_t copyRegions{ 0 };
+        uint64_t batchesSubmitted{ 0 };
+        uint64_t stalls{ 0 };               //环满时被迫等待GPU的次数
+    };
+
+    StagingRing(Device& device, VkDeviceSize capacity = DEFAULT_CAPACITY);
+    ~StagingRing();
+
+    StagingRing(const StagingRing&) = delete;
+    StagingRing& operator=(const StagingRing&) = delete;
+
+    //把数据拷进环并登记到 dst 的拷贝，超过环容量的数据会拆成多段
+    void stage(VkBuffer dstBuffer, VkDeviceSize dstOffset, const void* data, VkDeviceSize size);
+    //提交当前批次，不等待；之后提交到同一队列的命令都能看到拷贝结果
+    void flush();
+    //显存内缓冲之间的拷贝（段扩容），排在已登记的上传之后在图形队列上提交，不等待；
+    //有独立传输队列时，下一个传输批次等它完成再写入
+    void copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size);
+    //提交并等待所有批次完成
+    void waitIdle();
+    //回收已完成批次占用的空间
+    void reclaim();
+
+    bool hasPendingCopies() const { return !m_pendingCopies.empty(); }
+    VkDeviceSize getCapacity() const { return m_capacity; }
+    const Stats& getStats() const { return m_stats; }
+
+private:
+    struct PendingCopy
+    {
+        VkBuffer dstBuffer;
+        VkBufferCopy region;
+    };
+
+    struct InFlightBatch
+    {
+        VkFence fence = VK_NULL_HANDLE;
+        VkCommandBuffer commandBuffer = VK_NULL_HANDLE;         //图形队列：拷贝或所有权获取
+        VkCommandBuffer transferCommandBuffer = VK_NULL_HANDLE; //传输队列：拷贝和所有权释放
+        VkSemaphore semaphore = VK_NULL_HANDLE;
+        std::vector<VkSemaphore> waitSemaphores;    //传输队列等待的图形队列拷贝
+        VkDeviceSize end{ 0 };              //批次结束时的写指针，完成后读指针移到这里
+        VkDeviceSize bytes{ 0 };            //包含回绕时跳过的尾部
+    };
+
+    //在环上找 size 字节的连续空间，找不到返回 false
+    bool tryAllocate(VkDeviceSize size, VkDeviceSize& offset);
+    //等待最早的批次完成，腾出空间
+    void waitOldest();
+    VkFence acquireFence();
+    VkSemaphore acquireSemaphore();
+    VkCommandBuffer beginCommandBuffer(VkCommandPool commandPool);
+    void recordCopies(VkCommandBuffer commandBuffer);
+    //图形队列上的拷贝之后，让后续的绘制和拷贝看到写入的内容
+    void recordGraphicsBarrier(VkCommandBuffer commandBuffer);
+    //在传输队列上拷贝并释放所有权，图形队列等信号量后获取所有权
+    void submitOnTransferQueue(InFlightBatch& batch);
+    void submitOnGraphicsQueue(InFlightBatch& batch);
+
+private:
+    Device& m_device;
+
+    std::unique_ptr<VMABuffer>  m_buffer;
+    char*                       m_mapped = nullptr;
+    VkDeviceSize                m_capacity;
+
+    VkDeviceSize                m_head{ 0 };        //写指针
+    VkDeviceSize                m_tail{ 0 };        //最早未完成数据的起点
+    VkDeviceSize                m_used{ 0 };
+    VkDeviceSize                m_batchBytes{ 0 };  //当前未提交批次占用的字节
+
+    std::vector<PendingCopy>    m_pendingCopies;
+    std::deque<InFlightBatch>   m_inFlight;
+    std::vector<VkFence>        m_freeFences;
+    std::vector<VkSemaphore>    m_freeSemaphores;
+    std::vector<VkSemaphore>    m_transferWaitSemaphores;   //下一个传输批次要等待的信号量
+
+    Stats                       m_stats;
+};
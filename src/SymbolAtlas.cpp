@@ -0,0 +1,272 @@
+#include "SymbolAtlas.h"
+
+#include <cmath>
+#include <cstring>
+#include <functional>
+#include <stdexcept>
+
+#include <qdebug.h>
+
+namespace
+{
+    constexpr uint32_t BUILTIN_SYMBOL_SIZE = 32;
+    constexpr int SUPER_SAMPLES = 4;
+
+    //按覆盖率生成白色蒙版符号，颜色在着色器里由实例颜色决定
+    std::vector<uint8_t> rasterizeSymbol(uint32_t size, const std::function<bool(float, float)>& inside)
+    {
+        std::vector<uint8_t> rgba(size * size * 4, 255);
+        for (uint32_t y = 0; y < size; y++)
+        {
+            for (uint32_t x = 0; x < size; x++)
+            {
+                int covered = 0;
+                for (int sy = 0; sy < SUPER_SAMPLES; sy++)
+                {
+                    for (int sx = 0; sx < SUPER_SAMPLES; sx++)
+                    {
+                        //映射到 [-1, 1]
+                        float px = ((x + (sx + 0.5f) / SUPER_SAMPLES) / size) * 2.f - 1.f;
+                        float py = ((y + (sy + 0.5f) / SUPER_SAMPLES) / size) * 2.f - 1.f;
+                        if (inside(px, py))
+                            covered++;
+                    }
+                }
+                rgba[(y * size + x) * 4 + 3] = static_cast<uint8_t>(covered * 255 / (SUPER_SAMPLES * SUPER_SAMPLES));
+            }
+        }
+        return rgba;
+    }
+}
+
+SymbolAtlas::SymbolAtlas(Device& device) :
+    m_device(device),
+    m_pixels(ATLAS_SIZE* ATLAS_SIZE * 4, 0)
+{
+    m_rectBuffer = std::make_unique<Buffer>(
+        m_device,
+        sizeof(SymbolRect),
+        MAX_SYMBOLS,
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+    m_rectBuffer->map();
+
+    createImage();
+    createSampler();
+    addBuiltinSymbols();
+}
+
+SymbolAtlas::~SymbolAtlas()
+{
+    vkDestroySampler(m_device.device(), m_sampler, nullptr);
+    vkDestroyImageView(m_device.device(), m_imageView, nullptr);
+    vkDestroyImage(m_device.device(), m_image, nullptr);
+    vkFreeMemory(m_device.device(), m_imageMemory, nullptr);
+}
+
+uint16_t SymbolAtlas::addSymbol(uint32_t width, uint32_t height, const std::vector<uint8_t>& rgba)
+{
+    if (rgba.size() < static_cast<size_t>(width) * height * 4)
+    {
+        qWarning() << "symbol pixel data is smaller than" << width << "x" << height;
+        return Circle;
+    }
+
+    uint32_t x = 0, y = 0;
+    if (m_rects.size() >= MAX_SYMBOLS || !allocateRect(width, height, x, y))
+    {
+        qWarning() << "symbol atlas is full, fallback to circle";
+        return Circle;
+    }
+
+    for (uint32_t row = 0; row < height; row++)
+    {
+        std::memcpy(&m_pixels[((y + row) * ATLAS_SIZE + x) * 4],
+            &rgba[row * width * 4],
+            width * 4);
+    }
+
+    SymbolRect rect{};
+    rect.uvRect[0] = static_cast<float>(x) / ATLAS_SIZE;
+    rect.uvRect[1] = static_cast<float>(y) / ATLAS_SIZE;
+    rect.uvRect[2] = static_cast<float>(x + width) / ATLAS_SIZE;
+    rect.uvRect[3] = static_cast<float>(y + height) / ATLAS_SIZE;
+    rect.sizePx[0] = static_cast<float>(width);
+    rect.sizePx[1] = static_cast<float>(height);
+    m_rects.push_back(rect);
+
+    m_dirty = true;
+    return static_cast<uint16_t>(m_rects.size() - 1);
+}
+
+void SymbolAtlas::upload(VkCommandBuffer commandBuffer, FrameAllocator& staging)
+{
+    if (!m_dirty)
+        return;
+
+    VkDeviceSize imageSize = static_cast<VkDeviceSize>(m_pixels.size());
+    auto allocation = staging.write(m_pixels.data(), imageSize);
+    if (!allocation.isValid())
+        return;
+
+    //布局转换的源阶段包含之前提交的帧的片元着色，覆盖图像前在途帧已经读完
+    transitionImageLayout(commandBuffer, m_imageLayout, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+
+    VkBufferImageCopy region{};
+    region.bufferOffset = allocation.offset;
+    region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    region.imageSubresource.layerCount = 1;
+    region.imageExtent = { ATLAS_SIZE, ATLAS_SIZE, 1 };
+    vkCmdCopyBufferToImage(commandBuffer, allocation.buffer, m_image,
+        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+
+    transitionImageLayout(commandBuffer, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+    m_imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+    m_rectBuffer->writeToBuffer(m_rects.data(), m_rects.size() * sizeof(SymbolRect));
+    m_dirty = false;
+}
+
+VkDescriptorImageInfo SymbolAtlas::imageInfo() const
+{
+    VkDescriptorImageInfo info{};
+    info.sampler = m_sampler;
+    info.imageView = m_imageView;
+    info.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    return info;
+}
+
+void SymbolAtlas::createImage()
+{
+    VkImageCreateInfo imageInfo{};
+    imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    imageInfo.imageType = VK_IMAGE_TYPE_2D;
+    imageInfo.extent = { ATLAS_SIZE, ATLAS_SIZE, 1 };
+    imageInfo.mipLevels = 1;
+    imageInfo.arrayLayers = 1;
+    imageInfo.format = VK_FORMAT_R8G8B8A8_UNORM;
+    imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+    imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    imageInfo.usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+    imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+    imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+    m_device.createImageWithInfo(imageInfo, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_image, m_imageMemory);
+
+    VkImageViewCreateInfo viewInfo{};
+    viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    viewInfo.image = m_image;
+    viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+    viewInfo.format = VK_FORMAT_R8G8B8A8_UNORM;
+    viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    viewInfo.subresourceRange.levelCount = 1;
+    viewInfo.subresourceRange.layerCount = 1;
+
+    if (vkCreateImageView(m_device.device(), &viewInfo, nullptr, &m_imageView) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to create symbol atlas image view!");
+    }
+}
+
+void SymbolAtlas::createSampler()
+{
+    VkSamplerCreateInfo samplerInfo{};
+    samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+    samplerInfo.magFilter = VK_FILTER_LINEAR;
+    samplerInfo.minFilter = VK_FILTER_LINEAR;
+    samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+    samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.maxLod = 0.f;
+    samplerInfo.borderColor = VK_BORDER_COLOR_FLOAT_TRANSPARENT_BLACK;
+
+    if (vkCreateSampler(m_device.device(), &samplerInfo, nullptr, &m_sampler) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to create symbol atlas sampler!");
+    }
+}
+
+void SymbolAtlas::addBuiltinSymbols()
+{
+    const uint32_t size = BUILTIN_SYMBOL_SIZE;
+
+    //顺序必须和 BuiltinSymbol 一致
+    addSymbol(size, size, rasterizeSymbol(size, [](float x, float y) {
+        return x * x + y * y <= 0.81f;
+        }));
+    addSymbol(size, size, rasterizeSymbol(size, [](float x, float y) {
+        return std::abs(x) <= 0.8f && std::abs(y) <= 0.8f;
+        }));
+    addSymbol(size, size, rasterizeSymbol(size, [](float x, float y) {
+        //顶点朝上（纹理 v 方向向下）
+        return y <= 0.8f && y >= -0.8f + 2.f * std::abs(x);
+        }));
+    addSymbol(size, size, rasterizeSymbol(size, [](float x, float y) {
+        return std::abs(x) + std::abs(y) <= 0.9f;
+        }));
+    addSymbol(size, size, rasterizeSymbol(size, [](float x, float y) {
+        return (std::abs(x) <= 0.2f && std::abs(y) <= 0.9f) ||
+            (std::abs(y) <= 0.2f && std::abs(x) <= 0.9f);
+        }));
+}
+
+void SymbolAtlas::transitionImageLayout(VkCommandBuffer commandBuffer, VkImageLayout oldLayout, VkImageLayout newLayout)
+{
+    VkImageMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.oldLayout = oldLayout;
+    barrier.newLayout = newLayout;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = m_image;
+    barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    barrier.subresourceRange.levelCount = 1;
+    barrier.subresourceRange.layerCount = 1;
+
+    VkPipelineStageFlags srcStage;
+    VkPipelineStageFlags dstStage;
+
+    if (newLayout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL)
+    {
+        barrier.srcAccessMask = oldLayout == VK_IMAGE_LAYOUT_UNDEFINED ? 0 : VK_ACCESS_SHADER_READ_BIT;
+        barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        srcStage = oldLayout == VK_IMAGE_LAYOUT_UNDEFINED ? VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT : VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+        dstStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
+    }
+    else
+    {
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+        srcStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
+        dstStage = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+    }
+
+    vkCmdPipelineBarrier(commandBuffer, srcStage, dstStage, 0,
+        0, nullptr, 0, nullptr, 1, &barrier);
+}
+
+bool SymbolAtlas::allocateRect(uint32_t width, uint32_t height, uint32_t& x, uint32_t& y)
+{
+    uint32_t paddedWidth = width + SYMBOL_PADDING;
+    uint32_t paddedHeight = height + SYMBOL_PADDING;
+    if (paddedWidth > ATLAS_SIZE || paddedHeight > ATLAS_SIZE)
+        return false;
+
+    //当前货架放不下则换到下一行
+    if (m_shelfX + paddedWidth > ATLAS_SIZE)
+    {
+        m_shelfY += m_shelfHeight;
+        m_shelfX = 0;
+        m_shelfHeight = 0;
+    }
+
+    if (m_shelfY + paddedHeight > ATLAS_SIZE)
+        return false;
+
+    x = m_shelfX;
+    y = m_shelfY;
+    m_shelfX += paddedWidth;
+    m_shelfHeight = qMax(m_shelfHeight, paddedHeight);
+    return true;
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include "Buffer.h"
+#include "Device.h"
+#include "FrameAllocator.h"
+
+#include <memory>
+#include <vector>
+
+//点符号图集：所有符号位图打包进一张RGBA8纹理，符号ID索引到图集中的矩形
+class SymbolAtlas
+{
+public:
+    static constexpr uint32_t ATLAS_SIZE = 1024;
+    static constexpr uint32_t MAX_SYMBOLS = 256;
+    static constexpr uint32_t SYMBOL_PADDING = 1;      //相邻符号之间留空，避免线性采样串色
+
+    //内置符号，构造时按此顺序打包
+    enum BuiltinSymbol : uint16_t
+    {
+        Circle = 0,
+        Square,
+        Triangle,
+        Diamond,
+        Cross,
+        BuiltinCount
+    };
+
+    //与 point_symbol.vert 中的 SymbolRect 对应（std430）
+    struct SymbolRect
+    {
+        float uvRect[4];        //u0, v0, u1, v1
+        float sizePx[2];        //符号原始像素尺寸
+        float padding[2];
+    };
+
+    SymbolAtlas(Device& device);
+    ~SymbolAtlas();
+
+    SymbolAtlas(const SymbolAtlas&) = delete;
+    SymbolAtlas& operator=(const SymbolAtlas&) = delete;
+
+    //添加一个RGBA8符号，返回符号ID；图集放不下时返回 Circle
+    uint16_t addSymbol(uint32_t width, uint32_t height, const std::vector<uint8_t>& rgba);
+
+    //把新增的符号的拷贝录到帧命令缓冲上，需在渲染通道开始之前调用
+    void upload(VkCommandBuffer commandBuffer, FrameAllocator& staging);
+
+    uint32_t getSymbolCount() const { return static_cast<uint32_t>(m_rects.size()); }
+    //图集图像按 RGBA8 估算，不含驱动的对齐填充
+    VkDeviceSize getGpuBytes() const { return static_cast<VkDeviceSize>(ATLAS_SIZE) * ATLAS_SIZE * 4 + m_rectBuffer->getBufferSize(); }
+    VkDeviceSize getCpuBytes() const { return m_pixels.size() + m_rects.size() * sizeof(SymbolRect); }
+    VkDescriptorImageInfo imageInfo() const;
+    VkDescriptorBufferInfo rectInfo() { return m_rectBuffer->descriptorInfo(); }
+
+private:
+    void createImage();
+    void createSampler();
+    void addBuiltinSymbols();
+    void transitionImageLayout(VkCommandBuffer commandBuffer, VkImageLayout oldLayout, VkImageLayout newLayout);
+
+    //简单的货架式打包，返回false表示图集已满
+    bool allocateRect(uint32_t width, uint32_t height, uint32_t& x, uint32_t& y);
+
+private:
+    Device& m_device;
+
+    VkImage                         m_image = VK_NULL_HANDLE;
+    VkDeviceMemory                  m_imageMemory = VK_NULL_HANDLE;
+    VkImageView                     m_imageView = VK_NULL_HANDLE;
+    VkSampler                       m_sampler = VK_NULL_HANDLE;
+    VkImageLayout                   m_imageLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+    std::unique_ptr<Buffer>         m_rectBuffer;
+    std::vector<SymbolRect>         m_rects;
+    std::vector<uint8_t>            m_pixels;       //CPU侧图集像素，整张重新上传
+    bool                            m_dirty{ true };
+
+    uint32_t                        m_shelfX{ 0 };
+    uint32_t                        m_shelfY{ 0 };
+    uint32_t                        m_shelfHeight{ 0 };
+};
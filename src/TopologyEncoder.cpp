@@ -0,0 +1,245 @@
+#include "TopologyEncoder.h"
+
+#include <algorithm>
+#include <limits>
+#include <map>
+#include <unordered_map>
+
+#include "VertexWelder.h"
+
+TopologyEncoder::TopologyEncoder(float weldTolerance) :
+    m_weldTolerance(weldTolerance)
+{
+}
+
+uint32_t TopologyEncoder::addPolygon(const std::vector<std::vector<QVector2D>>& rings)
+{
+    for (const auto& ring : rings)
+    {
+        m_inputVertexCount += ring.size();
+    }
+
+    m_polygons.push_back(rings);
+    return static_cast<uint32_t>(m_polygons.size() - 1);
+}
+
+TopologyEncoder::Topology TopologyEncoder::encode() const
+{
+    Topology topology;
+    VertexWelder welder(m_weldTolerance);
+
+    //1. 焊接顶点，得到每个环的顶点序号，去掉连续重复点和闭合点
+    std::vector<std::vector<std::vector<uint32_t>>> polygonRings;
+    polygonRings.reserve(m_polygons.size());
+    for (const auto& rings : m_polygons)
+    {
+        auto& ringIds = polygonRings.emplace_back();
+        for (const auto& ring : rings)
+        {
+            std::vector<uint32_t> ids;
+            ids.reserve(ring.size());
+            for (const auto& point : ring)
+            {
+                uint32_t newIndex = static_cast<uint32_t>(topology.vertices.size());
+                uint32_t id = welder.weld(point.x(), point.y(), newIndex);
+                if (id == newIndex)
+                    topology.vertices.push_back(point);
+
+                if (ids.empty() || ids.back() != id)
+                    ids.push_back(id);
+            }
+
+            if (ids.size() > 1 && ids.front() == ids.back())
+                ids.pop_back();
+
+            if (ids.size() >= 2)
+                ringIds.push_back(std::move(ids));
+        }
+    }
+
+    //2. 统计每个顶点的不同邻居，邻居多于两个的顶点是结点，共享边界在结点处开始和结束
+    std::vector<std::vector<uint32_t>> neighbors(topology.vertices.size());
+    auto addNeighbor = [&neighbors](uint32_t a, uint32_t b) {
+        auto& list = neighbors[a];
+        if (std::find(list.begin(), list.end(), b) == list.end())
+            list.push_back(b);
+        };
+
+    for (const auto& rings : polygonRings)
+    {
+        for (const auto& ids : rings)
+        {
+            for (size_t i = 0; i < ids.size(); i++)
+            {
+                uint32_t a = ids[i];
+                uint32_t b = ids[(i + 1) % ids.size()];
+                addNeighbor(a, b);
+                addNeighbor(b, a);
+            }
+        }
+    }
+
+    auto isJunction = [&neighbors](uint32_t id) { return neighbors[id].size() > 2; };
+
+    //3. 在结点处切分环，相同（或反向相同）的弧段只保留一份
+    std::map<std::vector<uint32_t>, int32_t> arcIndex;
+    auto referenceArc = [&topology, &arcIndex](std::vector<uint32_t>&& arc) -> int32_t {
+        auto it = arcIndex.find(arc);
+        if (it != arcIndex.end())
+            return it->second;
+
+        std::vector<uint32_t> reversed(arc.rbegin(), arc.rend());
+        it = arcIndex.find(reversed);
+        if (it != arcIndex.end())
+            return ~it->second;
+
+        int32_t index = static_cast<int32_t>(topology.arcs.size());
+        arcIndex.emplace(arc, index);
+        topology.arcs.push_back(std::move(arc));
+        return index;
+        };
+
+    topology.polygons.reserve(polygonRings.size());
+    for (const auto& rings : polygonRings)
+    {
+        auto& polygonRefs = topology.polygons.emplace_back();
+        for (const auto& ids : rings)
+        {
+            //从第一个结点开始；没有结点的孤立环从最小序号开始，保证相同的环切出相同的弧
+            size_t start = std::numeric_limits<size_t>::max();
+            for (size_t i = 0; i < ids.size(); i++)
+            {
+                if (isJunction(ids[i]))
+                {
+                    start = i;
+                    break;
+                }
+            }
+            if (start == std::numeric_limits<size_t>::max())
+                start = std::min_element(ids.begin(), ids.end()) - ids.begin();
+
+            std::vector<uint32_t> rotated;
+            rotated.reserve(ids.size() + 1);
+            for (size_t i = 0; i <= ids.size(); i++)
+            {
+                rotated.push_back(ids[(start + i) % ids.size()]);
+            }
+
+            auto& ringRefs = polygonRefs.emplace_back();
+            std::vector<uint32_t> arc{ rotated.front() };
+            for (size_t i = 1; i < rotated.size(); i++)
+            {
+                arc.push_back(rotated[i]);
+                if (i + 1 == rotated.size() || isJunction(rotated[i]))
+                {
+                    ringRefs.push_back(referenceArc(std::move(arc)));
+                    arc = { rotated[i] };
+                }
+            }
+        }
+    }
+
+    return topology;
+}
+
+std::vector<Object::Builder> TopologyEncoder::buildArcBuilders(const Topology& topology,
+    const QVector3D& color, const TransformComponent& transform)
+{
+    std::vector<Object::Builder> builders;
+    builders.reserve(topology.arcs.size());
+
+    for (const auto& arc : topology.arcs)
+    {
+        if (arc.size() < 2)
+            continue;
+
+        Object::Builder builder{};
+        builder.type = ModelType::Line;
+        builder.color = color;
+        builder.transform = transform;
+        builder.bounds = AABB{ std::numeric_limits<float>::infinity(), std::numeric_limits<float>::infinity(),
+            -std::numeric_limits<float>::infinity(), -std::numeric_limits<float>::infinity() };
+
+        builder.vertices.reserve(arc.size());
+        for (uint32_t id : arc)
+        {
+            const QVector2D& point = topology.vertices[id];
+            Model::Vertex vertex;
+            vertex.position = QVector3D(point.x(), point.y(), 0.f);
+            vertex.color = color;
+            builder.vertices.push_back(vertex);
+
+            builder.bounds.minX = qMin(builder.bounds.minX, point.x());
+            builder.bounds.minY = qMin(builder.bounds.minY, point.y());
+            builder.bounds.maxX = qMax(builder.bounds.maxX, point.x());
+            builder.bounds.maxY = qMax(builder.bounds.maxY, point.y());
+        }
+
+        for (uint32_t i = 0; i + 1 < static_cast<uint32_t>(arc.size()); i++)
+        {
+            builder.indices.push_back(i);
+            builder.indices.push_back(i + 1);
+        }
+
+        builders.push_back(std::move(builder));
+    }
+
+    return builders;
+}
+
+std::vector<Object::Builder> TopologyEncoder::buildPolygonBuilders(const Topology& topology,
+    const QVector3D& color, const TransformComponent& transform)
+{
+    std::vector<Object::Builder> builders;
+    builders.reserve(topology.polygons.size());
+
+    for (const auto& rings : topology.polygons)
+    {
+        Object::Builder builder{};
+        builder.type = ModelType::Line;
+        builder.color = color;
+        builder.transform = transform;
+        builder.bounds = AABB{ std::numeric_limits<float>::infinity(), std::numeric_limits<float>::infinity(),
+            -std::numeric_limits<float>::infinity(), -std::numeric_limits<float>::infinity() };
+
+        //公共顶点序号 -> 要素内序号，同一个面里重复经过的顶点只存一次
+        std::unordered_map<uint32_t, uint32_t> localIds;
+        auto localId = [&](uint32_t id) {
+            auto [it, inserted] = localIds.emplace(id, static_cast<uint32_t>(builder.vertices.size()));
+            if (inserted)
+            {
+                const QVector2D& point = topology.vertices[id];
+                Model::Vertex vertex;
+                vertex.position = QVector3D(point.x(), point.y(), 0.f);
+                vertex.color = color;
+                builder.vertices.push_back(vertex);
+
+                builder.bounds.minX = qMin(builder.bounds.minX, point.x());
+                builder.bounds.minY = qMin(builder.bounds.minY, point.y());
+                builder.bounds.maxX = qMax(builder.bounds.maxX, point.x());
+                builder.bounds.maxY = qMax(builder.bounds.maxY, point.y());
+            }
+            return it->second;
+            };
+
+        for (const auto& ring : rings)
+        {
+            for (int32_t ref : ring)
+            {
+                //负数 ~i 表示反向使用第i条弧，画线段时方向无关
+                const auto& arc = topology.arcs[ref >= 0 ? ref : ~ref];
+                for (size_t i = 0; i + 1 < arc.size(); i++)
+                {
+                    builder.indices.push_back(localId(arc[i]));
+                    builder.indices.push_back(localId(arc[i + 1]));
+                }
+            }
+        }
+
+        if (builder.indices.empty())
+            continue;
+        builders.push_back(std::move(builder));
+    }
+
+    return builders;
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <vector>
+
+#include "Object.h"
+#include "const.h"
+
+//TopoJSON 风格的拓扑编码：焊接重合顶点，把面的边界在结点处切成弧段，相邻面共享的边界只存一次
+class TopologyEncoder
+{
+public:
+    struct Topology
+    {
+        std::vector<QVector2D> vertices;                            //焊接后的顶点
+        std::vector<std::vector<uint32_t>> arcs;                    //每条弧段的顶点序号
+        std::vector<std::vector<std::vector<int32_t>>> polygons;    //面 -> 环 -> 弧段引用，负数 ~i 表示反向使用第i条弧
+    };
+
+    TopologyEncoder(float weldTolerance);
+
+    //添加一个面，rings[0] 为外环，其余为内环；返回面序号
+    uint32_t addPolygon(const std::vector<std::vector<QVector2D>>& rings);
+
+    Topology encode() const;
+
+    //每条弧段生成一个线要素，共享边界只上传一次
+    static std::vector<Object::Builder> buildArcBuilders(const Topology& topology,
+        const QVector3D& color, const TransformComponent& transform);
+
+    //每个输入面生成一个线要素，按弧段引用拼出各个环。顶点取自焊接后的公共顶点，
+    //相邻面落在同一chunk时由缓冲池的焊接合并为一份，索引引用同一组顶点
+    static std::vector<Object::Builder> buildPolygonBuilders(const Topology& topology,
+        const QVector3D& color, const TransformComponent& transform);
+
+    size_t getInputVertexCount() const { return m_inputVertexCount; }
+
+private:
+    float                                           m_weldTolerance;
+    std::vector<std::vector<std::vector<QVector2D>>> m_polygons;
+    size_t                                          m_inputVertexCount{ 0 };
+};
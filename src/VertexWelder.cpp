@@ -0,0 +1,47 @@
+#include "VertexWelder.h"
+
+#include <algorithm>
+#include <cmath>
+
+#ifdef max
+#undef max
+#endif
+
+VertexWelder::VertexWelder(float tolerance) :
+    m_tolerance(tolerance),
+    m_invCellSize(1.f / std::max(tolerance, 1e-12f))
+{
+}
+
+uint32_t VertexWelder::weld(float x, float y, uint32_t newIndex, uint32_t tag)
+{
+    int64_t cx = static_cast<int64_t>(std::floor(x * m_invCellSize));
+    int64_t cy = static_cast<int64_t>(std::floor(y * m_invCellSize));
+    float toleranceSq = m_tolerance * m_tolerance;
+
+    for (int64_t dy = -1; dy <= 1; dy++)
+    {
+        for (int64_t dx = -1; dx <= 1; dx++)
+        {
+            auto it = m_cells.find(cellKey(cx + dx, cy + dy));
+            if (it == m_cells.end())
+                continue;
+
+            for (const Entry& entry : it->second)
+            {
+                float ex = entry.x - x;
+                float ey = entry.y - y;
+                if (entry.tag == tag && ex * ex + ey * ey <= toleranceSq)
+                    return entry.index;
+            }
+        }
+    }
+
+    m_cells[cellKey(cx, cy)].push_back(Entry{ x, y, newIndex, tag });
+    return newIndex;
+}
+
+uint64_t VertexWelder::cellKey(int64_t cx, int64_t cy)
+{
+    return (static_cast<uint64_t>(static_cast<uint32_t>(cx)) << 32) | static_cast<uint32_t>(cy);
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+//按容差合并重合顶点：网格哈希，格子边长等于容差，查询时检查相邻3x3个格子
+class VertexWelder
+{
+public:
+    VertexWelder(float tolerance);
+
+    //查找容差范围内且tag相同的已有顶点，找到返回其序号，否则登记 newIndex 并返回
+    uint32_t weld(float x, float y, uint32_t newIndex, uint32_t tag = 0);
+
+    void clear() { m_cells.clear(); }
+    float getTolerance() const { return m_tolerance; }
+
+private:
+    struct Entry
+    {
+        float x, y;
+        uint32_t index;
+        uint32_t tag;
+    };
+
+    static uint64_t cellKey(int64_t cx, int64_t cy);
+
+private:
+    float                                           m_tolerance;
+    float                                           m_invCellSize;
+    std::unordered_map<uint64_t, std::vector<Entry>> m_cells;
+};
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <cmath>
+#include <cstdint>
 #include <qgenericmatrix.h>
 
 #include <qmatrix4x4.h>
@@ -10,11 +11,50 @@ using Mat2F = QGenericMatrix<2, 2, float>;
 
 constexpr float IdentityMmatrix2D[4] = { 1.0f, 0.0f, 0.0f, 1.0f };
 
-struct SimplePushConstantData
+//2D 地图数据的逐实例数据：2x3 仿射变换加 RGBA8 颜色，32 字节。
+//与着色器中 std430 的 { vec4, vec2, uint, uint } 布局一致；QMatrix4x4 带标志位，不能直接上传
+struct InstanceData2D
 {
-    QMatrix4x4   modelMatrix;
-    alignas(16) QVector3D color;
+    float linear[4];            //2x2 线性部分，列主序
+    float translation[2];
+    uint32_t color;             //RGBA8，a 为覆盖顶点颜色的比例，0 表示保留顶点颜色
+    uint32_t reserved;
+
+    //取变换在 xy 平面上的部分，z 方向的旋转和平移不保留
+    static InstanceData2D fromMatrix(const QMatrix4x4& transform, const QVector3D& color, float colorWeight)
+    {
+        const float* m = transform.constData();
+        InstanceData2D data{};
+        data.linear[0] = m[0];
+        data.linear[1] = m[1];
+        data.linear[2] = m[4];
+        data.linear[3] = m[5];
+        data.translation[0] = m[12];
+        data.translation[1] = m[13];
+        data.color = packColor(color.x(), color.y(), color.z(), colorWeight);
+        return data;
+    }
+
+    //xy 平面上是否为单位变换；z 方向的平移只决定图层高度，不需要逐对象绘制
+    bool isIdentityTransform() const
+    {
+        return linear[0] == IdentityMmatrix2D[0] && linear[1] == IdentityMmatrix2D[1] &&
+            linear[2] == IdentityMmatrix2D[2] && linear[3] == IdentityMmatrix2D[3] &&
+            translation[0] == 0.f && translation[1] == 0.f;
+    }
+
+    static uint32_t packColor(float r, float g, float b, float a)
+    {
+        auto toByte = [](float v) {
+            return static_cast<uint32_t>(std::lround((v < 0.f ? 0.f : (v > 1.f ? 1.f : v)) * 255.f));
+        };
+        //低字节为 r，与 unpackUnorm4x8 一致
+        return toByte(r) | (toByte(g) << 8) | (toByte(b) << 16) | (toByte(a) << 24);
+    }
 };
+static_assert(sizeof(InstanceData2D) == 32, "InstanceData2D must match the std430 layout");
+
+using SimplePushConstantData = InstanceData2D;
 
 struct AABB
 {
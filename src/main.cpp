@@ -6,6 +6,7 @@ int main(int argc, char* argv[])
 {
     QApplication app(argc, argv);
     MyVulkanApp myApp;
+    myApp.setTopologyEncodingEnabled(!app.arguments().contains("--no-topology"));
 
     myApp.run();
     return app.exec();